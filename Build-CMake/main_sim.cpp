@@ -0,0 +1,534 @@
+// Copyright (C) 2016 Felix Ungman
+//
+// This file is part of the openwar platform (GPL v3 or later), see LICENSE.txt
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "BattleMap/BattleMap.h"
+#include "BattleMap/SmoothGroundMap.h"
+#include "BattleModel/BattleReplay.h"
+#include "BattleModel/BattleScenario.h"
+#include "BattleModel/BattleSimulationThread.h"
+#include "BattleModel/BattleSimulator_v1_0_0.h"
+#include "BattleScript/MonkeyScript.h"
+#include "Graphics/Image.h"
+#include "sim_bench.h"
+
+
+static void PrintUsage()
+{
+	std::cerr << "usage: openwar-sim <map.png> <units.txt> [--duration <seconds>] [--seed <n>] [--threads <n>]" << std::endl
+		<< "                   [--profile-csv <path>] [--profile-json <path>]" << std::endl
+		<< "                   [--hold <team>] [--no-sleep] [--lod] [--viewpoint <x> <y>]" << std::endl
+		<< "                   [--sim-thread] [--check-state <ticks>] [--record <path>] [--pathfinding]" << std::endl
+		<< "       openwar-sim <map.png> --replay <path> [--threads <n>] [--no-sleep] [--lod] [--viewpoint <x> <y>] [--pathfinding]" << std::endl
+		<< "       openwar-sim --bench-spatial" << std::endl
+		<< "       openwar-sim --bench-formation" << std::endl
+		<< "       openwar-sim --bench-separation" << std::endl
+		<< std::endl
+		<< "units.txt has one unit per line: <team> <unit-class> <fighters> <x> <y> <bearing-degrees>" << std::endl
+		<< "for example: 1 SAM-YARI 80 512 400 90" << std::endl
+		<< std::endl
+		<< "--profile-csv writes the phase timings of every time step, --profile-json a summary," << std::endl
+		<< "both need a build with OPENWAR_ENABLE_PROFILER" << std::endl
+		<< "--hold gives a team no script, its units hold their positions," << std::endl
+		<< "--no-sleep updates the fighters of settled units too," << std::endl
+		<< "--lod runs units far from contact and from every --viewpoint as one formation body," << std::endl
+		<< "--pathfinding makes units find their way around impassable terrain and water," << std::endl
+		<< "--sim-thread runs the simulator on its own thread and reads its snapshots on this one," << std::endl
+		<< "--check-state saves the state at the end, runs on, and checks that the state restored" << std::endl
+		<< "into the same and into a new simulator runs on identically," << std::endl
+		<< "--record writes a replay log of the battle, --replay plays it back with the same settings" << std::endl
+		<< "and checks that it plays out as recorded, and that seeking in it works" << std::endl;
+}
+
+
+static bool LoadOrderOfBattle(const char* path, BattleScenario* battleScenario)
+{
+	std::ifstream file(path);
+	if (!file)
+		return false;
+
+	BattleSimulator* battleSimulator = battleScenario->GetBattleSimulator();
+
+	std::string line;
+	int lineNumber = 0;
+	while (std::getline(file, line))
+	{
+		++lineNumber;
+		std::string::size_type comment = line.find('#');
+		if (comment != std::string::npos)
+			line.erase(comment);
+
+		std::istringstream s(line);
+		int team;
+		std::string unitClass;
+		int numberOfFighters;
+		float x, y, bearing;
+		if (!(s >> team))
+			continue;
+
+		if (!(s >> unitClass >> numberOfFighters >> x >> y >> bearing) || team < 1 || team > 2 || numberOfFighters <= 0)
+		{
+			std::cerr << path << ":" << lineNumber << ": invalid unit" << std::endl;
+			return false;
+		}
+
+		BattleCommander* commander = battleScenario->GetCommanders()[team - 1];
+		BattleObjects::Unit* unit = battleSimulator->AddUnit(commander, unitClass.c_str(), numberOfFighters, glm::vec2(x, y), glm::radians(bearing));
+		unit->SetOwnedBySimulator(true);
+	}
+
+	return true;
+}
+
+
+static std::uint64_t HashState(const std::vector<char>& data)
+{
+	std::uint64_t result = 14695981039346656037ull; // FNV-1a
+	for (char c : data)
+		result = (result ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+	return result;
+}
+
+
+static double ElapsedMilliseconds(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+
+// Runs on for the given number of time steps, without the scripts, after saving
+// the state, and then again from the state restored into the same simulator and
+// into a new one. The state after each time step must be the same all three times.
+static bool CheckStateRoundTrip(BattleSimulator_v1_0_0* battleSimulator, BattleScenario* battleScenario, const std::vector<glm::vec2>& viewpoints, int ticks)
+{
+	const std::vector<BattleCommander*>& commanders = battleScenario->GetCommanders();
+
+	std::vector<char> saved;
+	battleSimulator->SaveState(saved, commanders);
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	battleSimulator->SaveState(saved, commanders);
+	double saveTime = ElapsedMilliseconds(start);
+
+	int fighters = 0;
+	for (BattleObjects::Unit* unit : battleSimulator->GetUnits())
+		fighters += unit->GetFighterCount();
+
+	std::vector<char> data;
+	auto runOn = [&](BattleSimulator_v1_0_0* simulator, std::vector<std::uint64_t>& hashes) {
+		for (int tick = 0; tick < ticks; ++tick)
+		{
+			simulator->AdvanceTime(simulator->GetTimeStep());
+			simulator->SaveState(data, commanders);
+			hashes.push_back(HashState(data));
+		}
+	};
+	auto firstDifference = [ticks](const std::vector<std::uint64_t>& a, const std::vector<std::uint64_t>& b) {
+		int tick = 0;
+		while (tick < ticks && a[tick] == b[tick])
+			++tick;
+		return tick;
+	};
+
+	std::vector<std::uint64_t> expected;
+	runOn(battleSimulator, expected);
+
+	start = std::chrono::steady_clock::now();
+	bool rollbackRestored = battleSimulator->RestoreState(saved, commanders);
+	double rollbackTime = ElapsedMilliseconds(start);
+	std::vector<std::uint64_t> rollback;
+	if (rollbackRestored)
+		runOn(battleSimulator, rollback);
+
+	BattleSimulator_v1_0_0 fork(battleSimulator->GetBattleMap());
+	fork.SetThreadCount(battleSimulator->GetThreadCount());
+	fork.SetUnitSleeping(battleSimulator->IsUnitSleeping());
+	fork.SetAggregateSettings(battleSimulator->GetAggregateSettings());
+	fork.SetPathfinding(battleSimulator->IsPathfinding());
+	fork.SetPathfindingWaits(battleSimulator->IsPathfindingWaits());
+	for (std::size_t i = 0; i < viewpoints.size(); ++i)
+		fork.SetViewpoint(&viewpoints[i], viewpoints[i]);
+	start = std::chrono::steady_clock::now();
+	bool forkRestored = fork.RestoreState(saved, commanders);
+	double forkTime = ElapsedMilliseconds(start);
+	std::vector<std::uint64_t> forked;
+	if (forkRestored)
+		runOn(&fork, forked);
+
+	// leave the simulator as it was at the end of the battle
+	battleSimulator->RestoreState(saved, commanders);
+
+	int rollbackSame = rollbackRestored ? firstDifference(expected, rollback) : 0;
+	int forkSame = forkRestored ? firstDifference(expected, forked) : 0;
+
+	std::printf("state %zu bytes, %d fighters, save %.2f ms, restore %.2f ms into the same simulator, %.2f ms into a new one\n",
+		saved.size(), fighters, saveTime, rollbackTime, forkTime);
+	std::printf("state round trip: same simulator %d of %d ticks identical, new simulator %d of %d ticks identical\n",
+		rollbackSame, ticks, forkSame, ticks);
+
+	return rollbackSame == ticks && forkSame == ticks;
+}
+
+
+// Plays back a log written with --record, with the scenario but without the scripts,
+// whose commands are in the log. Then seeks back to the middle and forward to the
+// end again, which must end in the same state.
+static bool Replay(const char* path, BattleSimulator_v1_0_0* battleSimulator, BattleScenario* battleScenario)
+{
+	const std::vector<BattleCommander*>& commanders = battleScenario->GetCommanders();
+	BattleScenario* tickScenario = battleScenario;
+
+	BattlePlayer player(battleSimulator, commanders);
+	player.SetStepCallback([&tickScenario](float timeStep) { tickScenario->Tick(timeStep); });
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	if (!player.Open(path))
+	{
+		std::cerr << path << ": could not open replay" << std::endl;
+		return false;
+	}
+	double openTime = ElapsedMilliseconds(start);
+
+	start = std::chrono::steady_clock::now();
+	while (!player.IsAtEnd())
+		player.Step();
+	double playTime = ElapsedMilliseconds(start);
+
+	std::vector<char> data;
+	battleSimulator->SaveState(data, commanders);
+	std::uint64_t endHash = HashState(data);
+
+	std::printf("replay %d ticks, open %.2f ms, play %.0f ms\n", player.GetEndTick(), openTime, playTime);
+	std::printf("winner %d\n", battleScenario->GetWinnerTeam());
+	for (int team = 1; team <= 2; ++team)
+		std::printf("team %d: %d casualties\n", team, battleSimulator->GetKills(team));
+	std::printf("replay mismatches %d, first at tick %d\n", player.GetMismatchCount(), player.GetFirstMismatchTick());
+
+	// the scenario knows who won, which seeking back does not undo
+	BattleScenario seekScenario(battleSimulator, 0);
+	seekScenario.SetTeamPosition(1, 1);
+	seekScenario.SetTeamPosition(2, 2);
+	tickScenario = &seekScenario;
+
+	int middle = player.GetEndTick() / 2;
+	start = std::chrono::steady_clock::now();
+	bool seekedBack = player.Seek(middle);
+	double seekBackTime = ElapsedMilliseconds(start);
+	start = std::chrono::steady_clock::now();
+	bool seekedForward = player.Seek(player.GetEndTick());
+	double seekForwardTime = ElapsedMilliseconds(start);
+
+	battleSimulator->SaveState(data, commanders);
+	bool sameEnd = seekedBack && seekedForward && HashState(data) == endHash;
+
+	std::printf("seek back to tick %d %.2f ms, forward to the end %.0f ms, end state %s\n",
+		middle, seekBackTime, seekForwardTime, sameEnd ? "identical" : "different");
+
+	return player.GetMismatchCount() == 0 && sameEnd;
+}
+
+
+int main(int argc, char *argv[])
+{
+	const char* mapPath = nullptr;
+	const char* unitsPath = nullptr;
+	float duration = 600;
+	unsigned seed = 0;
+	int threads = 0;
+	const char* profileCsvPath = nullptr;
+	const char* profileJsonPath = nullptr;
+	int holdTeam = 0;
+	bool sleeping = true;
+	bool lod = false;
+	std::vector<glm::vec2> viewpoints;
+	bool simulationThread = false;
+	int checkStateTicks = 0;
+	const char* recordPath = nullptr;
+	const char* replayPath = nullptr;
+	bool pathfinding = false;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		if (std::strcmp(argv[i], "--duration") == 0 && i + 1 < argc)
+			duration = (float)std::atof(argv[++i]);
+		else if (std::strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+			seed = (unsigned)std::strtoul(argv[++i], nullptr, 10);
+		else if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+			threads = std::atoi(argv[++i]);
+		else if (std::strcmp(argv[i], "--profile-csv") == 0 && i + 1 < argc)
+			profileCsvPath = argv[++i];
+		else if (std::strcmp(argv[i], "--profile-json") == 0 && i + 1 < argc)
+			profileJsonPath = argv[++i];
+		else if (std::strcmp(argv[i], "--hold") == 0 && i + 1 < argc)
+			holdTeam = std::atoi(argv[++i]);
+		else if (std::strcmp(argv[i], "--no-sleep") == 0)
+			sleeping = false;
+		else if (std::strcmp(argv[i], "--lod") == 0)
+			lod = true;
+		else if (std::strcmp(argv[i], "--viewpoint") == 0 && i + 2 < argc)
+		{
+			float x = (float)std::atof(argv[++i]);
+			float y = (float)std::atof(argv[++i]);
+			viewpoints.push_back(glm::vec2(x, y));
+		}
+		else if (std::strcmp(argv[i], "--pathfinding") == 0)
+			pathfinding = true;
+		else if (std::strcmp(argv[i], "--sim-thread") == 0)
+			simulationThread = true;
+		else if (std::strcmp(argv[i], "--check-state") == 0 && i + 1 < argc)
+			checkStateTicks = std::atoi(argv[++i]);
+		else if (std::strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+			recordPath = argv[++i];
+		else if (std::strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+			replayPath = argv[++i];
+		else if (std::strcmp(argv[i], "--bench-spatial") == 0)
+			return RunSpatialIndexBenchmark();
+		else if (std::strcmp(argv[i], "--bench-formation") == 0)
+			return RunFormationBenchmark();
+		else if (std::strcmp(argv[i], "--bench-separation") == 0)
+			return RunSeparationBenchmark();
+		else if (mapPath == nullptr)
+			mapPath = argv[i];
+		else if (unitsPath == nullptr)
+			unitsPath = argv[i];
+		else
+			mapPath = nullptr, unitsPath = nullptr, i = argc;
+	}
+
+	if (mapPath == nullptr || (unitsPath == nullptr) == (replayPath == nullptr))
+	{
+		PrintUsage();
+		return 2;
+	}
+
+	std::srand(seed);
+
+	auto image = std::unique_ptr<Image>(new Image());
+	image->LoadFromResource(Resource(mapPath));
+	if (image->GetWidth() == 0)
+	{
+		std::cerr << mapPath << ": could not load map image" << std::endl;
+		return 1;
+	}
+
+	SmoothGroundMap* groundMap = new SmoothGroundMap(bounds2f(0, 0, 1024, 1024), std::move(image));
+	std::shared_ptr<BattleMap> battleMap = std::make_shared<BasicBattleMap>(groundMap->GetHeightMap(), groundMap);
+
+	BattleSimulator_v1_0_0* battleSimulator = new BattleSimulator_v1_0_0(battleMap);
+	battleSimulator->SetThreadCount(threads);
+	battleSimulator->SetRandomSeed(seed);
+	battleSimulator->SetUnitSleeping(sleeping);
+	battleSimulator->SetPathfinding(pathfinding);
+	battleSimulator->SetPathfindingWaits(true); // runs faster than the flow fields are found
+	if (lod)
+	{
+		BattleSimulator_v1_0_0::AggregateSettings aggregateSettings;
+		aggregateSettings.enabled = true;
+		battleSimulator->SetAggregateSettings(aggregateSettings);
+	}
+	for (std::size_t i = 0; i < viewpoints.size(); ++i)
+		battleSimulator->SetViewpoint(&viewpoints[i], viewpoints[i]);
+	const BattleProfiler* profiler = battleSimulator->GetProfiler();
+	if ((profileCsvPath || profileJsonPath) && profiler == nullptr)
+	{
+		std::cerr << "openwar-sim: built without OPENWAR_ENABLE_PROFILER" << std::endl;
+		return 2;
+	}
+
+	std::ofstream profileCsv;
+	if (profileCsvPath)
+	{
+		profileCsv.open(profileCsvPath);
+		BattleProfiler::WriteCsvHeader(profileCsv);
+	}
+
+	BattleScenario* battleScenario = new BattleScenario(battleSimulator, 0);
+	battleScenario->SetTeamPosition(1, 1);
+	battleScenario->SetTeamPosition(2, 2);
+
+	std::vector<MonkeyScript*> battleScripts;
+	for (int team = 1; team <= 2; ++team)
+	{
+		BattleCommander* commander = battleScenario->AddCommander(std::to_string(team).c_str(), team, BattleCommanderType::Script);
+		if (team != holdTeam && replayPath == nullptr)
+			battleScripts.push_back(new MonkeyScript(battleScenario, commander));
+	}
+
+	if (replayPath)
+	{
+		bool replayed = Replay(replayPath, battleSimulator, battleScenario);
+		delete battleScenario;
+		delete battleSimulator;
+		delete groundMap;
+		return replayed ? 0 : 1;
+	}
+
+	if (!LoadOrderOfBattle(unitsPath, battleScenario))
+	{
+		std::cerr << unitsPath << ": could not load units" << std::endl;
+		return 1;
+	}
+
+	// after the units are loaded, the log starts with them owned by the simulator
+	BattleRecorder battleRecorder(battleSimulator, battleScenario->GetCommanders());
+	if (recordPath && !battleRecorder.Open(recordPath))
+	{
+		std::cerr << recordPath << ": could not create replay" << std::endl;
+		return 1;
+	}
+
+	const float timeStep = 1.0f / 15.0f;
+	float elapsed = 0;
+	int ticks = 0;
+	int allocations = 0;
+	int lastAllocationTick = 0;
+	int profiledSteps = 0;
+	long awakeUnits = 0;
+	long asleepUnits = 0;
+	long aggregateUnits = 0;
+
+	auto beginStep = [&]() -> bool {
+		if (elapsed >= duration || battleScenario->GetWinnerTeam() != 0)
+			return false;
+		battleScenario->Tick(timeStep);
+		for (MonkeyScript* battleScript : battleScripts)
+			battleScript->Tick(timeStep);
+		return true;
+	};
+
+	auto endStep = [&]() {
+		elapsed += timeStep;
+		++ticks;
+		awakeUnits += battleSimulator->GetAwakeUnitCount();
+		asleepUnits += battleSimulator->GetAsleepUnitCount();
+		aggregateUnits += battleSimulator->GetAggregateUnitCount();
+
+		if (profileCsv.is_open())
+			for (int age = profiler->GetStepCount() - profiledSteps - 1; age >= 0; --age)
+				BattleProfiler::WriteCsvRow(profileCsv, profiler->GetSample(age));
+		if (profiler)
+			profiledSteps = profiler->GetStepCount();
+
+		if (battleSimulator->GetFighterIndexAllocations() != allocations)
+		{
+			allocations = battleSimulator->GetFighterIndexAllocations();
+			lastAllocationTick = ticks;
+		}
+	};
+
+	int snapshotsRead = 0;
+	long eventsRead = 0;
+	long casualtiesRead = 0;
+	int snapshotFighters = -1;
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	if (simulationThread)
+	{
+		// the scripts and the statistics run in step with the simulator on its
+		// thread, this thread only reads the snapshots like a renderer would
+		BattleSimulationThread battleSimulationThread(battleSimulator);
+		battleSimulationThread.SetSpeed(0);
+
+		bool stepping = false;
+		battleSimulationThread.SetStepCallback([&](float) {
+			if (stepping)
+				endStep();
+			stepping = beginStep();
+			if (!stepping)
+				battleSimulationThread.RequestStop();
+		});
+
+		auto readSnapshot = [&]() -> bool {
+			if (!battleSimulationThread.UpdateSnapshot())
+				return false;
+			const BattleSnapshot& snapshot = battleSimulationThread.GetSnapshot();
+			++snapshotsRead;
+			for (std::size_t index = static_cast<std::size_t>(battleSimulationThread.GetNewEventIndex()); index < snapshot.events.size(); ++index)
+			{
+				++eventsRead;
+				if (snapshot.events[index].type == BattleEventType_Casualties)
+					casualtiesRead += snapshot.events[index].casualtyCount;
+			}
+			snapshotFighters = static_cast<int>(snapshot.fighters.size());
+			return true;
+		};
+
+		battleSimulationThread.Start();
+		while (!battleSimulationThread.IsStopping())
+			if (!readSnapshot())
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		battleSimulationThread.Stop();
+		readSnapshot();
+	}
+	else
+	{
+		while (beginStep())
+		{
+			battleSimulator->AdvanceTime(timeStep);
+			endStep();
+		}
+	}
+
+	std::chrono::duration<double> wall = std::chrono::steady_clock::now() - start;
+
+	if (battleRecorder.IsOpen())
+	{
+		battleRecorder.Close();
+		std::printf("recorded %d records, %ld bytes\n", battleRecorder.GetRecordCount(), battleRecorder.GetSize());
+	}
+
+	int units[3] = {};
+	int fighters[3] = {};
+	for (BattleObjects::Unit* unit : battleSimulator->GetUnits())
+	{
+		units[unit->GetTeam()] += 1;
+		fighters[unit->GetTeam()] += unit->GetFighterCount();
+	}
+
+	std::printf("threads %d\n", battleSimulator->GetThreadCount());
+	std::printf("ticks %d\n", ticks);
+	std::printf("simulated %.1f s\n", elapsed);
+	std::printf("wall %.3f s (%.0f ticks/s)\n", wall.count(), ticks / (wall.count() > 0 ? wall.count() : 1));
+	std::printf("units per tick %.1f awake, %.1f asleep, %.1f aggregate\n", (double)awakeUnits / (ticks > 0 ? ticks : 1), (double)asleepUnits / (ticks > 0 ? ticks : 1), (double)aggregateUnits / (ticks > 0 ? ticks : 1));
+	std::printf("fighter index allocations %d, last at tick %d\n", allocations, lastAllocationTick);
+	std::printf("winner %d\n", battleScenario->GetWinnerTeam());
+	if (simulationThread)
+		std::printf("snapshots read %d, %ld events, %ld casualties, %d fighters in the last\n", snapshotsRead, eventsRead, casualtiesRead, snapshotFighters);
+	for (int team = 1; team <= 2; ++team)
+		std::printf("team %d: %d units, %d fighters, %d casualties\n", team, units[team], fighters[team], battleSimulator->GetKills(team));
+
+	if (profiler)
+	{
+		std::printf("profiled %d steps, mean of the last %d:\n", profiler->GetStepCount(), profiler->GetSampleCount());
+		for (int phase = 0; phase < BattlePhaseCount; ++phase)
+			std::printf("  %-24s %10.1f us\n", BattleProfiler::GetName(static_cast<BattlePhase>(phase)), profiler->GetMean(static_cast<BattlePhase>(phase)));
+	}
+
+	if (profileJsonPath)
+	{
+		std::ofstream profileJson(profileJsonPath);
+		profiler->WriteJson(profileJson);
+	}
+
+	bool stateChecked = checkStateTicks <= 0 || CheckStateRoundTrip(battleSimulator, battleScenario, viewpoints, checkStateTicks);
+
+	for (MonkeyScript* battleScript : battleScripts)
+		delete battleScript;
+	delete battleScenario;
+	delete battleSimulator;
+	delete groundMap;
+
+	return stateChecked ? 0 : 1;
+}
@@ -0,0 +1,412 @@
+// Copyright (C) 2016 Felix Ungman
+//
+// This file is part of the openwar platform (GPL v3 or later), see LICENSE.txt
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "Algorithms/quadtree.h"
+#include "Algorithms/spatial_grid.h"
+#include "BattleModel/BattleFormationSolver.h"
+#include "BattleModel/BattleSeparation.h"
+#include "sim_bench.h"
+
+
+typedef std::chrono::steady_clock bench_clock;
+
+
+static double MillisecondsSince(bench_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(bench_clock::now() - start).count();
+}
+
+
+// Fighters in blocks of 4 ranks by 30 files, like units in formation,
+// spread over the 1024x1024 map.
+static std::vector<glm::vec2> MakeFormationPoints(int count, unsigned seed)
+{
+	std::mt19937 random(seed);
+	std::uniform_real_distribution<float> position(100, 924);
+
+	std::vector<glm::vec2> result;
+	while ((int)result.size() < count)
+	{
+		glm::vec2 frontLeft(position(random), position(random));
+		for (int file = 0; file < 30; ++file)
+			for (int rank = 0; rank < 4; ++rank)
+				if ((int)result.size() < count)
+					result.push_back(frontLeft + glm::vec2(1.8f * file, 1.6f * rank));
+	}
+	return result;
+}
+
+
+static long CountNeighbours(quadtree<int>& index, const std::vector<glm::vec2>& points, float radius)
+{
+	static quadtree<int>::batch batch;
+	index.find_batch(&points[0].x, (int)points.size(), radius, batch);
+	long result = 0;
+	for (int j = 0; j < batch.size(); ++j)
+		result += batch.end(j) - batch.begin(j);
+	return result;
+}
+
+
+// The grid has no find_batch, see BattleSimulator_v1_0_0::NeighbourLists.
+static long CountNeighbours(spatial_grid<int>& index, const std::vector<glm::vec2>& points, float radius)
+{
+	long result = 0;
+	for (glm::vec2 p : points)
+		for (spatial_grid<int>::iterator j(index.find(p.x, p.y, radius)); *j; ++j)
+			++result;
+	return result;
+}
+
+
+struct SpatialIndexTiming
+{
+	double rebuild;
+	double query;
+	double batch; // the same searches with find_batch, where the index has one, and find_k_nearest
+	long neighbours;
+	long batchNeighbours;
+	int allocations; // during the timed rebuilds
+};
+
+
+template <class Index> static void Rebuild(Index& index, const std::vector<glm::vec2>& points)
+{
+	index.clear();
+	for (int i = 0; i < (int)points.size(); ++i)
+		index.insert(points[i].x, points[i].y, i);
+}
+
+
+static void Build(quadtree<int>&)
+{
+}
+
+
+static void Build(spatial_grid<int>& grid)
+{
+	grid.build();
+}
+
+
+template <class Index> static SpatialIndexTiming TimeSpatialIndex(Index& index, const std::vector<glm::vec2>& points, int repeats)
+{
+	SpatialIndexTiming result{};
+
+	Rebuild(index, points); // warm up
+	Build(index);
+
+	int allocations = index.allocation_count();
+	bench_clock::time_point start = bench_clock::now();
+	for (int i = 0; i < repeats; ++i)
+	{
+		Rebuild(index, points);
+		Build(index);
+	}
+	result.rebuild = MillisecondsSince(start) / repeats;
+	result.allocations = index.allocation_count() - allocations;
+
+	// the radii searched by NextFighterPosition and FindFighterStrikingTarget
+	start = bench_clock::now();
+	for (int i = 0; i < repeats; ++i)
+	{
+		for (glm::vec2 p : points)
+		{
+			for (typename Index::iterator j(index.find(p.x, p.y, 0.9f)); *j; ++j)
+				++result.neighbours;
+			for (typename Index::iterator j(index.find(p.x + 2.4f, p.y, 1.1f)); *j; ++j)
+				++result.neighbours;
+		}
+	}
+	result.query = MillisecondsSince(start) / repeats;
+	result.neighbours /= repeats;
+
+	int nearest[8];
+	start = bench_clock::now();
+	for (int i = 0; i < repeats; ++i)
+	{
+		result.batchNeighbours += CountNeighbours(index, points, 0.9f);
+		for (glm::vec2 p : points)
+			result.batchNeighbours += index.find_k_nearest(p.x + 2.4f, p.y, 1.1f, 8, nearest);
+	}
+	result.batch = MillisecondsSince(start) / repeats;
+	result.batchNeighbours /= repeats;
+
+	return result;
+}
+
+
+int RunSpatialIndexBenchmark()
+{
+	std::printf("%8s  %-14s %12s %12s %12s %12s %12s\n", "fighters", "index", "rebuild ms", "query ms", "batch ms", "neighbours", "allocations");
+
+	bool mismatch = false;
+	for (int count : {1000, 10000, 50000})
+	{
+		std::vector<glm::vec2> points = MakeFormationPoints(count, 1);
+		int repeats = count <= 1000 ? 200 : count <= 10000 ? 40 : 10;
+
+		quadtree<int> quadtree(0, 0, 1024, 1024);
+		SpatialIndexTiming q = TimeSpatialIndex(quadtree, points, repeats);
+		std::printf("%8d  %-14s %12.3f %12.3f %12.3f %12ld %12d\n", count, "quadtree", q.rebuild, q.query, q.batch, q.neighbours, q.allocations);
+
+		spatial_grid<int> grid(0, 0, 1024, 1024);
+		SpatialIndexTiming g = TimeSpatialIndex(grid, points, repeats);
+		std::printf("%8d  %-14s %12.3f %12.3f %12.3f %12ld %12d\n", count, "spatial_grid", g.rebuild, g.query, g.batch, g.neighbours, g.allocations);
+
+		// at most 8 nearest in a radius of 1.1 is every neighbour in formation
+		if (q.neighbours != g.neighbours || q.batchNeighbours != q.neighbours || g.batchNeighbours != g.neighbours)
+		{
+			std::printf("error: quadtree and spatial_grid found different neighbours\n");
+			mismatch = true;
+		}
+	}
+
+	return mismatch ? 1 : 0;
+}
+
+
+struct FormationUnit
+{
+	int first;
+	int count;
+	BattleFormationSolver solver;
+};
+
+
+// Units of 1 to 240 fighters, some moving and some not, whose fighters are
+// a little out of place, so the solvers get every kind of edge.
+static std::vector<FormationUnit> MakeFormationUnits(int count, unsigned seed, std::vector<glm::vec2>& positions, std::vector<glm::vec2>& destinations)
+{
+	std::mt19937 random(seed);
+	std::uniform_int_distribution<int> size(1, 240);
+	std::uniform_real_distribution<float> position(100, 924);
+	std::uniform_real_distribution<float> angle(0, 6.2831853f);
+	std::uniform_real_distribution<float> jitter(-0.5f, 0.5f);
+
+	std::vector<FormationUnit> result;
+	positions.clear();
+	destinations.clear();
+	while ((int)positions.size() < count)
+	{
+		FormationUnit unit;
+		unit.first = (int)positions.size();
+		unit.count = glm::min(size(random), count - unit.first);
+
+		float a = angle(random);
+		unit.solver.ranks = glm::min(4, unit.count);
+		unit.solver.towardRight = 1.8f * glm::vec2(glm::cos(a), glm::sin(a));
+		unit.solver.towardBack = 1.6f * glm::vec2(-glm::sin(a), glm::cos(a));
+		unit.solver.moving = result.size() % 3 != 0;
+		unit.solver.lead = glm::normalize(unit.solver.towardBack) * 2.0f;
+		unit.solver.frontLeft = glm::vec2(position(random), position(random));
+
+		glm::vec2 frontLeft(position(random), position(random));
+		for (int index = 0; index < unit.count; ++index)
+		{
+			glm::vec2 p = frontLeft + unit.solver.towardRight * (float)(index / unit.solver.ranks) + unit.solver.towardBack * (float)(index % unit.solver.ranks);
+			positions.push_back(p + glm::vec2(jitter(random), jitter(random)));
+			destinations.push_back(p + glm::vec2(jitter(random), jitter(random)));
+		}
+		result.push_back(unit);
+	}
+	return result;
+}
+
+
+int RunFormationBenchmark()
+{
+	std::printf("solver is %s\n", BattleFormationSolver::IsVectorized() ? "vectorized" : "scalar only");
+	std::printf("%8s  %12s %12s %12s %12s\n", "fighters", "scalar ms", "solve ms", "max diff", "mismatches");
+
+	bool mismatch = false;
+	for (int count : {1000, 10000, 50000})
+	{
+		std::vector<glm::vec2> positions, destinations;
+		std::vector<FormationUnit> units = MakeFormationUnits(count, 1, positions, destinations);
+		std::vector<glm::vec2> scalar(positions.size()), solved(positions.size());
+		int repeats = count <= 1000 ? 2000 : count <= 10000 ? 200 : 40;
+
+		bench_clock::time_point start = bench_clock::now();
+		for (int i = 0; i < repeats; ++i)
+			for (const FormationUnit& unit : units)
+				unit.solver.SolveScalar(&positions[unit.first], &destinations[unit.first], unit.count, &scalar[unit.first]);
+		double scalarTime = MillisecondsSince(start) / repeats;
+
+		start = bench_clock::now();
+		for (int i = 0; i < repeats; ++i)
+			for (const FormationUnit& unit : units)
+				unit.solver.Solve(&positions[unit.first], &destinations[unit.first], unit.count, &solved[unit.first]);
+		double solveTime = MillisecondsSince(start) / repeats;
+
+		// the same order of operations gives the same bits
+		float maxDiff = 0;
+		int mismatches = 0;
+		for (std::size_t i = 0; i < solved.size(); ++i)
+		{
+			maxDiff = glm::max(maxDiff, glm::length(solved[i] - scalar[i]));
+			if (std::memcmp(&solved[i], &scalar[i], sizeof(glm::vec2)) != 0)
+				++mismatches;
+		}
+		std::printf("%8d  %12.4f %12.4f %12g %12d\n", count, scalarTime, solveTime, maxDiff, mismatches);
+
+		if (mismatches != 0)
+		{
+			std::printf("error: Solve and SolveScalar gave different formation destinations\n");
+			mismatch = true;
+		}
+	}
+
+	return mismatch ? 1 : 0;
+}
+
+
+// The neighbours of each fighter gathered as FindFighterNeighbours does, for
+// the separation kernels to run over without searching.
+struct SeparationBatches
+{
+	std::vector<glm::vec2> points{};
+	BattleSeparation::Batch fighters{};
+	BattleSeparation::Batch weapons{};
+};
+
+
+// Pairs of blocks of 4 ranks by 30 files, of two teams, in contact front to
+// front, with the fighters a little out of place like in melee.
+static SeparationBatches MakeSeparationBatches(int count, unsigned seed)
+{
+	std::mt19937 random(seed);
+	std::uniform_real_distribution<float> position(100, 924);
+	std::uniform_real_distribution<float> jitter(-0.4f, 0.4f);
+
+	std::vector<glm::vec2> weapons;
+	std::vector<int> teams;
+	SeparationBatches result;
+	while ((int)result.points.size() < count)
+	{
+		glm::vec2 front(position(random), position(random));
+		for (int team = 0; team < 2; ++team)
+			for (int file = 0; file < 30; ++file)
+				for (int rank = 0; rank < 4; ++rank)
+					if ((int)result.points.size() < count)
+					{
+						float toward = team == 0 ? -1.0f : 1.0f; // the back of the block
+						glm::vec2 p = front + glm::vec2(1.1f * file + jitter(random), toward * (0.6f + 1.1f * rank) + jitter(random));
+						result.points.push_back(p);
+						weapons.push_back(p - glm::vec2(0, toward * 0.8f));
+						teams.push_back(team);
+					}
+	}
+
+	quadtree<int> fighterIndex(0, 0, 1024, 1024);
+	quadtree<int> weaponIndex(0, 0, 1024, 1024);
+	Rebuild(fighterIndex, result.points);
+	Rebuild(weaponIndex, weapons);
+	quadtree<int>::batch fighterNeighbours, weaponNeighbours;
+	fighterIndex.find_batch(&result.points[0].x, count, 0.9f, fighterNeighbours);
+	weaponIndex.find_batch(&result.points[0].x, count, 0.75f, weaponNeighbours);
+
+	for (int i = 0; i < count; ++i)
+	{
+		glm::vec2 point = result.points[i];
+		result.fighters.AddFighter();
+		for (const int* j = fighterNeighbours.begin(i); j != fighterNeighbours.end(i); ++j)
+			if (*j != i)
+				result.fighters.AddObstacle(point, result.points[*j], result.points[*j]);
+
+		result.weapons.AddFighter();
+		for (const int* j = weaponNeighbours.begin(i); j != weaponNeighbours.end(i); ++j)
+			if (teams[*j] != teams[i])
+				result.weapons.AddObstacle(point, weapons[*j], result.points[*j]);
+	}
+	result.fighters.Close();
+	result.weapons.Close();
+	return result;
+}
+
+
+static BattleSeparation MakeSeparation(float minDistance2, float maxDistance2, float distance)
+{
+	BattleSeparation result;
+	result.minDistance2 = minDistance2;
+	result.maxDistance2 = maxDistance2;
+	result.distance = distance;
+	return result;
+}
+
+
+template <class Push> static long Separate(SeparationBatches& batches, std::vector<glm::vec2>& result, Push push)
+{
+	// as in BattleSimulator_v1_0_0
+	static const BattleSeparation fighterSeparation = MakeSeparation(0.01f, 0.9f * 0.9f, 0.9f);
+	static const BattleSeparation weaponSeparation = MakeSeparation(-1.0f, 0.75f * 0.75f, 0.75f);
+
+	push(fighterSeparation, batches.fighters);
+	push(weaponSeparation, batches.weapons);
+
+	long pushes = 0;
+	for (int i = 0; i < (int)batches.points.size(); ++i)
+	{
+		glm::vec2 adjust;
+		int count = batches.fighters.Accumulate(i, adjust);
+		count += batches.weapons.Accumulate(i, adjust);
+		result[i] = count != 0 ? batches.points[i] + adjust / (float)count : batches.points[i];
+		pushes += count;
+	}
+	return pushes;
+}
+
+
+int RunSeparationBenchmark()
+{
+	std::printf("separation is %s\n", BattleSeparation::IsVectorized() ? "vectorized" : "scalar only");
+	std::printf("%8s  %12s %12s %12s %12s %12s\n", "fighters", "neighbours", "pushes", "scalar ms", "push ms", "mismatches");
+
+	bool mismatch = false;
+	for (int count : {1000, 10000, 50000})
+	{
+		SeparationBatches batches = MakeSeparationBatches(count, 1);
+		std::vector<glm::vec2> scalar(batches.points.size()), separated(batches.points.size());
+		int repeats = count <= 1000 ? 1000 : count <= 10000 ? 100 : 20;
+
+		long scalarPushes = 0, pushes = 0;
+		bench_clock::time_point start = bench_clock::now();
+		for (int i = 0; i < repeats; ++i)
+			scalarPushes = Separate(batches, scalar, [](const BattleSeparation& separation, BattleSeparation::Batch& batch) {
+				separation.PushScalar(batch);
+			});
+		double scalarTime = MillisecondsSince(start) / repeats;
+
+		start = bench_clock::now();
+		for (int i = 0; i < repeats; ++i)
+			pushes = Separate(batches, separated, [](const BattleSeparation& separation, BattleSeparation::Batch& batch) {
+				separation.Push(batch);
+			});
+		double pushTime = MillisecondsSince(start) / repeats;
+
+		// the same order of operations gives the same bits
+		int mismatches = 0;
+		for (std::size_t i = 0; i < separated.size(); ++i)
+			if (std::memcmp(&separated[i], &scalar[i], sizeof(glm::vec2)) != 0)
+				++mismatches;
+
+		long neighbours = (long)(batches.fighters.GetSize() + batches.weapons.GetSize());
+		std::printf("%8d  %12ld %12ld %12.4f %12.4f %12d\n", count, neighbours, pushes, scalarTime, pushTime, mismatches);
+
+		if (mismatches != 0 || pushes != scalarPushes)
+		{
+			std::printf("error: Push and PushScalar separated the fighters differently\n");
+			mismatch = true;
+		}
+	}
+
+	return mismatch ? 1 : 0;
+}
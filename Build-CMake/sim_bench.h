@@ -0,0 +1,16 @@
+// Copyright (C) 2016 Felix Ungman
+//
+// This file is part of the openwar platform (GPL v3 or later), see LICENSE.txt
+
+#ifndef SIM_BENCH_H
+#define SIM_BENCH_H
+
+
+// Micro-benchmarks for the simulator building blocks, run by openwar-sim --bench-xxx
+
+int RunSpatialIndexBenchmark();
+int RunFormationBenchmark();
+int RunSeparationBenchmark();
+
+
+#endif
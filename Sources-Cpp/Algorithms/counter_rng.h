@@ -0,0 +1,61 @@
+// Copyright (C) 2016 Felix Ungman
+//
+// This file is part of the openwar platform (GPL v3 or later), see LICENSE.txt
+
+#ifndef COUNTER_RNG_H
+#define COUNTER_RNG_H
+
+#include <array>
+#include <cstdint>
+
+
+// Counter-based random numbers (Philox4x32-10). Each draw is a function of the
+// seed and a four word counter only, so the same counter always gives the same
+// numbers, and any thread can draw them without shared state.
+
+class counter_rng
+{
+	std::uint32_t _key[2];
+
+public:
+	typedef std::array<std::uint32_t, 4> result_type;
+
+	explicit counter_rng(std::uint64_t seed = 0) { set_seed(seed); }
+
+	std::uint64_t get_seed() const { return (static_cast<std::uint64_t>(_key[1]) << 32) | _key[0]; }
+	void set_seed(std::uint64_t value)
+	{
+		_key[0] = static_cast<std::uint32_t>(value);
+		_key[1] = static_cast<std::uint32_t>(value >> 32);
+	}
+
+	result_type operator()(std::uint32_t c0, std::uint32_t c1, std::uint32_t c2, std::uint32_t c3) const
+	{
+		std::uint32_t c[4] = { c0, c1, c2, c3 };
+		std::uint32_t k[2] = { _key[0], _key[1] };
+
+		for (int round = 0; round < 10; ++round)
+		{
+			std::uint64_t p0 = static_cast<std::uint64_t>(0xD2511F53) * c[0];
+			std::uint64_t p1 = static_cast<std::uint64_t>(0xCD9E8D57) * c[2];
+			std::uint32_t hi0 = static_cast<std::uint32_t>(p0 >> 32);
+			std::uint32_t hi1 = static_cast<std::uint32_t>(p1 >> 32);
+
+			c[0] = hi1 ^ c[1] ^ k[0];
+			c[1] = static_cast<std::uint32_t>(p1);
+			c[2] = hi0 ^ c[3] ^ k[1];
+			c[3] = static_cast<std::uint32_t>(p0);
+
+			k[0] += 0x9E3779B9;
+			k[1] += 0xBB67AE85;
+		}
+
+		return result_type{{ c[0], c[1], c[2], c[3] }};
+	}
+
+	// uniform in [0, 1)
+	static float to_float(std::uint32_t value) { return (value >> 8) * (1.0f / 16777216.0f); }
+};
+
+
+#endif
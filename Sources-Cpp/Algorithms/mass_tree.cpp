@@ -0,0 +1,103 @@
+// Copyright (C) 2016 Felix Ungman
+//
+// This file is part of the openwar platform (GPL v3 or later), see LICENSE.txt
+
+#include "mass_tree.h"
+
+
+
+mass_tree::mass_tree(float theta) :
+_theta(theta)
+{
+}
+
+
+
+void mass_tree::clear()
+{
+	_points.clear();
+	_nodes.clear();
+}
+
+
+
+void mass_tree::insert(float x, float y, float mass)
+{
+	point p;
+	p._x = x;
+	p._y = y;
+	p._mass = mass;
+	_points.push_back(p);
+}
+
+
+
+void mass_tree::build()
+{
+	_nodes.clear();
+	_sorted = _points;
+
+	if (_points.empty())
+		return;
+
+	float minX = _points[0]._x, maxX = minX;
+	float minY = _points[0]._y, maxY = minY;
+	for (const point& p : _points)
+	{
+		minX = p._x < minX ? p._x : minX;
+		maxX = p._x > maxX ? p._x : maxX;
+		minY = p._y < minY ? p._y : minY;
+		maxY = p._y > maxY ? p._y : maxY;
+	}
+
+	_nodes.resize(1);
+	build(0, 0, static_cast<int>(_points.size()), minX, minY, maxX, maxY, 0);
+}
+
+
+
+void mass_tree::build(int index, int first, int count, float minX, float minY, float maxX, float maxY, int level)
+{
+	float mass = 0, x = 0, y = 0;
+	for (int i = first, end = first + count; i != end; ++i)
+	{
+		const point& p = _sorted[i];
+		mass += p._mass;
+		x += p._mass * p._x;
+		y += p._mass * p._y;
+	}
+
+	node& n = _nodes[index];
+	n._mass = mass;
+	n._x = mass > 0 ? x / mass : (minX + maxX) / 2;
+	n._y = mass > 0 ? y / mass : (minY + maxY) / 2;
+	n._size = maxX - minX > maxY - minY ? maxX - minX : maxY - minY;
+	n._children = -1;
+	n._first = first;
+	n._count = count;
+
+	if (count <= MassTreeLeafPoints || level == MassTreeMaxLevel)
+		return;
+
+	// stable partition of the points into the four quadrants
+	float midX = (minX + maxX) / 2;
+	float midY = (minY + maxY) / 2;
+	int counts[4] = { 0, 0, 0, 0 };
+	for (int i = first, end = first + count; i != end; ++i)
+		++counts[(_sorted[i]._x > midX ? 1 : 0) + (_sorted[i]._y > midY ? 2 : 0)];
+
+	int offsets[5] = { first, first + counts[0], first + counts[0] + counts[1], first + counts[0] + counts[1] + counts[2], first + count };
+	_scratch.assign(_sorted.begin() + first, _sorted.begin() + first + count);
+	int cursors[4] = { offsets[0], offsets[1], offsets[2], offsets[3] };
+	for (const point& p : _scratch)
+		_sorted[cursors[(p._x > midX ? 1 : 0) + (p._y > midY ? 2 : 0)]++] = p;
+
+	int children = static_cast<int>(_nodes.size());
+	_nodes[index]._children = children;
+	_nodes.resize(_nodes.size() + 4);
+
+	build(children + 0, offsets[0], counts[0], minX, minY, midX, midY, level + 1);
+	build(children + 1, offsets[1], counts[1], midX, minY, maxX, midY, level + 1);
+	build(children + 2, offsets[2], counts[2], minX, midY, midX, maxY, level + 1);
+	build(children + 3, offsets[3], counts[3], midX, midY, maxX, maxY, level + 1);
+}
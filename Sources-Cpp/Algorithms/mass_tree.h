@@ -0,0 +1,105 @@
+// Copyright (C) 2016 Felix Ungman
+//
+// This file is part of the openwar platform (GPL v3 or later), see LICENSE.txt
+
+#ifndef MASS_TREE_H
+#define MASS_TREE_H
+
+#include <cmath>
+#include <vector>
+
+
+const int MassTreeLeafPoints = 4;
+const int MassTreeMaxLevel = 16;
+
+
+// Barnes-Hut aggregation of weighted points. sum() adds up mass * kernel(distance)
+// over all points, but a group of points that is small compared to its distance
+// from (x, y) is taken as its total mass at its center of mass. The masses must
+// not be negative. Insert the points, then build() before summing.
+
+class mass_tree
+{
+	struct point
+	{
+		float _x, _y;
+		float _mass;
+	};
+
+	struct node
+	{
+		float _x, _y; // center of mass
+		float _mass;
+		float _size; // largest side of the bounds
+		int _children; // index of the first of four consecutive nodes, or -1
+		int _first, _count; // points of a leaf
+	};
+
+	std::vector<point> _points;
+	std::vector<point> _sorted; // _points in tree order, each leaf is a range
+	std::vector<point> _scratch;
+	std::vector<node> _nodes;
+	float _theta;
+
+public:
+	// theta is the largest size/distance ratio of a group that is not opened
+	explicit mass_tree(float theta = 0.5f);
+
+	void clear();
+	void insert(float x, float y, float mass);
+	void build();
+
+	template <class Kernel> float sum(float x, float y, Kernel kernel) const;
+
+	int node_count() const { return static_cast<int>(_nodes.size()); }
+
+private:
+	void build(int index, int first, int count, float minX, float minY, float maxX, float maxY, int level);
+	template <class Kernel> float sum(const node& node, float x, float y, Kernel kernel) const;
+};
+
+
+
+template <class Kernel> float mass_tree::sum(float x, float y, Kernel kernel) const
+{
+	return _nodes.empty() ? 0 : sum(_nodes[0], x, y, kernel);
+}
+
+
+
+template <class Kernel> float mass_tree::sum(const node& node, float x, float y, Kernel kernel) const
+{
+	if (node._mass <= 0)
+		return 0;
+
+	float dx = node._x - x;
+	float dy = node._y - y;
+	float distance = std::sqrt(dx * dx + dy * dy);
+
+	if (node._children == -1)
+	{
+		if (node._count == 1)
+			return node._mass * kernel(distance);
+
+		float result = 0;
+		for (int i = node._first, end = node._first + node._count; i != end; ++i)
+		{
+			const point& p = _sorted[i];
+			float px = p._x - x;
+			float py = p._y - y;
+			result += p._mass * kernel(std::sqrt(px * px + py * py));
+		}
+		return result;
+	}
+
+	if (node._size < _theta * distance)
+		return node._mass * kernel(distance);
+
+	float result = 0;
+	for (int i = 0; i < 4; ++i)
+		result += sum(_nodes[node._children + i], x, y, kernel);
+	return result;
+}
+
+
+#endif
@@ -5,8 +5,17 @@
 #ifndef QUADTREE_H
 #define QUADTREE_H
 
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
 
 const int QuadTreeNodeItems = 16;
+const int QuadTreeBlockNodes = 1024; // nodes per arena block, a multiple of four
+const int QuadTreeMaxBlocks = 4096;
+const int QuadTreeMaxNearest = 16; // largest k for find_k_nearest
 
 
 template <class T> class quadtree
@@ -22,7 +31,7 @@ template <class T> class quadtree
 	struct node
 	{
 		node* _parent;
-		node* _children[4];
+		node* _children; // first of four consecutive nodes
 		float _minX, _minY;
 		float _maxX, _maxY;
 		float _midX, _midY;
@@ -30,16 +39,24 @@ template <class T> class quadtree
 		item _items[QuadTreeNodeItems];
 		int _count;
 
-		node(node* parent, float minX, float minY, float maxX, float maxY);
-		~node();
+		node();
+		void init(node* parent, float minX, float minY, float maxX, float maxY);
 
 		int get_index();
 		int get_child_index(float x, float y);
-		void split();
-		void reset();
 	};
 
 	node _root;
+	std::vector<node*> _partitions;
+	std::vector<int> _partitionLevels;
+
+	// Nodes other than the root live in blocks that are never freed or moved,
+	// clear() keeps the tree shape, so a rebuild of a similar tree allocates nothing.
+	std::vector<std::unique_ptr<node[]>> _blocks;
+	std::atomic<int> _nodeCount;
+	std::atomic<int> _nodeCapacity;
+	std::mutex _mutex;
+	int _allocations;
 
 public:
 	class iterator
@@ -80,6 +97,25 @@ public:
 		node* get_next_node();
 	};
 
+	// Neighbour lists of a batch of query points. Keep one per thread and reuse
+	// it, the buffers grow to the largest batch and are then not reallocated.
+	class batch
+	{
+		friend class quadtree;
+		std::vector<int> _offsets;
+		std::vector<T> _values;
+		std::vector<int> _queries; // query of each value found, in traversal order
+		std::vector<T> _found;
+		std::vector<int> _active; // stack of queries overlapping the nodes being visited
+		int _visits{};
+
+	public:
+		int visits() const { return _visits; } // nodes visited by the last search
+		int size() const { return _offsets.empty() ? 0 : static_cast<int>(_offsets.size()) - 1; }
+		const T* begin(int query) const { return _values.data() + _offsets[query]; }
+		const T* end(int query) const { return _values.data() + _offsets[query + 1]; }
+	};
+
 public:
 	quadtree(float minX, float minY, float maxX, float maxY);
 	~quadtree();
@@ -89,7 +125,36 @@ public:
 
 	iterator find(float x, float y, float radius);
 
+	// Finds the neighbours of count points (x, y pairs in xy) in one traversal of
+	// the tree. Each point gets the values find() would return, in the same order.
+	// Points that are close to each other should be adjacent in xy, the nodes
+	// shared by consecutive queries are then visited once for all of them.
+	void find_batch(const float* xy, int count, float radius, batch& result);
+
+	// Writes the at most k values nearest to (x, y) within radius to values,
+	// nearest first, and returns how many were found. Adds the number of nodes
+	// visited to *visits if given.
+	int find_k_nearest(float x, float y, float radius, int k, T* values, int* visits = nullptr);
+
+	// The same, but only for the values accept(value) is true for.
+	template <class Accept> int find_k_nearest_if(float x, float y, float radius, int k, T* values, Accept accept, int* visits = nullptr);
+
+	int node_count() const { return _nodeCount + 1; }
+	int allocation_count() const { return _allocations; } // arena blocks allocated
+
+	// Prepares a cleared tree for inserting the given points from several threads.
+	// Splits the top levels of the tree the way inserting the points in order would,
+	// and stores the partition of each point. Partitions are disjoint sub-trees, and
+	// inserting each partition's points in order gives the same tree as insert().
+	int partition(const float* xy, int count, int* partitions);
+	void insert_partition(int partition, float x, float y, T value);
+
 private:
+	void insert(node* node, int level, float x, float y, T value);
+	void find_batch(node* node, const float* xy, float radius, int radius100, batch& result, int begin, int end);
+	template <class Accept> void find_k_nearest_if(node* node, float x, float y, float radiusSquared, int k, T* values, Accept& accept, float* distances, int& count, int& visits);
+	void split(node* node);
+	node* allocate_children();
 	static int convert(float value) { return (int)(value * 100); }
 };
 
@@ -97,8 +162,12 @@ private:
 
 
 template <class T> quadtree<T>::quadtree(float minX, float minY, float maxX, float maxY) :
-_root(0, minX, minY, maxX, maxY)
+_nodeCount(0),
+_nodeCapacity(0),
+_allocations(0)
 {
+	_root.init(0, minX, minY, maxX, maxY);
+	_blocks.reserve(QuadTreeMaxBlocks);
 }
 
 
@@ -111,22 +180,26 @@ template <class T> quadtree<T>::~quadtree()
 
 template <class T> void quadtree<T>::insert(float x, float y, T value)
 {
-	node* node = &_root;
-	int level = 0;
+	insert(&_root, 0, x, y, value);
+}
 
-	while (node->_children[0])
+
+
+template <class T> void quadtree<T>::insert(node* node, int level, float x, float y, T value)
+{
+	while (node->_children)
 	{
-		node = node->_children[node->get_child_index(x, y)];
+		node = node->_children + node->get_child_index(x, y);
 		if (++level > 12)
 			break;
 	}
 
 	while (node->_count == QuadTreeNodeItems)
 	{
-		node->split();
+		split(node);
 		if (++level > 12)
 			break;
-		node = node->_children[node->get_child_index(x, y)];
+		node = node->_children + node->get_child_index(x, y);
 	}
 
 	node->_items[node->_count++] = item(x, y, value);
@@ -136,7 +209,10 @@ template <class T> void quadtree<T>::insert(float x, float y, T value)
 
 template <class T> void quadtree<T>::clear()
 {
-    _root.reset();
+	_root._count = 0;
+
+	for (int i = 0, count = _nodeCount; i < count; ++i)
+		_blocks[i / QuadTreeBlockNodes][i % QuadTreeBlockNodes]._count = 0;
 }
 
 
@@ -148,39 +224,246 @@ template <class T> typename quadtree<T>::iterator quadtree<T>::find(float x, flo
 
 
 
-template <class T> quadtree<T>::node::node(node* parent, float minX, float minY, float maxX, float maxY)
-: _parent(parent),
-_minX(minX), _minY(minY),
-_maxX(maxX), _maxY(maxY),
-_midX((minX + maxX) / 2), _midY((minY + maxY) / 2),
-_minX100(convert(minX)), _maxX100(convert(maxX)), _minY100(convert(minY)), _maxY100(convert(maxY)),
+template <class T> void quadtree<T>::find_batch(const float* xy, int count, float radius, batch& result)
+{
+	result._queries.clear();
+	result._found.clear();
+	result._visits = 0;
+	result._active.resize(static_cast<std::size_t>(count));
+	for (int i = 0; i < count; ++i)
+		result._active[i] = i;
+
+	if (count != 0)
+		find_batch(&_root, xy, radius, convert(radius), result, 0, count);
+
+	// stable counting sort of the values by query, keeping the traversal order
+	result._offsets.assign(static_cast<std::size_t>(count + 1), 0);
+	for (int query : result._queries)
+		++result._offsets[query + 1];
+	for (int i = 0; i < count; ++i)
+		result._offsets[i + 1] += result._offsets[i];
+
+	result._active.assign(result._offsets.begin(), result._offsets.end() - 1);
+	result._values.resize(result._found.size());
+	for (std::size_t i = 0; i < result._found.size(); ++i)
+		result._values[result._active[result._queries[i]]++] = result._found[i];
+}
+
+
+
+template <class T> void quadtree<T>::find_batch(node* node, const float* xy, float radius, int radius100, batch& result, int begin, int end)
+{
+	++result._visits;
+
+	float radiusSquared = radius * radius;
+	for (int a = begin; a < end; ++a)
+	{
+		int query = result._active[a];
+		float x = xy[2 * query];
+		float y = xy[2 * query + 1];
+		for (int i = 0; i < node->_count; ++i)
+		{
+			const item& item = node->_items[i];
+			float dx = item._x - x;
+			float dy = item._y - y;
+			if (dx * dx + dy * dy <= radiusSquared)
+			{
+				result._queries.push_back(query);
+				result._found.push_back(item._value);
+			}
+		}
+	}
+
+	if (!node->_children)
+		return;
+
+	for (int index = 0; index < 4; ++index)
+	{
+		typename quadtree<T>::node* child = node->_children + index;
+		int childBegin = static_cast<int>(result._active.size());
+		for (int a = begin; a < end; ++a)
+		{
+			int query = result._active[a];
+			int x100 = convert(xy[2 * query]);
+			int y100 = convert(xy[2 * query + 1]);
+			if (child->_minX100 - radius100 <= x100 && x100 <= child->_maxX100 + radius100
+				&& child->_minY100 - radius100 <= y100 && y100 <= child->_maxY100 + radius100)
+				result._active.push_back(query);
+		}
+
+		int childEnd = static_cast<int>(result._active.size());
+		if (childBegin != childEnd)
+			find_batch(child, xy, radius, radius100, result, childBegin, childEnd);
+		result._active.resize(static_cast<std::size_t>(childBegin));
+	}
+}
+
+
+
+template <class T> int quadtree<T>::find_k_nearest(float x, float y, float radius, int k, T* values, int* visits)
+{
+	return find_k_nearest_if(x, y, radius, k, values, [](const T&) { return true; }, visits);
+}
+
+
+
+template <class T> template <class Accept> int quadtree<T>::find_k_nearest_if(float x, float y, float radius, int k, T* values, Accept accept, int* visits)
+{
+	float distances[QuadTreeMaxNearest];
+	if (k > QuadTreeMaxNearest)
+		k = QuadTreeMaxNearest;
+
+	int count = 0;
+	int nodes = 0;
+	if (k > 0)
+		find_k_nearest_if(&_root, x, y, radius * radius, k, values, accept, distances, count, nodes);
+	if (visits)
+		*visits += nodes;
+	return count;
+}
+
+
+
+template <class T> template <class Accept> void quadtree<T>::find_k_nearest_if(node* node, float x, float y, float radiusSquared, int k, T* values, Accept& accept, float* distances, int& count, int& visits)
+{
+	++visits;
+
+	for (int i = 0; i < node->_count; ++i)
+	{
+		const item& item = node->_items[i];
+		float dx = item._x - x;
+		float dy = item._y - y;
+		float d = dx * dx + dy * dy;
+		if (d > radiusSquared || (count == k && d >= distances[k - 1]) || !accept(item._value))
+			continue;
+
+		int j = count < k ? count++ : k - 1;
+		for (; j > 0 && distances[j - 1] > d; --j)
+		{
+			distances[j] = distances[j - 1];
+			values[j] = values[j - 1];
+		}
+		distances[j] = d;
+		values[j] = item._value;
+	}
+
+	if (!node->_children)
+		return;
+
+	for (int index = 0; index < 4; ++index)
+	{
+		typename quadtree<T>::node* child = node->_children + index;
+		float dx = x < child->_minX ? child->_minX - x : x > child->_maxX ? x - child->_maxX : 0;
+		float dy = y < child->_minY ? child->_minY - y : y > child->_maxY ? y - child->_maxY : 0;
+		float d = dx * dx + dy * dy;
+		if (d <= radiusSquared && (count < k || d < distances[k - 1]))
+			find_k_nearest_if(child, x, y, radiusSquared, k, values, accept, distances, count, visits);
+	}
+}
+
+
+
+template <class T> int quadtree<T>::partition(const float* xy, int count, int* partitions)
+{
+	_partitions.clear();
+	_partitionLevels.clear();
+
+	if (!_root._children && count <= QuadTreeNodeItems)
+	{
+		_partitions.push_back(&_root);
+		_partitionLevels.push_back(0);
+		for (int i = 0; i < count; ++i)
+			partitions[i] = 0;
+		return 1;
+	}
+
+	split(&_root);
+
+	int counts[4] = { 0, 0, 0, 0 };
+	for (int i = 0; i < count; ++i)
+	{
+		partitions[i] = _root.get_child_index(xy[2 * i], xy[2 * i + 1]);
+		++counts[partitions[i]];
+	}
+
+	int first[4];
+	bool split[4];
+	for (int index = 0; index < 4; ++index)
+	{
+		node* child = _root._children + index;
+		first[index] = static_cast<int>(_partitions.size());
+		split[index] = child->_children || counts[index] > QuadTreeNodeItems;
+		if (split[index])
+		{
+			this->split(child);
+			for (int i = 0; i < 4; ++i)
+			{
+				_partitions.push_back(child->_children + i);
+				_partitionLevels.push_back(2);
+			}
+		}
+		else
+		{
+			_partitions.push_back(child);
+			_partitionLevels.push_back(1);
+		}
+	}
+
+	for (int i = 0; i < count; ++i)
+	{
+		int index = partitions[i];
+		partitions[i] = first[index];
+		if (split[index])
+			partitions[i] += _root._children[index].get_child_index(xy[2 * i], xy[2 * i + 1]);
+	}
+
+	return static_cast<int>(_partitions.size());
+}
+
+
+
+template <class T> void quadtree<T>::insert_partition(int partition, float x, float y, T value)
+{
+	insert(_partitions[partition], _partitionLevels[partition], x, y, value);
+}
+
+
+
+template <class T> quadtree<T>::node::node()
+: _parent(0),
+_children(0),
+_minX(0), _minY(0),
+_maxX(0), _maxY(0),
+_midX(0), _midY(0),
+_minX100(0), _maxX100(0), _minY100(0), _maxY100(0),
 _count(0)
 {
-	_children[0] = 0;
-	_children[1] = 0;
-	_children[2] = 0;
-	_children[3] = 0;
 }
 
 
 
-template <class T> quadtree<T>::node::~node()
+template <class T> void quadtree<T>::node::init(node* parent, float minX, float minY, float maxX, float maxY)
 {
-	delete _children[0];
-	delete _children[1];
-	delete _children[2];
-	delete _children[3];
+	_parent = parent;
+	_children = 0;
+	_minX = minX;
+	_minY = minY;
+	_maxX = maxX;
+	_maxY = maxY;
+	_midX = (minX + maxX) / 2;
+	_midY = (minY + maxY) / 2;
+	_minX100 = convert(minX);
+	_maxX100 = convert(maxX);
+	_minY100 = convert(minY);
+	_maxY100 = convert(maxY);
+	_count = 0;
 }
 
 
 
 template <class T> int quadtree<T>::node::get_index()
 {
-	if (this == _parent->_children[0]) return 0;
-	if (this == _parent->_children[1]) return 1;
-	if (this == _parent->_children[2]) return 2;
-	if (this == _parent->_children[3]) return 3;
-	return -1;
+	return static_cast<int>(this - _parent->_children);
 }
 
 
@@ -192,42 +475,52 @@ template <class T> int quadtree<T>::node::get_child_index(float x, float y)
 
 
 
-template <class T> void quadtree<T>::node::split()
+template <class T> void quadtree<T>::split(node* node)
 {
-	if (!_children[0])
+	if (!node->_children)
 	{
-		_children[0] = new node(this, _minX, _minY, _midX, _midY);
-		_children[1] = new node(this, _midX, _minY, _maxX, _midY);
-		_children[2] = new node(this, _minX, _midY, _midX, _maxY);
-		_children[3] = new node(this, _midX, _midY, _maxX, _maxY);
+		typename quadtree<T>::node* children = allocate_children();
+		children[0].init(node, node->_minX, node->_minY, node->_midX, node->_midY);
+		children[1].init(node, node->_midX, node->_minY, node->_maxX, node->_midY);
+		children[2].init(node, node->_minX, node->_midY, node->_midX, node->_maxY);
+		children[3].init(node, node->_midX, node->_midY, node->_maxX, node->_maxY);
+		node->_children = children;
 	}
 
-	for (int i = 0; i < _count; ++i)
+	for (int i = 0; i < node->_count; ++i)
 	{
-		item& item = _items[i];
-		int index = get_child_index(item._x, item._y);
-		node* child = _children[index];
+		item& item = node->_items[i];
+		int index = node->get_child_index(item._x, item._y);
+		typename quadtree<T>::node* child = node->_children + index;
 
 		if (child->_count == QuadTreeNodeItems)
-			child->split();
+			split(child);
 
 		child->_items[child->_count++] = item;
 	}
 
-	_count = 0;
+	node->_count = 0;
 }
 
 
 
-template <class T> void quadtree<T>::node::reset()
+// Safe to call from several threads, each filling its own partition.
+template <class T> typename quadtree<T>::node* quadtree<T>::allocate_children()
 {
-	_count = 0;
+	int index = _nodeCount.fetch_add(4);
 
-	if (_children[0])
+	if (index + 4 > _nodeCapacity.load(std::memory_order_acquire))
 	{
-		for (int i = 0; i < 4; ++i)
-			_children[i]->reset();
+		std::lock_guard<std::mutex> lock(_mutex);
+		while (index + 4 > _nodeCapacity.load(std::memory_order_relaxed))
+		{
+			_blocks.push_back(std::unique_ptr<node[]>(new node[QuadTreeBlockNodes]));
+			_nodeCapacity.store(_nodeCapacity.load(std::memory_order_relaxed) + QuadTreeBlockNodes, std::memory_order_release);
+			++_allocations;
+		}
 	}
+
+	return &_blocks[index / QuadTreeBlockNodes][index % QuadTreeBlockNodes];
 }
 
 
@@ -318,11 +611,11 @@ template <class T> void quadtree<T>::iterator::move_next()
 
 template <class T> typename quadtree<T>::node* quadtree<T>::iterator::get_next_node()
 {
-	if (_node->_children[0])
+	if (_node->_children)
 	{
 		for (int index = 0; index < 4; ++index)
         {
-            node* child = _node->_children[index];
+            node* child = _node->_children + index;
 			if (is_within_radius(child))
 				return child;
         }
@@ -334,7 +627,7 @@ template <class T> typename quadtree<T>::node* quadtree<T>::iterator::get_next_n
 		int index = current->get_index();
 		while (++index != 4)
         {
-            node* sibling = current->_parent->_children[index];
+            node* sibling = current->_parent->_children + index;
 			if (is_within_radius(sibling))
 				return sibling;
 		}
@@ -0,0 +1,8 @@
+// Copyright (C) 2016 Felix Ungman
+//
+// This file is part of the openwar platform (GPL v3 or later), see LICENSE.txt
+
+#include "spatial_grid.h"
+
+
+template class spatial_grid<int>;
@@ -0,0 +1,332 @@
+// Copyright (C) 2016 Felix Ungman
+//
+// This file is part of the openwar platform (GPL v3 or later), see LICENSE.txt
+
+#ifndef SPATIAL_GRID_H
+#define SPATIAL_GRID_H
+
+#include <cstddef>
+#include <vector>
+
+
+// Uniform grid with the same insert/find contract as quadtree<T>. Items are
+// bucketed by cell with a counting sort when the grid is first searched after
+// an insert. Only the cells occupied by the last build are cleared and counted,
+// so a clear and rebuild is O(n) however fine the grid, and allocates nothing
+// once the buffers have grown. Call build() before searching from several threads.
+
+template <class T> class spatial_grid
+{
+	struct item
+	{
+		float _x, _y;
+		T _value;
+		item() : _x(), _y(), _value() {}
+		item(float x, float y, T value) : _x(x), _y(y), _value(value) {}
+	};
+
+	float _minX, _minY;
+	float _cellSize;
+	float _inverseCellSize;
+	int _columns, _rows;
+
+	struct range
+	{
+		int _begin, _end;
+		range() : _begin(), _end() {}
+	};
+
+	std::vector<item> _inserted;
+	std::vector<int> _insertedCells; // of each item in _inserted
+	std::vector<item> _items; // _inserted sorted by cell, the cells in the order they were first occupied
+	std::vector<range> _cells; // of each cell, the items in _items, empty unless occupied
+	std::vector<int> _occupied; // cells with items, in the order they were first occupied
+	bool _built;
+	int _allocations;
+
+public:
+	class iterator
+	{
+		const spatial_grid* _grid;
+		float _x, _y;
+		float _radiusSquared;
+		int _column0, _column1, _column;
+		int _row, _row1;
+		const item* _item;
+		const item* _end;
+
+	public:
+		iterator(const spatial_grid* grid, float x, float y, float radius);
+
+		T* operator*() { return _item != _end ? const_cast<T*>(&_item->_value) : 0; }
+
+		iterator& operator++()
+		{
+			++_item;
+			move_next();
+			return *this;
+		}
+
+	private:
+		void move_next();
+		bool next_cell();
+	};
+
+public:
+	spatial_grid(float minX, float minY, float maxX, float maxY, float cellSize = 2);
+
+	void insert(float x, float y, T value);
+	void clear();
+	void build();
+
+	iterator find(float x, float y, float radius);
+	int cell_count(float x, float y, float radius) const; // cells visited by find()
+	int find_k_nearest(float x, float y, float radius, int k, T* values, int* visits = nullptr);
+	template <class Accept> int find_k_nearest_if(float x, float y, float radius, int k, T* values, Accept accept, int* visits = nullptr);
+
+	int allocation_count() const { return _allocations; } // buffer reallocations
+
+private:
+	int get_column(float x) const;
+	int get_row(float y) const;
+};
+
+
+
+
+template <class T> spatial_grid<T>::spatial_grid(float minX, float minY, float maxX, float maxY, float cellSize) :
+_minX(minX), _minY(minY),
+_cellSize(cellSize),
+_inverseCellSize(1 / cellSize),
+_columns((int)((maxX - minX) / cellSize + 0.999f)),
+_rows((int)((maxY - minY) / cellSize + 0.999f)),
+_built(true),
+_allocations(0)
+{
+	if (_columns < 1)
+		_columns = 1;
+	if (_rows < 1)
+		_rows = 1;
+
+	_cells.resize((std::size_t)(_columns * _rows));
+}
+
+
+
+template <class T> void spatial_grid<T>::insert(float x, float y, T value)
+{
+	if (_inserted.size() == _inserted.capacity())
+		++_allocations;
+	_inserted.push_back(item(x, y, value));
+	_built = false;
+}
+
+
+
+template <class T> void spatial_grid<T>::clear()
+{
+	_inserted.clear();
+	_built = false;
+}
+
+
+
+template <class T> void spatial_grid<T>::build()
+{
+	if (_built)
+		return;
+
+	int count = (int)_inserted.size();
+
+	for (int cell : _occupied)
+		_cells[cell] = range();
+	_occupied.clear();
+
+	// _end counts the items of each cell
+	if (_insertedCells.capacity() < _inserted.size())
+		++_allocations;
+	_insertedCells.resize(_inserted.size());
+	for (int i = 0; i < count; ++i)
+	{
+		const item& item = _inserted[i];
+		int cell = get_row(item._y) * _columns + get_column(item._x);
+		_insertedCells[i] = cell;
+		if (_cells[cell]._end++ == 0)
+		{
+			if (_occupied.size() == _occupied.capacity())
+				++_allocations;
+			_occupied.push_back(cell);
+		}
+	}
+
+	int offset = 0;
+	for (int cell : _occupied)
+	{
+		int n = _cells[cell]._end;
+		_cells[cell]._begin = offset;
+		_cells[cell]._end = offset;
+		offset += n;
+	}
+
+	// _end is used as the write cursor, ending up at the end of the cell
+	if (_items.capacity() < _inserted.size())
+		++_allocations;
+	_items.resize(_inserted.size());
+	for (int i = 0; i < count; ++i)
+		_items[_cells[_insertedCells[i]]._end++] = _inserted[i];
+
+	_built = true;
+}
+
+
+
+template <class T> typename spatial_grid<T>::iterator spatial_grid<T>::find(float x, float y, float radius)
+{
+	build();
+	return iterator(this, x, y, radius);
+}
+
+
+
+template <class T> int spatial_grid<T>::cell_count(float x, float y, float radius) const
+{
+	return (get_column(x + radius) - get_column(x - radius) + 1) * (get_row(y + radius) - get_row(y - radius) + 1);
+}
+
+
+
+template <class T> int spatial_grid<T>::find_k_nearest(float x, float y, float radius, int k, T* values, int* visits)
+{
+	return find_k_nearest_if(x, y, radius, k, values, [](const T&) { return true; }, visits);
+}
+
+
+
+template <class T> template <class Accept> int spatial_grid<T>::find_k_nearest_if(float x, float y, float radius, int k, T* values, Accept accept, int* visits)
+{
+	build();
+
+	const int maxNearest = 16;
+	float distances[maxNearest];
+	if (k > maxNearest)
+		k = maxNearest;
+
+	int count = 0;
+	if (k <= 0)
+		return 0;
+
+	float radiusSquared = radius * radius;
+	int column0 = get_column(x - radius);
+	int column1 = get_column(x + radius);
+	int row0 = get_row(y - radius);
+	int row1 = get_row(y + radius);
+	if (visits)
+		*visits += (column1 - column0 + 1) * (row1 - row0 + 1);
+
+	for (int row = row0; row <= row1; ++row)
+	{
+		for (int column = column0; column <= column1; ++column)
+		{
+			const range& cell = _cells[row * _columns + column];
+			const item* end = _items.data() + cell._end;
+			for (const item* i = _items.data() + cell._begin; i != end; ++i)
+			{
+				float dx = i->_x - x;
+				float dy = i->_y - y;
+				float d = dx * dx + dy * dy;
+				if (d > radiusSquared || (count == k && d >= distances[k - 1]) || !accept(i->_value))
+					continue;
+
+				int j = count < k ? count++ : k - 1;
+				for (; j > 0 && distances[j - 1] > d; --j)
+				{
+					distances[j] = distances[j - 1];
+					values[j] = values[j - 1];
+				}
+				distances[j] = d;
+				values[j] = i->_value;
+			}
+		}
+	}
+
+	return count;
+}
+
+
+
+template <class T> int spatial_grid<T>::get_column(float x) const
+{
+	int column = (int)((x - _minX) * _inverseCellSize);
+	return column < 0 ? 0 : column < _columns ? column : _columns - 1;
+}
+
+
+
+template <class T> int spatial_grid<T>::get_row(float y) const
+{
+	int row = (int)((y - _minY) * _inverseCellSize);
+	return row < 0 ? 0 : row < _rows ? row : _rows - 1;
+}
+
+
+
+template <class T> spatial_grid<T>::iterator::iterator(const spatial_grid* grid, float x, float y, float radius)
+: _grid(grid),
+_x(x), _y(y),
+_radiusSquared(radius * radius),
+_column0(grid->get_column(x - radius)),
+_column1(grid->get_column(x + radius)),
+_column(_column1),
+_row(grid->get_row(y - radius) - 1),
+_row1(grid->get_row(y + radius)),
+_item(0),
+_end(0)
+{
+	move_next();
+}
+
+
+
+template <class T> void spatial_grid<T>::iterator::move_next()
+{
+	while (true)
+	{
+		while (_item != _end)
+		{
+			float dx = _item->_x - _x;
+			float dy = _item->_y - _y;
+			if (dx * dx + dy * dy <= _radiusSquared)
+				return;
+			++_item;
+		}
+
+		if (!next_cell())
+			return;
+	}
+}
+
+
+
+template <class T> bool spatial_grid<T>::iterator::next_cell()
+{
+	// the cells row by row, so items are found in the same order however they are stored
+	if (_column != _column1)
+	{
+		++_column;
+	}
+	else
+	{
+		if (_row == _row1)
+			return false;
+		++_row;
+		_column = _column0;
+	}
+
+	const range& cell = _grid->_cells[_row * _grid->_columns + _column];
+	_item = _grid->_items.data() + cell._begin;
+	_end = _grid->_items.data() + cell._end;
+	return true;
+}
+
+
+#endif
@@ -0,0 +1,58 @@
+// Copyright (C) 2016 Felix Ungman
+//
+// This file is part of the openwar platform (GPL v3 or later), see LICENSE.txt
+
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+
+// Bounded queue from one producer thread to one consumer thread without locks.
+// The slots are allocated up front, so pushing never allocates unless moving
+// a value into its slot does.
+
+template <class T>
+class spsc_queue
+{
+	std::vector<T> _items;
+	std::atomic<std::size_t> _head{}; // next slot to pop, written by the consumer
+	std::atomic<std::size_t> _tail{}; // next slot to push, written by the producer
+
+public:
+	explicit spsc_queue(std::size_t capacity) : _items(capacity + 1) { }
+
+	spsc_queue(const spsc_queue&) = delete;
+	spsc_queue& operator=(const spsc_queue&) = delete;
+
+	std::size_t capacity() const { return _items.size() - 1; }
+
+	// producer, returns false if the queue is full
+	bool try_push(T value)
+	{
+		std::size_t tail = _tail.load(std::memory_order_relaxed);
+		std::size_t next = tail + 1 != _items.size() ? tail + 1 : 0;
+		if (next == _head.load(std::memory_order_acquire))
+			return false;
+		_items[tail] = std::move(value);
+		_tail.store(next, std::memory_order_release);
+		return true;
+	}
+
+	// consumer, returns false if the queue is empty
+	bool try_pop(T& value)
+	{
+		std::size_t head = _head.load(std::memory_order_relaxed);
+		if (head == _tail.load(std::memory_order_acquire))
+			return false;
+		value = std::move(_items[head]);
+		_head.store(head + 1 != _items.size() ? head + 1 : 0, std::memory_order_release);
+		return true;
+	}
+};
+
+
+#endif
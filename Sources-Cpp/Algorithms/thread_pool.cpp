@@ -0,0 +1,98 @@
+// Copyright (C) 2016 Felix Ungman
+//
+// This file is part of the openwar platform (GPL v3 or later), see LICENSE.txt
+
+#include "thread_pool.h"
+
+
+thread_pool::thread_pool(int threads)
+{
+	if (threads <= 0)
+		threads = static_cast<int>(std::thread::hardware_concurrency());
+
+	for (int i = 1; i < threads; ++i)
+		_threads.emplace_back(&thread_pool::worker, this);
+}
+
+
+thread_pool::~thread_pool()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stopping = true;
+	}
+	_started.notify_all();
+
+	for (std::thread& thread : _threads)
+		thread.join();
+}
+
+
+void thread_pool::parallel_for(int count, int grain, const std::function<void(int, int)>& body)
+{
+	if (grain < 1)
+		grain = 1;
+
+	if (_threads.empty() || count <= grain)
+	{
+		if (count > 0)
+			body(0, count);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_body = &body;
+		_count = count;
+		_grain = grain;
+		_next = 0;
+		_running = static_cast<int>(_threads.size());
+		++_generation;
+	}
+	_started.notify_all();
+
+	run_chunks();
+
+	std::unique_lock<std::mutex> lock(_mutex);
+	_finished.wait(lock, [this]() { return _running == 0; });
+	_body = nullptr;
+}
+
+
+void thread_pool::run_chunks()
+{
+	int chunks = (_count + _grain - 1) / _grain;
+	for (int chunk = _next++; chunk < chunks; chunk = _next++)
+	{
+		int begin = chunk * _grain;
+		int end = begin + _grain < _count ? begin + _grain : _count;
+		(*_body)(begin, end);
+	}
+}
+
+
+void thread_pool::worker()
+{
+	unsigned generation = 0;
+
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_started.wait(lock, [this, generation]() { return _stopping || _generation != generation; });
+			if (_stopping)
+				return;
+			generation = _generation;
+		}
+
+		run_chunks();
+
+		bool last;
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			last = --_running == 0;
+		}
+		if (last)
+			_finished.notify_one();
+	}
+}
@@ -0,0 +1,52 @@
+// Copyright (C) 2016 Felix Ungman
+//
+// This file is part of the openwar platform (GPL v3 or later), see LICENSE.txt
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+class thread_pool
+{
+	std::vector<std::thread> _threads{};
+	std::mutex _mutex{};
+	std::condition_variable _started{};
+	std::condition_variable _finished{};
+
+	const std::function<void(int, int)>* _body{};
+	int _count{};
+	int _grain{};
+	std::atomic<int> _next{};
+	int _running{};
+	unsigned _generation{};
+	bool _stopping{};
+
+public:
+	// threads is the total number of threads including the calling thread,
+	// zero means one per hardware thread
+	explicit thread_pool(int threads);
+	~thread_pool();
+
+	thread_pool(const thread_pool&) = delete;
+	thread_pool& operator=(const thread_pool&) = delete;
+
+	int size() const { return static_cast<int>(_threads.size()) + 1; }
+
+	// calls body(begin, end) for consecutive chunks of at most grain
+	// indices in [0, count), returns when all chunks are done
+	void parallel_for(int count, int grain, const std::function<void(int, int)>& body);
+
+private:
+	void run_chunks();
+	void worker();
+};
+
+
+#endif
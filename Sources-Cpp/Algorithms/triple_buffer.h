@@ -0,0 +1,54 @@
+// Copyright (C) 2016 Felix Ungman
+//
+// This file is part of the openwar platform (GPL v3 or later), see LICENSE.txt
+
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <atomic>
+
+
+// Hands the latest of a series of values from one writer thread to one reader
+// thread without locks. The writer fills back() and publishes it, the reader
+// picks up the latest published value with update() and reads front(). Neither
+// ever waits for the other; values published faster than they are read are dropped.
+
+template <class T>
+class triple_buffer
+{
+	static const int fresh_bit = 4; // set in _middle when it has not been read
+
+	T _buffers[3]{};
+	std::atomic<int> _middle{1};
+	int _back{0}; // only used by the writer
+	int _front{2}; // only used by the reader
+
+public:
+	triple_buffer() { }
+
+	triple_buffer(const triple_buffer&) = delete;
+	triple_buffer& operator=(const triple_buffer&) = delete;
+
+	// writer, returns true if the previously published value was never read
+	T& back() { return _buffers[_back]; }
+	bool publish()
+	{
+		int previous = _middle.exchange(_back | fresh_bit, std::memory_order_acq_rel);
+		_back = previous & ~fresh_bit;
+		return (previous & fresh_bit) != 0;
+	}
+
+	// reader, returns true if front() changed to a newly published value
+	bool update()
+	{
+		if ((_middle.load(std::memory_order_relaxed) & fresh_bit) == 0)
+			return false;
+		int previous = _middle.exchange(_front, std::memory_order_acq_rel);
+		_front = previous & ~fresh_bit;
+		return true;
+	}
+	const T& front() const { return _buffers[_front]; }
+};
+
+
+#endif
@@ -7,6 +7,7 @@
 
 #include "Algebra/bounds.h"
 #include "HeightMap.h"
+#include "TerrainAttributeMap.h"
 
 class HeightMap;
 
@@ -18,6 +19,7 @@ public:
 
 	virtual bounds2f GetBounds() const = 0;
 	virtual const HeightMap* GetHeightMap() const = 0;
+	virtual const TerrainAttributeMap* GetAttributeMap() const = 0;
 	virtual float CalculateHeight(int x, int y) const = 0;
 
 	virtual bool IsForest(glm::vec2 position) const = 0;
@@ -30,10 +32,12 @@ public:
 class BlankGroundMap : public GroundMap
 {
 	HeightMap _heightMap{{0, 0, 1024, 1024}};
+	TerrainAttributeMap _attributeMap{{0, 0, 1024, 1024}, {0, 0}};
 
 public:
 	bounds2f GetBounds() const { return _heightMap.GetBounds(); }
 	const HeightMap* GetHeightMap() const { return &_heightMap; }
+	const TerrainAttributeMap* GetAttributeMap() const { return &_attributeMap; }
 	float CalculateHeight(int x, int y) const { return 2.0f; }
 
 	bool IsForest(glm::vec2 position) const { return false; }
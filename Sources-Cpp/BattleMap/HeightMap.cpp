@@ -30,6 +30,7 @@ void HeightMap::Update(const GroundMap* groundMap)
 {
 	UpdateHeights(groundMap);
 	UpdateNormals();
+	++_version;
 }
 
 
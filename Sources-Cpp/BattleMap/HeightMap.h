@@ -18,6 +18,7 @@ class HeightMap
 	int _cacheMaxIndex{254};
 	float* _cacheHeights{};
 	glm::vec3* _cacheNormals{};
+	int _version{};
 
 public:
 	HeightMap(bounds2f bounds);
@@ -26,6 +27,7 @@ public:
 	bounds2f GetBounds() const { return _bounds; }
 
 	void Update(const GroundMap* groundMap);
+	int GetVersion() const { return _version; } // incremented by Update()
 
 	int GetHeightStride() const { return _cacheStride; }
 	int GetMaxIndex() const { return _cacheMaxIndex; }
@@ -6,12 +6,19 @@
 #include "HeightMap.h"
 
 
+// a height map point depends on the pixels next to it, and a normal on the
+// points next to it, so painting a pixel can change impassable three pixels away
+static const int AttributeMapMargin = 3;
+
+
 SmoothGroundMap::SmoothGroundMap(bounds2f bounds, std::unique_ptr<Image>&& image) :
 	_heightMap{bounds},
 	_bounds{bounds},
-	_image{std::move(image)}
+	_image{std::move(image)},
+	_attributeMap{bounds, _image ? _image->size() : glm::ivec2()}
 {
 	UpdateHeightMap();
+	UpdateAttributeMap(glm::ivec2(0, 0), _attributeMap.GetSize() - 1);
 }
 
 
@@ -187,6 +194,7 @@ bounds2f SmoothGroundMap::Paint(TerrainFeature feature, glm::vec2 position, floa
 		}
 
 	UpdateHeightMap();
+	UpdateAttributeMap(origin - AttributeMapMargin, origin + size - 1 + AttributeMapMargin);
 
 	return bounds2f(position).add_radius(radius + 1);
 }
@@ -231,6 +239,7 @@ bounds2f SmoothGroundMap::Paint(TerrainFeature feature, glm::vec2 position, floa
 		}
 
 	UpdateHeightMap();
+	UpdateAttributeMap(center - 10 - AttributeMapMargin, center + 10 + AttributeMapMargin);
 
 	return bounds2f(position).add_radius(radius + 1);
 }
@@ -240,3 +249,39 @@ void SmoothGroundMap::UpdateHeightMap()
 {
 	_heightMap.Update(this);
 }
+
+
+void SmoothGroundMap::UpdateAttributeMap(glm::ivec2 min, glm::ivec2 max)
+{
+	if (!_image)
+		return;
+
+	min = glm::max(min, glm::ivec2(0, 0));
+	max = glm::min(max, _attributeMap.GetSize() - 1);
+
+	for (int y = min.y; y <= max.y; ++y)
+		for (int x = min.x; x <= max.x; ++x)
+		{
+			glm::vec4 c = _image->GetPixel(x, y);
+			float forest = GetForestValue(x, y);
+			float impassable = GetImpassableValue(x, y);
+
+			unsigned char attributes = 0;
+			if (forest >= 0.5f)
+				attributes |= TerrainAttribute_Forest;
+			if (impassable >= 0.5f)
+				attributes |= TerrainAttribute_Impassable;
+			if (c.b >= 0.5f)
+				attributes |= TerrainAttribute_Water;
+			if (c.b >= 0.5f && c.r >= 0.5f)
+				attributes |= TerrainAttribute_Ford;
+
+			unsigned char movementCost = impassable >= 0.5f
+				? TerrainAttributeMap::MovementCostImpassable
+				: (unsigned char)(TerrainAttributeMap::MovementCostOpen * (1.0f + forest + 2.0f * impassable));
+
+			_attributeMap.SetCell(x, y, attributes, movementCost);
+		}
+
+	_attributeMap.Updated(min, max);
+}
@@ -18,6 +18,7 @@ class SmoothGroundMap : public GroundMap, public MapEditor
 {
 	bounds2f _bounds;
 	std::unique_ptr<Image> _image;
+	TerrainAttributeMap _attributeMap;
 
 public:
 	HeightMap _heightMap;
@@ -28,6 +29,7 @@ public:
 public: // GroundMap
 	bounds2f GetBounds() const override { return _bounds; }
 	const HeightMap* GetHeightMap() const override { return &_heightMap; }
+	const TerrainAttributeMap* GetAttributeMap() const override { return &_attributeMap; }
 	float CalculateHeight(int x, int y) const override;
 
 	bool IsForest(glm::vec2 position) const override;
@@ -49,6 +51,7 @@ public:
 
 private:
 	void UpdateHeightMap();
+	void UpdateAttributeMap(glm::ivec2 min, glm::ivec2 max);
 };
 
 
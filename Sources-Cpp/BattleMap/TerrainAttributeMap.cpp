@@ -0,0 +1,68 @@
+// Copyright (C) 2016 Felix Ungman
+//
+// This file is part of the openwar platform (GPL v3 or later), see LICENSE.txt
+
+#include "TerrainAttributeMap.h"
+
+
+const unsigned char TerrainAttributeMap::MovementCostOpen;
+const unsigned char TerrainAttributeMap::MovementCostImpassable;
+const int TerrainAttributeMap::MaxChanges;
+
+
+TerrainAttributeMap::TerrainAttributeMap(bounds2f bounds, glm::ivec2 size) :
+	_bounds{bounds},
+	_size{size}
+{
+	Cell open;
+	open.movementCost = MovementCostOpen;
+	_cells.assign(static_cast<std::size_t>(size.x * size.y), open);
+}
+
+
+void TerrainAttributeMap::SetCell(int x, int y, unsigned char attributes, unsigned char movementCost)
+{
+	if (0 <= x && x < _size.x && 0 <= y && y < _size.y)
+	{
+		Cell& cell = _cells[x + y * _size.x];
+		cell.attributes = attributes;
+		cell.movementCost = movementCost;
+	}
+}
+
+
+void TerrainAttributeMap::Updated(glm::ivec2 min, glm::ivec2 max)
+{
+	Change change;
+	change.version = ++_version;
+	change.min = glm::max(min, glm::ivec2(0, 0));
+	change.max = glm::min(max, _size - 1);
+
+	if (static_cast<int>(_changes.size()) == MaxChanges)
+		_changes.erase(_changes.begin());
+	_changes.push_back(change);
+}
+
+
+bool TerrainAttributeMap::GetChangedCells(int version, glm::ivec2& min, glm::ivec2& max) const
+{
+	if (version >= _version)
+		return false;
+
+	if (_changes.empty() || version < _changes.front().version - 1)
+	{
+		min = glm::ivec2(0, 0);
+		max = _size - 1;
+		return true;
+	}
+
+	min = _size;
+	max = glm::ivec2(-1, -1);
+	for (const Change& change : _changes)
+		if (change.version > version)
+		{
+			min = glm::min(min, change.min);
+			max = glm::max(max, change.max);
+		}
+	return true;
+}
@@ -0,0 +1,88 @@
+// Copyright (C) 2016 Felix Ungman
+//
+// This file is part of the openwar platform (GPL v3 or later), see LICENSE.txt
+
+#ifndef TerrainAttributeMap_H
+#define TerrainAttributeMap_H
+
+#include <glm/glm.hpp>
+#include <vector>
+#include "Algebra/bounds.h"
+
+
+enum TerrainAttribute
+{
+	TerrainAttribute_Forest = 1,
+	TerrainAttribute_Impassable = 2,
+	TerrainAttribute_Water = 4,
+	TerrainAttribute_Ford = 8
+};
+
+
+// Raster of the terrain attributes of a GroundMap, one cell per ground map
+// pixel, so the simulator can look them up without going through the ground
+// map. The ground map owns it and keeps it up to date when it is painted.
+
+class TerrainAttributeMap
+{
+public:
+	static const unsigned char MovementCostOpen = 16;
+	static const unsigned char MovementCostImpassable = 255;
+	static const int MaxChanges = 32; // remembered by GetChangedCells()
+
+	struct Cell
+	{
+		unsigned char attributes{}; // TerrainAttribute flags
+		unsigned char movementCost{}; // in 1/16ths of open ground
+	};
+
+private:
+	struct Change
+	{
+		int version{};
+		glm::ivec2 min{};
+		glm::ivec2 max{};
+	};
+
+	bounds2f _bounds;
+	glm::ivec2 _size{};
+	std::vector<Cell> _cells{};
+	int _version{};
+	std::vector<Change> _changes{}; // the last MaxChanges
+
+public:
+	TerrainAttributeMap(bounds2f bounds, glm::ivec2 size);
+
+	bounds2f GetBounds() const { return _bounds; }
+	glm::ivec2 GetSize() const { return _size; }
+	int GetVersion() const { return _version; } // incremented by Updated()
+
+	// the cells, inclusive, changed by the updates after the given version;
+	// false if there were none, all cells if they are too far back
+	bool GetChangedCells(int version, glm::ivec2& min, glm::ivec2& max) const;
+
+	glm::ivec2 ToCellCoordinate(glm::vec2 position) const
+	{
+		glm::vec2 p = (position - _bounds.min) / _bounds.size();
+		return glm::ivec2((int)(p.x * _size.x), (int)(p.y * _size.y));
+	}
+
+	// cells outside the map have no attributes
+	Cell GetCell(int x, int y) const
+	{
+		return 0 <= x && x < _size.x && 0 <= y && y < _size.y ? _cells[x + y * _size.x] : Cell();
+	}
+
+	unsigned char GetAttributes(glm::vec2 position) const
+	{
+		glm::ivec2 coord = ToCellCoordinate(position);
+		return GetCell(coord.x, coord.y).attributes;
+	}
+
+	void SetCell(int x, int y, unsigned char attributes, unsigned char movementCost);
+	void Updated() { Updated(glm::ivec2(0, 0), _size - 1); }
+	void Updated(glm::ivec2 min, glm::ivec2 max); // the cells that were set, inclusive
+};
+
+
+#endif
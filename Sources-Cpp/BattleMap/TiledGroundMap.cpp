@@ -10,6 +10,7 @@
 
 TiledGroundMap::TiledGroundMap(bounds2f bounds, glm::ivec2 size) :
 _heightMap(nullptr),
+_attributeMap(bounds, glm::ivec2()),
 _bounds(bounds),
 _size(size)
 {
@@ -42,6 +43,12 @@ const HeightMap* TiledGroundMap::GetHeightMap() const
 }
 
 
+const TerrainAttributeMap* TiledGroundMap::GetAttributeMap() const
+{
+	return &_attributeMap;
+}
+
+
 float TiledGroundMap::CalculateHeight(int x, int y) const
 {
 	return _patch->get_height(x, y);
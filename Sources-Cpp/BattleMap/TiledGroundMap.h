@@ -23,6 +23,7 @@ public:
 
 private:
 	HeightMap* _heightMap;
+	TerrainAttributeMap _attributeMap;
 	bounds2f _bounds;
 	glm::ivec2 _size;
 	Tile* _tiles{};
@@ -35,6 +36,7 @@ public:
 public: // GroundMap
 	bounds2f GetBounds() const override;
 	const HeightMap* GetHeightMap() const override;
+	const TerrainAttributeMap* GetAttributeMap() const override;
 	float CalculateHeight(int x, int y) const override;
 
 	bool IsForest(glm::vec2 position) const override;
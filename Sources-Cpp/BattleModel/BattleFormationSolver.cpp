@@ -0,0 +1,190 @@
+// Copyright (C) 2016 Felix Ungman
+//
+// This file is part of the openwar platform (GPL v3 or later), see LICENSE.txt
+
+#include "BattleFormationSolver.h"
+
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+
+#if defined(__SSE__)
+
+// one register holds the vec2 of two fighters, x0 y0 x1 y1
+
+static inline __m128 LoadPair(const glm::vec2* a, const glm::vec2* b)
+{
+	__m128 result = _mm_loadl_pi(_mm_setzero_ps(), reinterpret_cast<const __m64*>(a));
+	return _mm_loadh_pi(result, reinterpret_cast<const __m64*>(b));
+}
+
+
+static inline void StorePair(glm::vec2* a, glm::vec2* b, __m128 value)
+{
+	_mm_storel_pi(reinterpret_cast<__m64*>(a), value);
+	_mm_storeh_pi(reinterpret_cast<__m64*>(b), value);
+}
+
+
+static inline __m128 SetPair(glm::vec2 value)
+{
+	return _mm_setr_ps(value.x, value.y, value.x, value.y);
+}
+
+#endif
+
+
+bool BattleFormationSolver::IsVectorized()
+{
+#if defined(__SSE__)
+	return true;
+#else
+	return false;
+#endif
+}
+
+
+void BattleFormationSolver::Solve(const glm::vec2* position, const glm::vec2* destination, int count, glm::vec2* result) const
+{
+#if defined(__SSE__)
+	if (count == 0)
+		return;
+
+	int files = (count + ranks - 1) / ranks;
+
+	// The rear ranks, from the second file to the last one with a fighter on
+	// its right in the rank in front. The front rank slots in between get
+	// the same formula, but are overwritten below.
+	int first = ranks + 1;
+	int last = first;
+	if (ranks > 1)
+	{
+		__m128 half = _mm_set1_ps(0.5f);
+		__m128 back = SetPair(towardBack);
+		for (int end = count - ranks + 1; last + 2 <= end; last += 2)
+		{
+			__m128 left = _mm_loadu_ps(&destination[last - ranks - 1].x);
+			__m128 right = _mm_loadu_ps(&destination[last + ranks - 1].x);
+			_mm_storeu_ps(&result[last].x, _mm_add_ps(_mm_mul_ps(_mm_add_ps(left, right), half), back));
+		}
+	}
+	for (int index = 1, end = glm::min(ranks, count); index < end; ++index)
+		result[index] = SolveFighter(position, destination, count, index);
+	for (int index = last; index < count; ++index)
+		if (index % ranks != 0)
+			result[index] = SolveFighter(position, destination, count, index);
+
+	if (moving)
+	{
+		// two files at a time, near the ends of the rank the neighbours
+		// beyond them are loaded from the end and masked out
+		__m128 zero = _mm_setzero_ps();
+		__m128 one = _mm_set1_ps(1.0f);
+		__m128 fileCount = _mm_set1_ps((float)files);
+		__m128 towardRightPair = SetPair(towardRight);
+		__m128 leadPair = SetPair(lead);
+
+		__m128 offsets[6];
+		for (int i = 1; i <= 5; ++i)
+			offsets[i] = _mm_mul_ps(_mm_set1_ps((float)i), towardRightPair);
+
+		int file = 0;
+		for (; file + 1 < files; file += 2)
+		{
+			const glm::vec2* a = position + file * ranks;
+			const glm::vec2* b = a + ranks;
+			__m128 sum = LoadPair(a, b);
+			__m128 n;
+			if (file >= 5 && file + 6 < files)
+			{
+				for (int i = 1; i <= 5; ++i)
+					sum = _mm_add_ps(sum, _mm_add_ps(LoadPair(a - i * ranks, b - i * ranks), offsets[i]));
+				for (int i = 1; i <= 5; ++i)
+					sum = _mm_add_ps(sum, _mm_sub_ps(LoadPair(a + i * ranks, b + i * ranks), offsets[i]));
+				n = _mm_set1_ps(11.0f);
+			}
+			else
+			{
+				n = one;
+				for (int i = 1; i <= 5; ++i)
+				{
+					int left = file - i;
+					__m128 valid = _mm_cmpge_ps(_mm_setr_ps((float)left, (float)left, (float)(left + 1), (float)(left + 1)), zero);
+					__m128 p = LoadPair(position + glm::max(left, 0) * ranks, position + glm::max(left + 1, 0) * ranks);
+					sum = _mm_add_ps(sum, _mm_and_ps(_mm_add_ps(p, offsets[i]), valid));
+					n = _mm_add_ps(n, _mm_and_ps(one, valid));
+				}
+				for (int i = 1; i <= 5; ++i)
+				{
+					int right = file + i;
+					__m128 valid = _mm_cmplt_ps(_mm_setr_ps((float)right, (float)right, (float)(right + 1), (float)(right + 1)), fileCount);
+					__m128 p = LoadPair(position + glm::min(right, files - 1) * ranks, position + glm::min(right + 1, files - 1) * ranks);
+					sum = _mm_add_ps(sum, _mm_and_ps(_mm_sub_ps(p, offsets[i]), valid));
+					n = _mm_add_ps(n, _mm_and_ps(one, valid));
+				}
+			}
+			StorePair(result + file * ranks, result + (file + 1) * ranks, _mm_sub_ps(_mm_div_ps(sum, n), leadPair));
+		}
+		if (file < files)
+			result[file * ranks] = SolveFighter(position, destination, count, file * ranks);
+	}
+	else
+	{
+		for (int file = 0; file < files; ++file)
+			result[file * ranks] = frontLeft + towardRight * (float)file;
+	}
+#else
+	SolveScalar(position, destination, count, result);
+#endif
+}
+
+
+void BattleFormationSolver::SolveScalar(const glm::vec2* position, const glm::vec2* destination, int count, glm::vec2* result) const
+{
+	for (int index = 0; index < count; ++index)
+		result[index] = SolveFighter(position, destination, count, index);
+}
+
+
+glm::vec2 BattleFormationSolver::SolveFighter(const glm::vec2* position, const glm::vec2* destination, int count, int index) const
+{
+	int rank = index % ranks;
+	int file = index / ranks;
+	glm::vec2 result;
+	if (rank == 0)
+	{
+		if (moving)
+		{
+			result = position[index];
+			int n = 1;
+			for (int i = 1; i <= 5 && file - i >= 0; ++i)
+			{
+				result += position[(file - i) * ranks] + (float)i * towardRight;
+				++n;
+			}
+			for (int i = 1; i <= 5 && (file + i) * ranks < count; ++i)
+			{
+				result += position[(file + i) * ranks] - (float)i * towardRight;
+				++n;
+			}
+			result /= n;
+			result -= lead;
+		}
+		else
+		{
+			result = frontLeft + towardRight * (float)file;
+		}
+	}
+	else
+	{
+		int left = index - ranks - 1;
+		int right = index + ranks - 1;
+		if (file == 0 || right >= count)
+			result = destination[index - 1];
+		else
+			result = (destination[left] + destination[right]) / 2.0f;
+		result += towardBack;
+	}
+	return result;
+}
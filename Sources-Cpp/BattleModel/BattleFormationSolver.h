@@ -0,0 +1,42 @@
+// Copyright (C) 2016 Felix Ungman
+//
+// This file is part of the openwar platform (GPL v3 or later), see LICENSE.txt
+
+#ifndef BattleFormationSolver_H
+#define BattleFormationSolver_H
+
+#include <glm/glm.hpp>
+
+
+// Where the fighters of a unit go to keep their formation, computed for the
+// whole unit in one pass. The fighters are in fighter store order, rank +
+// file * ranks. A moving front rank keeps to the mean place of its five
+// neighbours on each side, otherwise it lines up from frontLeft, and each
+// rear rank follows the last destinations of the rank in front of it.
+//
+// Solve() handles two fighters at a time with SSE where it is available, in
+// the same order of operations as SolveScalar(), so both give the same result.
+
+class BattleFormationSolver
+{
+public:
+	int ranks{1};
+	glm::vec2 towardRight{};
+	glm::vec2 towardBack{};
+	bool moving{};
+	glm::vec2 lead{}; // moving, how far the front rank goes ahead of its mean place
+	glm::vec2 frontLeft{}; // not moving, where the front rank lines up from
+
+	// position and destination are those of the count fighters now, result
+	// gets their formation destinations and may not overlap either
+	void Solve(const glm::vec2* position, const glm::vec2* destination, int count, glm::vec2* result) const;
+	void SolveScalar(const glm::vec2* position, const glm::vec2* destination, int count, glm::vec2* result) const;
+
+	static bool IsVectorized();
+
+private:
+	glm::vec2 SolveFighter(const glm::vec2* position, const glm::vec2* destination, int count, int index) const;
+};
+
+
+#endif
@@ -1,32 +1,82 @@
 #include "BattleObjects.h"
 #include "BattleSimulator_v1_0_0.h"
+#include <cmath>
 
 
-void BattleObjects::UnitCommand::UpdateMovementPathStart(std::vector<glm::vec2>& path, glm::vec2 startPosition)
+const int BattleObjects::MovementPath::Capacity;
+const int BattleObjects::MovementPath::FrontSpace;
+
+
+void BattleObjects::MovementPath::push_front(glm::vec2 point)
+{
+	if (_size == Capacity)
+	{
+		_points[_head] = point;
+		return;
+	}
+
+	if (_head == 0)
+		MoveTo((Capacity - _size + 1) / 2);
+
+	_points[--_head] = point;
+	++_size;
+}
+
+
+void BattleObjects::MovementPath::push_back(glm::vec2 point)
+{
+	if (_size == Capacity)
+	{
+		_points[_head + _size - 1] = point;
+		return;
+	}
+
+	if (_head + _size == Capacity)
+		MoveTo(std::min(FrontSpace, (Capacity - _size) / 2));
+
+	_points[_head + _size] = point;
+	++_size;
+}
+
+
+void BattleObjects::MovementPath::MoveTo(int head)
+{
+	if (head < _head)
+		std::copy(begin(), end(), _points + head);
+	else
+		std::copy_backward(begin(), end(), _points + head + _size);
+	_head = head;
+}
+
+
+/***/
+
+
+void BattleObjects::UnitCommand::UpdateMovementPathStart(MovementPath& path, glm::vec2 startPosition)
 {
 	const float spacing = 10;
 
 	while (!path.empty() && glm::distance(path.front(), startPosition) < spacing)
-		path.erase(path.begin());
+		path.pop_front();
 
-	path.insert(path.begin(), startPosition);
+	path.push_front(startPosition);
 }
 
 
-void BattleObjects::UnitCommand::UpdateMovementPath(std::vector<glm::vec2>& path, glm::vec2 startPosition, glm::vec2 endPosition)
+void BattleObjects::UnitCommand::UpdateMovementPath(MovementPath& path, glm::vec2 startPosition, glm::vec2 endPosition)
 {
 	const float spacing = 10;
 
 	while (!path.empty() && glm::distance(path.front(), startPosition) < spacing)
-		path.erase(path.begin());
+		path.pop_front();
 
 	while (!path.empty() && glm::distance(path.back(), endPosition) < spacing)
-		path.erase(path.end() - 1);
+		path.pop_back();
 
 	while (!IsForwardMotion(path, endPosition))
 		path.pop_back();
 
-	path.insert(path.begin(), startPosition);
+	path.push_front(startPosition);
 
 	int n = 20;
 	glm::vec2 p = path.back();
@@ -44,30 +94,42 @@ void BattleObjects::UnitCommand::UpdateMovementPath(std::vector<glm::vec2>& path
 }
 
 
-float BattleObjects::UnitCommand::MovementPathLength(const std::vector<glm::vec2>& path)
+float BattleObjects::UnitCommand::MovementPathLength(const MovementPath& path)
 {
 	float result = 0;
 
-	for (std::vector<glm::vec2>::const_iterator i = path.begin() + 1; i < path.end(); ++i)
-		result += glm::distance(*(i - 1), *i);
+	for (std::size_t i = 1; i < path.size(); ++i)
+		result += glm::distance(path[i - 1], path[i]);
 
 	return result;
 }
 
 
-bool BattleObjects::UnitCommand::IsForwardMotion(const std::vector<glm::vec2>& path, glm::vec2 position)
+bool BattleObjects::UnitCommand::IsForwardMotion(const MovementPath& path, glm::vec2 position)
 {
 	if (path.size() < 2)
 		return true;
 
-	glm::vec2 last = *(path.end() - 1);
-	glm::vec2 prev = *(path.end() - 2);
+	glm::vec2 last = path[path.size() - 1];
+	glm::vec2 prev = path[path.size() - 2];
 	glm::vec2 next = last + (last - prev);
 
 	return glm::length(position - next) < glm::length(position - prev);
 }
 
 
+BattleObjects::FighterPosition BattleObjects::FighterPosition::Interpolate(FighterPosition previous, FighterPosition current, float alpha)
+{
+	float turn = current.bearing - previous.bearing;
+	turn -= 2.0f * (float)M_PI * std::floor((turn + (float)M_PI) / (2.0f * (float)M_PI));
+
+	FighterPosition result;
+	result.position = glm::mix(previous.position, current.position, alpha);
+	result.bearing = previous.bearing + alpha * turn;
+	return result;
+}
+
+
 /***/
 
 
@@ -88,6 +150,12 @@ void BattleObjects::Unit::SetOwnedBySimulator(bool value)
 }
 
 
+BattleObjects::FighterPosition BattleObjects::Unit::GetInterpolatedFighterPosition(int index, float alpha) const
+{
+	return FighterPosition::Interpolate(GetPreviousFighterPosition(index), GetFighterPosition(index), alpha);
+}
+
+
 /***/
 
 
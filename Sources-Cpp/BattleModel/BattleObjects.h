@@ -1,6 +1,7 @@
 #ifndef BattleObjects_H
 #define BattleObjects_H
 
+#include <algorithm>
 #include <string>
 #include <vector>
 #include <glm/glm.hpp>
@@ -64,9 +65,64 @@ public:
 	};
 
 
+	// The points of a movement path, kept in a fixed array from a head index, so
+	// the path is trimmed and extended at both ends without shifting the points
+	// or allocating, and is copied by copying only the points in use. A full path
+	// replaces its first point on push_front and its last on push_back, so the
+	// start and the destination are kept.
+	class MovementPath
+	{
+	public:
+		static const int Capacity = 128;
+		typedef glm::vec2* iterator;
+		typedef const glm::vec2* const_iterator;
+
+	private:
+		static const int FrontSpace = 8; // left for push_front after clear()
+
+		glm::vec2 _points[Capacity];
+		int _head{FrontSpace};
+		int _size{};
+
+	public:
+		MovementPath() { }
+		MovementPath(const MovementPath& other) : _head{other._head}, _size{other._size} { std::copy(other.begin(), other.end(), begin()); }
+
+		MovementPath& operator=(const MovementPath& other)
+		{
+			_head = other._head;
+			_size = other._size;
+			std::copy(other.begin(), other.end(), begin());
+			return *this;
+		}
+
+		bool empty() const { return _size == 0; }
+		std::size_t size() const { return static_cast<std::size_t>(_size); }
+
+		iterator begin() { return _points + _head; }
+		iterator end() { return _points + _head + _size; }
+		const_iterator begin() const { return _points + _head; }
+		const_iterator end() const { return _points + _head + _size; }
+
+		glm::vec2& operator[](std::size_t index) { return _points[_head + static_cast<int>(index)]; }
+		glm::vec2 operator[](std::size_t index) const { return _points[_head + static_cast<int>(index)]; }
+		glm::vec2 front() const { return _points[_head]; }
+		glm::vec2 back() const { return _points[_head + _size - 1]; }
+
+		void clear() { _head = FrontSpace; _size = 0; }
+		void push_front(glm::vec2 point);
+		void push_back(glm::vec2 point);
+		void pop_front() { ++_head; --_size; }
+		void pop_back() { --_size; }
+
+	private:
+		void MoveTo(int head);
+	};
+
+
 	struct UnitCommand
 	{
-		std::vector<glm::vec2> path{};
+		MovementPath path{};
 		bool running{};
 		float bearing{};
 		Unit* meleeTarget{};
@@ -90,10 +146,10 @@ public:
 			return !path.empty() ? path.back() : glm::vec2(512, 512);
 		}
 
-		static void UpdateMovementPathStart(std::vector<glm::vec2>& path, glm::vec2 startPosition);
-		static void UpdateMovementPath(std::vector<glm::vec2>& path, glm::vec2 startPosition, glm::vec2 endPosition);
-		static float MovementPathLength(const std::vector<glm::vec2>& path);
-		static bool IsForwardMotion(const std::vector<glm::vec2>& path, glm::vec2 position);
+		static void UpdateMovementPathStart(MovementPath& path, glm::vec2 startPosition);
+		static void UpdateMovementPath(MovementPath& path, glm::vec2 startPosition, glm::vec2 endPosition);
+		static float MovementPathLength(const MovementPath& path);
+		static bool IsForwardMotion(const MovementPath& path, glm::vec2 position);
 	};
 
 
@@ -101,6 +157,9 @@ public:
 	{
 		glm::vec2 position;
 		float bearing;
+
+		// turns the short way around
+		static FighterPosition Interpolate(FighterPosition previous, FighterPosition current, float alpha);
 	};
 
 
@@ -142,6 +201,7 @@ public:
 		void SetOwnedBySimulator(bool value);
 
 		int GetTeam() const { return commander->GetTeam(); }
+		virtual int GetUnitId() const = 0; // unique within the simulator, also after the unit is deleted
 
 		virtual glm::vec2 GetCenter() const = 0;
 		virtual void SetCenter(glm::vec2 value) = 0;
@@ -171,6 +231,8 @@ public:
 		virtual void SetFighterCount(int value) = 0;
 
 		virtual FighterPosition GetFighterPosition(int index) const = 0;
+		virtual FighterPosition GetPreviousFighterPosition(int index) const = 0; // at the start of the last time step
+		FighterPosition GetInterpolatedFighterPosition(int index, float alpha) const;
 		virtual void SetFighterPosition(int index, glm::vec3 value) = 0;
 
 		virtual FighterAssignment GetFighterAssignment(int index) const = 0;
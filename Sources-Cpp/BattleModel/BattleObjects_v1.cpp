@@ -9,15 +9,194 @@
 #include <cstring>
 
 
-int BattleObjects_v1::Fighter::GetRank() const
+BattleObjects_v1::FighterState BattleObjects_v1::FighterStates::Get(int index) const
 {
-	return static_cast<int>(this - unit->fighters) % unit->formation.numberOfRanks;
+	FighterState result;
+	result.position = position[index];
+	result.position_z = position_z[index];
+	result.readyState = readyState[index];
+	result.readyingTimer = readyingTimer[index];
+	result.strikingTimer = strikingTimer[index];
+	result.stunnedTimer = stunnedTimer[index];
+	result.opponent = opponent[index];
+	result.destination = destination[index];
+	result.velocity = velocity[index];
+	result.bearing = bearing[index];
+	result.meleeTarget = meleeTarget[index];
+	return result;
+}
+
+
+void BattleObjects_v1::FighterStates::Set(int index, const FighterState& value)
+{
+	position[index] = value.position;
+	position_z[index] = value.position_z;
+	readyState[index] = value.readyState;
+	readyingTimer[index] = value.readyingTimer;
+	strikingTimer[index] = value.strikingTimer;
+	stunnedTimer[index] = value.stunnedTimer;
+	opponent[index] = value.opponent;
+	destination[index] = value.destination;
+	velocity[index] = value.velocity;
+	bearing[index] = value.bearing;
+	meleeTarget[index] = value.meleeTarget;
+}
+
+
+void BattleObjects_v1::FighterStates::Copy(int to, int from)
+{
+	position[to] = position[from];
+	position_z[to] = position_z[from];
+	readyState[to] = readyState[from];
+	readyingTimer[to] = readyingTimer[from];
+	strikingTimer[to] = strikingTimer[from];
+	stunnedTimer[to] = stunnedTimer[from];
+	opponent[to] = opponent[from];
+	destination[to] = destination[from];
+	velocity[to] = velocity[from];
+	bearing[to] = bearing[from];
+	meleeTarget[to] = meleeTarget[from];
+}
+
+
+template <class T> static void append_items(std::vector<T>& v, int count, T value)
+{
+	v.insert(v.end(), static_cast<std::size_t>(count), value);
+}
+
+
+void BattleObjects_v1::FighterStates::Append(int count)
+{
+	FighterState value;
+	append_items(position, count, value.position);
+	append_items(position_z, count, value.position_z);
+	append_items(readyState, count, value.readyState);
+	append_items(readyingTimer, count, value.readyingTimer);
+	append_items(strikingTimer, count, value.strikingTimer);
+	append_items(stunnedTimer, count, value.stunnedTimer);
+	append_items(opponent, count, value.opponent);
+	append_items(destination, count, value.destination);
+	append_items(velocity, count, value.velocity);
+	append_items(bearing, count, value.bearing);
+	append_items(meleeTarget, count, value.meleeTarget);
+}
+
+
+int BattleObjects_v1::FighterStore::Allocate(Unit* owner, int count)
+{
+	for (std::pair<int, int>& range : freeRanges)
+	{
+		if (range.second >= count)
+		{
+			int first = range.first;
+			range.first += count;
+			range.second -= count;
+			if (range.second == 0)
+			{
+				range = freeRanges.back();
+				freeRanges.pop_back();
+			}
+
+			for (int index = first, end = first + count; index != end; ++index)
+			{
+				unit[index] = owner;
+				state.Set(index, FighterState());
+				terrainAttributes[index] = 0;
+				terrainPosition[index] = glm::vec2{};
+				previousPosition[index] = glm::vec2{};
+				previousBearing[index] = 0;
+				nextState.Set(index, FighterState());
+				casualty[index] = 0;
+				formationDestination[index] = glm::vec2{};
+			}
+			return first;
+		}
+	}
+
+	int first = GetSize();
+
+	append_items(unit, count, owner);
+	append_items(generation, count, 0);
+	state.Append(count);
+	append_items(terrainAttributes, count, static_cast<unsigned char>(0));
+	append_items(terrainPosition, count, glm::vec2{});
+	append_items(previousPosition, count, glm::vec2{});
+	append_items(previousBearing, count, 0.0f);
+	nextState.Append(count);
+	append_items(casualty, count, char{});
+	append_items(formationDestination, count, glm::vec2{});
+
+	return first;
+}
+
+
+void BattleObjects_v1::FighterStore::Release(int first, int count)
+{
+	for (int index = first, end = first + count; index != end; ++index)
+	{
+		unit[index] = nullptr;
+		++generation[index];
+	}
+
+	// merge with the free ranges on either side
+	for (std::size_t i = 0; i != freeRanges.size(); )
+	{
+		std::pair<int, int>& range = freeRanges[i];
+		if (range.first + range.second == first || first + count == range.first)
+		{
+			count += range.second;
+			first = range.first < first ? range.first : first;
+			range = freeRanges.back();
+			freeRanges.pop_back();
+		}
+		else
+		{
+			++i;
+		}
+	}
+
+	freeRanges.push_back(std::make_pair(first, count));
+}
+
+
+BattleObjects_v1::FighterHandle BattleObjects_v1::FighterStore::GetHandle(int index) const
+{
+	FighterHandle result;
+	if (index != -1)
+	{
+		result.index = index;
+		result.generation = generation[index];
+	}
+	return result;
 }
 
 
-int BattleObjects_v1::Fighter::GetFile() const
+void BattleObjects_v1::FighterStore::ResetFighter(int index)
 {
-	return static_cast<int>(this - unit->fighters) / unit->formation.numberOfRanks;
+	state.readyState[index] = ReadyState_Unready;
+	state.readyingTimer[index] = 0;
+	state.strikingTimer[index] = 0;
+	state.stunnedTimer[index] = 0;
+	state.opponent[index] = FighterHandle();
+	casualty[index] = false;
+}
+
+
+void BattleObjects_v1::FighterStore::SavePreviousState()
+{
+	// reuses the capacity, the store only grows
+	previousPosition.assign(state.position.begin(), state.position.end());
+	previousBearing.assign(state.bearing.begin(), state.bearing.end());
+}
+
+
+void BattleObjects_v1::FighterStore::ResetPreviousState(int first, int count)
+{
+	for (int index = first, end = first + count; index != end; ++index)
+	{
+		previousPosition[index] = state.position[index];
+		previousBearing[index] = state.bearing[index];
+	}
 }
 
 
@@ -67,6 +246,24 @@ bool BattleObjects::UnitRange::IsWithinRange(glm::vec2 p) const
 
 
 
+bool BattleObjects_v1::FighterInputs::operator==(const FighterInputs& other) const
+{
+	return unitMode == other.unitMode
+		&& center == other.center
+		&& bearing == other.bearing
+		&& waypoint == other.waypoint
+		&& routing == other.routing
+		&& speed == other.speed
+		&& meleeTarget == other.meleeTarget
+		&& fightersCount == other.fightersCount
+		&& numberOfRanks == other.numberOfRanks
+		&& numberOfFiles == other.numberOfFiles
+		&& direction == other.direction
+		&& heightMapVersion == other.heightMapVersion
+		&& attributeMapVersion == other.attributeMapVersion;
+}
+
+
 glm::vec2 BattleObjects_v1::Unit::CalculateUnitCenter()
 {
 	if (state.unitMode == UnitMode_Initializing)
@@ -75,9 +272,10 @@ glm::vec2 BattleObjects_v1::Unit::CalculateUnitCenter()
 	glm::vec2 p = glm::vec2();
 	int count = 0;
 
-	for (Fighter* fighter = fighters, * end = fighter + fightersCount; fighter != end; ++fighter)
+	const glm::vec2* position = fighterStore->state.position.data();
+	for (int fighter = fighters, end = fighter + fightersCount; fighter != end; ++fighter)
 	{
-		p += fighter->state.position;
+		p += position[fighter];
 		++count;
 	}
 
@@ -97,15 +295,16 @@ float BattleObjects_v1::Unit::GetSpeed()
 bool BattleObjects_v1::Unit::IsInMelee() const
 {
 	int count = 0;
-	for (Fighter* fighter = fighters, * end = fighter + fightersCount; fighter != end; ++fighter)
-		if (fighter->state.opponent && ++count >= 3)
+	const FighterHandle* opponent = fighterStore->state.opponent.data();
+	for (int fighter = fighters, end = fighter + fightersCount; fighter != end; ++fighter)
+		if (fighterStore->Resolve(opponent[fighter]) != -1 && ++count >= 3)
 			return true;
 
 	return false;
 }
 
 
-BattleObjects_v1::Fighter* BattleObjects_v1::Unit::GetFighter(int rank, int file) const
+int BattleObjects_v1::Unit::GetFighter(int rank, int file) const
 {
 	if (0 <= rank && rank < formation.numberOfRanks && file >= 0)
 	{
@@ -113,7 +312,7 @@ BattleObjects_v1::Fighter* BattleObjects_v1::Unit::GetFighter(int rank, int file
 		if (index < fightersCount)
 			return fighters + index;
 	}
-	return 0;
+	return -1;
 }
 
 
@@ -133,22 +332,22 @@ void BattleObjects::Formation::SetDirection(float direction)
 
 void BattleObjects_v1::Unit::SetFighterCasualty(glm::vec2 position)
 {
-	Fighter* fighter = nullptr;
+	int fighter = -1;
 	float distance = 0.0f;
-	for (int i = 0; i < fightersCount; ++i)
-		if (!fighters[i].casualty)
+	for (int i = fighters, end = i + fightersCount; i != end; ++i)
+		if (!fighterStore->casualty[i])
 		{
-			float d = glm::length(fighters[i].state.position - position);
-			if (fighter == nullptr || d < distance)
+			float d = glm::length(fighterStore->state.position[i] - position);
+			if (fighter == -1 || d < distance)
 			{
-				fighter = &fighters[i];
+				fighter = i;
 				distance = d;
 			}
 		}
 
-	if (fighter)
+	if (fighter != -1)
 	{
-		fighter->casualty = true;
+		fighterStore->casualty[fighter] = true;
 		timeUntilSwapFighters = 0.2f;
 	}
 }
@@ -5,6 +5,7 @@
 #ifndef BattleObjects_v1_H
 #define BattleObjects_v1_H
 
+#include <utility>
 #include "BattleObjects.h"
 
 class BattleMap;
@@ -16,7 +17,6 @@ class HeightMap;
 class BattleObjects_v1 : public virtual BattleObjects
 {
 public:
-	struct Fighter;
 	struct Unit;
 
 
@@ -57,6 +57,15 @@ public:
 	};
 
 
+	// Refers to a fighter slot of a FighterStore. The slot's generation advances
+	// when it is released, which makes older handles to it stale, see Resolve().
+	struct FighterHandle
+	{
+		int index{-1};
+		int generation{};
+	};
+
+
 	struct FighterState
 	{
 		// dynamic attributes
@@ -66,36 +75,85 @@ public:
 		float readyingTimer{};
 		float strikingTimer{};
 		float stunnedTimer{};
-		Fighter* opponent{};
+		FighterHandle opponent{};
 
 		// intermediate attributes
 		glm::vec2 destination{};
 		glm::vec2 velocity{};
 		float bearing{};
-		Fighter* meleeTarget{};
+		FighterHandle meleeTarget{};
+	};
+
+
+	// FighterState for all fighters, one contiguous array per attribute
+	struct FighterStates
+	{
+		std::vector<glm::vec2> position{};
+		std::vector<float> position_z{};
+		std::vector<ReadyState> readyState{};
+		std::vector<float> readyingTimer{};
+		std::vector<float> strikingTimer{};
+		std::vector<float> stunnedTimer{};
+		std::vector<FighterHandle> opponent{};
+		std::vector<glm::vec2> destination{};
+		std::vector<glm::vec2> velocity{};
+		std::vector<float> bearing{};
+		std::vector<FighterHandle> meleeTarget{};
+
+		FighterState Get(int index) const;
+		void Set(int index, const FighterState& value);
+		void Copy(int to, int from);
+
+		void Append(int count);
 	};
 
 
-	struct Fighter
+	// Fighters are stored by the simulator in one structure-of-arrays,
+	// each unit owns the index range [fighters, fighters + fightersCapacity).
+	// Released ranges go to a free list and are reused, the slots of a free
+	// range have no unit.
+	struct FighterStore
 	{
 		// static attributes
-		Unit* unit{};
+		std::vector<Unit*> unit{};
+		std::vector<int> generation{};
 
 		// dynamic attributes
-		FighterState state{};
+		FighterStates state{};
 
 		// optimization attributes
-		bool terrainForest{};
-		bool terrainImpassable{};
-		glm::vec2 terrainPosition{};
+		std::vector<unsigned char> terrainAttributes{}; // TerrainAttribute flags
+		std::vector<glm::vec2> terrainPosition{};
+
+		// interpolation attributes, the state at the start of the last time step
+		std::vector<glm::vec2> previousPosition{};
+		std::vector<float> previousBearing{};
 
 		// intermediate attributes
-		FighterState nextState{};
-		bool casualty{};
+		FighterStates nextState{};
+		std::vector<char> casualty{};
+		std::vector<glm::vec2> formationDestination{}; // of the fighters of simulated units that are not routing
+
+		std::vector<std::pair<int, int>> freeRanges{}; // first and count
+
+		int GetSize() const { return static_cast<int>(unit.size()); }
+
+		int Allocate(Unit* owner, int count);
+		void Release(int first, int count);
+
+		FighterHandle GetHandle(int index) const; // index may be -1
+		int Resolve(FighterHandle handle) const { return handle.index != -1 && generation[handle.index] == handle.generation ? handle.index : -1; } // -1 if stale
+
+		void ResetFighter(int index);
+		void AssignNextState() { std::swap(state, nextState); }
 
-		Unit* GetUnit() const { return unit; }
-		int GetRank() const;
-		int GetFile() const;
+		void SavePreviousState();
+		void ResetPreviousState(int first, int count); // so the fighters are not interpolated
+		void CopyPreviousState(int to, int from)
+		{
+			previousPosition[to] = previousPosition[from];
+			previousBearing[to] = previousBearing[from];
+		}
 	};
 
 
@@ -144,11 +202,39 @@ public:
 	};
 
 
+	// What NextFighterState() reads of a unit. While it stays the same, and no
+	// fighter of another unit comes near, the fighters of a settled unit keep
+	// their state, so they are not updated, see BattleSimulator_v1_0_0::WakeUnit().
+	struct FighterInputs
+	{
+		UnitMode unitMode{};
+		glm::vec2 center{};
+		float bearing{};
+		glm::vec2 waypoint{};
+		bool routing{};
+		float speed{};
+		const BattleObjects::Unit* meleeTarget{};
+		int fightersCount{};
+		int numberOfRanks{};
+		int numberOfFiles{};
+		float direction{};
+		int heightMapVersion{};
+		int attributeMapVersion{};
+
+		bool operator==(const FighterInputs& other) const;
+		bool operator!=(const FighterInputs& other) const { return !(*this == other); }
+	};
+
+
 	struct Unit : public BattleObjects::Unit
 	{
 		// static attributes
+		int unitId{}; // unique within the simulator, keys the random numbers of the unit
+		int unitIndex{}; // in the simulator's unit lists, changes when another unit is removed
 		UnitStats stats{};
-		Fighter* fighters{};
+		FighterStore* fighterStore{};
+		int fighters{}; // index of first fighter in fighterStore
+		int fightersCapacity{};
 
 		// dynamic attributes
 		UnitState state{}; // updated by AssignNextState()
@@ -160,18 +246,35 @@ public:
 		// intermediate attributes
 		UnitState nextState{}; // updated by ComputeNextState()
 		UnitRange unitRange{};
+		glm::vec2 unitRangeCenter{}; // where unitRange.actualRanges was computed
+		float unitRangeBearing{};
+		int unitRangeVersion{-1}; // of the height map
+		bool asleep{}; // its fighters are settled and are not updated
+		FighterInputs asleepInputs{}; // when it fell asleep
+		float asleepRadius{}; // of its fighters around the center
+		bool wasAsleep{}; // asleep at the start of the time step, read by BattleSimulator_v1_0_0::WakeUnit()
+		bool aggregate{}; // runs as one formation body, see BattleSimulator_v1_0_0::NextAggregateState()
+		float aggregateLosses{}; // fighters lost to attrition but not yet removed
 
 		// control attributes
 		UnitCommand command{};
 		UnitCommand nextCommand{};
 		float nextCommandTimer{};
+		int pathGoal{-1}; // the pathfinder cell of the command's destination
+		int pathTick{}; // when the path to it is found, or found again
+		int pathCell{-1}; // where the path was found from, -1 while the command's own path is followed
 
 		glm::vec2 CalculateUnitCenter();
 		float GetSpeed();
 
-		Fighter* GetFighter(int rank, int file) const;
+		int GetFighter(int rank, int file) const;
+		int GetRank(int fighter) const { return (fighter - fighters) % formation.numberOfRanks; }
+		int GetFile(int fighter) const { return (fighter - fighters) / formation.numberOfRanks; }
+		bool IsAlive(int fighter) const { return fighter - fighters < fightersCount; }
 
 	public: // BattleObjects::Unit overrides
+		int GetUnitId() const override { return unitId; }
+
 		glm::vec2 GetCenter() const override { return state.center; }
 		void SetCenter(glm::vec2 value) override { state.center = value; }
 
@@ -204,25 +307,26 @@ public:
 		const Formation& GetFormation() const override { return formation; }
 
 		int GetFighterCount() const override { return fightersCount; }
-		void SetFighterCount(int value) override { fightersCount = value; }
+		void SetFighterCount(int value) override { fightersCount = value < fightersCapacity ? value : fightersCapacity; }
 
 		FighterPosition GetFighterPosition(int index) const override
 		{
-			const FighterState& state = fighters[index].state;
-			return {state.position, state.bearing};
+			const FighterStates& state = fighterStore->state;
+			return {state.position[fighters + index], state.bearing[fighters + index]};
+		}
+
+		FighterPosition GetPreviousFighterPosition(int index) const override
+		{
+			return {fighterStore->previousPosition[fighters + index], fighterStore->previousBearing[fighters + index]};
 		}
 
 		void SetFighterPosition(int index, glm::vec3 value) override
 		{
-			FighterState& state = fighters[index].state;
-			state.position = value.xy();
-			state.position_z = value.z;
-			state.readyState = BattleObjects_v1::ReadyState_Unready;
-			state.readyingTimer = 0;
-			state.strikingTimer = 0;
-			state.stunnedTimer = 0;
-			state.opponent = nullptr;
-			fighters[index].casualty = false;
+			fighterStore->ResetFighter(fighters + index);
+			asleep = false;
+			fighterStore->state.position[fighters + index] = value.xy();
+			fighterStore->state.position_z[fighters + index] = value.z;
+			fighterStore->ResetPreviousState(fighters + index, 1);
 			timeUntilSwapFighters = 0.2f;
 		}
 
@@ -237,6 +341,7 @@ public:
 protected:
 	std::vector<BattleObjects::Unit*> _units_base{};
 	std::vector<BattleObjects_v1::Unit*> _units{};
+	FighterStore _fighters{};
 
 public:
 	const std::vector<BattleObjects::Unit*>& GetUnits() const override { return _units_base; }
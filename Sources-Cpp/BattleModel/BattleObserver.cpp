@@ -4,3 +4,30 @@
 BattleObserver::~BattleObserver()
 {
 }
+
+
+void BattleObserver::OnCasualties(BattleObjects::Unit* unit, const glm::vec2* fighters, int count)
+{
+	for (int i = 0; i < count; ++i)
+		OnCasualty(unit, fighters[i]);
+}
+
+
+void BattleObserver::OnAddUnitCall(BattleCommander* commander, const char* unitClass, int numberOfFighters, glm::vec2 position, float bearing)
+{
+}
+
+
+void BattleObserver::OnDeployUnitCall(BattleObjects::Unit* unit, glm::vec2 position, float bearing)
+{
+}
+
+
+void BattleObserver::OnRemoveUnitCall(BattleObjects::Unit* unit)
+{
+}
+
+
+void BattleObserver::OnUnitCommandCall(BattleObjects::Unit* unit, const BattleObjects::UnitCommand& command, float timer, bool issue)
+{
+}
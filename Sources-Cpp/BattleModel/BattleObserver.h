@@ -18,7 +18,15 @@ private:
 	virtual void OnShooting(const BattleObjects::Shooting& shooting, float timer) = 0;
 	virtual void OnRelease(const BattleObjects::Shooting& shooting) = 0;
 	virtual void OnCasualty(BattleObjects::Unit* unit, glm::vec2 fighter) = 0;
+	virtual void OnCasualties(BattleObjects::Unit* unit, const glm::vec2* fighters, int count); // calls OnCasualty() for each
 	virtual void OnRouting(BattleObjects::Unit* unit) = 0;
+
+	// calls from outside that change the simulator, before they are made, so
+	// they can be recorded and replayed; they do nothing by default
+	virtual void OnAddUnitCall(BattleCommander* commander, const char* unitClass, int numberOfFighters, glm::vec2 position, float bearing);
+	virtual void OnDeployUnitCall(BattleObjects::Unit* unit, glm::vec2 position, float bearing);
+	virtual void OnRemoveUnitCall(BattleObjects::Unit* unit);
+	virtual void OnUnitCommandCall(BattleObjects::Unit* unit, const BattleObjects::UnitCommand& command, float timer, bool issue);
 };
 
 
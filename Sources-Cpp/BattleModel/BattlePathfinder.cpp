@@ -0,0 +1,369 @@
+// Copyright (C) 2016 Felix Ungman
+//
+// This file is part of the openwar platform (GPL v3 or later), see LICENSE.txt
+
+#include "BattlePathfinder.h"
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <queue>
+
+
+const int BattlePathfinder::CellSize;
+const unsigned char BattlePathfinder::Blocked;
+const int BattlePathfinder::MaxFlowFields;
+
+
+static const float Unreachable = std::numeric_limits<float>::infinity();
+
+static const int NeighbourX[8] = { 1, -1, 0, 0, 1, 1, -1, -1 };
+static const int NeighbourY[8] = { 0, 0, 1, -1, 1, -1, 1, -1 };
+
+
+BattlePathfinder::BattlePathfinder(const TerrainAttributeMap* attributeMap) :
+	_attributeMap{attributeMap},
+	_bounds{attributeMap->GetBounds()}
+{
+	if (attributeMap->GetSize().x > 0 && attributeMap->GetSize().y > 0)
+		_size = glm::ivec2(glm::ceil(_bounds.size() / (float)CellSize));
+
+	std::shared_ptr<CostGrid> costs = std::make_shared<CostGrid>(static_cast<std::size_t>(_size.x * _size.y));
+	for (int y = 0; y < _size.y; ++y)
+		for (int x = 0; x < _size.x; ++x)
+			(*costs)[x + y * _size.x] = ComputeCost(x, y);
+	_costs = costs;
+	_attributeMapVersion = attributeMap->GetVersion();
+
+	_thread = std::thread(&BattlePathfinder::Run, this);
+}
+
+
+BattlePathfinder::~BattlePathfinder()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stopping = true;
+	}
+	_queued.notify_one();
+	_thread.join();
+}
+
+
+bool BattlePathfinder::Update(bounds2f& changed)
+{
+	glm::ivec2 min, max;
+	if (!_attributeMap->GetChangedCells(_attributeMapVersion, min, max))
+		return false;
+	_attributeMapVersion = _attributeMap->GetVersion();
+	if (_size.x == 0 || _size.y == 0 || min.x > max.x || min.y > max.y)
+		return false;
+
+	// from attribute map cells to the cells they are in
+	glm::vec2 attributeCellSize = _bounds.size() / glm::vec2(_attributeMap->GetSize());
+	glm::ivec2 first = glm::ivec2(glm::vec2(min) * attributeCellSize / (float)CellSize);
+	glm::ivec2 last = glm::ivec2(glm::vec2(max + 1) * attributeCellSize / (float)CellSize);
+	first = glm::clamp(first, glm::ivec2(0, 0), _size - 1);
+	last = glm::clamp(last, glm::ivec2(0, 0), _size - 1);
+
+	std::shared_ptr<CostGrid> costs = std::make_shared<CostGrid>(*_costs);
+	glm::ivec2 changedMin = _size;
+	glm::ivec2 changedMax = glm::ivec2(-1, -1);
+	for (int y = first.y; y <= last.y; ++y)
+		for (int x = first.x; x <= last.x; ++x)
+		{
+			unsigned char cost = ComputeCost(x, y);
+			if (cost != (*costs)[x + y * _size.x])
+			{
+				(*costs)[x + y * _size.x] = cost;
+				changedMin = glm::min(changedMin, glm::ivec2(x, y));
+				changedMax = glm::max(changedMax, glm::ivec2(x, y));
+			}
+		}
+
+	if (changedMax.x == -1)
+		return false;
+
+	_costs = costs;
+	for (std::pair<const int, std::shared_ptr<FlowField>>& flowField : _flowFields)
+		flowField.second = StartFlowField(flowField.first, flowField.second->lastUsed);
+
+	changed = bounds2f(_bounds.min + (float)CellSize * glm::vec2(changedMin), _bounds.min + (float)CellSize * glm::vec2(changedMax + 1));
+	return true;
+}
+
+
+int BattlePathfinder::GetCell(glm::vec2 position) const
+{
+	glm::ivec2 cell = glm::ivec2(glm::floor((position - _bounds.min) / (float)CellSize));
+	if (cell.x < 0 || cell.x >= _size.x || cell.y < 0 || cell.y >= _size.y)
+		return -1;
+	return cell.x + cell.y * _size.x;
+}
+
+
+void BattlePathfinder::Request(glm::vec2 start, glm::vec2 destination)
+{
+	int goal = GetCell(destination);
+	if (goal != -1 && !IsClear(*_costs, start, destination))
+		GetFlowField(goal);
+}
+
+
+bool BattlePathfinder::FindPath(glm::vec2 start, glm::vec2 destination, BattleObjects::MovementPath& path, bool wait)
+{
+	int goal = GetCell(destination);
+	int cell = GetCell(start);
+	if (goal == -1 || cell == -1)
+		return false;
+
+	// most ways are straight, and need no flow field
+	if (IsClear(*_costs, start, destination))
+	{
+		path.clear();
+		path.push_back(start);
+		path.push_back(destination);
+		return true;
+	}
+
+	std::shared_ptr<FlowField> flowField = GetFlowField(goal);
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		if (wait)
+			_computed.wait(lock, [&flowField]() { return flowField->ready; });
+		else if (!flowField->ready)
+			return false;
+	}
+
+	const std::vector<float>& distances = flowField->distances;
+	const CostGrid& costs = *flowField->costs;
+
+	// from a blocked cell, like the edge of a river, out to the nearest open one
+	if (distances[cell] == Unreachable)
+	{
+		int x = cell % _size.x;
+		int y = cell / _size.x;
+		for (int i = 0; i < 8; ++i)
+		{
+			int nx = x + NeighbourX[i];
+			int ny = y + NeighbourY[i];
+			if (0 <= nx && nx < _size.x && 0 <= ny && ny < _size.y && distances[nx + ny * _size.x] < distances[cell])
+				cell = nx + ny * _size.x;
+		}
+		if (distances[cell] == Unreachable)
+			return false;
+	}
+
+	// down the flow field, with a turn where the way is no longer straight
+	path.clear();
+	path.push_back(start);
+	glm::vec2 corner = start;
+	while (cell != goal && static_cast<int>(path.size()) < BattleObjects::MovementPath::Capacity - 1)
+	{
+		int x = cell % _size.x;
+		int y = cell / _size.x;
+		int next = cell;
+		for (int i = 0; i < 8; ++i)
+		{
+			int nx = x + NeighbourX[i];
+			int ny = y + NeighbourY[i];
+			if (nx < 0 || nx >= _size.x || ny < 0 || ny >= _size.y)
+				continue;
+			if (i >= 4 && (costs[nx + y * _size.x] == Blocked || costs[x + ny * _size.x] == Blocked))
+				continue;
+			if (distances[nx + ny * _size.x] < distances[next])
+				next = nx + ny * _size.x;
+		}
+		if (next == cell)
+			break;
+
+		if (!IsClear(costs, corner, GetCellCenter(next)))
+		{
+			corner = GetCellCenter(cell);
+			path.push_back(corner);
+		}
+		cell = next;
+	}
+
+	path.push_back(destination);
+	return true;
+}
+
+
+// Impassable terrain and water without a ford block a cell when they cover at
+// least half of it, otherwise it costs the mean movement cost of the rest.
+unsigned char BattlePathfinder::ComputeCost(int x, int y) const
+{
+	glm::ivec2 size = _attributeMap->GetSize();
+	glm::vec2 attributeCellSize = _bounds.size() / glm::vec2(size);
+	glm::ivec2 first = glm::ivec2(glm::vec2(x, y) * (float)CellSize / attributeCellSize);
+	glm::ivec2 last = glm::ivec2(glm::vec2(x + 1, y + 1) * (float)CellSize / attributeCellSize) - 1;
+	first = glm::clamp(first, glm::ivec2(0, 0), size - 1);
+	last = glm::clamp(last, first, size - 1);
+
+	int blocked = 0;
+	int open = 0;
+	int cost = 0;
+	for (int ay = first.y; ay <= last.y; ++ay)
+		for (int ax = first.x; ax <= last.x; ++ax)
+		{
+			TerrainAttributeMap::Cell cell = _attributeMap->GetCell(ax, ay);
+			bool water = (cell.attributes & TerrainAttribute_Water) != 0 && (cell.attributes & TerrainAttribute_Ford) == 0;
+			if ((cell.attributes & TerrainAttribute_Impassable) != 0 || water || cell.movementCost == TerrainAttributeMap::MovementCostImpassable)
+			{
+				++blocked;
+			}
+			else
+			{
+				++open;
+				cost += cell.movementCost;
+			}
+		}
+
+	if (blocked >= open)
+		return Blocked;
+
+	return static_cast<unsigned char>(glm::clamp(cost / open, (int)TerrainAttributeMap::MovementCostOpen, Blocked - 1));
+}
+
+
+glm::vec2 BattlePathfinder::GetCellCenter(int cell) const
+{
+	return _bounds.min + (float)CellSize * (glm::vec2(cell % _size.x, cell / _size.x) + 0.5f);
+}
+
+
+// Whether the straight way between the points is open, and no slower than
+// the slower of the cells at its ends.
+bool BattlePathfinder::IsClear(const CostGrid& costs, glm::vec2 from, glm::vec2 to) const
+{
+	int fromCell = GetCell(from);
+	int toCell = GetCell(to);
+	if (fromCell == -1 || toCell == -1)
+		return false;
+
+	unsigned char limit = glm::max(costs[fromCell], costs[toCell]);
+	int steps = (int)glm::ceil(2.0f * glm::distance(from, to) / CellSize);
+	for (int i = 0; i <= steps; ++i)
+	{
+		int cell = GetCell(glm::mix(from, to, steps != 0 ? (float)i / steps : 0.0f));
+		if (cell == -1 || costs[cell] == Blocked || costs[cell] > limit)
+			return false;
+	}
+	return true;
+}
+
+
+std::shared_ptr<BattlePathfinder::FlowField> BattlePathfinder::StartFlowField(int goal, int lastUsed)
+{
+	std::shared_ptr<FlowField> flowField = std::make_shared<FlowField>();
+	flowField->goal = goal;
+	flowField->costs = _costs;
+	flowField->lastUsed = lastUsed;
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_queue.push_back(flowField);
+	}
+	_queued.notify_one();
+	return flowField;
+}
+
+
+std::shared_ptr<BattlePathfinder::FlowField> BattlePathfinder::GetFlowField(int goal)
+{
+	auto i = _flowFields.find(goal);
+	if (i != _flowFields.end())
+	{
+		i->second->lastUsed = ++_useCount;
+		return i->second;
+	}
+
+	if (static_cast<int>(_flowFields.size()) >= MaxFlowFields)
+	{
+		auto leastRecentlyUsed = _flowFields.begin();
+		for (auto j = _flowFields.begin(); j != _flowFields.end(); ++j)
+			if (j->second->lastUsed < leastRecentlyUsed->second->lastUsed)
+				leastRecentlyUsed = j;
+		_flowFields.erase(leastRecentlyUsed);
+	}
+
+	std::shared_ptr<FlowField> flowField = StartFlowField(goal, ++_useCount);
+	_flowFields[goal] = flowField;
+	return flowField;
+}
+
+
+// Dijkstra's algorithm from the goal, the cost of a step is its length times
+// the mean cost of the cells it is between, and a diagonal step may not cut the
+// corner of a blocked cell. The goal itself may be blocked.
+void BattlePathfinder::ComputeFlowField(FlowField& flowField) const
+{
+	typedef std::pair<float, int> Entry;
+
+	const CostGrid& costs = *flowField.costs;
+	std::vector<float> distances(costs.size(), Unreachable);
+	std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> open;
+
+	distances[flowField.goal] = 0;
+	open.push(Entry(0.0f, flowField.goal));
+	while (!open.empty())
+	{
+		Entry entry = open.top();
+		open.pop();
+		int cell = entry.second;
+		if (entry.first > distances[cell])
+			continue;
+
+		int x = cell % _size.x;
+		int y = cell / _size.x;
+		for (int i = 0; i < 8; ++i)
+		{
+			int nx = x + NeighbourX[i];
+			int ny = y + NeighbourY[i];
+			if (nx < 0 || nx >= _size.x || ny < 0 || ny >= _size.y)
+				continue;
+
+			int neighbour = nx + ny * _size.x;
+			if (costs[neighbour] == Blocked)
+				continue;
+
+			bool diagonal = i >= 4;
+			if (diagonal && (costs[nx + y * _size.x] == Blocked || costs[x + ny * _size.x] == Blocked))
+				continue;
+
+			float cost = costs[cell] != Blocked ? 0.5f * (costs[cell] + costs[neighbour]) : costs[neighbour];
+			float distance = entry.first + (diagonal ? 1.41421356f : 1.0f) * cost / TerrainAttributeMap::MovementCostOpen;
+			if (distance < distances[neighbour])
+			{
+				distances[neighbour] = distance;
+				open.push(Entry(distance, neighbour));
+			}
+		}
+	}
+
+	flowField.distances.swap(distances);
+}
+
+
+void BattlePathfinder::Run()
+{
+	while (true)
+	{
+		std::shared_ptr<FlowField> flowField;
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_queued.wait(lock, [this]() { return _stopping || !_queue.empty(); });
+			if (_stopping)
+				return;
+			flowField = _queue.front();
+			_queue.pop_front();
+		}
+
+		ComputeFlowField(*flowField);
+
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			flowField->ready = true;
+		}
+		_computed.notify_all();
+	}
+}
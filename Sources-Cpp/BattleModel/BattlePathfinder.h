@@ -0,0 +1,96 @@
+// Copyright (C) 2016 Felix Ungman
+//
+// This file is part of the openwar platform (GPL v3 or later), see LICENSE.txt
+
+#ifndef BattlePathfinder_H
+#define BattlePathfinder_H
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "BattleMap/TerrainAttributeMap.h"
+#include "BattleObjects.h"
+
+
+// Finds paths around impassable terrain and water, and through forest only
+// where going around is slower, on a grid of CellSize cells over the terrain
+// attribute map. The paths to a goal cell all follow one flow field, the cost of
+// going from each cell to the goal, which is shared by every unit going there.
+// The flow fields are computed on a thread of their own and cached, and when
+// the map is painted only the cells that changed are updated.
+
+class BattlePathfinder
+{
+public:
+	static const int CellSize = 8; // meters
+	static const unsigned char Blocked = 255; // cell cost
+	static const int MaxFlowFields = 64; // cached, the least recently used are dropped
+
+private:
+	typedef std::vector<unsigned char> CostGrid; // in 1/16ths of open ground
+
+	struct FlowField
+	{
+		int goal{};
+		std::shared_ptr<const CostGrid> costs{};
+		std::vector<float> distances{}; // to the goal, in cells of open ground
+		bool ready{}; // guarded by _mutex
+		int lastUsed{};
+	};
+
+	const TerrainAttributeMap* _attributeMap{};
+	bounds2f _bounds{};
+	glm::ivec2 _size{}; // in cells
+	int _attributeMapVersion{};
+	std::shared_ptr<const CostGrid> _costs{};
+	std::map<int, std::shared_ptr<FlowField>> _flowFields{}; // by goal
+	int _useCount{};
+
+	std::mutex _mutex{};
+	std::condition_variable _queued{};
+	std::condition_variable _computed{};
+	std::deque<std::shared_ptr<FlowField>> _queue{};
+	bool _stopping{};
+	std::thread _thread{};
+
+public:
+	explicit BattlePathfinder(const TerrainAttributeMap* attributeMap);
+	~BattlePathfinder();
+
+	BattlePathfinder(const BattlePathfinder&) = delete;
+	BattlePathfinder& operator=(const BattlePathfinder&) = delete;
+
+	// updates the cells painted since the last call, and recomputes the cached
+	// flow fields if any cell cost changed; changed is then where it did
+	bool Update(bounds2f& changed);
+
+	int GetCell(glm::vec2 position) const; // -1 outside the grid
+	int GetFlowFieldCount() const { return static_cast<int>(_flowFields.size()); }
+
+	// starts computing the flow field to the destination, unless it is cached
+	// or the way there is straight
+	void Request(glm::vec2 start, glm::vec2 destination);
+
+	// the path from start to destination, with a point at each turn; false if
+	// there is no path, or the flow field is not done yet and wait is false,
+	// path is then unchanged
+	bool FindPath(glm::vec2 start, glm::vec2 destination, BattleObjects::MovementPath& path, bool wait);
+
+private:
+	unsigned char ComputeCost(int x, int y) const;
+	glm::vec2 GetCellCenter(int cell) const;
+	bool IsClear(const CostGrid& costs, glm::vec2 from, glm::vec2 to) const;
+
+	std::shared_ptr<FlowField> StartFlowField(int goal, int lastUsed);
+	std::shared_ptr<FlowField> GetFlowField(int goal);
+	void ComputeFlowField(FlowField& flowField) const;
+	void Run();
+};
+
+
+#endif
@@ -0,0 +1,196 @@
+// Copyright (C) 2016 Felix Ungman
+//
+// This file is part of the openwar platform (GPL v3 or later), see LICENSE.txt
+
+#include "BattleProfiler.h"
+#include <ostream>
+
+
+const int BattleProfiler::HistoryLength;
+const int BattleProfiler::HistogramBuckets;
+
+
+double BattleProfiler::Sample::GetTotal() const
+{
+	double result = 0;
+	for (double phase : phases)
+		result += phase;
+	return result;
+}
+
+
+void BattleProfiler::BeginStep()
+{
+	_current = Sample();
+	_current.step = _steps;
+	_phase = -1;
+}
+
+
+void BattleProfiler::BeginPhase(BattlePhase phase)
+{
+	clock::time_point now = clock::now();
+	EndPhase(now);
+	_phase = static_cast<int>(phase);
+	_phaseStart = now;
+}
+
+
+void BattleProfiler::EndStep()
+{
+	EndPhase(clock::now());
+	_phase = -1;
+
+	Sample& slot = _history[_steps % HistoryLength];
+	if (_steps >= HistoryLength)
+		for (int phase = 0; phase < BattlePhaseCount; ++phase)
+			--_histograms[phase][GetBucket(slot.phases[phase])];
+
+	slot = _current;
+	for (int phase = 0; phase < BattlePhaseCount; ++phase)
+	{
+		++_histograms[phase][GetBucket(slot.phases[phase])];
+		_totalPhases[phase] += slot.phases[phase];
+	}
+	for (int counter = 0; counter < BattleCounterCount; ++counter)
+		_totalCounters[counter] += slot.counters[counter];
+
+	++_steps;
+}
+
+
+void BattleProfiler::EndPhase(clock::time_point now)
+{
+	if (_phase != -1)
+		_current.phases[_phase] += std::chrono::duration<double, std::micro>(now - _phaseStart).count();
+}
+
+
+const BattleProfiler::Sample& BattleProfiler::GetSample(int age) const
+{
+	return _history[(_steps - 1 - age + HistoryLength) % HistoryLength];
+}
+
+
+double BattleProfiler::GetMean(BattlePhase phase) const
+{
+	int count = GetSampleCount();
+	double sum = 0;
+	for (int age = 0; age < count; ++age)
+		sum += GetSample(age).phases[static_cast<int>(phase)];
+	return count != 0 ? sum / count : 0;
+}
+
+
+double BattleProfiler::GetMax(BattlePhase phase) const
+{
+	double result = 0;
+	for (int age = 0, count = GetSampleCount(); age < count; ++age)
+		if (GetSample(age).phases[static_cast<int>(phase)] > result)
+			result = GetSample(age).phases[static_cast<int>(phase)];
+	return result;
+}
+
+
+const char* BattleProfiler::GetName(BattlePhase phase)
+{
+	switch (phase)
+	{
+		case BattlePhase::RebuildQuadTree: return "RebuildQuadTree";
+		case BattlePhase::MovementRules: return "MovementRules";
+		case BattlePhase::ComputeNextState: return "ComputeNextState";
+		case BattlePhase::AssignNextState: return "AssignNextState";
+		case BattlePhase::ResolveMeleeCombat: return "ResolveMeleeCombat";
+		case BattlePhase::ResolveMissileCombat: return "ResolveMissileCombat";
+		case BattlePhase::RemoveCasualties: return "RemoveCasualties";
+		case BattlePhase::RemoveDeadUnits: return "RemoveDeadUnits";
+	}
+	return "";
+}
+
+
+const char* BattleProfiler::GetName(BattleCounter counter)
+{
+	switch (counter)
+	{
+		case BattleCounter::QuadTreeNodesVisited: return "QuadTreeNodesVisited";
+		case BattleCounter::FightersProcessed: return "FightersProcessed";
+		case BattleCounter::ProjectilesResolved: return "ProjectilesResolved";
+		case BattleCounter::ObserverNotifications: return "ObserverNotifications";
+		case BattleCounter::UnitsAwake: return "UnitsAwake";
+		case BattleCounter::UnitsAsleep: return "UnitsAsleep";
+		case BattleCounter::UnitsAggregate: return "UnitsAggregate";
+	}
+	return "";
+}
+
+
+void BattleProfiler::WriteCsvHeader(std::ostream& out)
+{
+	out << "step";
+	for (int phase = 0; phase < BattlePhaseCount; ++phase)
+		out << ',' << GetName(static_cast<BattlePhase>(phase));
+	out << ",Total";
+	for (int counter = 0; counter < BattleCounterCount; ++counter)
+		out << ',' << GetName(static_cast<BattleCounter>(counter));
+	out << '\n';
+}
+
+
+void BattleProfiler::WriteCsvRow(std::ostream& out, const Sample& sample)
+{
+	out << sample.step;
+	for (double phase : sample.phases)
+		out << ',' << phase;
+	out << ',' << sample.GetTotal();
+	for (long counter : sample.counters)
+		out << ',' << counter;
+	out << '\n';
+}
+
+
+void BattleProfiler::WriteCsv(std::ostream& out) const
+{
+	WriteCsvHeader(out);
+	for (int age = GetSampleCount() - 1; age >= 0; --age)
+		WriteCsvRow(out, GetSample(age));
+}
+
+
+void BattleProfiler::WriteJson(std::ostream& out) const
+{
+	out << "{\n";
+	out << "  \"steps\": " << _steps << ",\n";
+	out << "  \"samples\": " << GetSampleCount() << ",\n";
+	out << "  \"timeUnit\": \"microseconds\",\n";
+
+	out << "  \"phases\": {\n";
+	for (int phase = 0; phase < BattlePhaseCount; ++phase)
+	{
+		BattlePhase p = static_cast<BattlePhase>(phase);
+		out << "    \"" << GetName(p) << "\": { \"mean\": " << GetMean(p) << ", \"max\": " << GetMax(p) << ", \"total\": " << GetTotal(p) << ", \"histogram\": [";
+		for (int bucket = 0; bucket < HistogramBuckets; ++bucket)
+			out << (bucket != 0 ? ", " : "") << _histograms[phase][bucket];
+		out << "] }" << (phase + 1 != BattlePhaseCount ? "," : "") << '\n';
+	}
+	out << "  },\n";
+
+	out << "  \"counters\": {\n";
+	for (int counter = 0; counter < BattleCounterCount; ++counter)
+	{
+		BattleCounter c = static_cast<BattleCounter>(counter);
+		out << "    \"" << GetName(c) << "\": { \"total\": " << GetTotal(c) << " }" << (counter + 1 != BattleCounterCount ? "," : "") << '\n';
+	}
+	out << "  }\n";
+
+	out << "}\n";
+}
+
+
+int BattleProfiler::GetBucket(double microseconds)
+{
+	int bucket = 0;
+	for (double limit = 1; bucket < HistogramBuckets - 1 && microseconds >= limit; limit *= 2)
+		++bucket;
+	return bucket;
+}
@@ -0,0 +1,118 @@
+// Copyright (C) 2016 Felix Ungman
+//
+// This file is part of the openwar platform (GPL v3 or later), see LICENSE.txt
+
+#ifndef BattleProfiler_H
+#define BattleProfiler_H
+
+#include <chrono>
+#include <iosfwd>
+
+
+enum class BattlePhase
+{
+	RebuildQuadTree,
+	MovementRules,
+	ComputeNextState,
+	AssignNextState,
+	ResolveMeleeCombat,
+	ResolveMissileCombat,
+	RemoveCasualties,
+	RemoveDeadUnits
+};
+
+enum class BattleCounter
+{
+	QuadTreeNodesVisited,
+	FightersProcessed,
+	ProjectilesResolved,
+	ObserverNotifications,
+	UnitsAwake,
+	UnitsAsleep,
+	UnitsAggregate
+};
+
+const int BattlePhaseCount = 8;
+const int BattleCounterCount = 7;
+
+
+// Times the phases of each simulated time step and keeps the last HistoryLength
+// steps, with a histogram of each phase over those steps. The simulator only
+// calls it through the BATTLE_PROFILER_xxx macros, which are empty unless
+// OPENWAR_ENABLE_PROFILER is defined.
+
+class BattleProfiler
+{
+public:
+	static const int HistoryLength = 512;
+	// bucket 0 counts phases shorter than 1 microsecond, bucket i those of
+	// [2^(i-1), 2^i) microseconds, and the last bucket also all longer ones
+	static const int HistogramBuckets = 20;
+
+	struct Sample
+	{
+		int step{};
+		double phases[BattlePhaseCount]{}; // microseconds
+		long counters[BattleCounterCount]{};
+
+		double GetTotal() const;
+	};
+
+private:
+	typedef std::chrono::steady_clock clock;
+
+	Sample _history[HistoryLength]{};
+	int _histograms[BattlePhaseCount][HistogramBuckets]{};
+	double _totalPhases[BattlePhaseCount]{};
+	long _totalCounters[BattleCounterCount]{};
+	int _steps{};
+
+	Sample _current{};
+	int _phase{-1};
+	clock::time_point _phaseStart{};
+
+public:
+	void BeginStep();
+	void BeginPhase(BattlePhase phase);
+	void EndStep();
+
+	void Count(BattleCounter counter, long value) { _current.counters[static_cast<int>(counter)] += value; }
+
+	int GetStepCount() const { return _steps; }
+	int GetSampleCount() const { return _steps < HistoryLength ? _steps : HistoryLength; }
+	const Sample& GetSample(int age) const; // zero is the last step
+
+	const int* GetHistogram(BattlePhase phase) const { return _histograms[static_cast<int>(phase)]; }
+	double GetMean(BattlePhase phase) const; // over the samples
+	double GetMax(BattlePhase phase) const;
+	double GetTotal(BattlePhase phase) const { return _totalPhases[static_cast<int>(phase)]; } // since the first step
+	long GetTotal(BattleCounter counter) const { return _totalCounters[static_cast<int>(counter)]; }
+
+	static const char* GetName(BattlePhase phase);
+	static const char* GetName(BattleCounter counter);
+
+	static void WriteCsvHeader(std::ostream& out);
+	static void WriteCsvRow(std::ostream& out, const Sample& sample);
+	void WriteCsv(std::ostream& out) const; // the samples, oldest first
+	void WriteJson(std::ostream& out) const; // summary of the samples and totals
+
+private:
+	void EndPhase(clock::time_point now);
+	static int GetBucket(double microseconds);
+};
+
+
+#if defined(OPENWAR_ENABLE_PROFILER)
+#define BATTLE_PROFILER_BEGIN_STEP(profiler) (profiler).BeginStep()
+#define BATTLE_PROFILER_PHASE(profiler, phase) (profiler).BeginPhase(BattlePhase::phase)
+#define BATTLE_PROFILER_END_STEP(profiler) (profiler).EndStep()
+#define BATTLE_PROFILER_COUNT(profiler, counter, value) (profiler).Count(BattleCounter::counter, (value))
+#else
+#define BATTLE_PROFILER_BEGIN_STEP(profiler) ((void)0)
+#define BATTLE_PROFILER_PHASE(profiler, phase) ((void)0)
+#define BATTLE_PROFILER_END_STEP(profiler) ((void)0)
+#define BATTLE_PROFILER_COUNT(profiler, counter, value) ((void)0)
+#endif
+
+
+#endif
@@ -0,0 +1,602 @@
+// Copyright (C) 2016 Felix Ungman
+//
+// This file is part of the openwar platform (GPL v3 or later), see LICENSE.txt
+
+#include "BattleReplay.h"
+#include "BattleSimulator_v1_0_0.h"
+#include <algorithm>
+#include <cstring>
+
+
+static const char ReplayMagic[4] = { 'O', 'W', 'R', 'L' };
+static const int ReplayVersion = 1;
+static const std::size_t ReplayHeaderSize = sizeof(ReplayMagic) + sizeof(int);
+static const std::size_t RecordHeaderSize = 1 + sizeof(int) + sizeof(unsigned int);
+
+const int BattleRecorder::FlushInterval;
+const int BattlePlayer::DefaultKeyframeInterval;
+
+
+// reads the payload of a record, anything read past its end is zero
+class RecordReader
+{
+	const char* _data;
+	std::size_t _size;
+	std::size_t _offset{};
+
+public:
+	RecordReader(const char* data, std::size_t size) : _data{data}, _size{size} { }
+
+	bool IsValid() const { return _offset <= _size; }
+
+	template <class T> T Read()
+	{
+		T result{};
+		if (_offset + sizeof(T) <= _size)
+			std::memcpy(&result, _data + _offset, sizeof(T));
+		_offset += sizeof(T);
+		return result;
+	}
+
+	glm::vec2 ReadVec2()
+	{
+		float x = Read<float>();
+		float y = Read<float>();
+		return glm::vec2(x, y);
+	}
+
+	std::string ReadString()
+	{
+		int length = Read<int>();
+		if (length < 0 || _offset + length > _size)
+		{
+			_offset = _size + 1;
+			return std::string();
+		}
+		std::string result(_data + _offset, static_cast<std::size_t>(length));
+		_offset += static_cast<std::size_t>(length);
+		return result;
+	}
+};
+
+
+static bool IsCall(BattleRecordType type)
+{
+	return BattleRecordType_AddUnit <= type && type <= BattleRecordType_UnitCommand;
+}
+
+
+/***/
+
+
+BattleRecorder::BattleRecorder(BattleSimulator_v1_0_0* battleSimulator, const std::vector<BattleCommander*>& commanders) :
+	_battleSimulator{battleSimulator},
+	_commanders{commanders}
+{
+}
+
+
+BattleRecorder::~BattleRecorder()
+{
+	Close();
+}
+
+
+bool BattleRecorder::Open(const char* path)
+{
+	Close();
+
+	_file = std::fopen(path, "wb");
+	if (!_file)
+		return false;
+
+	_size = 0;
+	_recordCount = 0;
+	_flushedTick = _battleSimulator->GetTick();
+
+	_record.clear();
+	AppendBytes(ReplayMagic, sizeof(ReplayMagic));
+	Append(ReplayVersion);
+	std::fwrite(_record.data(), 1, _record.size(), _file);
+	_size += static_cast<long>(_record.size());
+
+	std::vector<char> state;
+	_battleSimulator->SaveState(state, _commanders);
+	BeginRecord(BattleRecordType_State);
+	AppendBytes(state.data(), state.size());
+	EndRecord();
+
+	// numbers the units of the state, in order
+	_unitNumbers.clear();
+	_unitCount = 0;
+	_battleSimulator->AddObserver(this);
+
+	return true;
+}
+
+
+void BattleRecorder::Close()
+{
+	if (!_file)
+		return;
+
+	BeginRecord(BattleRecordType_End);
+	EndRecord();
+
+	_battleSimulator->RemoveObserver(this);
+	std::fclose(_file);
+	_file = nullptr;
+}
+
+
+void BattleRecorder::BeginRecord(BattleRecordType type)
+{
+	_record.clear();
+	Append(static_cast<unsigned char>(type));
+	Append(_battleSimulator->GetTick());
+	Append(0u);
+}
+
+
+void BattleRecorder::EndRecord()
+{
+	unsigned int payloadSize = static_cast<unsigned int>(_record.size() - RecordHeaderSize);
+	std::memcpy(_record.data() + 1 + sizeof(int), &payloadSize, sizeof(payloadSize));
+
+	std::fwrite(_record.data(), 1, _record.size(), _file);
+	_size += static_cast<long>(_record.size());
+	++_recordCount;
+
+	int tick = _battleSimulator->GetTick();
+	if (tick >= _flushedTick + FlushInterval)
+	{
+		std::fflush(_file);
+		_flushedTick = tick;
+	}
+}
+
+
+void BattleRecorder::AppendBytes(const void* bytes, std::size_t size)
+{
+	std::size_t offset = _record.size();
+	_record.resize(offset + size);
+	std::memcpy(_record.data() + offset, bytes, size);
+}
+
+
+int BattleRecorder::GetUnitNumber(const BattleObjects::Unit* unit) const
+{
+	auto i = _unitNumbers.find(unit);
+	return i != _unitNumbers.end() ? i->second : -1;
+}
+
+
+void BattleRecorder::OnAddUnit(BattleObjects::Unit* unit)
+{
+	_unitNumbers[unit] = _unitCount++;
+}
+
+
+void BattleRecorder::OnRemoveUnit(BattleObjects::Unit* unit)
+{
+	_unitNumbers.erase(unit);
+}
+
+
+void BattleRecorder::OnCommand(BattleObjects::Unit* unit, float timer)
+{
+}
+
+
+void BattleRecorder::OnShooting(const BattleObjects::Shooting& shooting, float timer)
+{
+	BeginRecord(BattleRecordType_Shooting);
+	Append(GetUnitNumber(shooting.unit));
+	Append(static_cast<int>(shooting.missileType));
+	Append(shooting.target.x);
+	Append(shooting.target.y);
+	Append(static_cast<int>(shooting.projectiles.size()));
+	Append(timer);
+	EndRecord();
+}
+
+
+void BattleRecorder::OnRelease(const BattleObjects::Shooting& shooting)
+{
+}
+
+
+void BattleRecorder::OnCasualty(BattleObjects::Unit* unit, glm::vec2 fighter)
+{
+	BeginRecord(BattleRecordType_Casualty);
+	Append(GetUnitNumber(unit));
+	Append(fighter.x);
+	Append(fighter.y);
+	EndRecord();
+}
+
+
+void BattleRecorder::OnRouting(BattleObjects::Unit* unit)
+{
+	BeginRecord(BattleRecordType_Routing);
+	Append(GetUnitNumber(unit));
+	EndRecord();
+}
+
+
+void BattleRecorder::OnAddUnitCall(BattleCommander* commander, const char* unitClass, int numberOfFighters, glm::vec2 position, float bearing)
+{
+	auto i = std::find(_commanders.begin(), _commanders.end(), commander);
+	int length = static_cast<int>(std::strlen(unitClass));
+
+	BeginRecord(BattleRecordType_AddUnit);
+	Append(i != _commanders.end() ? static_cast<int>(i - _commanders.begin()) : -1);
+	Append(length);
+	AppendBytes(unitClass, static_cast<std::size_t>(length));
+	Append(numberOfFighters);
+	Append(position.x);
+	Append(position.y);
+	Append(bearing);
+	EndRecord();
+}
+
+
+void BattleRecorder::OnDeployUnitCall(BattleObjects::Unit* unit, glm::vec2 position, float bearing)
+{
+	BeginRecord(BattleRecordType_DeployUnit);
+	Append(GetUnitNumber(unit));
+	Append(position.x);
+	Append(position.y);
+	Append(bearing);
+	EndRecord();
+}
+
+
+void BattleRecorder::OnRemoveUnitCall(BattleObjects::Unit* unit)
+{
+	BeginRecord(BattleRecordType_RemoveUnit);
+	Append(GetUnitNumber(unit));
+	EndRecord();
+}
+
+
+void BattleRecorder::OnUnitCommandCall(BattleObjects::Unit* unit, const BattleObjects::UnitCommand& command, float timer, bool issue)
+{
+	BeginRecord(BattleRecordType_UnitCommand);
+	Append(GetUnitNumber(unit));
+	Append(static_cast<unsigned char>(issue));
+	Append(timer);
+	Append(static_cast<int>(command.path.size()));
+	for (glm::vec2 p : command.path)
+	{
+		Append(p.x);
+		Append(p.y);
+	}
+	Append(static_cast<unsigned char>(command.running));
+	Append(command.bearing);
+	Append(GetUnitNumber(command.meleeTarget));
+	Append(GetUnitNumber(command.missileTarget));
+	Append(static_cast<unsigned char>(command.missileTargetLocked));
+	EndRecord();
+}
+
+
+/***/
+
+
+BattlePlayer::BattlePlayer(BattleSimulator_v1_0_0* battleSimulator, const std::vector<BattleCommander*>& commanders) :
+	_battleSimulator{battleSimulator},
+	_commanders{commanders}
+{
+}
+
+
+BattlePlayer::~BattlePlayer()
+{
+	if (_file.is_open())
+		_battleSimulator->RemoveObserver(this);
+}
+
+
+bool BattlePlayer::Open(const char* path)
+{
+	if (_file.is_open())
+	{
+		_battleSimulator->RemoveObserver(this);
+		_file.close();
+	}
+
+	_keyframes.clear();
+	_units.clear();
+	_mismatchCount = 0;
+	_firstMismatchTick = -1;
+
+	if (!_file.open(path))
+		return false;
+
+	const char* data = static_cast<const char*>(_file.data());
+	int version = 0;
+	if (_file.size() < ReplayHeaderSize || std::memcmp(data, ReplayMagic, sizeof(ReplayMagic)) != 0)
+	{
+		_file.close();
+		return false;
+	}
+	std::memcpy(&version, data + sizeof(ReplayMagic), sizeof(version));
+
+	Record record;
+	if (version != ReplayVersion || !ReadRecord(ReplayHeaderSize, record) || record.type != BattleRecordType_State)
+	{
+		_file.close();
+		return false;
+	}
+
+	std::vector<char> state(record.payload, record.payload + record.size);
+	if (!_battleSimulator->RestoreState(state, _commanders))
+	{
+		_file.close();
+		return false;
+	}
+	_offset = record.next;
+
+	// a log that was not closed ends with its last whole record
+	_endTick = _battleSimulator->GetTick();
+	for (std::size_t offset = _offset; ReadRecord(offset, record); offset = record.next)
+		_endTick = std::max(_endTick, record.tick);
+
+	_units = _battleSimulator->GetUnits();
+	_battleSimulator->AddObserver(this);
+	SaveKeyframe();
+	return true;
+}
+
+
+int BattlePlayer::GetTick() const
+{
+	return _battleSimulator->GetTick();
+}
+
+
+void BattlePlayer::Step()
+{
+	int tick = GetTick();
+	if (_keyframeInterval > 0 && tick % _keyframeInterval == 0 && (_keyframes.empty() || _keyframes.back().tick < tick))
+		SaveKeyframe();
+
+	// outcomes still before the time step did not happen on replay
+	Record record;
+	while (ReadRecord(_offset, record) && record.tick <= tick)
+	{
+		if (IsCall(record.type))
+			ApplyCall(record);
+		else if (record.type != BattleRecordType_End)
+			Mismatch();
+		_offset = record.next;
+	}
+
+	float timeStep = _battleSimulator->GetTimeStep();
+	if (_stepCallback)
+		_stepCallback(timeStep);
+
+	_battleSimulator->AdvanceTime(timeStep);
+}
+
+
+bool BattlePlayer::Seek(int tick)
+{
+	if (_keyframes.empty() || tick < _keyframes.front().tick || tick > _endTick)
+		return false;
+
+	// the last keyframe at or before tick, if it is ahead of the current tick or tick is behind it
+	auto i = std::upper_bound(_keyframes.begin(), _keyframes.end(), tick,
+		[](int t, const Keyframe& keyframe) { return t < keyframe.tick; });
+	const Keyframe& keyframe = *(i - 1);
+	if ((tick < GetTick() || keyframe.tick > GetTick()) && !RestoreKeyframe(keyframe))
+		return false;
+
+	while (GetTick() < tick)
+		Step();
+
+	return true;
+}
+
+
+bool BattlePlayer::ReadRecord(std::size_t offset, Record& record) const
+{
+	const char* data = static_cast<const char*>(_file.data());
+	std::size_t size = _file.size();
+	if (offset + RecordHeaderSize > size)
+		return false;
+
+	unsigned int payloadSize;
+	record.type = static_cast<BattleRecordType>(static_cast<unsigned char>(data[offset]));
+	std::memcpy(&record.tick, data + offset + 1, sizeof(int));
+	std::memcpy(&payloadSize, data + offset + 1 + sizeof(int), sizeof(payloadSize));
+	if (payloadSize > size - offset - RecordHeaderSize)
+		return false;
+
+	record.payload = data + offset + RecordHeaderSize;
+	record.size = payloadSize;
+	record.next = offset + RecordHeaderSize + payloadSize;
+	return true;
+}
+
+
+void BattlePlayer::ApplyCall(const Record& record)
+{
+	RecordReader reader(record.payload, record.size);
+	switch (record.type)
+	{
+		case BattleRecordType_AddUnit:
+		{
+			int commander = reader.Read<int>();
+			std::string unitClass = reader.ReadString();
+			int numberOfFighters = reader.Read<int>();
+			glm::vec2 position = reader.ReadVec2();
+			float bearing = reader.Read<float>();
+			if (reader.IsValid() && 0 <= commander && commander < static_cast<int>(_commanders.size()))
+				_units.push_back(_battleSimulator->AddUnit(_commanders[commander], unitClass.c_str(), numberOfFighters, position, bearing));
+			else
+				Mismatch();
+			break;
+		}
+
+		case BattleRecordType_DeployUnit:
+		{
+			BattleObjects::Unit* unit = GetUnit(reader.Read<int>());
+			glm::vec2 position = reader.ReadVec2();
+			float bearing = reader.Read<float>();
+			if (reader.IsValid() && unit)
+				_battleSimulator->DeployUnit(unit, position, bearing);
+			else
+				Mismatch();
+			break;
+		}
+
+		case BattleRecordType_RemoveUnit:
+		{
+			BattleObjects::Unit* unit = GetUnit(reader.Read<int>());
+			if (reader.IsValid() && unit)
+				_battleSimulator->RemoveUnit(unit);
+			else
+				Mismatch();
+			break;
+		}
+
+		case BattleRecordType_UnitCommand:
+		{
+			BattleObjects::Unit* unit = GetUnit(reader.Read<int>());
+			bool issue = reader.Read<unsigned char>() != 0;
+			float timer = reader.Read<float>();
+			BattleObjects::UnitCommand command;
+			int count = reader.Read<int>();
+			for (int i = 0; i < count && reader.IsValid(); ++i)
+				command.path.push_back(reader.ReadVec2());
+			command.running = reader.Read<unsigned char>() != 0;
+			command.bearing = reader.Read<float>();
+			command.meleeTarget = GetUnit(reader.Read<int>());
+			command.missileTarget = GetUnit(reader.Read<int>());
+			command.missileTargetLocked = reader.Read<unsigned char>() != 0;
+			if (!reader.IsValid() || !unit)
+				Mismatch();
+			else if (issue)
+				_battleSimulator->IssueUnitCommand(unit, command, timer);
+			else
+				_battleSimulator->SetUnitCommand(unit, command, timer);
+			break;
+		}
+
+		default:
+			break;
+	}
+}
+
+
+void BattlePlayer::CheckOutcome(BattleRecordType type, const BattleObjects::Unit* unit, glm::vec2 position)
+{
+	Record record;
+	if (ReadRecord(_offset, record) && record.type == type && record.tick == GetTick())
+	{
+		RecordReader reader(record.payload, record.size);
+		int number = reader.Read<int>();
+		if (type == BattleRecordType_Shooting)
+			reader.Read<int>(); // missile type
+		glm::vec2 recorded = type != BattleRecordType_Routing ? reader.ReadVec2() : glm::vec2();
+		if (number == GetUnitNumber(unit) && recorded == position)
+		{
+			_offset = record.next;
+			return;
+		}
+	}
+	Mismatch();
+}
+
+
+void BattlePlayer::Mismatch()
+{
+	if (_mismatchCount++ == 0)
+		_firstMismatchTick = GetTick();
+}
+
+
+int BattlePlayer::GetUnitNumber(const BattleObjects::Unit* unit) const
+{
+	if (!unit)
+		return -1;
+	auto i = std::find(_units.begin(), _units.end(), unit);
+	return i != _units.end() ? static_cast<int>(i - _units.begin()) : -1;
+}
+
+
+BattleObjects::Unit* BattlePlayer::GetUnit(int number) const
+{
+	return 0 <= number && number < static_cast<int>(_units.size()) ? _units[number] : nullptr;
+}
+
+
+void BattlePlayer::SaveKeyframe()
+{
+	Keyframe keyframe;
+	keyframe.tick = GetTick();
+	keyframe.offset = _offset;
+	_battleSimulator->SaveState(keyframe.state, _commanders);
+	for (BattleObjects::Unit* unit : _battleSimulator->GetUnits())
+		keyframe.unitNumbers.push_back(GetUnitNumber(unit));
+	keyframe.unitCount = static_cast<int>(_units.size());
+	_keyframes.push_back(std::move(keyframe));
+}
+
+
+bool BattlePlayer::RestoreKeyframe(const Keyframe& keyframe)
+{
+	if (!_battleSimulator->RestoreState(keyframe.state, _commanders))
+		return false;
+	_offset = keyframe.offset;
+
+	const std::vector<BattleObjects::Unit*>& units = _battleSimulator->GetUnits();
+	_units.assign(static_cast<std::size_t>(keyframe.unitCount), nullptr);
+	for (std::size_t i = 0; i < units.size(); ++i)
+		if (keyframe.unitNumbers[i] != -1)
+			_units[keyframe.unitNumbers[i]] = units[i];
+	return true;
+}
+
+
+void BattlePlayer::OnAddUnit(BattleObjects::Unit* unit)
+{
+}
+
+
+void BattlePlayer::OnRemoveUnit(BattleObjects::Unit* unit)
+{
+	for (BattleObjects::Unit*& u : _units)
+		if (u == unit)
+			u = nullptr;
+}
+
+
+void BattlePlayer::OnCommand(BattleObjects::Unit* unit, float timer)
+{
+}
+
+
+void BattlePlayer::OnShooting(const BattleObjects::Shooting& shooting, float timer)
+{
+	CheckOutcome(BattleRecordType_Shooting, shooting.unit, shooting.target);
+}
+
+
+void BattlePlayer::OnRelease(const BattleObjects::Shooting& shooting)
+{
+}
+
+
+void BattlePlayer::OnCasualty(BattleObjects::Unit* unit, glm::vec2 fighter)
+{
+	CheckOutcome(BattleRecordType_Casualty, unit, fighter);
+}
+
+
+void BattlePlayer::OnRouting(BattleObjects::Unit* unit)
+{
+	CheckOutcome(BattleRecordType_Routing, unit, glm::vec2());
+}
@@ -0,0 +1,194 @@
+// Copyright (C) 2016 Felix Ungman
+//
+// This file is part of the openwar platform (GPL v3 or later), see LICENSE.txt
+
+#ifndef BattleReplay_H
+#define BattleReplay_H
+
+#include <cstddef>
+#include <cstdio>
+#include <functional>
+#include <map>
+#include <vector>
+
+#include "Storage/MappedFile.h"
+#include "BattleObserver.h"
+
+class BattleSimulator_v1_0_0;
+
+
+// A replay log starts with "OWRL" and a version, and is followed by records, each
+// a type byte, the tick and the size of the rest of the record. The first record
+// is the state the battle was recorded from. Calls are recorded with the tick
+// they were made before, outcomes with the tick they happened in. Units are
+// numbered in the order they were added, the units of the first state first.
+
+enum BattleRecordType
+{
+	BattleRecordType_State = 1,
+
+	// calls, replayed
+	BattleRecordType_AddUnit,
+	BattleRecordType_DeployUnit,
+	BattleRecordType_RemoveUnit,
+	BattleRecordType_UnitCommand,
+
+	// outcomes, checked
+	BattleRecordType_Shooting,
+	BattleRecordType_Casualty,
+	BattleRecordType_Routing,
+
+	BattleRecordType_End
+};
+
+
+// Writes a replay log of a simulator as it runs. Only the calls to the simulator
+// are needed to replay it, the outcomes are there to check the replay and for
+// reading a battle without replaying it. Changes made to the units directly,
+// like the deployed flag and the morale set by a BattleScenario, are not recorded,
+// whatever made them has to make them again on replay.
+
+class BattleRecorder : private BattleObserver
+{
+public:
+	static const int FlushInterval = 15; // ticks between writes to the file
+
+private:
+	BattleSimulator_v1_0_0* _battleSimulator{};
+	std::vector<BattleCommander*> _commanders{};
+	std::FILE* _file{};
+	std::map<const BattleObjects::Unit*, int> _unitNumbers{};
+	int _unitCount{};
+	std::vector<char> _record{};
+	long _size{};
+	int _recordCount{};
+	int _flushedTick{};
+
+public:
+	// the commanders of the units are recorded as indexes in commanders
+	BattleRecorder(BattleSimulator_v1_0_0* battleSimulator, const std::vector<BattleCommander*>& commanders);
+	~BattleRecorder();
+
+	BattleRecorder(const BattleRecorder&) = delete;
+	BattleRecorder& operator=(const BattleRecorder&) = delete;
+
+	bool Open(const char* path); // starts with the current state
+	void Close(); // a log that was never closed can still be replayed up to its last record
+
+	bool IsOpen() const { return _file != nullptr; }
+	long GetSize() const { return _size; } // in bytes
+	int GetRecordCount() const { return _recordCount; }
+
+private:
+	void BeginRecord(BattleRecordType type);
+	void EndRecord();
+	void AppendBytes(const void* bytes, std::size_t size);
+	template <class T> void Append(const T& value) { AppendBytes(&value, sizeof(T)); }
+	int GetUnitNumber(const BattleObjects::Unit* unit) const; // -1 for none
+
+	void OnAddUnit(BattleObjects::Unit* unit) override;
+	void OnRemoveUnit(BattleObjects::Unit* unit) override;
+	void OnCommand(BattleObjects::Unit* unit, float timer) override;
+	void OnShooting(const BattleObjects::Shooting& shooting, float timer) override;
+	void OnRelease(const BattleObjects::Shooting& shooting) override;
+	void OnCasualty(BattleObjects::Unit* unit, glm::vec2 fighter) override;
+	void OnRouting(BattleObjects::Unit* unit) override;
+
+	void OnAddUnitCall(BattleCommander* commander, const char* unitClass, int numberOfFighters, glm::vec2 position, float bearing) override;
+	void OnDeployUnitCall(BattleObjects::Unit* unit, glm::vec2 position, float bearing) override;
+	void OnRemoveUnitCall(BattleObjects::Unit* unit) override;
+	void OnUnitCommandCall(BattleObjects::Unit* unit, const BattleObjects::UnitCommand& command, float timer, bool issue) override;
+};
+
+
+// Replays a log, mapped into memory, on a simulator, one time step at a time,
+// and counts the outcomes that differ from the recorded ones. It saves the state
+// every KeyframeInterval ticks as it goes, so seeking back restores the last
+// keyframe before the tick and replays from there.
+
+class BattlePlayer : private BattleObserver
+{
+public:
+	static const int DefaultKeyframeInterval = 450; // 30 seconds
+
+private:
+	struct Record
+	{
+		BattleRecordType type{};
+		int tick{};
+		const char* payload{};
+		std::size_t size{}; // of the payload
+		std::size_t next{}; // offset of the next record
+	};
+
+	struct Keyframe
+	{
+		int tick{};
+		std::size_t offset{}; // of the next record
+		std::vector<char> state{};
+		std::vector<int> unitNumbers{}; // of the units of the simulator, in order
+		int unitCount{}; // numbered so far
+	};
+
+	BattleSimulator_v1_0_0* _battleSimulator{};
+	std::vector<BattleCommander*> _commanders{};
+	std::function<void(float)> _stepCallback{};
+	MappedFile _file{};
+	std::size_t _offset{}; // of the next record
+	int _endTick{};
+	std::vector<BattleObjects::Unit*> _units{}; // by number, nullptr when removed
+	int _keyframeInterval{DefaultKeyframeInterval};
+	std::vector<Keyframe> _keyframes{}; // by tick
+	int _mismatchCount{};
+	int _firstMismatchTick{-1};
+
+public:
+	BattlePlayer(BattleSimulator_v1_0_0* battleSimulator, const std::vector<BattleCommander*>& commanders);
+	~BattlePlayer();
+
+	BattlePlayer(const BattlePlayer&) = delete;
+	BattlePlayer& operator=(const BattlePlayer&) = delete;
+
+	bool Open(const char* path); // and restores the first state
+
+	// called before each time step, after the calls recorded for it, with the
+	// time step, for whatever changed the units directly when the log was
+	// recorded, like the scenario
+	void SetStepCallback(std::function<void(float)> value) { _stepCallback = value; }
+
+	// zero saves no keyframes, seeking back then replays from the start
+	void SetKeyframeInterval(int value) { _keyframeInterval = value; }
+
+	int GetTick() const;
+	int GetEndTick() const { return _endTick; }
+	bool IsAtEnd() const { return GetTick() >= _endTick; }
+
+	void Step();
+	bool Seek(int tick); // returns false if tick is outside the log or its keyframe does not restore
+
+	int GetMismatchCount() const { return _mismatchCount; }
+	int GetFirstMismatchTick() const { return _firstMismatchTick; } // -1 if none
+
+private:
+	bool ReadRecord(std::size_t offset, Record& record) const; // false at the end
+	void ApplyCall(const Record& record);
+	void CheckOutcome(BattleRecordType type, const BattleObjects::Unit* unit, glm::vec2 position);
+	void Mismatch();
+
+	int GetUnitNumber(const BattleObjects::Unit* unit) const; // -1 for none
+	BattleObjects::Unit* GetUnit(int number) const;
+
+	void SaveKeyframe();
+	bool RestoreKeyframe(const Keyframe& keyframe); // false leaves the simulator as it is
+
+	void OnAddUnit(BattleObjects::Unit* unit) override;
+	void OnRemoveUnit(BattleObjects::Unit* unit) override;
+	void OnCommand(BattleObjects::Unit* unit, float timer) override;
+	void OnShooting(const BattleObjects::Shooting& shooting, float timer) override;
+	void OnRelease(const BattleObjects::Shooting& shooting) override;
+	void OnCasualty(BattleObjects::Unit* unit, glm::vec2 fighter) override;
+	void OnRouting(BattleObjects::Unit* unit) override;
+};
+
+
+#endif
@@ -93,35 +93,47 @@ BattleCommander* BattleScenario::GetDummyCommander() const
 
 
 bool BattleScenario::IsFriendlyCommander(const BattleObjects::Unit* unit, BattleCommander* battleCommander) const
+{
+	return IsFriendlyCommander(unit->commander, battleCommander);
+}
+
+
+bool BattleScenario::IsCommandableBy(const BattleObjects::Unit* unit, BattleCommander* battleCommander) const
+{
+	return IsCommandableBy(unit->commander, battleCommander);
+}
+
+
+bool BattleScenario::IsFriendlyCommander(const BattleCommander* unitCommander, BattleCommander* battleCommander) const
 {
 	if (battleCommander == nullptr)
 		return false;
 
-	if (unit->commander == battleCommander)
+	if (unitCommander == battleCommander)
 		return true;
 
 	if (battleCommander->GetType() == BattleCommanderType::None)
 		return false;
 
-	if (unit->commander->GetTeam() != battleCommander->GetTeam())
+	if (unitCommander->GetTeam() != battleCommander->GetTeam())
 		return false;
 
 	return true;
 }
 
 
-bool BattleScenario::IsCommandableBy(const BattleObjects::Unit* unit, BattleCommander* battleCommander) const
+bool BattleScenario::IsCommandableBy(const BattleCommander* unitCommander, BattleCommander* battleCommander) const
 {
 	if (battleCommander == nullptr)
 		return false;
 
-	if (unit->commander == battleCommander)
+	if (unitCommander == battleCommander)
 		return true;
 
 	if (battleCommander->GetType() == BattleCommanderType::None)
 		return false;
 
-	if (unit->commander->IsIncapacitated() && unit->commander->GetTeam() == battleCommander->GetTeam())
+	if (unitCommander->IsIncapacitated() && unitCommander->GetTeam() == battleCommander->GetTeam())
 		return true;
 
 	return false;
@@ -167,14 +179,24 @@ std::pair<glm::vec2, float> BattleScenario::GetDeploymentZone(int team) const
 
 bool BattleScenario::IsDeploymentZone(int team, glm::vec2 position) const
 {
-	std::pair<glm::vec2, float> deploymentZone = GetDeploymentZone(team);
-	return glm::distance(position, deploymentZone.first) < deploymentZone.second;
+	return IsDeploymentZone(GetDeploymentZone(team), position);
 }
 
 
 glm::vec2 BattleScenario::ConstrainDeploymentZone(int team, glm::vec2 position, float inset) const
 {
-	std::pair<glm::vec2, float> deploymentZone = GetDeploymentZone(team);
+	return ConstrainDeploymentZone(GetDeploymentZone(team), position, inset);
+}
+
+
+bool BattleScenario::IsDeploymentZone(std::pair<glm::vec2, float> deploymentZone, glm::vec2 position)
+{
+	return glm::distance(position, deploymentZone.first) < deploymentZone.second;
+}
+
+
+glm::vec2 BattleScenario::ConstrainDeploymentZone(std::pair<glm::vec2, float> deploymentZone, glm::vec2 position, float inset)
+{
 	float radius = deploymentZone.second - inset;
 	if (radius > 0)
 	{
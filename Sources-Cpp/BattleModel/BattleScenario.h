@@ -43,6 +43,10 @@ public:
 	bool IsFriendlyCommander(const BattleObjects::Unit* unit, BattleCommander* battleCommander) const;
 	bool IsCommandableBy(const BattleObjects::Unit* unit, BattleCommander* battleCommander) const;
 
+	// for the commander of a unit in a snapshot
+	bool IsFriendlyCommander(const BattleCommander* unitCommander, BattleCommander* battleCommander) const;
+	bool IsCommandableBy(const BattleCommander* unitCommander, BattleCommander* battleCommander) const;
+
 	void SetTeamPosition(int team, int position);
 	int GetTeamPosition(int team) const;
 
@@ -53,6 +57,10 @@ public:
 	bool IsDeploymentZone(int team, glm::vec2 position) const;
 	glm::vec2 ConstrainDeploymentZone(int team, glm::vec2 position, float inset) const;
 
+	// for a deployment zone from GetDeploymentZone() or a snapshot
+	static bool IsDeploymentZone(std::pair<glm::vec2, float> deploymentZone, glm::vec2 position);
+	static glm::vec2 ConstrainDeploymentZone(std::pair<glm::vec2, float> deploymentZone, glm::vec2 position, float inset);
+
 	void SetPractice(bool value) { _practice = value; }
 	int GetWinnerTeam() const { return _winnerTeam; }
 
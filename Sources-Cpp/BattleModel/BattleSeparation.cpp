@@ -0,0 +1,137 @@
+// Copyright (C) 2016 Felix Ungman
+//
+// This file is part of the openwar platform (GPL v3 or later), see LICENSE.txt
+
+#include "BattleSeparation.h"
+
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+
+void BattleSeparation::Batch::Clear()
+{
+	first.clear();
+	point.clear();
+	test.clear();
+	obstacle.clear();
+}
+
+
+void BattleSeparation::Batch::AddObstacle(glm::vec2 fighterPoint, glm::vec2 testPoint, glm::vec2 obstaclePoint)
+{
+	point.push_back(fighterPoint);
+	test.push_back(testPoint);
+	obstacle.push_back(obstaclePoint);
+}
+
+
+int BattleSeparation::Batch::Accumulate(int fighter, glm::vec2& adjust) const
+{
+	int result = 0;
+	for (int i = first[fighter], end = first[fighter + 1]; i != end; ++i)
+		if (pushing[i])
+		{
+			adjust -= push[i];
+			++result;
+		}
+	return result;
+}
+
+
+bool BattleSeparation::IsVectorized()
+{
+#if defined(__SSE__)
+	return true;
+#else
+	return false;
+#endif
+}
+
+
+#if defined(__SSE__)
+
+// four vec2, x0 y0 x1 y1 and x2 y2 x3 y3, to x0 x1 x2 x3 and y0 y1 y2 y3
+static inline void LoadQuad(const glm::vec2* p, __m128& x, __m128& y)
+{
+	__m128 a = _mm_loadu_ps(&p[0].x);
+	__m128 b = _mm_loadu_ps(&p[2].x);
+	x = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+	y = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+}
+
+
+static inline void StoreQuad(glm::vec2* p, __m128 x, __m128 y)
+{
+	_mm_storeu_ps(&p[0].x, _mm_unpacklo_ps(x, y));
+	_mm_storeu_ps(&p[2].x, _mm_unpackhi_ps(x, y));
+}
+
+#endif
+
+
+void BattleSeparation::Push(Batch& batch) const
+{
+	int size = batch.GetSize();
+	batch.push.resize(static_cast<std::size_t>(size));
+	batch.pushing.resize(static_cast<std::size_t>(size));
+
+#if defined(__SSE__)
+	__m128 min2 = _mm_set1_ps(minDistance2);
+	__m128 max2 = _mm_set1_ps(maxDistance2);
+	__m128 push = _mm_set1_ps(distance);
+	__m128 one = _mm_set1_ps(1.0f);
+
+	int i = 0;
+	for (; i + 4 <= size; i += 4)
+	{
+		__m128 px, py, x, y;
+		LoadQuad(&batch.point[i], px, py);
+		LoadQuad(&batch.test[i], x, y);
+		__m128 dx = _mm_sub_ps(x, px);
+		__m128 dy = _mm_sub_ps(y, py);
+		__m128 d2 = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+		__m128 pushing = _mm_and_ps(_mm_cmplt_ps(min2, d2), _mm_cmplt_ps(d2, max2));
+
+		LoadQuad(&batch.obstacle[i], x, y);
+		dx = _mm_sub_ps(x, px);
+		dy = _mm_sub_ps(y, py);
+		d2 = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+
+		// glm::normalize(d) is d * (1 / sqrt(dot(d, d)))
+		__m128 scale = _mm_div_ps(one, _mm_sqrt_ps(d2));
+		x = _mm_and_ps(_mm_mul_ps(_mm_mul_ps(dx, scale), push), pushing);
+		y = _mm_and_ps(_mm_mul_ps(_mm_mul_ps(dy, scale), push), pushing);
+		StoreQuad(&batch.push[i], x, y);
+
+		int mask = _mm_movemask_ps(pushing);
+		for (int lane = 0; lane < 4; ++lane)
+			batch.pushing[i + lane] = (mask >> lane) & 1;
+	}
+
+	PushScalar(batch, i, size);
+#else
+	PushScalar(batch, 0, size);
+#endif
+}
+
+
+void BattleSeparation::PushScalar(Batch& batch) const
+{
+	int size = batch.GetSize();
+	batch.push.resize(static_cast<std::size_t>(size));
+	batch.pushing.resize(static_cast<std::size_t>(size));
+	PushScalar(batch, 0, size);
+}
+
+
+void BattleSeparation::PushScalar(Batch& batch, int begin, int end) const
+{
+	for (int i = begin; i != end; ++i)
+	{
+		glm::vec2 diff = batch.test[i] - batch.point[i];
+		float distance2 = glm::dot(diff, diff);
+		batch.pushing[i] = minDistance2 < distance2 && distance2 < maxDistance2;
+		batch.push[i] = batch.pushing[i] ? glm::normalize(batch.obstacle[i] - batch.point[i]) * distance : glm::vec2();
+	}
+}
@@ -0,0 +1,59 @@
+// Copyright (C) 2016 Felix Ungman
+//
+// This file is part of the openwar platform (GPL v3 or later), see LICENSE.txt
+
+#ifndef BattleSeparation_H
+#define BattleSeparation_H
+
+#include <glm/glm.hpp>
+#include <vector>
+
+
+// Keeps fighters apart from the fighters and enemy weapons around them. Each
+// obstacle whose test point is in range of a fighter pushes it distance away
+// from the obstacle, and the pushes on a fighter are added up in order.
+//
+// Few fighters have more than one obstacle in range, so the obstacles of a
+// whole range of fighters are gathered into one batch, and Push() tests and
+// normalizes four of them at a time with SSE where it is available. It does
+// so the way glm::normalize does, so it gives the same result as PushScalar().
+
+class BattleSeparation
+{
+public:
+	// Pairs of a fighter and an obstacle, the pairs of each fighter consecutive.
+	struct Batch
+	{
+		std::vector<int> first{}; // per fighter, its first pair, and one past the last
+		std::vector<glm::vec2> point{}; // per pair, of the fighter
+		std::vector<glm::vec2> test{};
+		std::vector<glm::vec2> obstacle{};
+		std::vector<glm::vec2> push{}; // zero when out of range
+		std::vector<char> pushing{};
+
+		void Clear();
+		void AddFighter() { first.push_back(static_cast<int>(point.size())); }
+		void AddObstacle(glm::vec2 fighterPoint, glm::vec2 testPoint, glm::vec2 obstaclePoint);
+		void Close() { AddFighter(); } // after the last fighter
+
+		int GetSize() const { return static_cast<int>(point.size()); }
+
+		// adds the pushes on the fighter to adjust, returns how many
+		int Accumulate(int fighter, glm::vec2& adjust) const;
+	};
+
+	float minDistance2{}; // an obstacle pushes when the squared distance to its test point is between these
+	float maxDistance2{};
+	float distance{}; // how far each obstacle pushes
+
+	void Push(Batch& batch) const;
+	void PushScalar(Batch& batch) const;
+
+	static bool IsVectorized();
+
+private:
+	void PushScalar(Batch& batch, int begin, int end) const;
+};
+
+
+#endif
@@ -0,0 +1,269 @@
+// Copyright (C) 2016 Felix Ungman
+//
+// This file is part of the openwar platform (GPL v3 or later), see LICENSE.txt
+
+#include "BattleSimulationThread.h"
+#include "BattleScenario.h"
+#include "BattleSimulator.h"
+#include <algorithm>
+#include <chrono>
+
+
+const int BattleSimulationThread::CommandCapacity;
+const int BattleSimulationThread::ViewpointCapacity;
+
+
+BattleSimulationThread::BattleSimulationThread(BattleSimulator* battleSimulator) :
+	_battleSimulator{battleSimulator}
+{
+	_battleSimulator->AddObserver(this);
+}
+
+
+BattleSimulationThread::~BattleSimulationThread()
+{
+	Stop();
+	_battleSimulator->RemoveObserver(this);
+}
+
+
+void BattleSimulationThread::Start()
+{
+	if (!_thread.joinable())
+	{
+		_stopping = false;
+		_thread = std::thread([this]() { Run(); });
+	}
+}
+
+
+void BattleSimulationThread::Stop()
+{
+	_stopping = true;
+	if (_thread.joinable())
+		_thread.join();
+}
+
+
+bool BattleSimulationThread::PushCommand(Command command)
+{
+	return _commands.try_push(std::move(command));
+}
+
+
+bool BattleSimulationThread::PushViewpoint(Viewpoint viewpoint)
+{
+	return _viewpoints.try_push(viewpoint);
+}
+
+
+bool BattleSimulationThread::UpdateSnapshot()
+{
+	if (!_snapshots.update())
+		return false;
+
+	// a snapshot repeats the events of snapshots that were read before it was published
+	const std::vector<BattleEvent>& events = _snapshots.front().events;
+	_newEventIndex = static_cast<int>(events.size());
+	for (int index = 0; index < static_cast<int>(events.size()); ++index)
+		if (events[index].sequence > _readSequence)
+		{
+			_newEventIndex = index;
+			break;
+		}
+	if (!events.empty() && events.back().sequence > _readSequence)
+		_readSequence = events.back().sequence;
+
+	return true;
+}
+
+
+void BattleSimulationThread::Run()
+{
+	typedef std::chrono::steady_clock clock;
+
+	float timeStep = _battleSimulator->GetTimeStep();
+	clock::time_point next = clock::now();
+
+	PublishSnapshot();
+
+	while (!_stopping)
+	{
+		ExecuteCommands();
+		UpdateViewpoints();
+
+		bool paused = _paused;
+		if (!paused)
+		{
+			if (_stepCallback)
+				_stepCallback(timeStep);
+			if (_stopping)
+				break;
+
+			_battleSimulator->AdvanceTime(timeStep);
+			++_tick;
+		}
+		PublishSnapshot();
+
+		float speed = paused ? 1.0f : _speed.load(); // a paused thread doesn't spin
+		if (speed > 0)
+		{
+			next += std::chrono::duration_cast<clock::duration>(std::chrono::duration<float>(timeStep / speed));
+			clock::time_point now = clock::now();
+			if (now > next + std::chrono::milliseconds(250))
+				next = now; // fell behind, don't try to catch up
+			else
+				std::this_thread::sleep_until(next);
+		}
+	}
+}
+
+
+void BattleSimulationThread::ExecuteCommands()
+{
+	Command command;
+	while (_commands.try_pop(command))
+	{
+		BattleObjects::Unit* unit = FindUnit(command.unitId);
+		if (unit == nullptr)
+			continue;
+		command.command.meleeTarget = FindUnit(command.meleeTargetId);
+		command.command.missileTarget = FindUnit(command.missileTargetId);
+
+		switch (command.type)
+		{
+			case CommandType::Set:
+				_battleSimulator->SetUnitCommand(unit, command.command, command.timer);
+				break;
+
+			case CommandType::Issue:
+				_battleSimulator->IssueUnitCommand(unit, command.command, command.timer);
+				break;
+
+			case CommandType::Deploy:
+				_battleSimulator->DeployUnit(unit, command.command.GetDestination(), command.command.bearing);
+				break;
+		}
+	}
+}
+
+
+void BattleSimulationThread::UpdateViewpoints()
+{
+	Viewpoint viewpoint;
+	while (_viewpoints.try_pop(viewpoint))
+	{
+		if (viewpoint.remove)
+			_battleSimulator->RemoveViewpoint(viewpoint.owner);
+		else
+			_battleSimulator->SetViewpoint(viewpoint.owner, viewpoint.position);
+	}
+}
+
+
+void BattleSimulationThread::PublishSnapshot()
+{
+	BattleSnapshot& snapshot = _snapshots.back();
+	snapshot.Capture(*_battleSimulator, _tick);
+	if (_battleScenario)
+		snapshot.CaptureScenario(*_battleScenario);
+	snapshot.events = _pendingEvents;
+	snapshot.casualties = _pendingCasualties;
+
+	int previousSequence = _publishedSequence;
+	_publishedSequence = _eventSequence;
+
+	// once the previous snapshot has been read, its events need not be sent again
+	if (!_snapshots.publish())
+	{
+		_pendingEvents.erase(
+			std::remove_if(_pendingEvents.begin(), _pendingEvents.end(), [previousSequence](const BattleEvent& event) {
+				return event.sequence <= previousSequence;
+			}),
+			_pendingEvents.end());
+
+		// the casualties of the removed events come before those of the others
+		int readCasualties = static_cast<int>(_pendingCasualties.size());
+		for (const BattleEvent& event : _pendingEvents)
+			if (event.type == BattleEventType_Casualties)
+				readCasualties = std::min(readCasualties, event.firstCasualty);
+
+		_pendingCasualties.erase(_pendingCasualties.begin(), _pendingCasualties.begin() + readCasualties);
+		for (BattleEvent& event : _pendingEvents)
+			if (event.type == BattleEventType_Casualties)
+				event.firstCasualty -= readCasualties;
+	}
+}
+
+
+BattleObjects::Unit* BattleSimulationThread::FindUnit(int unitId) const
+{
+	std::unordered_map<int, BattleObjects::Unit*>::const_iterator i = _units.find(unitId);
+	return i != _units.end() ? i->second : nullptr;
+}
+
+
+BattleEvent& BattleSimulationThread::AddEvent(BattleEventType type, BattleObjects::Unit* unit)
+{
+	_pendingEvents.push_back(BattleEvent());
+	BattleEvent& event = _pendingEvents.back();
+	event.sequence = ++_eventSequence;
+	event.type = type;
+	event.unit = unit;
+	return event;
+}
+
+
+void BattleSimulationThread::OnAddUnit(BattleObjects::Unit* unit)
+{
+	_units[unit->GetUnitId()] = unit;
+	AddEvent(BattleEventType_AddUnit, unit);
+}
+
+
+void BattleSimulationThread::OnRemoveUnit(BattleObjects::Unit* unit)
+{
+	_units.erase(unit->GetUnitId());
+	AddEvent(BattleEventType_RemoveUnit, unit);
+}
+
+
+void BattleSimulationThread::OnCommand(BattleObjects::Unit* unit, float timer)
+{
+	AddEvent(BattleEventType_Command, unit).timer = timer;
+}
+
+
+void BattleSimulationThread::OnShooting(const BattleObjects::Shooting& shooting, float timer)
+{
+	BattleEvent& event = AddEvent(BattleEventType_Shooting, shooting.unit);
+	event.timer = timer;
+	event.shooting = shooting;
+}
+
+
+void BattleSimulationThread::OnRelease(const BattleObjects::Shooting& shooting)
+{
+	AddEvent(BattleEventType_Release, shooting.unit).shooting = shooting;
+}
+
+
+void BattleSimulationThread::OnCasualty(BattleObjects::Unit* unit, glm::vec2 fighter)
+{
+	OnCasualties(unit, &fighter, 1);
+}
+
+
+void BattleSimulationThread::OnCasualties(BattleObjects::Unit* unit, const glm::vec2* fighters, int count)
+{
+	BattleEvent& event = AddEvent(BattleEventType_Casualties, unit);
+	event.firstCasualty = static_cast<int>(_pendingCasualties.size());
+	event.casualtyCount = count;
+	_pendingCasualties.insert(_pendingCasualties.end(), fighters, fighters + count);
+}
+
+
+void BattleSimulationThread::OnRouting(BattleObjects::Unit* unit)
+{
+	AddEvent(BattleEventType_Routing, unit);
+}
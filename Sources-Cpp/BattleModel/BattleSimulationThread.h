@@ -0,0 +1,154 @@
+// Copyright (C) 2016 Felix Ungman
+//
+// This file is part of the openwar platform (GPL v3 or later), see LICENSE.txt
+
+#ifndef BattleSimulationThread_H
+#define BattleSimulationThread_H
+
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "Algorithms/spsc_queue.h"
+#include "Algorithms/triple_buffer.h"
+#include "BattleObserver.h"
+#include "BattleSnapshot.h"
+
+class BattleScenario;
+class BattleSimulator;
+
+
+// Runs a simulator on its own thread, one time step at a time, and publishes a
+// snapshot after each step. The owning thread must not touch the simulator or
+// its units while the thread runs. It reads the latest snapshot instead, and
+// hands unit commands and viewpoints to the simulation thread through queues.
+// Each snapshot carries every observer event since the last snapshot the owning
+// thread read.
+
+class BattleSimulationThread : private BattleObserver
+{
+public:
+	enum class CommandType
+	{
+		Set, // SetUnitCommand()
+		Issue, // IssueUnitCommand()
+		Deploy // DeployUnit() to the destination and bearing of the command
+	};
+
+	// the unit and the targets are given by their unit ids, since the unit
+	// that a pointer pointed to may be deleted and another allocated at the
+	// same address before the simulation thread gets to the command
+	struct Command
+	{
+		CommandType type{};
+		int unitId{};
+		BattleObjects::UnitCommand command{}; // its targets are set from the ids
+		int meleeTargetId{-1};
+		int missileTargetId{-1};
+		float timer{};
+	};
+
+	struct Viewpoint
+	{
+		const void* owner{};
+		glm::vec2 position{};
+		bool remove{}; // RemoveViewpoint() rather than SetViewpoint()
+	};
+
+	static const int CommandCapacity = 256;
+	static const int ViewpointCapacity = 16;
+
+private:
+	BattleSimulator* _battleSimulator{};
+	BattleScenario* _battleScenario{};
+	std::function<void(float)> _stepCallback{};
+	std::atomic<float> _speed{1}; // set by the owning thread, read by the simulation thread
+	std::atomic<bool> _paused{};
+
+	std::thread _thread{};
+	std::atomic<bool> _stopping{};
+	spsc_queue<Command> _commands{CommandCapacity};
+	spsc_queue<Viewpoint> _viewpoints{ViewpointCapacity};
+	triple_buffer<BattleSnapshot> _snapshots{};
+
+	// only used by the simulation thread
+	int _tick{};
+	int _eventSequence{};
+	int _publishedSequence{}; // of the last event in the last published snapshot
+	std::unordered_map<int, BattleObjects::Unit*> _units{}; // by unit id
+	std::vector<BattleEvent> _pendingEvents{}; // not yet known to have been read
+	std::vector<glm::vec2> _pendingCasualties{}; // of the pending events
+
+	// only used by the owning thread
+	int _readSequence{}; // of the last event returned by GetNewEventIndex()
+	int _newEventIndex{};
+
+public:
+	explicit BattleSimulationThread(BattleSimulator* battleSimulator);
+	~BattleSimulationThread();
+
+	BattleSimulationThread(const BattleSimulationThread&) = delete;
+	BattleSimulationThread& operator=(const BattleSimulationThread&) = delete;
+
+	BattleSimulator* GetBattleSimulator() const { return _battleSimulator; }
+
+	// the scenario whose winner and deployment zones go into the snapshots; only
+	// set it before Start()
+	void SetBattleScenario(BattleScenario* value) { _battleScenario = value; }
+
+	// called on the simulation thread before each time step, with the time step,
+	// for whatever else must run in step with the simulator, like scripts; only
+	// set it before Start()
+	void SetStepCallback(std::function<void(float)> value) { _stepCallback = value; }
+
+	// simulated seconds per wall clock second, zero means as fast as possible,
+	// may be changed while the thread runs
+	void SetSpeed(float value) { _speed = value; }
+	float GetSpeed() const { return _speed; }
+
+	// while paused, the thread still executes commands and publishes snapshots,
+	// but neither calls the step callback nor advances the time
+	void SetPaused(bool value) { _paused = value; }
+	bool IsPaused() const { return _paused; }
+
+	void Start();
+	void Stop(); // waits for the current time step to finish
+	void RequestStop() { _stopping = true; } // may be called from the step callback
+	bool IsStopping() const { return _stopping; }
+
+	// returns false if the queue is full; commands for units that are gone by the
+	// time the simulation thread gets to them are dropped
+	bool PushCommand(Command command);
+
+	// returns false if the queue is full, which only loses a viewpoint that is
+	// set again on the next frame
+	bool PushViewpoint(Viewpoint viewpoint);
+
+	// returns true if a newer snapshot has been published since the last call
+	bool UpdateSnapshot();
+	const BattleSnapshot& GetSnapshot() const { return _snapshots.front(); }
+	int GetNewEventIndex() const { return _newEventIndex; } // first event in GetSnapshot() not seen before
+
+private:
+	void Run();
+	void ExecuteCommands();
+	void UpdateViewpoints();
+	void PublishSnapshot();
+	BattleObjects::Unit* FindUnit(int unitId) const;
+
+	BattleEvent& AddEvent(BattleEventType type, BattleObjects::Unit* unit);
+
+	void OnAddUnit(BattleObjects::Unit* unit) override;
+	void OnRemoveUnit(BattleObjects::Unit* unit) override;
+	void OnCommand(BattleObjects::Unit* unit, float timer) override;
+	void OnShooting(const BattleObjects::Shooting& shooting, float timer) override;
+	void OnRelease(const BattleObjects::Shooting& shooting) override;
+	void OnCasualty(BattleObjects::Unit* unit, glm::vec2 fighter) override;
+	void OnCasualties(BattleObjects::Unit* unit, const glm::vec2* fighters, int count) override;
+	void OnRouting(BattleObjects::Unit* unit) override;
+};
+
+
+#endif
@@ -27,11 +27,23 @@ void BattleSimulator::AddObserver(BattleObserver* observer)
 void BattleSimulator::RemoveObserver(BattleObserver* observer)
 {
 	_observers.erase(observer);
+	_viewpoints.erase(observer);
+}
+
+
+const BattleProfiler* BattleSimulator::GetProfiler() const
+{
+#if defined(OPENWAR_ENABLE_PROFILER)
+	return &_profiler;
+#else
+	return nullptr;
+#endif
 }
 
 
 void BattleSimulator::NotifyAddUnit(BattleObjects::Unit* unit)
 {
+	BATTLE_PROFILER_COUNT(_profiler, ObserverNotifications, 1);
 	for (BattleObserver* observer : _observers)
 		observer->OnAddUnit(unit);
 }
@@ -39,6 +51,7 @@ void BattleSimulator::NotifyAddUnit(BattleObjects::Unit* unit)
 
 void BattleSimulator::NotifyRemoveUnit(BattleObjects::Unit* unit)
 {
+	BATTLE_PROFILER_COUNT(_profiler, ObserverNotifications, 1);
 	for (BattleObserver* observer : _observers)
 		observer->OnRemoveUnit(unit);
 }
@@ -46,6 +59,7 @@ void BattleSimulator::NotifyRemoveUnit(BattleObjects::Unit* unit)
 
 void BattleSimulator::NotifyCommand(BattleObjects::Unit* unit, float timer)
 {
+	BATTLE_PROFILER_COUNT(_profiler, ObserverNotifications, 1);
 	for (BattleObserver* observer : _observers)
 		observer->OnCommand(unit, timer);
 }
@@ -53,6 +67,7 @@ void BattleSimulator::NotifyCommand(BattleObjects::Unit* unit, float timer)
 
 void BattleSimulator::NotifyShooting(const BattleObjects::Shooting& shooting, float timer)
 {
+	BATTLE_PROFILER_COUNT(_profiler, ObserverNotifications, 1);
 	for (BattleObserver* observer : _observers)
 		observer->OnShooting(shooting, timer);
 }
@@ -60,6 +75,7 @@ void BattleSimulator::NotifyShooting(const BattleObjects::Shooting& shooting, fl
 
 void BattleSimulator::NotifyRelease(const BattleObjects::Shooting& shooting)
 {
+	BATTLE_PROFILER_COUNT(_profiler, ObserverNotifications, 1);
 	for (BattleObserver* observer : _observers)
 		observer->OnRelease(shooting);
 }
@@ -67,13 +83,51 @@ void BattleSimulator::NotifyRelease(const BattleObjects::Shooting& shooting)
 
 void BattleSimulator::NotifyCasualty(BattleObjects::Unit* unit, glm::vec2 fighter)
 {
+	BATTLE_PROFILER_COUNT(_profiler, ObserverNotifications, 1);
 	for (BattleObserver* observer : _observers)
 		observer->OnCasualty(unit, fighter);
 }
 
 
+void BattleSimulator::NotifyCasualties(BattleObjects::Unit* unit, const glm::vec2* fighters, int count)
+{
+	BATTLE_PROFILER_COUNT(_profiler, ObserverNotifications, 1);
+	for (BattleObserver* observer : _observers)
+		observer->OnCasualties(unit, fighters, count);
+}
+
+
 void BattleSimulator::NotifyRouting(BattleObjects::Unit* unit)
 {
+	BATTLE_PROFILER_COUNT(_profiler, ObserverNotifications, 1);
 	for (BattleObserver* observer : _observers)
 		observer->OnRouting(unit);
 }
+
+
+void BattleSimulator::NotifyAddUnitCall(BattleCommander* commander, const char* unitClass, int numberOfFighters, glm::vec2 position, float bearing)
+{
+	for (BattleObserver* observer : _observers)
+		observer->OnAddUnitCall(commander, unitClass, numberOfFighters, position, bearing);
+}
+
+
+void BattleSimulator::NotifyDeployUnitCall(BattleObjects::Unit* unit, glm::vec2 position, float bearing)
+{
+	for (BattleObserver* observer : _observers)
+		observer->OnDeployUnitCall(unit, position, bearing);
+}
+
+
+void BattleSimulator::NotifyRemoveUnitCall(BattleObjects::Unit* unit)
+{
+	for (BattleObserver* observer : _observers)
+		observer->OnRemoveUnitCall(unit);
+}
+
+
+void BattleSimulator::NotifyUnitCommandCall(BattleObjects::Unit* unit, const BattleObjects::UnitCommand& command, float timer, bool issue)
+{
+	for (BattleObserver* observer : _observers)
+		observer->OnUnitCommandCall(unit, command, timer, issue);
+}
@@ -1,9 +1,11 @@
 #ifndef BattleSimulator_H
 #define BattleSimulator_H
 
+#include <map>
 #include <set>
 
 #include "BattleObjects.h"
+#include "BattleProfiler.h"
 
 class BattleObserver;
 
@@ -12,6 +14,10 @@ class BattleSimulator : public virtual BattleObjects
 {
 protected:
 	std::set<BattleObserver*> _observers{};
+	std::map<const void*, glm::vec2> _viewpoints{}; // by owner
+#if defined(OPENWAR_ENABLE_PROFILER)
+	BattleProfiler _profiler{};
+#endif
 
 public:
 	BattleSimulator();
@@ -20,8 +26,21 @@ public:
 	void AddObserver(BattleObserver* observer);
 	void RemoveObserver(BattleObserver* observer);
 
+	// where the battle is watched from, usually by an observer, which loses its
+	// viewpoint when removed; the simulator may simplify what is far from every viewpoint
+	void SetViewpoint(const void* owner, glm::vec2 position) { _viewpoints[owner] = position; }
+	void RemoveViewpoint(const void* owner) { _viewpoints.erase(owner); }
+
 	float GetTimerDelay() const { return 0.25f; }
 
+	// phase timings of the last time steps, nullptr unless OPENWAR_ENABLE_PROFILER is defined
+	const BattleProfiler* GetProfiler() const;
+
+	virtual float GetTimeStep() const = 0; // simulated seconds per time step
+
+	// how far the time is from the last time step toward the next, in [0, 1),
+	// for interpolating from the previous fighter positions to the current ones
+	virtual float GetInterpolationAlpha() const = 0;
 	virtual void AdvanceTime(float secondsSinceLastTime) = 0;
 
 	virtual int GetKills(int team) = 0;
@@ -42,7 +61,13 @@ protected:
 	void NotifyShooting(const BattleObjects::Shooting& shooting, float timer);
 	void NotifyRelease(const BattleObjects::Shooting& shooting);
 	void NotifyCasualty(BattleObjects::Unit* unit, glm::vec2 fighter);
+	void NotifyCasualties(BattleObjects::Unit* unit, const glm::vec2* fighters, int count);
 	void NotifyRouting(BattleObjects::Unit* unit);
+
+	void NotifyAddUnitCall(BattleCommander* commander, const char* unitClass, int numberOfFighters, glm::vec2 position, float bearing);
+	void NotifyDeployUnitCall(BattleObjects::Unit* unit, glm::vec2 position, float bearing);
+	void NotifyRemoveUnitCall(BattleObjects::Unit* unit);
+	void NotifyUnitCommandCall(BattleObjects::Unit* unit, const BattleObjects::UnitCommand& command, float timer, bool issue);
 };
 
 
@@ -15,40 +15,91 @@
 #include <algorithm>
 #include <cstdlib>
 #include <cstring>
+#include <limits>
 #include <set>
 #include <sstream>
+#include <type_traits>
+
+
+static const int FighterChunkSize = 256; // fighters per parallel task
+static const float FighterDistance = 0.9f;
+static const float WeaponDistance = 0.75f;
+static const float UnitRangeMaxMovement = 1.0f;
+static const float UnitRangeMaxTurn = 0.02f;
+static const float SleepActivationDistance = 10.0f; // beyond the reach of any fighter in one time step
+static const float SleepContactDistance = FighterDistance + 1.0f; // of a friend that pushes a fighter, with a margin for its query point
+static const float ProjectileScatter = 10.0f; // from the target center, in x and y
+static const float ProjectileHitRadius = 0.45f;
+static const int PathfindingDelay = 3; // time steps from a destination to the path to it
+
+
+// fighters of sleeping and aggregate units are not updated one by one
+static bool IsFighterSimulated(const BattleObjects_v1::Unit* unit)
+{
+	return !unit->asleep && !unit->aggregate;
+}
+
+
+static BattleSeparation MakeSeparation(float minDistance2, float maxDistance2, float distance)
+{
+	BattleSeparation result;
+	result.minDistance2 = minDistance2;
+	result.maxDistance2 = maxDistance2;
+	result.distance = distance;
+	return result;
+}
+
+
+// fighters push each other apart, unless they are on top of each other, and
+// enemy weapons push them away from the enemy holding them
+static const BattleSeparation FighterSeparation = MakeSeparation(0.01f, FighterDistance * FighterDistance, FighterDistance);
+static const BattleSeparation WeaponSeparation = MakeSeparation(-1.0f, WeaponDistance * WeaponDistance, WeaponDistance);
+
+
+enum RandomStream
+{
+	RandomStream_MeleeRoll,
+	RandomStream_Shooting,
+	RandomStream_ProjectileBlocked,
+	RandomStream_Loading,
+	RandomStream_Attrition
+};
 
 
 BattleSimulator_v1_0_0::BattleSimulator_v1_0_0(std::shared_ptr<BattleMap> battleMap)
 {
 	_battleMap = battleMap;
+	if (_battleMap && _battleMap->GetGroundMap())
+		_attributeMap = _battleMap->GetGroundMap()->GetAttributeMap();
 }
 
 
 BattleSimulator_v1_0_0::~BattleSimulator_v1_0_0()
 {
 	for (BattleObjects_v1::Unit* unit : _units)
-	{
-		delete[] unit->fighters;
 		delete unit;
-	}
 }
 
 
 BattleObjects::Unit* BattleSimulator_v1_0_0::AddUnit(BattleCommander* commander, const char* unitClass, int numberOfFighters, glm::vec2 position, float bearing)
 {
+	NotifyAddUnitCall(commander, unitClass, numberOfFighters, position, bearing);
+
 	BattleObjects_v1::UnitStats stats = BattleObjects_v1::GetDefaultUnitStats(unitClass);
 
 	BattleObjects_v1::Unit* unit = new BattleObjects_v1::Unit();
 
 	//float bearing = commander->GetTeamPosition() == 1 ? (float)M_PI_2 : (float)M_PI_2 * 3;
 
+	unit->unitId = _nextUnitId++;
 	unit->commander = commander;
 	unit->unitClass = unitClass;
 	unit->stats = stats;
 
 	unit->fightersCount = numberOfFighters;
-	unit->fighters = new BattleObjects_v1::Fighter[numberOfFighters];
+	unit->fightersCapacity = numberOfFighters;
+	unit->fighterStore = &_fighters;
+	unit->fighters = _fighters.Allocate(unit, numberOfFighters);
 
 	unit->command.bearing = bearing;
 	unit->nextCommand = unit->command;
@@ -63,20 +114,27 @@ BattleObjects::Unit* BattleSimulator_v1_0_0::AddUnit(BattleCommander* commander,
 	unit->formation.numberOfRanks = (int)fminf(4, unit->fightersCount);
 	unit->formation.numberOfFiles = (int)ceilf((float)unit->fightersCount / unit->formation.numberOfRanks);
 
+	unit->unitIndex = static_cast<int>(_units.size());
 	_units_base.push_back(unit);
 	_units.push_back(unit);
 
-	for (BattleObjects_v1::Fighter* i = unit->fighters, * end = i + numberOfFighters; i != end; ++i)
-		i->unit = unit;
-
 	MovementRules_AdvanceTime(unit, 0);
+	RebuildTeamInfluence();
+	_teamUnitsValid = false;
 	unit->nextState = NextUnitState(unit);
-	for (BattleObjects_v1::Fighter* i = unit->fighters, * end = i + numberOfFighters; i != end; ++i)
-		i->nextState = NextFighterState(i);
+	CommitNextUnitState(unit);
+	if (_fighterNeighbours.empty())
+		_fighterNeighbours.resize(1);
+	FindFighterNeighbours(_fighterNeighbours[0], unit->fighters, unit->fighters + numberOfFighters);
+	if (!unit->state.IsRouting())
+		MovementRules_SolveFormation(unit);
+	for (int i = unit->fighters, end = i + numberOfFighters; i != end; ++i)
+		_fighters.nextState.Set(i, NextFighterState(i, _fighterNeighbours[0]));
 
 	unit->state = unit->nextState;
-	for (BattleObjects_v1::Fighter* i = unit->fighters, * end = i + numberOfFighters; i != end; ++i)
-		i->state = i->nextState;
+	for (int i = unit->fighters, end = i + numberOfFighters; i != end; ++i)
+		_fighters.state.Set(i, _fighters.nextState.Get(i));
+	_fighters.ResetPreviousState(unit->fighters, numberOfFighters);
 
 	NotifyAddUnit(unit);
 
@@ -86,6 +144,8 @@ BattleObjects::Unit* BattleSimulator_v1_0_0::AddUnit(BattleCommander* commander,
 
 void BattleSimulator_v1_0_0::DeployUnit(BattleObjects::Unit* _unit, glm::vec2 position, float bearing)
 {
+	NotifyDeployUnitCall(_unit, position, bearing);
+
 	Unit* unit = static_cast<Unit*>(_unit);
 
 	unit->state.center = position;
@@ -96,37 +156,53 @@ void BattleSimulator_v1_0_0::DeployUnit(BattleObjects::Unit* _unit, glm::vec2 po
 	unit->nextCommand = unit->command;
 
 	unit->state.unitMode = BattleObjects_v1::UnitMode_Initializing;
+	unit->asleep = false;
+	unit->aggregate = false;
 	MovementRules_AdvanceTime(unit, 0);
+	RebuildTeamInfluence();
+	_teamUnitsValid = false;
 	unit->nextState = NextUnitState(unit);
-	for (BattleObjects_v1::Fighter* i = unit->fighters, * end = i + unit->fightersCount; i != end; ++i)
-		i->nextState = NextFighterState(i);
+	CommitNextUnitState(unit);
+	if (_fighterNeighbours.empty())
+		_fighterNeighbours.resize(1);
+	FindFighterNeighbours(_fighterNeighbours[0], unit->fighters, unit->fighters + unit->fightersCount);
+	if (!unit->state.IsRouting())
+		MovementRules_SolveFormation(unit);
+	for (int i = unit->fighters, end = i + unit->fightersCount; i != end; ++i)
+		_fighters.nextState.Set(i, NextFighterState(i, _fighterNeighbours[0]));
 
 	unit->state = unit->nextState;
-	for (BattleObjects_v1::Fighter* i = unit->fighters, * end = i + unit->fightersCount; i != end; ++i)
-		i->state = i->nextState;
+	for (int i = unit->fighters, end = i + unit->fightersCount; i != end; ++i)
+		_fighters.state.Set(i, _fighters.nextState.Get(i));
+	_fighters.ResetPreviousState(unit->fighters, unit->fightersCount);
 }
 
 
-void BattleSimulator_v1_0_0::RemoveUnit(BattleObjects::Unit* _unit)
+void BattleSimulator_v1_0_0::RemoveUnit(BattleObjects::Unit* unit)
 {
-	Unit* unit = static_cast<Unit*>(_unit);
+	NotifyRemoveUnitCall(unit);
+	DeleteUnit(static_cast<Unit*>(unit));
+}
+
 
+void BattleSimulator_v1_0_0::DeleteUnit(BattleObjects_v1::Unit* unit)
+{
 	NotifyRemoveUnit(unit);
 
-	_units_base.erase(std::find(_units_base.begin(), _units_base.end(), unit));
-	_units.erase(std::find(_units.begin(), _units.end(), unit));
+	// swap and pop, the last unit takes the place of the removed one
+	int index = unit->unitIndex;
+	_units[index] = _units.back();
+	_units[index]->unitIndex = index;
+	_units.pop_back();
+	_units_base[index] = _units_base.back();
+	_units_base.pop_back();
+	_teamUnitsValid = false;
+
+	// opponents and melee targets referring to the released fighters go stale
+	_fighters.Release(unit->fighters, unit->fightersCapacity);
 
 	for (BattleObjects_v1::Unit* other : _units)
 	{
-		for (int i = 0; i < other->fightersCount; ++i)
-		{
-			BattleObjects_v1::Fighter* fighter = &other->fighters[i];
-			if (fighter->state.opponent && fighter->state.opponent->unit == unit)
-				fighter->state.opponent = nullptr;
-			if (fighter->state.meleeTarget && fighter->state.meleeTarget->unit == unit)
-				fighter->state.meleeTarget = nullptr;
-		}
-
 		if (other->command.meleeTarget == unit)
 			other->command.meleeTarget = nullptr;
 		if (other->command.missileTarget == unit)
@@ -136,47 +212,131 @@ void BattleSimulator_v1_0_0::RemoveUnit(BattleObjects::Unit* _unit)
 			other->nextCommand.meleeTarget = nullptr;
 		if (other->nextCommand.missileTarget == unit)
 			other->nextCommand.missileTarget = nullptr;
+
+		// its melee target is gone, so it would wake anyway, and the address may be reused
+		if (other->asleepInputs.meleeTarget == unit)
+		{
+			other->asleepInputs.meleeTarget = nullptr;
+			other->asleep = false;
+		}
 	}
 
-	delete[] unit->fighters;
 	delete unit;
 }
 
 
-void BattleSimulator_v1_0_0::SetUnitCommand(BattleObjects::Unit* _unit, const BattleObjects::UnitCommand& command, float timer)
+void BattleSimulator_v1_0_0::SetUnitCommand(BattleObjects::Unit* unit, const BattleObjects::UnitCommand& command, float timer)
 {
-	Unit* unit = static_cast<Unit*>(_unit);
+	NotifyUnitCommandCall(unit, command, timer, false);
+	ApplyUnitCommand(static_cast<Unit*>(unit), command, timer);
+}
+
+
+void BattleSimulator_v1_0_0::IssueUnitCommand(BattleObjects::Unit* unit, const BattleObjects::UnitCommand& command, float timer)
+{
+	NotifyUnitCommandCall(unit, command, timer, true);
 
+	static_cast<BattleObjects_v1::Unit*>(unit)->state.loadingTimer = 0;
+	static_cast<BattleObjects_v1::Unit*>(unit)->timeUntilSwapFighters = 0.2f;
+
+	ApplyUnitCommand(static_cast<Unit*>(unit), command, timer);
+}
+
+
+void BattleSimulator_v1_0_0::ApplyUnitCommand(BattleObjects_v1::Unit* unit, const BattleObjects::UnitCommand& command, float timer)
+{
 	unit->nextCommand = command;
 	unit->nextCommandTimer = timer;
+	unit->asleep = false;
 
 	if (unit->nextCommandTimer <= 0)
 	{
 		unit->command = unit->nextCommand;
 		unit->nextCommandTimer = 0;
+		unit->pathGoal = -1;
 	}
 
 	NotifyCommand(unit, timer);
 }
 
 
-void BattleSimulator_v1_0_0::IssueUnitCommand(BattleObjects::Unit* unit, const BattleObjects::UnitCommand& command, float timer)
+// The time step in which a timer, counted down by timeStep once per step from the
+// step first on, runs out. The timer is stepped as a float, as the shooting timers
+// used to be, so the impacts land in the same steps as they always have.
+static int CountdownTick(int first, float timer, float timeStep)
 {
-	static_cast<BattleObjects_v1::Unit*>(unit)->state.loadingTimer = 0;
-	static_cast<BattleObjects_v1::Unit*>(unit)->timeUntilSwapFighters = 0.2f;
-
-	SetUnitCommand(unit, command, timer);
+	int result = first;
+	timer -= timeStep;
+	while (timer > 0)
+	{
+		timer -= timeStep;
+		++result;
+	}
+	return result;
 }
 
 
 void BattleSimulator_v1_0_0::AddShooting(const BattleObjects::Shooting& shooting, float timer)
 {
-	_shootings.push_back(std::pair<float, BattleObjects::Shooting>(timer, shooting));
+	int first = _projectileTick + 1;
+	int release = timer > 0 ? CountdownTick(first, timer, _timeStep) : first;
+
+	// a shooting without projectiles is only released if it is due at once
+	if (!shooting.projectiles.empty() || release == first)
+	{
+		PendingRelease pending;
+		pending.tick = release;
+		pending.shooting = shooting;
+		pending.shooting.released = false;
+		_pendingReleases.push_back(pending);
+	}
+
+	for (const BattleObjects::Projectile& projectile : shooting.projectiles)
+	{
+		ProjectileImpact impact;
+		impact.tick = CountdownTick(release, shooting.timeToImpact + projectile.delay, _timeStep);
+		impact.sequence = _projectileSequence++;
+		impact.position = projectile.position2;
+		_projectileImpacts.push_back(impact);
+		std::push_heap(_projectileImpacts.begin(), _projectileImpacts.end(), ProjectileImpact::IsLater);
+	}
 
 	NotifyShooting(shooting, timer);
 }
 
 
+void BattleSimulator_v1_0_0::SetThreadCount(int value)
+{
+	if (value <= 0)
+		value = static_cast<int>(std::thread::hardware_concurrency());
+
+	if (value == GetThreadCount())
+		return;
+
+	_threadPool.reset();
+	if (value > 1)
+		_threadPool.reset(new thread_pool(value));
+}
+
+
+void BattleSimulator_v1_0_0::SetPathfinding(bool value)
+{
+	if (!value)
+		_pathfinder.reset();
+	else if (!_pathfinder && _attributeMap)
+		_pathfinder.reset(new BattlePathfinder(_attributeMap));
+}
+
+
+void BattleSimulator_v1_0_0::ParallelFor(int count, int grain, const std::function<void(int, int)>& body)
+{
+	if (_threadPool)
+		_threadPool->parallel_for(count, grain, body);
+	else if (count > 0)
+		body(0, count);
+}
+
+
 void BattleSimulator_v1_0_0::AdvanceTime(float secondsSinceLastTime)
 {
 	bool didStep = false;
@@ -191,16 +351,32 @@ void BattleSimulator_v1_0_0::AdvanceTime(float secondsSinceLastTime)
 
 	if (!didStep)
 	{
-		for (BattleObjects_v1::Unit* unit : _units)
-		{
-			UpdateUnitRange(unit);
-		}
+		ParallelFor(static_cast<int>(_units.size()), 1, [this](int begin, int end) {
+			for (int i = begin; i != end; ++i)
+				UpdateUnitRange(_units[i]);
+		});
 	}
 }
 
 
+// Draws the random numbers of a unit, or one of its fighters, for the current time
+// step. The numbers only depend on the arguments, not on what has been drawn before.
+counter_rng::result_type BattleSimulator_v1_0_0::Random(int stream, const BattleObjects_v1::Unit* unit, int index, int draw) const
+{
+	return _random(
+		static_cast<std::uint32_t>(_tick),
+		static_cast<std::uint32_t>(unit->unitId),
+		static_cast<std::uint32_t>(index),
+		static_cast<std::uint32_t>(stream | draw << 8));
+}
+
+
 void BattleSimulator_v1_0_0::SimulateOneTimeStep()
 {
+	++_tick;
+
+	_fighters.SavePreviousState();
+
 	for (BattleObjects_v1::Unit* unit : _units)
 	{
 		if (unit->nextCommandTimer > 0)
@@ -210,69 +386,657 @@ void BattleSimulator_v1_0_0::SimulateOneTimeStep()
 			{
 				unit->command = unit->nextCommand;
 				unit->nextCommandTimer = 0;
+				unit->pathGoal = -1;
 			}
 		}
 	}
 
+	BATTLE_PROFILER_BEGIN_STEP(_profiler);
+
+	BATTLE_PROFILER_PHASE(_profiler, RebuildQuadTree);
 	RebuildQuadTree();
 
+	BATTLE_PROFILER_PHASE(_profiler, MovementRules);
+	if (_pathfinder)
+		MovementRules_FindPaths();
 	for (BattleObjects_v1::Unit* unit : _units)
 	{
 		MovementRules_AdvanceTime(unit, _timeStep);
 	}
 
+	BATTLE_PROFILER_PHASE(_profiler, ComputeNextState);
 	ComputeNextState();
+	BATTLE_PROFILER_PHASE(_profiler, AssignNextState);
 	AssignNextState();
 
+	BATTLE_PROFILER_PHASE(_profiler, ResolveMeleeCombat);
 	ResolveMeleeCombat();
+	BATTLE_PROFILER_PHASE(_profiler, ResolveMissileCombat);
 	ResolveMissileCombat();
+	BATTLE_PROFILER_PHASE(_profiler, RemoveCasualties);
 	RemoveCasualties();
+	BATTLE_PROFILER_PHASE(_profiler, RemoveDeadUnits);
 	RemoveDeadUnits();
-	RemoveFinishedShootings();
+
+	BATTLE_PROFILER_END_STEP(_profiler);
 }
 
 
 void BattleSimulator_v1_0_0::RebuildQuadTree()
 {
+#if !defined(OPENWAR_USE_SPATIAL_GRID)
+	if (_threadPool)
+	{
+		RebuildQuadTreeParallel();
+		return;
+	}
+#endif
+
 	_fighterQuadTree.clear();
 	_weaponQuadTree.clear();
 
+	const glm::vec2* position = _fighters.state.position.data();
+	const float* bearing = _fighters.state.bearing.data();
+
 	for (BattleObjects_v1::Unit* unit : _units)
 	{
 		if (unit->state.unitMode != BattleObjects_v1::UnitMode_Initializing)
 		{
-			for (BattleObjects_v1::Fighter* fighter = unit->fighters, * end = fighter + unit->fightersCount; fighter != end; ++fighter)
+			for (int fighter = unit->fighters, end = fighter + unit->fightersCount; fighter != end; ++fighter)
 			{
-				_fighterQuadTree.insert(fighter->state.position.x, fighter->state.position.y, fighter);
+				_fighterQuadTree.insert(position[fighter].x, position[fighter].y, fighter);
 
 				if (unit->stats.weaponReach > 0)
 				{
-					glm::vec2 d = unit->stats.weaponReach * vector2_from_angle(fighter->state.bearing);
-					glm::vec2 p = fighter->state.position + d;
+					glm::vec2 d = unit->stats.weaponReach * vector2_from_angle(bearing[fighter]);
+					glm::vec2 p = position[fighter] + d;
 					_weaponQuadTree.insert(p.x, p.y, fighter);
 				}
 			}
 		}
 	}
+
+#if defined(OPENWAR_USE_SPATIAL_GRID)
+	// bucket the grids now, before they are searched from several threads
+	_fighterQuadTree.build();
+	_weaponQuadTree.build();
+#endif
+}
+
+
+#if !defined(OPENWAR_USE_SPATIAL_GRID)
+
+void BattleSimulator_v1_0_0::RebuildQuadTreeParallel()
+{
+	_fighterQuadTree.clear();
+	_weaponQuadTree.clear();
+	_fighterQuadTreeBuilder.Clear();
+	_weaponQuadTreeBuilder.Clear();
+
+	const glm::vec2* position = _fighters.state.position.data();
+	const float* bearing = _fighters.state.bearing.data();
+
+	for (BattleObjects_v1::Unit* unit : _units)
+	{
+		if (unit->state.unitMode != BattleObjects_v1::UnitMode_Initializing)
+		{
+			for (int fighter = unit->fighters, end = fighter + unit->fightersCount; fighter != end; ++fighter)
+			{
+				_fighterQuadTreeBuilder.Add(position[fighter], fighter);
+
+				if (unit->stats.weaponReach > 0)
+				{
+					glm::vec2 d = unit->stats.weaponReach * vector2_from_angle(bearing[fighter]);
+					_weaponQuadTreeBuilder.Add(position[fighter] + d, fighter);
+				}
+			}
+		}
+	}
+
+	// each thread fills whole sub-trees, in the same order as the serial insert
+	int fighterPartitions = _fighterQuadTreeBuilder.Partition(_fighterQuadTree);
+	int weaponPartitions = _weaponQuadTreeBuilder.Partition(_weaponQuadTree);
+
+	ParallelFor(fighterPartitions + weaponPartitions, 1, [this, fighterPartitions](int begin, int end) {
+		for (int i = begin; i != end; ++i)
+		{
+			if (i < fighterPartitions)
+				_fighterQuadTreeBuilder.Insert(_fighterQuadTree, i);
+			else
+				_weaponQuadTreeBuilder.Insert(_weaponQuadTree, i - fighterPartitions);
+		}
+	});
+}
+
+#endif
+
+
+void BattleSimulator_v1_0_0::QuadTreeBuilder::Clear()
+{
+	points.clear();
+	fighters.clear();
+}
+
+
+void BattleSimulator_v1_0_0::QuadTreeBuilder::Add(glm::vec2 point, int fighter)
+{
+	points.push_back(point);
+	fighters.push_back(fighter);
+}
+
+
+int BattleSimulator_v1_0_0::QuadTreeBuilder::Partition(quadtree<int>& quadtree)
+{
+	int count = static_cast<int>(points.size());
+	partitions.resize(points.size());
+	int result = quadtree.partition(count != 0 ? &points[0].x : nullptr, count, partitions.data());
+
+	// counting sort by partition, keeping the insert order within each partition
+	offsets.assign(static_cast<std::size_t>(result + 1), 0);
+	for (int partition : partitions)
+		++offsets[partition + 1];
+	for (int i = 0; i < result; ++i)
+		offsets[i + 1] += offsets[i];
+
+	order.resize(points.size());
+	cursors.assign(offsets.begin(), offsets.end() - 1);
+	for (int i = 0; i < count; ++i)
+		order[cursors[partitions[i]]++] = i;
+
+	return result;
+}
+
+
+void BattleSimulator_v1_0_0::QuadTreeBuilder::Insert(quadtree<int>& quadtree, int partition) const
+{
+	for (int i = offsets[partition], end = offsets[partition + 1]; i != end; ++i)
+	{
+		int item = order[i];
+		quadtree.insert_partition(partition, points[item].x, points[item].y, fighters[item]);
+	}
+}
+
+
+void BattleSimulator_v1_0_0::RebuildTeamInfluence()
+{
+	for (std::pair<const int, mass_tree>& i : _teamInfluence)
+		i.second.clear();
+
+	for (BattleObjects_v1::Unit* unit : _units)
+	{
+		// units with more than full morale, from regain overshooting 1 or from a
+		// script, weigh nothing, the tree needs masses that are not negative
+		float mass = glm::max(0.0f, 1 - unit->state.morale) * unit->stats.trainingLevel;
+		_teamInfluence[unit->GetTeam()].insert(unit->state.center.x, unit->state.center.y, mass);
+	}
+
+	for (std::pair<const int, mass_tree>& i : _teamInfluence)
+		i.second.build();
+}
+
+
+void BattleSimulator_v1_0_0::RebuildTeamUnits()
+{
+	for (std::pair<const int, spatial_grid<int>>& i : _teamUnits)
+		i.second.clear();
+
+	for (int i = 0; i < static_cast<int>(_units.size()); ++i)
+	{
+		BattleObjects_v1::Unit* unit = _units[i];
+		std::map<int, spatial_grid<int>>::iterator team = _teamUnits.find(unit->GetTeam());
+		if (team == _teamUnits.end())
+			team = _teamUnits.emplace(unit->GetTeam(), spatial_grid<int>(0, 0, 1024, 1024, 64)).first;
+		team->second.insert(unit->state.center.x, unit->state.center.y, i);
+	}
+
+	for (std::pair<const int, spatial_grid<int>>& i : _teamUnits)
+		i.second.build();
+
+	_teamUnitsValid = true;
 }
 
 
 void BattleSimulator_v1_0_0::ComputeNextState()
 {
+	RebuildTeamInfluence();
+	_teamUnitsValid = false;
+
+	if (_aggregateSettings.enabled)
+	{
+		RebuildTeamUnits();
+		float maxRadius = 0;
+		for (BattleObjects_v1::Unit* unit : _units)
+			maxRadius = glm::max(maxRadius, GetFormationRadius(unit));
+
+		ParallelFor(static_cast<int>(_units.size()), 1, [this, maxRadius](int begin, int end) {
+			for (int i = begin; i != end; ++i)
+				UpdateUnitDetail(_units[i], maxRadius);
+		});
+	}
+	else
+	{
+		for (BattleObjects_v1::Unit* unit : _units)
+			unit->aggregate = false;
+	}
+
+	for (BattleObjects_v1::Unit* unit : _units)
+		unit->wasAsleep = unit->asleep;
+
+	ParallelFor(static_cast<int>(_units.size()), 1, [this](int begin, int end) {
+		for (int i = begin; i != end; ++i)
+		{
+			_units[i]->nextState = NextUnitState(_units[i]);
+			WakeUnit(_units[i]);
+			if (IsFighterSimulated(_units[i]) && !_units[i]->state.IsRouting())
+				MovementRules_SolveFormation(_units[i]);
+		}
+	});
+
+	_asleepUnitCount = 0;
+	_aggregateUnitCount = 0;
 	for (BattleObjects_v1::Unit* unit : _units)
 	{
-		unit->nextState = NextUnitState(unit);
+		if (unit->asleep)
+			++_asleepUnitCount;
+		else if (unit->aggregate)
+			++_aggregateUnitCount;
+		else
+			BATTLE_PROFILER_COUNT(_profiler, FightersProcessed, unit->fightersCount);
+	}
+	_awakeUnitCount = static_cast<int>(_units.size()) - _asleepUnitCount;
+	BATTLE_PROFILER_COUNT(_profiler, UnitsAwake, _awakeUnitCount);
+	BATTLE_PROFILER_COUNT(_profiler, UnitsAsleep, _asleepUnitCount);
+	BATTLE_PROFILER_COUNT(_profiler, UnitsAggregate, _aggregateUnitCount);
+
+	int chunks = (_fighters.GetSize() + FighterChunkSize - 1) / FighterChunkSize;
+	if (static_cast<int>(_fighterNeighbours.size()) < chunks)
+		_fighterNeighbours.resize(static_cast<std::size_t>(chunks));
+
+	ParallelFor(_fighters.GetSize(), FighterChunkSize, [this](int begin, int end) {
+		FighterNeighbours& neighbours = _fighterNeighbours[begin / FighterChunkSize];
+		FindFighterNeighbours(neighbours, begin, end);
+		for (int fighter = begin; fighter != end; ++fighter)
+			if (_fighters.unit[fighter] != nullptr && IsFighterSimulated(_fighters.unit[fighter]) && _fighters.unit[fighter]->IsAlive(fighter))
+				_fighters.nextState.Set(fighter, NextFighterState(fighter, neighbours));
+	});
+
+	ParallelFor(static_cast<int>(_units.size()), 1, [this](int begin, int end) {
+		for (int i = begin; i != end; ++i)
+		{
+			if (_units[i]->aggregate)
+				NextAggregateState(_units[i]);
+			else
+				SleepUnit(_units[i]);
+		}
+	});
+
+	for (BattleObjects_v1::Unit* unit : _units)
+		CommitNextUnitState(unit);
+
+#if defined(OPENWAR_ENABLE_PROFILER)
+	for (int chunk = 0; chunk < chunks; ++chunk)
+	{
+		const FighterNeighbours& neighbours = _fighterNeighbours[chunk];
+		BATTLE_PROFILER_COUNT(_profiler, QuadTreeNodesVisited, neighbours.fighters.visits() + neighbours.weapons.visits() + neighbours.visits);
+	}
+#endif
+}
+
+
+// The fighters of a sleeping unit keep their state, both state and nextState,
+// as long as nothing they read changes. The unit wakes when its inputs change,
+// such as by a command or a change of whether it routs, when an enemy fighter or
+// weapon comes within SleepActivationDistance, and, by the caller, when its fighters
+// are changed by melee, projectiles or casualties. Friendly units only wake it
+// when one that was awake comes close enough to push its fighters, so units
+// standing side by side in a line can all sleep.
+void BattleSimulator_v1_0_0::WakeUnit(BattleObjects_v1::Unit* unit)
+{
+	if (unit->asleep
+		&& (!_unitSleeping
+			|| GetFighterInputs(unit) != unit->asleepInputs
+			|| IsEnemyNear(unit, unit->asleepRadius)
+			|| IsMovingFriendInContact(unit, unit->asleepRadius)))
+	{
+		unit->asleep = false;
+	}
+}
+
+
+// A unit falls asleep when its fighters computed the same next state as their
+// current one, with no enemy near. Friends that are still moving wake it again
+// in the next time step, before they can push its fighters.
+void BattleSimulator_v1_0_0::SleepUnit(BattleObjects_v1::Unit* unit)
+{
+	if (!_unitSleeping
+		|| unit->asleep
+		|| unit->aggregate
+		|| unit->fightersCount == 0
+		|| unit->state.unitMode == BattleObjects_v1::UnitMode_Initializing
+		|| !IsFighterStateSettled(unit))
+	{
+		return;
+	}
+
+	const glm::vec2* position = _fighters.state.position.data();
+	float radius = 0;
+	for (int fighter = unit->fighters, end = fighter + unit->fightersCount; fighter != end; ++fighter)
+		radius = glm::max(radius, glm::length(position[fighter] - unit->state.center));
+
+	if (!IsEnemyNear(unit, radius))
+	{
+		unit->asleep = true;
+		unit->asleepInputs = GetFighterInputs(unit);
+		unit->asleepRadius = radius;
+	}
+}
+
+
+BattleObjects_v1::FighterInputs BattleSimulator_v1_0_0::GetFighterInputs(BattleObjects_v1::Unit* unit) const
+{
+	BattleObjects_v1::FighterInputs result;
+	result.unitMode = unit->state.unitMode;
+	result.center = unit->state.center;
+	result.bearing = unit->state.bearing;
+	result.waypoint = unit->state.waypoint;
+	result.routing = unit->state.IsRouting();
+	result.speed = unit->GetSpeed();
+	result.meleeTarget = unit->command.meleeTarget;
+	result.fightersCount = unit->fightersCount;
+	result.numberOfRanks = unit->formation.numberOfRanks;
+	result.numberOfFiles = unit->formation.numberOfFiles;
+	result.direction = unit->formation._direction;
+	result.heightMapVersion = _battleMap->GetHeightMap()->GetVersion();
+	result.attributeMapVersion = _attributeMap ? _attributeMap->GetVersion() : 0;
+	return result;
+}
+
+
+bool BattleSimulator_v1_0_0::IsFighterStateSettled(BattleObjects_v1::Unit* unit) const
+{
+	const BattleObjects_v1::FighterStates& state = _fighters.state;
+	const BattleObjects_v1::FighterStates& next = _fighters.nextState;
+
+	for (int fighter = unit->fighters, end = fighter + unit->fightersCount; fighter != end; ++fighter)
+	{
+		if (next.position[fighter] != state.position[fighter]
+			|| next.position_z[fighter] != state.position_z[fighter]
+			|| next.readyState[fighter] != state.readyState[fighter]
+			|| next.readyingTimer[fighter] != state.readyingTimer[fighter]
+			|| next.strikingTimer[fighter] != state.strikingTimer[fighter]
+			|| next.stunnedTimer[fighter] != state.stunnedTimer[fighter]
+			|| next.opponent[fighter].index != state.opponent[fighter].index
+			|| next.opponent[fighter].generation != state.opponent[fighter].generation
+			|| next.destination[fighter] != state.destination[fighter]
+			|| next.velocity[fighter] != state.velocity[fighter]
+			|| next.bearing[fighter] != state.bearing[fighter]
+			|| next.meleeTarget[fighter].index != state.meleeTarget[fighter].index
+			|| next.meleeTarget[fighter].generation != state.meleeTarget[fighter].generation)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+// Whether an enemy fighter or weapon is within SleepActivationDistance of the
+// circle of the given radius around the unit's center.
+bool BattleSimulator_v1_0_0::IsEnemyNear(BattleObjects_v1::Unit* unit, float radius)
+{
+	glm::vec2 center = unit->state.center;
+	int team = unit->GetTeam();
+
+	for (FighterIndex::iterator i(_fighterQuadTree.find(center.x, center.y, radius + SleepActivationDistance)); *i; ++i)
+		if (_fighters.unit[**i]->GetTeam() != team)
+			return true;
+
+	for (FighterIndex::iterator i(_weaponQuadTree.find(center.x, center.y, radius + SleepActivationDistance)); *i; ++i)
+		if (_fighters.unit[**i]->GetTeam() != team)
+			return true;
+
+	return false;
+}
+
+
+// Whether a fighter of another unit that was awake at the start of the time step
+// is within SleepContactDistance of one of the unit's fighters. Enemies are
+// found by IsEnemyNear() from farther away, this is for friends.
+bool BattleSimulator_v1_0_0::IsMovingFriendInContact(BattleObjects_v1::Unit* unit, float radius)
+{
+	const glm::vec2* position = _fighters.state.position.data();
+	glm::vec2 center = unit->state.center;
+
+	bool near = false;
+	for (FighterIndex::iterator i(_fighterQuadTree.find(center.x, center.y, radius + SleepContactDistance)); *i && !near; ++i)
+		near = _fighters.unit[**i] != unit && !_fighters.unit[**i]->wasAsleep;
+	if (!near)
+		return false;
+
+	for (int fighter = unit->fighters, end = fighter + unit->fightersCount; fighter != end; ++fighter)
+		for (FighterIndex::iterator i(_fighterQuadTree.find(position[fighter].x, position[fighter].y, SleepContactDistance)); *i; ++i)
+			if (_fighters.unit[**i] != unit && !_fighters.unit[**i]->wasAsleep)
+				return true;
+
+	return false;
+}
+
+
+// A unit collapses into an aggregate when it is far from every viewpoint and
+// every enemy, and expands again when either comes near. The decision only
+// depends on the current state and the viewpoints, so given the same viewpoints
+// the simulation is the same.
+void BattleSimulator_v1_0_0::UpdateUnitDetail(BattleObjects_v1::Unit* unit, float maxRadius)
+{
+	const AggregateSettings& settings = _aggregateSettings;
+
+	if (unit->state.unitMode == BattleObjects_v1::UnitMode_Initializing
+		|| unit->state.IsRouting()
+		|| unit->command.meleeTarget != nullptr)
+	{
+		unit->aggregate = false;
+		return;
+	}
+
+	if (unit->aggregate)
+	{
+		if (GetViewpointDistance(unit) < settings.expandViewpointDistance
+			|| GetContactDistance(unit, maxRadius, settings.expandContactDistance) < settings.expandContactDistance)
+		{
+			unit->aggregate = false;
+		}
+	}
+	else if (GetViewpointDistance(unit) > settings.collapseViewpointDistance
+		&& GetContactDistance(unit, maxRadius, settings.collapseContactDistance) > settings.collapseContactDistance)
+	{
+		for (int fighter = unit->fighters, end = fighter + unit->fightersCount; fighter != end; ++fighter)
+			if (_fighters.Resolve(_fighters.state.opponent[fighter]) != -1)
+				return;
+
+		unit->aggregate = true;
+		unit->aggregateLosses = 0;
+		unit->asleep = false;
+	}
+}
+
+
+// from the unit's formation edge to the nearest viewpoint
+float BattleSimulator_v1_0_0::GetViewpointDistance(BattleObjects_v1::Unit* unit) const
+{
+	float result = std::numeric_limits<float>::max();
+	for (const std::pair<const void* const, glm::vec2>& viewpoint : _viewpoints)
+		result = glm::min(result, glm::distance(viewpoint.second, unit->state.center));
+
+	return result - GetFormationRadius(unit);
+}
+
+
+// between the formation edges of the unit and the nearest enemy, or more than
+// limit if there is no enemy that near
+float BattleSimulator_v1_0_0::GetContactDistance(BattleObjects_v1::Unit* unit, float maxRadius, float limit)
+{
+	float radius = GetFormationRadius(unit);
+	glm::vec2 center = unit->state.center;
+	float result = limit + 1;
+
+	for (std::pair<const int, spatial_grid<int>>& team : _teamUnits)
+	{
+		if (team.first == unit->GetTeam())
+			continue;
+
+		for (spatial_grid<int>::iterator i(team.second.find(center.x, center.y, radius + maxRadius + limit)); *i; ++i)
+		{
+			BattleObjects_v1::Unit* enemy = _units[**i];
+			float distance = glm::distance(enemy->state.center, center) - radius - GetFormationRadius(enemy);
+			result = glm::min(result, distance);
+		}
+	}
+
+	return result;
+}
+
+
+// An aggregate unit moves as one body toward its waypoint, at the speed its
+// fighters would walk or run. Its fighters move along with it, and toward their
+// places in the formation, so they are where the fighter by fighter simulation
+// left them when the unit collapsed, and where it takes over when it expands.
+void BattleSimulator_v1_0_0::NextAggregateState(BattleObjects_v1::Unit* unit)
+{
+	const BattleObjects_v1::FighterStates& state = _fighters.state;
+	BattleObjects_v1::FighterStates& next = _fighters.nextState;
+	const HeightMap* heightMap = _battleMap->GetHeightMap();
+	glm::vec2 center = unit->state.center;
+	bool moving = unit->state.unitMode == BattleObjects_v1::UnitMode_Moving;
+
+	glm::vec2 movement;
+	if (moving)
+	{
+		float speed = unit->GetSpeed();
+		unsigned char attributes = _attributeMap ? _attributeMap->GetAttributes(center) : 0;
+		if (attributes & TerrainAttribute_Forest)
+			speed *= unit->stats.platformType == BattleObjects::PlatformType::Cavalry ? 0.5f : 0.9f;
+
+		glm::vec2 diff = unit->state.waypoint - center;
+		float distance = glm::length(diff);
+		if (distance > 0)
+			movement = diff * glm::min(1.0f, speed * _timeStep / distance);
+
+		if (_attributeMap && (_attributeMap->GetAttributes(center + movement) & TerrainAttribute_Impassable))
+			movement = glm::vec2();
+	}
+
+	glm::vec2 frontLeft = unit->formation.GetFrontLeft(center + movement);
+	float bearing = moving && movement != glm::vec2() ? angle(movement) : unit->state.bearing;
+	float reform = unit->stats.walkingSpeed * _timeStep;
+
+	for (int fighter = unit->fighters, end = fighter + unit->fightersCount; fighter != end; ++fighter)
+	{
+		glm::vec2 place = frontLeft
+			+ unit->formation.towardRight * (float)unit->GetFile(fighter)
+			+ unit->formation.towardBack * (float)unit->GetRank(fighter);
+
+		glm::vec2 position = state.position[fighter] + movement;
+		glm::vec2 diff = place - position;
+		float distance = glm::length(diff);
+		position += distance > reform ? diff * (reform / distance) : diff;
+
+		BattleObjects_v1::FighterState result;
+		result.position = position;
+		result.position_z = heightMap->InterpolateHeight(position);
+		result.velocity = (position - state.position[fighter]) / _timeStep;
+		result.destination = place;
+		result.bearing = bearing;
+
+		BattleObjects_v1::ReadyState readyState = state.readyState[fighter];
+		if (moving && unit->command.meleeTarget == nullptr)
+		{
+			result.readyState = BattleObjects_v1::ReadyState_Unready;
+		}
+		else if (readyState == BattleObjects_v1::ReadyState_Unready)
+		{
+			result.readyState = BattleObjects_v1::ReadyState_Readying;
+			result.readyingTimer = unit->stats.readyingDuration;
+		}
+		else if (readyState == BattleObjects_v1::ReadyState_Prepared)
+		{
+			result.readyState = readyState;
+		}
+		else
+		{
+			float timer = glm::max(state.readyingTimer[fighter], state.stunnedTimer[fighter]);
+			if (timer > _timeStep)
+			{
+				result.readyState = BattleObjects_v1::ReadyState_Readying;
+				result.readyingTimer = timer - _timeStep;
+			}
+			else
+			{
+				result.readyState = BattleObjects_v1::ReadyState_Prepared;
+			}
+		}
 
-		for (BattleObjects_v1::Fighter* fighter = unit->fighters, * end = fighter + unit->fightersCount; fighter != end; ++fighter)
-			fighter->nextState = NextFighterState(fighter);
+		next.Set(fighter, result);
+		UpdateFighterTerrain(fighter);
+	}
+}
+
+
+// Aimed fire between aggregate units, Lanchester style: the losses of a volley
+// are proportional to the number of shooters, with a hit chance given by how
+// densely the target's fighters fill the area the projectiles scatter over.
+// The casualties are drawn at random and removed with the others.
+void BattleSimulator_v1_0_0::ResolveAttrition(BattleObjects_v1::Unit* unit, BattleObjects_v1::Unit* target)
+{
+	int shooters = 0;
+	for (int fighter = unit->fighters, end = fighter + unit->fightersCount; fighter != end; ++fighter)
+		if (_fighters.state.readyState[fighter] == BattleObjects_v1::ReadyState_Prepared)
+			++shooters;
+
+	if (shooters == 0 || target->fightersCount == 0 || !target->IsOwnedBySimulator())
+		return;
+
+	float scatterArea = 4 * ProjectileScatter * ProjectileScatter;
+	float fighterArea = target->formation.fileDistance * target->formation.rankDistance;
+	float density = glm::min(target->fightersCount / scatterArea, 1 / fighterArea);
+	float losses = shooters * (float)M_PI * ProjectileHitRadius * ProjectileHitRadius * density;
+
+	// as in ResolveProjectileCasualties(), the forest stops six projectiles of eight
+	if (_attributeMap && (_attributeMap->GetAttributes(target->state.center) & TerrainAttribute_Forest))
+		losses *= 0.25f;
+
+	target->aggregateLosses += losses;
+
+	int draw = 0;
+	int remaining = 0;
+	for (int fighter = target->fighters, end = fighter + target->fightersCount; fighter != end; ++fighter)
+		if (!_fighters.casualty[fighter])
+			++remaining;
+
+	while (target->aggregateLosses >= 1 && remaining != 0)
+	{
+		std::uint32_t random = Random(RandomStream_Attrition, target, unit->unitId, draw++)[0];
+		int fighter = target->fighters + static_cast<int>(random % static_cast<std::uint32_t>(target->fightersCount));
+		while (_fighters.casualty[fighter])
+			fighter = fighter + 1 != target->fighters + target->fightersCount ? fighter + 1 : target->fighters;
+
+		_fighters.casualty[fighter] = true;
+		target->aggregateLosses -= 1;
+		--remaining;
 	}
 }
 
 
 void BattleSimulator_v1_0_0::AssignNextState()
 {
+	_fighters.AssignNextState();
+
 	for (BattleObjects_v1::Unit* unit : _units)
 	{
+		// casualties keep their last state, it may still be read through an opponent handle
+		for (int fighter = unit->fighters + unit->fightersCount, end = unit->fighters + unit->fightersCapacity; fighter != end; ++fighter)
+			_fighters.state.Set(fighter, _fighters.nextState.Get(fighter));
+
 		if (!unit->state.IsRouting() && unit->nextState.IsRouting())
 			NotifyRouting(unit);
 
@@ -283,14 +1047,12 @@ void BattleSimulator_v1_0_0::AssignNextState()
 			unit->command.ClearPathAndSetDestination(unit->state.center);
 			unit->command.meleeTarget = nullptr;
 		}
-
-		for (BattleObjects_v1::Fighter* fighter = unit->fighters, * end = fighter + unit->fightersCount; fighter != end; ++fighter)
-		{
-			fighter->state = fighter->nextState;
-		}
-
-		UpdateUnitRange(unit);
 	}
+
+	ParallelFor(static_cast<int>(_units.size()), 1, [this](int begin, int end) {
+		for (int i = begin; i != end; ++i)
+			UpdateUnitRange(_units[i]);
+	});
 }
 
 
@@ -305,11 +1067,26 @@ void BattleSimulator_v1_0_0::UpdateUnitRange(BattleObjects_v1::Unit* unit)
 	unitRange.minimumRange = unit->stats.minimumRange;
 	unitRange.maximumRange = unit->stats.maximumRange;
 
+	// the ray marching is only redone when the unit has moved or turned noticeably,
+	// small changes keep the ranges but move them with the unit
+	const HeightMap* heightMap = _battleMap->GetHeightMap();
+	if (!unitRange.actualRanges.empty()
+		&& unit->unitRangeVersion == heightMap->GetVersion()
+		&& glm::length(unitRange.center - unit->unitRangeCenter) < UnitRangeMaxMovement
+		&& glm::abs(diff_radians(unit->state.bearing, unit->unitRangeBearing)) < UnitRangeMaxTurn)
+	{
+		return;
+	}
+
 	unitRange.actualRanges.clear();
 
 	if (unitRange.minimumRange > 0 && unitRange.maximumRange > 0)
 	{
-		float centerHeight = _battleMap->GetHeightMap()->InterpolateHeight(unitRange.center) + 1.9f;
+		unit->unitRangeCenter = unitRange.center;
+		unit->unitRangeBearing = unit->state.bearing;
+		unit->unitRangeVersion = heightMap->GetVersion();
+
+		float centerHeight = heightMap->InterpolateHeight(unitRange.center) + 1.9f;
 
 		int n = 24;
 		for (int i = 0; i <= n; ++i)
@@ -321,7 +1098,7 @@ void BattleSimulator_v1_0_0::UpdateUnitRange(BattleObjects_v1::Unit* unit)
 			float maxAngle = -100;
 			for (float range = unitRange.minimumRange + delta; range <= unitRange.maximumRange; range += delta)
 			{
-				float height = _battleMap->GetHeightMap()->InterpolateHeight(unitRange.center + range * direction) + 0.5f;
+				float height = heightMap->InterpolateHeight(unitRange.center + range * direction) + 0.5f;
 				float verticalAngle = glm::atan(height - centerHeight, range);
 				if (verticalAngle > maxAngle)
 				{
@@ -338,15 +1115,17 @@ void BattleSimulator_v1_0_0::UpdateUnitRange(BattleObjects_v1::Unit* unit)
 
 void BattleSimulator_v1_0_0::ResolveMeleeCombat()
 {
+	BattleObjects_v1::FighterStates& state = _fighters.state;
+
 	for (BattleObjects_v1::Unit* unit : _units)
 	{
 		bool isMissile = unit->stats.missileType != BattleObjects::MissileType::None;
-		for (BattleObjects_v1::Fighter* fighter = unit->fighters, * end = fighter + unit->fightersCount; fighter != end; ++fighter)
+		for (int fighter = unit->fighters, end = fighter + unit->fightersCount; fighter != end; ++fighter)
 		{
-			BattleObjects_v1::Fighter* meleeTarget = fighter->state.meleeTarget;
-			if (meleeTarget && meleeTarget->GetUnit()->IsOwnedBySimulator())
+			int meleeTarget = _fighters.Resolve(state.meleeTarget[fighter]);
+			if (meleeTarget != -1 && _fighters.unit[meleeTarget]->IsOwnedBySimulator())
 			{
-				BattleObjects_v1::Unit* enemyUnit = meleeTarget->GetUnit();
+				BattleObjects_v1::Unit* enemyUnit = _fighters.unit[meleeTarget];
 				float killProbability = 0.5f;
 
 				killProbability *= 1.25f + unit->stats.trainingLevel;
@@ -355,25 +1134,26 @@ void BattleSimulator_v1_0_0::ResolveMeleeCombat()
 				if (isMissile)
 					killProbability *= 0.15;
 
-				float heightDiff = fighter->state.position_z - meleeTarget->state.position_z;
+				float heightDiff = state.position_z[fighter] - state.position_z[meleeTarget];
 				killProbability *= 1.0f + 0.4f * bounds1d(-1.5f, 1.5f).clamp(heightDiff);
 
-				float speed = glm::length(fighter->state.velocity);
+				float speed = glm::length(state.velocity[fighter]);
 				killProbability *= (0.9f + speed / 10.0f);
 
-				float roll = (rand() & 0x7FFF) / (float)0x7FFF;
+				float roll = counter_rng::to_float(Random(RandomStream_MeleeRoll, unit, fighter - unit->fighters)[0]);
 
 				if (roll < killProbability)
 				{
-					meleeTarget->casualty = true;
+					_fighters.casualty[meleeTarget] = true;
 				}
 				else
 				{
-					meleeTarget->state.readyState = BattleObjects_v1::ReadyState_Stunned;
-					meleeTarget->state.stunnedTimer = 0.6f;
+					state.readyState[meleeTarget] = BattleObjects_v1::ReadyState_Stunned;
+					state.stunnedTimer[meleeTarget] = 0.6f;
+					enemyUnit->asleep = false;
 				}
 
-				fighter->state.readyingTimer = fighter->GetUnit()->stats.readyingDuration;
+				state.readyingTimer[fighter] = unit->stats.readyingDuration;
 			}
 		}
 	}
@@ -404,6 +1184,13 @@ void BattleSimulator_v1_0_0::TriggerShooting(BattleObjects_v1::Unit* unit)
 	if (unit->command.missileTarget == nullptr)
 		return;
 
+	BattleObjects_v1::Unit* target = static_cast<BattleObjects_v1::Unit*>(unit->command.missileTarget);
+	if (unit->aggregate && target->aggregate)
+	{
+		ResolveAttrition(unit, target);
+		return;
+	}
+
 	BattleObjects::Shooting shooting;
 	shooting.unit = unit;
 	shooting.missileType = unit->stats.missileType;
@@ -412,17 +1199,20 @@ void BattleSimulator_v1_0_0::TriggerShooting(BattleObjects_v1::Unit* unit)
 	bool arq = shooting.missileType == BattleObjects::MissileType::Arq;
 	float distance = 0;
 
-	for (BattleObjects_v1::Fighter* fighter = unit->fighters, * end = fighter + unit->fightersCount; fighter != end; ++fighter)
+	const BattleObjects_v1::FighterStates& state = _fighters.state;
+
+	for (int fighter = unit->fighters, end = fighter + unit->fightersCount; fighter != end; ++fighter)
 	{
-		if (fighter->state.readyState == BattleObjects_v1::ReadyState_Prepared)
+		if (state.readyState[fighter] == BattleObjects_v1::ReadyState_Prepared)
 		{
-			float dx = 10.0f * ((rand() & 255) / 128.0f - 1.0f);
-			float dy = 10.0f * ((rand() & 255) / 127.0f - 1.0f);
+			counter_rng::result_type random = Random(RandomStream_Shooting, unit, fighter - unit->fighters);
+			float dx = ProjectileScatter * ((random[0] & 255) / 128.0f - 1.0f);
+			float dy = ProjectileScatter * ((random[1] & 255) / 127.0f - 1.0f);
 
 			BattleObjects::Projectile projectile;
-			projectile.position1 = fighter->state.position;
+			projectile.position1 = state.position[fighter];
 			projectile.position2 = shooting.target + glm::vec2(dx, dy);
-			projectile.delay = (arq ? 0.5f : 0.2f) * ((rand() & 0x7FFF) / (float)0x7FFF);
+			projectile.delay = (arq ? 0.5f : 0.2f) * counter_rng::to_float(random[2]);
 			shooting.projectiles.push_back(projectile);
 			distance += glm::length(projectile.position1 - projectile.position2) / unit->fightersCount;
 		}
@@ -437,53 +1227,50 @@ void BattleSimulator_v1_0_0::TriggerShooting(BattleObjects_v1::Unit* unit)
 
 void BattleSimulator_v1_0_0::ResolveProjectileCasualties()
 {
-	static int random = 0;
+	_projectileTick = _tick;
 
-	for (std::pair<float, BattleObjects::Shooting>& s : _shootings)
+	int released = 0;
+	for (PendingRelease& pending : _pendingReleases)
 	{
-		if (s.first > 0)
+		if (pending.tick <= _projectileTick)
 		{
-			s.first -= _timeStep;
+			pending.shooting.released = true;
+			NotifyRelease(pending.shooting);
 		}
-
-		if (s.first <= 0)
+		else
 		{
-			BattleObjects::Shooting& shooting = s.second;
+			std::swap(_pendingReleases[released++], pending);
+		}
+	}
+	_pendingReleases.erase(_pendingReleases.begin() + released, _pendingReleases.end());
 
-			if (!shooting.released)
-			{
-				NotifyRelease(s.second);
-				shooting.released = true;
-			}
+	_projectileHitpoints.clear();
+	while (!_projectileImpacts.empty() && _projectileImpacts.front().tick <= _projectileTick)
+	{
+		_projectileHitpoints.push_back(_projectileImpacts.front().position);
+		std::pop_heap(_projectileImpacts.begin(), _projectileImpacts.end(), ProjectileImpact::IsLater);
+		_projectileImpacts.pop_back();
+	}
 
-			shooting.timeToImpact -= _timeStep;
+	int count = static_cast<int>(_projectileHitpoints.size());
+	FindNeighbours(_fighterQuadTree, count != 0 ? &_projectileHitpoints[0].x : nullptr, count, ProjectileHitRadius, _projectileHits);
+	BATTLE_PROFILER_COUNT(_profiler, ProjectilesResolved, count);
+	BATTLE_PROFILER_COUNT(_profiler, QuadTreeNodesVisited, _projectileHits.visits());
 
-			std::vector<BattleObjects::Projectile>::iterator i = shooting.projectiles.begin();
-			while (i != shooting.projectiles.end())
+	for (int hit = 0; hit != count; ++hit)
+	{
+		for (const int* j = _projectileHits.begin(hit), * end = _projectileHits.end(hit); j != end; ++j)
+		{
+			int fighter = *j;
+			BattleObjects_v1::Unit* target = _fighters.unit[fighter];
+			target->asleep = false;
+			if (target->IsOwnedBySimulator())
 			{
-				BattleObjects::Projectile& projectile = *i;
-				if (shooting.timeToImpact + projectile.delay <= 0)
-				{
-					glm::vec2 hitpoint = projectile.position2;
-					for (quadtree<BattleObjects_v1::Fighter*>::iterator j(_fighterQuadTree.find(hitpoint.x, hitpoint.y, 0.45f)); *j; ++j)
-					{
-						BattleObjects_v1::Fighter* fighter = **j;
-						if (fighter->GetUnit()->IsOwnedBySimulator())
-						{
-							bool blocked = false;
-							if (fighter->terrainForest)
-								blocked = (random++ & 7) <= 5;
-							if (!blocked)
-								fighter->casualty = true;
-						}
-					}
-					shooting.projectiles.erase(i);
-				}
-				else
-				{
-					++i;
-				}
-				++random;
+				bool blocked = false;
+				if (_fighters.terrainAttributes[fighter] & TerrainAttribute_Forest)
+					blocked = (Random(RandomStream_ProjectileBlocked, target, fighter - target->fighters, hit)[0] & 7) <= 5;
+				if (!blocked)
+					_fighters.casualty[fighter] = true;
 			}
 		}
 	}
@@ -497,22 +1284,24 @@ void BattleSimulator_v1_0_0::RemoveCasualties()
 	float radius = bounds.x().size() / 2;
 	float radius_squared = radius * radius;
 
+	BattleObjects_v1::FighterStates& state = _fighters.state;
+	char* casualty = _fighters.casualty.data();
+
 	for (BattleObjects_v1::Unit* unit : _units)
 	{
 		if (unit->IsOwnedBySimulator())
 		{
-			BattleObjects_v1::Fighter* end = unit->fighters + unit->fightersCount;
-			for (BattleObjects_v1::Fighter* fighter = unit->fighters; fighter != end; ++fighter)
+			for (int fighter = unit->fighters, end = fighter + unit->fightersCount; fighter != end; ++fighter)
 			{
-				if (!fighter->casualty)
+				if (!casualty[fighter])
 				{
-					fighter->casualty = fighter->terrainImpassable && unit->state.IsRouting();
+					casualty[fighter] = (_fighters.terrainAttributes[fighter] & TerrainAttribute_Impassable) && unit->state.IsRouting();
 				}
 
-				if (!fighter->casualty)
+				if (!casualty[fighter])
 				{
-					glm::vec2 diff = fighter->state.position - center;
-					fighter->casualty = glm::dot(diff, diff) >= radius_squared;
+					glm::vec2 diff = state.position[fighter] - center;
+					casualty[fighter] = glm::dot(diff, diff) >= radius_squared;
 				}
 			}
 		}
@@ -520,61 +1309,57 @@ void BattleSimulator_v1_0_0::RemoveCasualties()
 
 	for (BattleObjects_v1::Unit* unit : _units)
 	{
-		BattleObjects_v1::Fighter* end = unit->fighters + unit->fightersCount;
-		for (BattleObjects_v1::Fighter* fighter = unit->fighters; fighter != end; ++fighter)
-			if (fighter->state.opponent && fighter->state.opponent->casualty)
-				fighter->state.opponent = nullptr;
+		for (int fighter = unit->fighters, end = fighter + unit->fightersCount; fighter != end; ++fighter)
+		{
+			int opponent = _fighters.Resolve(state.opponent[fighter]);
+			if (opponent != -1 && casualty[opponent])
+				state.opponent[fighter] = BattleObjects_v1::FighterHandle();
+		}
 	}
 
 	for (BattleObjects_v1::Unit* unit : _units)
 	{
-		std::vector<BattleObjects_v1::Fighter> fighters;
+		std::vector<glm::vec2>& casualties = _casualtyPositions;
+		casualties.clear();
 
-		int index = 0;
-		int n = unit->fightersCount;
-		for (int j = 0; j < n; ++j)
+		int index = unit->fighters;
+		for (int j = unit->fighters, end = j + unit->fightersCount; j != end; ++j)
 		{
-			if (unit->fighters[j].casualty)
+			if (casualty[j])
 			{
 				++unit->state.recentCasualties;
-				fighters.push_back(unit->fighters[j]);
+				casualties.push_back(state.position[j]);
 			}
 			else
 			{
 				if (index < j)
-					unit->fighters[index].state = unit->fighters[j].state;
-				unit->fighters[index].casualty = false;
+				{
+					state.Copy(index, j);
+					_fighters.CopyPreviousState(index, j);
+				}
+				casualty[index] = false;
 				index++;
 			}
 		}
 
-		unit->fightersCount = index;
-
-		_kills[unit->GetTeam()] += fighters.size();
+		unit->fightersCount = index - unit->fighters;
 
-		for (const BattleObjects_v1::Fighter& fighter : fighters)
-			NotifyCasualty(unit, fighter.state.position);
+		if (!casualties.empty())
+		{
+			unit->asleep = false;
+			_kills[unit->GetTeam()] += casualties.size();
+			NotifyCasualties(unit, casualties.data(), static_cast<int>(casualties.size()));
+		}
 	}
 }
 
 
 void BattleSimulator_v1_0_0::RemoveDeadUnits()
 {
-	std::vector<BattleObjects_v1::Unit*> remove;
-
-	for (BattleObjects_v1::Unit* unit : _units)
-		if (unit->fightersCount == 0)
-			remove.push_back(unit);
-
-	for (BattleObjects_v1::Unit* unit : remove)
-		RemoveUnit(unit);
-}
-
-
-void BattleSimulator_v1_0_0::RemoveFinishedShootings()
-{
-	auto i = std::remove_if(_shootings.begin(), _shootings.end(), [](const std::pair<float, BattleObjects::Shooting>& s) { return s.second.projectiles.empty(); });
-	_shootings.erase(i, _shootings.end());
+	// backwards, so the units moved by DeleteUnit have already been checked
+	for (int i = static_cast<int>(_units.size()) - 1; i >= 0; --i)
+		if (_units[i]->fightersCount == 0)
+			DeleteUnit(_units[i]);
 }
 
 
@@ -588,6 +1373,51 @@ BattleObjects_v1::UnitState BattleSimulator_v1_0_0::NextUnitState(BattleObjects_
 
 	result.shootingCounter = unit->state.shootingCounter;
 
+	result.morale = unit->state.morale;
+	if (unit->state.recentCasualties > 0)
+	{
+		result.morale -= unit->state.recentCasualties * (2.4f - unit->stats.trainingLevel) / 100;
+	}
+	else if (-0.2f < result.morale && result.morale < 1)
+	{
+		result.morale += (0.1f + unit->stats.trainingLevel) / 2000;
+	}
+
+	if (result.morale > -1 && TeamHasAbandondedBattle(unit->GetTeam()))
+	{
+		result.morale -= 1.0f / 250;
+	}
+
+	std::map<int, mass_tree>::const_iterator team = _teamInfluence.find(unit->GetTeam());
+	if (team != _teamInfluence.end())
+	{
+		glm::vec2 center = unit->state.center;
+		float weight = team->second.sum(center.x, center.y, [](float distance) { return 1.0f * 50.0f / (distance + 50.0f); });
+		result.influence -= weight * (1 - unit->stats.trainingLevel);
+	}
+
+	if (unit->state.IsRouting() && !unit->canRally)
+	{
+		result.morale = -1;
+	}
+
+	if (unit->fightersCount <= 8)
+	{
+		result.morale = -1;
+	}
+
+	result.waypoint = MovementRules_NextWaypoint(unit);
+
+	return result;
+}
+
+
+// The part of NextUnitState() that updates the unit command, it runs serially
+// in unit order after the next states are computed.
+void BattleSimulator_v1_0_0::CommitNextUnitState(BattleObjects_v1::Unit* unit)
+{
+	BattleObjects_v1::UnitState& result = unit->nextState;
+
 	if (!unit->command.missileTargetLocked)
 	{
 		unit->command.missileTarget = ClosestEnemyWithinLineOfFire(unit);
@@ -616,70 +1446,48 @@ BattleObjects_v1::UnitState BattleSimulator_v1_0_0::NextUnitState(BattleObjects_
 			&& unit->command.missileTarget
 			&& IsWithinLineOfFire(unit, unit->command.missileTarget->GetCenter()))
 		{
-			++result.shootingCounter;
-		}
-
-		result.loadingTimer = 0;
-		result.loadingDuration = 4 + (rand() % 100) / 200.0f;
-	}
-
-	result.morale = unit->state.morale;
-	if (unit->state.recentCasualties > 0)
-	{
-		result.morale -= unit->state.recentCasualties * (2.4f - unit->stats.trainingLevel) / 100;
-	}
-	else if (-0.2f < result.morale && result.morale < 1)
-	{
-		result.morale += (0.1f + unit->stats.trainingLevel) / 2000;
-	}
-
-	if (result.morale > -1 && TeamHasAbandondedBattle(unit->GetTeam()))
-	{
-		result.morale -= 1.0f / 250;
-	}
-
-	for (BattleObjects_v1::Unit* other : _units)
-	{
-		float distance = glm::length(other->state.center - unit->state.center);
-		float weight = 1.0f * 50.0f / (distance + 50.0f);
-		if (other->GetTeam() == unit->GetTeam())
-		{
-			result.influence -= weight
-					* (1 - other->state.morale)
-					* (1 - unit->stats.trainingLevel)
-					* other->stats.trainingLevel;
-		}
-	}
-
-	if (unit->state.IsRouting() && !unit->canRally)
-	{
-		result.morale = -1;
-	}
+			++result.shootingCounter;
+		}
 
-	if (unit->fightersCount <= 8)
-	{
-		result.morale = -1;
+		result.loadingTimer = 0;
+		result.loadingDuration = 4 + (Random(RandomStream_Loading, unit, 0)[0] % 100) / 200.0f;
 	}
-
-	result.waypoint = MovementRules_NextWaypoint(unit);
-
-	return result;
 }
 
 
 BattleObjects_v1::Unit* BattleSimulator_v1_0_0::ClosestEnemyWithinLineOfFire(BattleObjects_v1::Unit* unit)
 {
+	const BattleObjects::UnitRange& unitRange = unit->unitRange;
+	if (unitRange.minimumRange <= 0 || unitRange.maximumRange <= 0)
+		return nullptr;
+
+	if (!_teamUnitsValid)
+		RebuildTeamUnits();
+
+	// no target is further away than the maximum range
+	float radius = glm::max(unitRange.minimumRange, unitRange.maximumRange);
+
 	BattleObjects_v1::Unit* closestEnemy = 0;
+	int closestIndex = 0;
 	float closestDistance = 10000;
-	for (BattleObjects_v1::Unit* target : _units)
+	for (std::pair<const int, spatial_grid<int>>& team : _teamUnits)
 	{
-		if (target->GetTeam() != unit->GetTeam() && IsWithinLineOfFire(unit, target->state.center))
+		if (team.first == unit->GetTeam())
+			continue;
+
+		for (spatial_grid<int>::iterator i(team.second.find(unitRange.center.x, unitRange.center.y, radius)); *i; ++i)
 		{
-			float distance = glm::length(target->state.center - unit->state.center);
-			if (distance < closestDistance)
+			BattleObjects_v1::Unit* target = _units[**i];
+			if (IsWithinLineOfFire(unit, target->state.center))
 			{
-				closestEnemy = target;
-				closestDistance = distance;
+				// ties go to the first unit in _units, as when scanning all units
+				float distance = glm::length(target->state.center - unit->state.center);
+				if (distance < closestDistance || (distance == closestDistance && **i < closestIndex))
+				{
+					closestEnemy = target;
+					closestIndex = **i;
+					closestDistance = distance;
+				}
 			}
 		}
 	}
@@ -717,6 +1525,15 @@ BattleObjects_v1::UnitMode BattleSimulator_v1_0_0::NextUnitMode(BattleObjects_v1
 }
 
 
+// half the diagonal of the formation
+float BattleSimulator_v1_0_0::GetFormationRadius(BattleObjects_v1::Unit* unit)
+{
+	const BattleObjects::Formation& formation = unit->formation;
+	glm::vec2 size(formation.numberOfFiles * formation.fileDistance, formation.numberOfRanks * formation.rankDistance);
+	return 0.5f * glm::length(size);
+}
+
+
 float BattleSimulator_v1_0_0::NextUnitDirection(BattleObjects_v1::Unit* unit)
 {
 	if (true) // unit->movement
@@ -726,63 +1543,153 @@ float BattleSimulator_v1_0_0::NextUnitDirection(BattleObjects_v1::Unit* unit)
 }
 
 
-BattleObjects_v1::FighterState BattleSimulator_v1_0_0::NextFighterState(BattleObjects_v1::Fighter* fighter)
+void BattleSimulator_v1_0_0::FindFighterNeighbours(FighterNeighbours& neighbours, int begin, int end)
+{
+	const BattleObjects_v1::FighterStates& state = _fighters.state;
+
+	neighbours.first = begin;
+	neighbours.visits = 0;
+	neighbours.query.resize(static_cast<std::size_t>(end - begin));
+	neighbours.points.clear();
+
+	for (int fighter = begin; fighter != end; ++fighter)
+	{
+		BattleObjects_v1::Unit* unit = _fighters.unit[fighter];
+		if (unit != nullptr && IsFighterSimulated(unit) && unit->IsAlive(fighter) && unit->state.unitMode != BattleObjects_v1::UnitMode_Initializing)
+		{
+			neighbours.query[fighter - begin] = static_cast<int>(neighbours.points.size());
+			neighbours.points.push_back(state.position[fighter] + state.velocity[fighter] * _timeStep);
+		}
+		else
+		{
+			neighbours.query[fighter - begin] = -1;
+		}
+	}
+
+	int count = static_cast<int>(neighbours.points.size());
+	const float* xy = count != 0 ? &neighbours.points[0].x : nullptr;
+	FindNeighbours(_fighterQuadTree, xy, count, FighterDistance, neighbours.fighters);
+	FindNeighbours(_weaponQuadTree, xy, count, WeaponDistance, neighbours.weapons);
+
+	// the fighters and enemy weapons around each query, pushed all at once
+	BattleSeparation::Batch& fighterBatch = neighbours.fighterSeparation;
+	BattleSeparation::Batch& weaponBatch = neighbours.weaponSeparation;
+	fighterBatch.Clear();
+	weaponBatch.Clear();
+	for (int fighter = begin; fighter != end; ++fighter)
+	{
+		int query = neighbours.query[fighter - begin];
+		if (query == -1)
+			continue;
+
+		glm::vec2 point = neighbours.points[query];
+		int team = _fighters.unit[fighter]->GetTeam();
+
+		fighterBatch.AddFighter();
+		for (const int* i = neighbours.fighters.begin(query), * e = neighbours.fighters.end(query); i != e; ++i)
+			if (*i != fighter)
+				fighterBatch.AddObstacle(point, state.position[*i], state.position[*i]);
+
+		weaponBatch.AddFighter();
+		for (const int* i = neighbours.weapons.begin(query), * e = neighbours.weapons.end(query); i != e; ++i)
+		{
+			int obstacle = *i;
+			BattleObjects_v1::Unit* obstacleUnit = _fighters.unit[obstacle];
+			if (obstacleUnit->GetTeam() != team)
+			{
+				glm::vec2 r = obstacleUnit->stats.weaponReach * vector2_from_angle(state.bearing[obstacle]);
+				weaponBatch.AddObstacle(point, state.position[obstacle] + r, state.position[obstacle]);
+			}
+		}
+	}
+	fighterBatch.Close();
+	weaponBatch.Close();
+	FighterSeparation.Push(fighterBatch);
+	WeaponSeparation.Push(weaponBatch);
+}
+
+
+void BattleSimulator_v1_0_0::FindNeighbours(FighterIndex& index, const float* xy, int count, float radius, NeighbourLists& result)
+{
+#if defined(OPENWAR_USE_SPATIAL_GRID)
+	result._offsets.resize(static_cast<std::size_t>(count + 1));
+	result._values.clear();
+	result._offsets[0] = 0;
+	result._visits = 0;
+	for (int i = 0; i < count; ++i)
+	{
+		float x = xy[2 * i];
+		float y = xy[2 * i + 1];
+		result._visits += index.cell_count(x, y, radius);
+		for (FighterIndex::iterator j(index.find(x, y, radius)); *j; ++j)
+			result._values.push_back(**j);
+		result._offsets[i + 1] = static_cast<int>(result._values.size());
+	}
+#else
+	index.find_batch(xy, count, radius, result);
+#endif
+}
+
+
+BattleObjects_v1::FighterState BattleSimulator_v1_0_0::NextFighterState(int fighter, FighterNeighbours& neighbours)
 {
-	const BattleObjects_v1::FighterState& original = fighter->state;
+	BattleObjects_v1::Unit* unit = _fighters.unit[fighter];
+	const BattleObjects_v1::FighterState original = _fighters.state.Get(fighter);
+	int opponent = _fighters.Resolve(original.opponent);
 	BattleObjects_v1::FighterState result;
 
 	result.readyState = original.readyState;
-	result.position = NextFighterPosition(fighter);
+	result.position = NextFighterPosition(fighter, neighbours);
 	result.position_z = _battleMap->GetHeightMap()->InterpolateHeight(result.position);
 	result.velocity = NextFighterVelocity(fighter);
 
 
 	// DIRECTION
 
-	if (fighter->GetUnit()->state.unitMode == BattleObjects_v1::UnitMode_Moving)
+	if (unit->state.unitMode == BattleObjects_v1::UnitMode_Moving)
 	{
 		result.bearing = angle(original.velocity);
 	}
-	else if (original.opponent)
+	else if (opponent != -1)
 	{
-		result.bearing = angle(original.opponent->state.position - original.position);
+		result.bearing = angle(_fighters.state.position[opponent] - original.position);
 	}
 	else
 	{
-		result.bearing = fighter->GetUnit()->state.bearing;
+		result.bearing = unit->state.bearing;
 	}
 
 
 	// OPPONENT
 
-	if (original.opponent
-		&& (original.opponent - original.opponent->GetUnit()->fighters) < original.opponent->GetUnit()->fightersCount
-		&& glm::length(original.position - original.opponent->state.position) <= fighter->GetUnit()->stats.weaponReach * 2)
+	if (opponent != -1
+		&& _fighters.unit[opponent]->IsAlive(opponent)
+		&& glm::length(original.position - _fighters.state.position[opponent]) <= unit->stats.weaponReach * 2)
 	{
 		result.opponent = original.opponent;
 	}
-	else if (fighter->GetUnit()->state.unitMode != BattleObjects_v1::UnitMode_Moving && !fighter->GetUnit()->state.IsRouting())
+	else if (unit->state.unitMode != BattleObjects_v1::UnitMode_Moving && !unit->state.IsRouting())
 	{
-		result.opponent = FindFighterStrikingTarget(fighter);
+		result.opponent = _fighters.GetHandle(FindFighterStrikingTarget(fighter, neighbours));
 	}
 
 	// DESTINATION
 
-	result.destination = MovementRules_NextFighterDestination(fighter);
+	result.destination = MovementRules_NextFighterDestination(unit, fighter);
 
 	// READY STATE
 
 	switch (original.readyState)
 	{
 		case BattleObjects_v1::ReadyState_Unready:
-			if (fighter->GetUnit()->command.meleeTarget)
+			if (unit->command.meleeTarget)
 			{
 				result.readyState = BattleObjects_v1::ReadyState_Prepared;
 			}
-			else if (fighter->GetUnit()->state.unitMode == BattleObjects_v1::UnitMode_Standing)
+			else if (unit->state.unitMode == BattleObjects_v1::UnitMode_Standing)
 			{
 				result.readyState = BattleObjects_v1::ReadyState_Readying;
-				result.readyingTimer = fighter->GetUnit()->stats.readyingDuration;
+				result.readyingTimer = unit->stats.readyingDuration;
 			}
 			break;
 
@@ -799,14 +1706,14 @@ BattleObjects_v1::FighterState BattleSimulator_v1_0_0::NextFighterState(BattleOb
 			break;
 
 		case BattleObjects_v1::ReadyState_Prepared:
-			if (fighter->GetUnit()->state.unitMode == BattleObjects_v1::UnitMode_Moving && fighter->GetUnit()->command.meleeTarget == nullptr)
+			if (unit->state.unitMode == BattleObjects_v1::UnitMode_Moving && unit->command.meleeTarget == nullptr)
 			{
 				result.readyState = BattleObjects_v1::ReadyState_Unready;
 			}
-			else if (result.opponent)
+			else if (result.opponent.index != -1)
 			{
 				result.readyState = BattleObjects_v1::ReadyState_Striking;
-				result.strikingTimer = fighter->GetUnit()->stats.strikingDuration;
+				result.strikingTimer = unit->stats.strikingDuration;
 			}
 			break;
 
@@ -821,7 +1728,7 @@ BattleObjects_v1::FighterState BattleSimulator_v1_0_0::NextFighterState(BattleOb
 				result.meleeTarget = original.opponent;
 				result.strikingTimer = 0;
 				result.readyState = BattleObjects_v1::ReadyState_Readying;
-				result.readyingTimer = fighter->GetUnit()->stats.readyingDuration;
+				result.readyingTimer = unit->stats.readyingDuration;
 			}
 			break;
 
@@ -834,7 +1741,7 @@ BattleObjects_v1::FighterState BattleSimulator_v1_0_0::NextFighterState(BattleOb
 			{
 				result.stunnedTimer = 0;
 				result.readyState = BattleObjects_v1::ReadyState_Readying;
-				result.readyingTimer = fighter->GetUnit()->stats.readyingDuration;
+				result.readyingTimer = unit->stats.readyingDuration;
 			}
 			break;
 	}
@@ -843,13 +1750,13 @@ BattleObjects_v1::FighterState BattleSimulator_v1_0_0::NextFighterState(BattleOb
 }
 
 
-glm::vec2 BattleSimulator_v1_0_0::NextFighterPosition(BattleObjects_v1::Fighter* fighter)
+glm::vec2 BattleSimulator_v1_0_0::NextFighterPosition(int fighter, const FighterNeighbours& neighbours)
 {
-	BattleObjects_v1::Unit* unit = fighter->GetUnit();
+	BattleObjects_v1::Unit* unit = _fighters.unit[fighter];
 
 	if (unit->state.unitMode == BattleObjects_v1::UnitMode_Initializing)
 	{
-		FighterAssignment assignment = unit->GetFighterAssignment(static_cast<int>(fighter - unit->fighters));
+		FighterAssignment assignment = unit->GetFighterAssignment(fighter - unit->fighters);
 		glm::vec2 center = unit->state.center;
 		glm::vec2 frontLeft = unit->formation.GetFrontLeft(center);
 		glm::vec2 offsetRight = unit->formation.towardRight * (float)assignment.file;
@@ -858,46 +1765,12 @@ glm::vec2 BattleSimulator_v1_0_0::NextFighterPosition(BattleObjects_v1::Fighter*
 	}
 	else
 	{
-		glm::vec2 result = fighter->state.position + fighter->state.velocity * _timeStep;
+		int query = neighbours.query[fighter - neighbours.first];
+		glm::vec2 result = neighbours.points[query];
 		glm::vec2 adjust;
-		int count = 0;
-
-		const float fighterDistance = 0.9f;
-
-		for (quadtree<BattleObjects_v1::Fighter*>::iterator i(_fighterQuadTree.find(result.x, result.y, fighterDistance)); *i; ++i)
-		{
-			BattleObjects_v1::Fighter* obstacle = **i;
-			if (obstacle != fighter)
-			{
-				glm::vec2 position = obstacle->state.position;
-				glm::vec2 diff = position - result;
-				float distance2 = glm::dot(diff, diff);
-				if (0.01f < distance2 && distance2 < fighterDistance * fighterDistance)
-				{
-					adjust -= glm::normalize(diff) * fighterDistance;
-					++count;
-				}
-			}
-		}
-
-		const float weaponDistance = 0.75f;
 
-		for (quadtree<BattleObjects_v1::Fighter*>::iterator i(_weaponQuadTree.find(result.x, result.y, weaponDistance)); *i; ++i)
-		{
-			BattleObjects_v1::Fighter* obstacle = **i;
-			if (obstacle->GetUnit()->GetTeam() != unit->GetTeam())
-			{
-				glm::vec2 r = obstacle->GetUnit()->stats.weaponReach * vector2_from_angle(obstacle->state.bearing);
-				glm::vec2 position = obstacle->state.position + r;
-				glm::vec2 diff = position - result;
-				if (glm::dot(diff, diff) < weaponDistance * weaponDistance)
-				{
-					diff = obstacle->state.position - result;
-					adjust -= glm::normalize(diff) * weaponDistance;
-					++count;
-				}
-			}
-		}
+		int count = neighbours.fighterSeparation.Accumulate(query, adjust);
+		count += neighbours.weaponSeparation.Accumulate(query, adjust);
 
 		if (count != 0)
 		{
@@ -909,13 +1782,15 @@ glm::vec2 BattleSimulator_v1_0_0::NextFighterPosition(BattleObjects_v1::Fighter*
 }
 
 
-glm::vec2 BattleSimulator_v1_0_0::NextFighterVelocity(BattleObjects_v1::Fighter* fighter)
+glm::vec2 BattleSimulator_v1_0_0::NextFighterVelocity(int fighter)
 {
-	BattleObjects_v1::Unit* unit = fighter->GetUnit();
+	BattleObjects_v1::Unit* unit = _fighters.unit[fighter];
+	const BattleObjects_v1::FighterStates& state = _fighters.state;
 	float speed = unit->GetSpeed();
-	glm::vec2 destination = fighter->state.destination;
+	glm::vec2 position = state.position[fighter];
+	glm::vec2 destination = state.destination[fighter];
 
-	switch (fighter->state.readyState)
+	switch (state.readyState[fighter])
 	{
 		case BattleObjects_v1::ReadyState_Striking:
 			speed = unit->stats.walkingSpeed / 4;
@@ -929,15 +1804,9 @@ glm::vec2 BattleSimulator_v1_0_0::NextFighterVelocity(BattleObjects_v1::Fighter*
 			break;
 	}
 
-	if (_battleMap && glm::length(fighter->state.position - fighter->terrainPosition) > 4)
-	{
-		fighter->terrainForest = _battleMap->GetGroundMap()->IsForest(fighter->state.position);
-		fighter->terrainImpassable = _battleMap->GetGroundMap()->IsImpassable(fighter->state.position);
-		if (!fighter->terrainImpassable)
-			fighter->terrainPosition = fighter->state.position;
-	}
+	UpdateFighterTerrain(fighter);
 
-	if (fighter->terrainForest)
+	if (_fighters.terrainAttributes[fighter] & TerrainAttribute_Forest)
 	{
 		if (unit->stats.platformType == BattleObjects::PlatformType::Cavalry)
 			speed *= 0.5;
@@ -945,10 +1814,10 @@ glm::vec2 BattleSimulator_v1_0_0::NextFighterVelocity(BattleObjects_v1::Fighter*
 			speed *= 0.9;
 	}
 
-	if (fighter->terrainImpassable)
-		destination = fighter->terrainPosition;
+	if (_fighters.terrainAttributes[fighter] & TerrainAttribute_Impassable)
+		destination = _fighters.terrainPosition[fighter];
 
-	glm::vec2 diff = destination - fighter->state.position;
+	glm::vec2 diff = destination - position;
 	float diff_len = glm::dot(diff, diff);
 	if (diff_len < 0.3f)
 		return diff;
@@ -960,23 +1829,34 @@ glm::vec2 BattleSimulator_v1_0_0::NextFighterVelocity(BattleObjects_v1::Fighter*
 }
 
 
-BattleObjects_v1::Fighter* BattleSimulator_v1_0_0::FindFighterStrikingTarget(BattleObjects_v1::Fighter* fighter)
+// The terrain under a fighter is looked up again once it has moved a few meters.
+void BattleSimulator_v1_0_0::UpdateFighterTerrain(int fighter)
+{
+	glm::vec2 position = _fighters.state.position[fighter];
+	if (_attributeMap && glm::length(position - _fighters.terrainPosition[fighter]) > 4)
+	{
+		_fighters.terrainAttributes[fighter] = _attributeMap->GetAttributes(position);
+		if (!(_fighters.terrainAttributes[fighter] & TerrainAttribute_Impassable))
+			_fighters.terrainPosition[fighter] = position;
+	}
+}
+
+
+int BattleSimulator_v1_0_0::FindFighterStrikingTarget(int fighter, FighterNeighbours& neighbours)
 {
-	BattleObjects_v1::Unit* unit = fighter->GetUnit();
+	BattleObjects_v1::Unit* unit = _fighters.unit[fighter];
 
-	glm::vec2 position = fighter->state.position + unit->stats.weaponReach * vector2_from_angle(fighter->state.bearing);
+	glm::vec2 position = _fighters.state.position[fighter] + unit->stats.weaponReach * vector2_from_angle(_fighters.state.bearing[fighter]);
 	float radius = 1.1f;
 
-	for (quadtree<BattleObjects_v1::Fighter*>::iterator i(_fighterQuadTree.find(position.x, position.y, radius)); *i; ++i)
-	{
-		BattleObjects_v1::Fighter* target = **i;
-		if (target != fighter && target->GetUnit()->GetTeam() != unit->GetTeam())
-		{
-			return target;
-		}
-	}
+	// strike the nearest enemy, rather than whichever the search finds first
+	int team = unit->GetTeam();
+	int target = -1;
+	_fighterQuadTree.find_k_nearest_if(position.x, position.y, radius, 1, &target, [this, team](int other) {
+		return _fighters.unit[other]->GetTeam() != team;
+	}, &neighbours.visits);
 
-	return nullptr;
+	return target;
 }
 
 
@@ -1000,12 +1880,74 @@ glm::vec2 BattleSimulator_v1_0_0::MovementRules_NextWaypoint(BattleObjects_v1::U
 
 
 
+// A unit with a destination asks the pathfinder for the flow field to it, and
+// follows the path down the field from PathfindingDelay time steps later, when
+// the field is most likely done. Unless it waits for a late field, see
+// SetPathfindingWaits(), the unit keeps to the command's own path until it is
+// done and looks again the next time step.
+// The path is found again when the unit enters another cell, or is due to be
+// after the terrain it goes through has been painted.
+void BattleSimulator_v1_0_0::MovementRules_FindPaths()
+{
+	bounds2f changed;
+	bool terrainChanged = _pathfinder->Update(changed);
+
+	for (BattleObjects_v1::Unit* unit : _units)
+	{
+		if (unit->command.meleeTarget || unit->command.path.empty())
+		{
+			unit->pathGoal = -1;
+			unit->pathCell = -1;
+			continue;
+		}
+
+		glm::vec2 destination = unit->command.path.back();
+		int goal = _pathfinder->GetCell(destination);
+		if (goal != unit->pathGoal)
+		{
+			unit->pathGoal = goal;
+			unit->pathTick = _tick + PathfindingDelay;
+			unit->pathCell = -1;
+			_pathfinder->Request(unit->state.center, destination);
+			continue;
+		}
+
+		if (terrainChanged && unit->pathCell != -1 && unit->pathTick < _tick)
+		{
+			bounds2f pathBounds(unit->command.path[0]);
+			for (glm::vec2 p : unit->command.path)
+				pathBounds = bounds2f(glm::min(pathBounds.min, p), glm::max(pathBounds.max, p));
+			if (pathBounds.intersects(changed))
+				unit->pathTick = _tick + PathfindingDelay;
+		}
+
+		if (goal == -1 || _tick < unit->pathTick)
+			continue;
+
+		int cell = _pathfinder->GetCell(unit->state.center);
+		if (cell != unit->pathCell || _tick == unit->pathTick)
+		{
+			unit->pathCell = _pathfinder->FindPath(unit->state.center, destination, unit->command.path, _pathfindingWaits) ? cell : -1;
+			unit->asleep = false;
+		}
+	}
+}
+
+
 void BattleSimulator_v1_0_0::MovementRules_AdvanceTime(BattleObjects_v1::Unit* unit, float timeStep)
 {
 	if (unit->command.meleeTarget)
 		unit->command.UpdatePath(unit->state.center, unit->command.meleeTarget->GetCenter());
 	else if (unit->command.path.empty())
 		unit->command.ClearPathAndSetDestination(unit->state.center);
+	else if (unit->pathCell != -1)
+	{
+		// the turns of a found path are kept, not straightened out
+		glm::vec2 destination = unit->command.path.back();
+		BattleObjects::UnitCommand::UpdateMovementPathStart(unit->command.path, unit->state.center);
+		if (unit->command.path.back() != destination)
+			unit->command.path.push_back(destination);
+	}
 	else
 		unit->command.UpdatePath(unit->state.center, unit->command.path.back());
 
@@ -1037,6 +1979,7 @@ void BattleSimulator_v1_0_0::MovementRules_AdvanceTime(BattleObjects_v1::Unit* u
 
 	if (unit->timeUntilSwapFighters <= timeStep)
 	{
+		unit->asleep = false;
 		MovementRules_SwapFighters(unit);
 		unit->timeUntilSwapFighters = 5;
 	}
@@ -1047,140 +1990,711 @@ void BattleSimulator_v1_0_0::MovementRules_AdvanceTime(BattleObjects_v1::Unit* u
 }
 
 
-struct FighterPos
+// Sorts slots that are nearly in order, and gives up, leaving them partly
+// sorted, when that takes more than maxMoves moves. Like std::stable_sort it
+// keeps equal slots in order, so both give the same result.
+template <class T, class Compare>
+static bool InsertionSort(T* begin, T* end, Compare compare, int maxMoves)
 {
-	BattleObjects_v1::Fighter* fighter;
-	BattleObjects_v1::FighterState state;
-	glm::vec2 pos;
-};
-
+	if (begin == end)
+		return true;
 
-static bool SortLeftToRight(const FighterPos& v1, const FighterPos& v2) { return v1.pos.y > v2.pos.y; }
-static bool SortFrontToBack(const FighterPos& v1, const FighterPos& v2) { return v1.pos.x > v2.pos.x; }
+	int moves = 0;
+	for (T* i = begin + 1; i != end; ++i)
+	{
+		T value = *i;
+		T* j = i;
+		for (; j != begin && compare(value, *(j - 1)); --j)
+			*j = *(j - 1);
+		*j = value;
+
+		moves += static_cast<int>(i - j);
+		if (moves > maxMoves)
+			return false;
+	}
+	return true;
+}
 
 
+// Orders the fighters into files from left to right, and each file from
+// front to back. The fighters are already in that order, except where they
+// have moved past each other, so the slots are repaired with an insertion
+// sort, and only fully sorted when the unit has turned so far that most of
+// them have to move. Fighters whose slot is unchanged are not copied.
 void BattleSimulator_v1_0_0::MovementRules_SwapFighters(BattleObjects_v1::Unit* unit)
 {
-	std::vector<FighterPos> fighters;
-
 	float direction = unit->formation._direction;
 
-	BattleObjects_v1::Fighter* fightersEnd = unit->fighters + unit->fightersCount;
+	BattleObjects_v1::FighterStore& store = *unit->fighterStore;
 
-	for (BattleObjects_v1::Fighter* fighter = unit->fighters; fighter != fightersEnd; ++fighter)
+	_fighterSlots.clear();
+	for (int fighter = unit->fighters, end = fighter + unit->fightersCount; fighter != end; ++fighter)
 	{
-		FighterPos fighterPos;
-		fighterPos.fighter = fighter;
-		fighterPos.state = fighter->state;
-		fighterPos.pos = rotate(fighter->state.position, -direction);
-		fighters.push_back(fighterPos);
+		FighterSlot slot;
+		slot.position = rotate(store.state.position[fighter], -direction);
+		slot.fighter = fighter;
+		_fighterSlots.push_back(slot);
 	}
 
-	std::sort(fighters.begin(), fighters.end(), SortLeftToRight);
+	FighterSlot* slots = _fighterSlots.data();
+	int ranks = unit->formation.numberOfRanks;
+	auto leftToRight = [](const FighterSlot& v1, const FighterSlot& v2) { return v1.position.y > v2.position.y; };
+	auto frontToBack = [](const FighterSlot& v1, const FighterSlot& v2) { return v1.position.x > v2.position.x; };
 
-	int index = 0;
-	while (index < unit->fightersCount)
+	// within a file the fighters are ordered front to back, not left to right,
+	// so an unturned unit takes up to ranks / 2 moves per fighter
+	if (!InsertionSort(slots, slots + unit->fightersCount, leftToRight, ranks * unit->fightersCount))
+		std::stable_sort(slots, slots + unit->fightersCount, leftToRight);
+
+	for (int index = 0; index < unit->fightersCount; index += ranks)
+	{
+		int count = glm::min(ranks, unit->fightersCount - index);
+		InsertionSort(slots + index, slots + index + count, frontToBack, std::numeric_limits<int>::max());
+	}
+
+	// each cycle of moved fighters is copied around through one of them
+	for (int index = 0; index < unit->fightersCount; ++index)
 	{
-		int count = unit->fightersCount - index;
-		if (count > unit->formation.numberOfRanks)
-			count = unit->formation.numberOfRanks;
+		int first = unit->fighters + index;
+		if (slots[index].fighter == first)
+			continue;
 
-		std::vector<FighterPos>::iterator begin = fighters.begin() + index;
-		std::sort(begin, begin + count, SortFrontToBack);
-		while (count-- != 0)
+		BattleObjects_v1::FighterState state = store.state.Get(first);
+		glm::vec2 previousPosition = store.previousPosition[first];
+		float previousBearing = store.previousBearing[first];
+
+		int to = first;
+		while (slots[to - unit->fighters].fighter != first)
 		{
-			unit->fighters[index].state = fighters[index].state;
-			++index;
+			int from = slots[to - unit->fighters].fighter;
+			store.state.Copy(to, from);
+			store.previousPosition[to] = store.previousPosition[from];
+			store.previousBearing[to] = store.previousBearing[from];
+			slots[to - unit->fighters].fighter = to;
+			to = from;
 		}
+
+		store.state.Set(to, state);
+		store.previousPosition[to] = previousPosition;
+		store.previousBearing[to] = previousBearing;
+		slots[to - unit->fighters].fighter = to;
 	}
 }
 
 
-glm::vec2 BattleSimulator_v1_0_0::MovementRules_NextFighterDestination(BattleObjects_v1::Fighter* fighter)
+glm::vec2 BattleSimulator_v1_0_0::MovementRules_NextFighterDestination(BattleObjects_v1::Unit* unit, int fighter)
 {
-	BattleObjects_v1::Unit* unit = fighter->GetUnit();
-
 	const BattleObjects_v1::UnitState& unitState = unit->state;
-	const BattleObjects_v1::FighterState& fighterState = fighter->state;
+	const BattleObjects_v1::FighterStates& state = unit->fighterStore->state;
+	glm::vec2 position = state.position[fighter];
 
 	if (unitState.IsRouting())
 	{
 		if (unit->commander->GetTeamPosition() == 1)
-			return glm::vec2(fighterState.position.x * 3, -2000);
+			return glm::vec2(position.x * 3, -2000);
 		else
-			return glm::vec2(fighterState.position.x * 3, 2000);
+			return glm::vec2(position.x * 3, 2000);
 	}
 
-	if (fighterState.opponent)
+	int opponent = unit->fighterStore->Resolve(state.opponent[fighter]);
+	if (opponent != -1)
 	{
-		return fighterState.opponent->state.position
-			- unit->stats.weaponReach * vector2_from_angle(fighterState.bearing);
+		return state.position[opponent]
+			- unit->stats.weaponReach * vector2_from_angle(state.bearing[fighter]);
 	}
 
-	switch (fighterState.readyState)
+	switch (state.readyState[fighter])
 	{
 		case BattleObjects_v1::ReadyState_Striking:
 		case BattleObjects_v1::ReadyState_Stunned:
-			return fighterState.position;
+			return position;
 		default:
 			break;
 	}
 
-	int rank = fighter->GetRank();
-	int file = fighter->GetFile();
-	glm::vec2 destination;
-	if (rank == 0)
+	return unit->fighterStore->formationDestination[fighter];
+}
+
+
+// Solves the formation destinations of all fighters of the unit at once, from
+// the unit and fighter state at the start of the time step.
+void BattleSimulator_v1_0_0::MovementRules_SolveFormation(BattleObjects_v1::Unit* unit)
+{
+	const BattleObjects_v1::UnitState& unitState = unit->state;
+
+	BattleFormationSolver solver;
+	solver.ranks = unit->formation.numberOfRanks;
+	solver.towardRight = unit->formation.towardRight;
+	solver.towardBack = unit->formation.towardBack;
+	if (unitState.unitMode == BattleObjects_v1::UnitMode_Moving)
 	{
-		if (unitState.unitMode == BattleObjects_v1::UnitMode_Moving)
-		{
-			destination = fighterState.position;
-			int n = 1;
-			for (int i = 1; i <= 5; ++i)
-			{
-				BattleObjects_v1::Fighter* other = unit->GetFighter(rank, file - i);
-				if (other == 0)
-					break;
-				destination += other->state.position + (float)i * unit->formation.towardRight;
-				++n;
-			}
-			for (int i = 1; i <= 5; ++i)
-			{
-				BattleObjects_v1::Fighter* other = unit->GetFighter(rank, file + i);
-				if (other == nullptr)
-					break;
-				destination += other->state.position - (float)i * unit->formation.towardRight;
-				++n;
-			}
-			destination /= n;
-			destination -= glm::normalize(unit->formation.towardBack) * unit->GetSpeed();
-		}
-		else if (unitState.unitMode == BattleObjects_v1::UnitMode_Turning)
+		solver.moving = true;
+		solver.lead = glm::normalize(unit->formation.towardBack) * unit->GetSpeed();
+	}
+	else if (unitState.unitMode == BattleObjects_v1::UnitMode_Turning)
+	{
+		solver.frontLeft = unit->formation.GetFrontLeft(unitState.center);
+	}
+	else
+	{
+		solver.frontLeft = unit->formation.GetFrontLeft(unitState.waypoint);
+	}
+
+	BattleObjects_v1::FighterStore& store = *unit->fighterStore;
+	solver.Solve(store.state.position.data() + unit->fighters,
+		store.state.destination.data() + unit->fighters,
+		unit->fightersCount,
+		store.formationDestination.data() + unit->fighters);
+}
+
+
+/***/
+
+
+static const char StateMagic[4] = { 'O', 'W', 'B', 'S' };
+static const int StateVersion = 2;
+
+
+// Appends the bytes of trivially copyable values, vectors of them in one memcpy.
+class StateWriter
+{
+	std::vector<char>& _data;
+
+public:
+	explicit StateWriter(std::vector<char>& data) : _data(data) { }
+
+	void WriteBytes(const void* bytes, std::size_t size)
+	{
+		std::size_t offset = _data.size();
+		_data.resize(offset + size);
+		if (size != 0)
+			std::memcpy(_data.data() + offset, bytes, size);
+	}
+
+	template <class T> void Write(const T& value)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "not trivially copyable");
+		WriteBytes(&value, sizeof(T));
+	}
+
+	template <class T> void WriteVector(const std::vector<T>& values)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "not trivially copyable");
+		Write(static_cast<int>(values.size()));
+		WriteBytes(values.data(), values.size() * sizeof(T));
+	}
+
+	void WriteString(const std::string& value)
+	{
+		Write(static_cast<int>(value.size()));
+		WriteBytes(value.data(), value.size());
+	}
+};
+
+
+// Reads what StateWriter wrote, and fails, rather than reading past the end,
+// on data that is not a state.
+class StateReader
+{
+	const char* _next;
+	const char* _end;
+	bool _failed{};
+
+public:
+	explicit StateReader(const std::vector<char>& data) : _next(data.data()), _end(data.data() + data.size()) { }
+
+	bool IsFailed() const { return _failed; }
+	bool IsAtEnd() const { return _next == _end; }
+	void Fail() { _failed = true; }
+
+	bool ReadBytes(void* bytes, std::size_t size)
+	{
+		if (_failed || static_cast<std::size_t>(_end - _next) < size)
 		{
-			glm::vec2 frontLeft = unit->formation.GetFrontLeft(unitState.center);
-			destination = frontLeft + unit->formation.towardRight * (float)file;
+			_failed = true;
+			return false;
 		}
-		else
+		if (size != 0)
+			std::memcpy(bytes, _next, size);
+		_next += size;
+		return true;
+	}
+
+	template <class T> T Read()
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "not trivially copyable");
+		T result{};
+		ReadBytes(&result, sizeof(T));
+		return result;
+	}
+
+	int ReadCount(std::size_t itemSize)
+	{
+		int count = Read<int>();
+		if (count < 0 || static_cast<std::size_t>(_end - _next) / (itemSize != 0 ? itemSize : 1) < static_cast<std::size_t>(count))
 		{
-			glm::vec2 frontLeft = unit->formation.GetFrontLeft(unitState.waypoint);
-			destination = frontLeft + unit->formation.towardRight * (float)file;
+			_failed = true;
+			return 0;
 		}
+		return count;
 	}
-	else
+
+	template <class T> void ReadVector(std::vector<T>& values)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "not trivially copyable");
+		values.resize(static_cast<std::size_t>(ReadCount(sizeof(T))));
+		ReadBytes(values.data(), values.size() * sizeof(T));
+	}
+
+	std::string ReadString()
+	{
+		std::string result(static_cast<std::size_t>(ReadCount(1)), '\0');
+		ReadBytes(&result[0], result.size());
+		return result;
+	}
+};
+
+
+template <class T> static int IndexOf(const std::vector<T*>& items, const T* item)
+{
+	typename std::vector<T*>::const_iterator i = std::find(items.begin(), items.end(), item);
+	return item != nullptr && i != items.end() ? static_cast<int>(i - items.begin()) : -1;
+}
+
+
+template <class T> static T* ItemAt(const std::vector<T*>& items, int index)
+{
+	return 0 <= index && index < static_cast<int>(items.size()) ? items[index] : nullptr;
+}
+
+
+static void WriteFighterStates(StateWriter& writer, const BattleObjects_v1::FighterStates& states)
+{
+	writer.WriteVector(states.position);
+	writer.WriteVector(states.position_z);
+	writer.WriteVector(states.readyState);
+	writer.WriteVector(states.readyingTimer);
+	writer.WriteVector(states.strikingTimer);
+	writer.WriteVector(states.stunnedTimer);
+	writer.WriteVector(states.opponent);
+	writer.WriteVector(states.destination);
+	writer.WriteVector(states.velocity);
+	writer.WriteVector(states.bearing);
+	writer.WriteVector(states.meleeTarget);
+}
+
+
+static void ReadFighterStates(StateReader& reader, BattleObjects_v1::FighterStates& states, std::size_t size)
+{
+	reader.ReadVector(states.position);
+	reader.ReadVector(states.position_z);
+	reader.ReadVector(states.readyState);
+	reader.ReadVector(states.readyingTimer);
+	reader.ReadVector(states.strikingTimer);
+	reader.ReadVector(states.stunnedTimer);
+	reader.ReadVector(states.opponent);
+	reader.ReadVector(states.destination);
+	reader.ReadVector(states.velocity);
+	reader.ReadVector(states.bearing);
+	reader.ReadVector(states.meleeTarget);
+
+	if (states.position.size() != size || states.position_z.size() != size || states.readyState.size() != size
+		|| states.readyingTimer.size() != size || states.strikingTimer.size() != size || states.stunnedTimer.size() != size
+		|| states.opponent.size() != size || states.destination.size() != size || states.velocity.size() != size
+		|| states.bearing.size() != size || states.meleeTarget.size() != size)
+		reader.Fail();
+}
+
+
+// field by field, it has padding
+static void WriteFighterInputs(StateWriter& writer, const BattleObjects_v1::FighterInputs& inputs, const std::vector<BattleObjects::Unit*>& units)
+{
+	writer.Write(inputs.unitMode);
+	writer.Write(inputs.center);
+	writer.Write(inputs.bearing);
+	writer.Write(inputs.waypoint);
+	writer.Write(inputs.routing);
+	writer.Write(inputs.speed);
+	writer.Write(IndexOf(units, inputs.meleeTarget));
+	writer.Write(inputs.fightersCount);
+	writer.Write(inputs.numberOfRanks);
+	writer.Write(inputs.numberOfFiles);
+	writer.Write(inputs.direction);
+	writer.Write(inputs.heightMapVersion);
+	writer.Write(inputs.attributeMapVersion);
+}
+
+
+static void ReadFighterInputs(StateReader& reader, BattleObjects_v1::FighterInputs& inputs, int& meleeTarget)
+{
+	inputs.unitMode = reader.Read<BattleObjects_v1::UnitMode>();
+	inputs.center = reader.Read<glm::vec2>();
+	inputs.bearing = reader.Read<float>();
+	inputs.waypoint = reader.Read<glm::vec2>();
+	inputs.routing = reader.Read<bool>();
+	inputs.speed = reader.Read<float>();
+	meleeTarget = reader.Read<int>();
+	inputs.fightersCount = reader.Read<int>();
+	inputs.numberOfRanks = reader.Read<int>();
+	inputs.numberOfFiles = reader.Read<int>();
+	inputs.direction = reader.Read<float>();
+	inputs.heightMapVersion = reader.Read<int>();
+	inputs.attributeMapVersion = reader.Read<int>();
+}
+
+
+static void WriteUnitCommand(StateWriter& writer, const BattleObjects::UnitCommand& command, const std::vector<BattleObjects::Unit*>& units)
+{
+	writer.Write(static_cast<int>(command.path.size()));
+	writer.WriteBytes(command.path.begin(), command.path.size() * sizeof(glm::vec2));
+	writer.Write(command.running);
+	writer.Write(command.bearing);
+	writer.Write(IndexOf(units, command.meleeTarget));
+	writer.Write(IndexOf(units, command.missileTarget));
+	writer.Write(command.missileTargetLocked);
+}
+
+
+// the targets are unit indexes until the units have been restored
+static void ReadUnitCommand(StateReader& reader, BattleObjects::UnitCommand& command, int& meleeTarget, int& missileTarget)
+{
+	int count = reader.ReadCount(sizeof(glm::vec2));
+	if (count > BattleObjects::MovementPath::Capacity)
+		reader.Fail();
+	command.path.clear();
+	for (int i = 0; i < count && !reader.IsFailed(); ++i)
+		command.path.push_back(reader.Read<glm::vec2>());
+	command.running = reader.Read<bool>();
+	command.bearing = reader.Read<float>();
+	meleeTarget = reader.Read<int>();
+	missileTarget = reader.Read<int>();
+	command.missileTargetLocked = reader.Read<bool>();
+}
+
+
+void BattleSimulator_v1_0_0::SaveState(std::vector<char>& data, const std::vector<BattleCommander*>& commanders) const
+{
+	data.clear();
+	StateWriter writer(data);
+
+	writer.WriteBytes(StateMagic, sizeof(StateMagic));
+	writer.Write(StateVersion);
+
+	writer.Write(_secondsSinceLastTimeStep);
+	writer.Write(_timeStep);
+	writer.Write(_tick);
+	writer.Write(_nextUnitId);
+	writer.Write(_random.get_seed());
+	writer.Write(_projectileSequence);
+	writer.Write(_projectileTick);
+	writer.Write(_awakeUnitCount);
+	writer.Write(_asleepUnitCount);
+	writer.Write(_aggregateUnitCount);
+
+	writer.Write(static_cast<int>(_kills.size()));
+	for (const std::pair<const int, int>& kills : _kills)
+	{
+		writer.Write(kills.first);
+		writer.Write(kills.second);
+	}
+
+	writer.Write(static_cast<int>(_units.size()));
+	for (const BattleObjects_v1::Unit* unit : _units)
+	{
+		writer.Write(IndexOf(commanders, unit->commander));
+		writer.WriteString(unit->unitClass);
+		writer.Write(unit->deployed);
+		writer.Write(unit->canRally);
+		writer.Write(unit->IsOwnedBySimulator());
+
+		writer.Write(unit->unitId);
+		writer.Write(unit->stats);
+		writer.Write(unit->fighters);
+		writer.Write(unit->fightersCapacity);
+		writer.Write(unit->state);
+		writer.Write(unit->fightersCount);
+		writer.Write(unit->shootingCounter);
+		writer.Write(unit->formation);
+		writer.Write(unit->timeUntilSwapFighters);
+		writer.Write(unit->nextState);
+
+		writer.Write(unit->unitRange.center);
+		writer.Write(unit->unitRange.angleStart);
+		writer.Write(unit->unitRange.angleLength);
+		writer.Write(unit->unitRange.minimumRange);
+		writer.Write(unit->unitRange.maximumRange);
+		writer.WriteVector(unit->unitRange.actualRanges);
+		writer.Write(unit->unitRangeCenter);
+		writer.Write(unit->unitRangeBearing);
+		writer.Write(unit->unitRangeVersion);
+
+		writer.Write(unit->asleep);
+		WriteFighterInputs(writer, unit->asleepInputs, _units_base);
+		writer.Write(unit->asleepRadius);
+		writer.Write(unit->aggregate);
+		writer.Write(unit->aggregateLosses);
+
+		WriteUnitCommand(writer, unit->command, _units_base);
+		WriteUnitCommand(writer, unit->nextCommand, _units_base);
+		writer.Write(unit->nextCommandTimer);
+		writer.Write(unit->pathGoal);
+		writer.Write(unit->pathTick);
+		writer.Write(unit->pathCell);
+	}
+
+	std::vector<int> fighterUnits(_fighters.unit.size());
+	for (std::size_t i = 0; i != fighterUnits.size(); ++i)
+		fighterUnits[i] = _fighters.unit[i] ? _fighters.unit[i]->unitIndex : -1;
+	writer.WriteVector(fighterUnits);
+	writer.WriteVector(_fighters.generation);
+	WriteFighterStates(writer, _fighters.state);
+	writer.WriteVector(_fighters.terrainAttributes);
+	writer.WriteVector(_fighters.terrainPosition);
+	writer.WriteVector(_fighters.previousPosition);
+	writer.WriteVector(_fighters.previousBearing);
+	WriteFighterStates(writer, _fighters.nextState);
+	writer.WriteVector(_fighters.casualty);
+	writer.Write(static_cast<int>(_fighters.freeRanges.size()));
+	for (const std::pair<int, int>& range : _fighters.freeRanges)
+	{
+		writer.Write(range.first);
+		writer.Write(range.second);
+	}
+
+	writer.Write(static_cast<int>(_pendingReleases.size()));
+	for (const PendingRelease& pending : _pendingReleases)
+	{
+		writer.Write(pending.tick);
+		writer.Write(IndexOf(_units_base, pending.shooting.unit));
+		writer.Write(pending.shooting.missileType);
+		writer.Write(pending.shooting.timeToImpact);
+		writer.Write(pending.shooting.target);
+		writer.Write(pending.shooting.released);
+		writer.WriteVector(pending.shooting.projectiles);
+	}
+
+	writer.WriteVector(_projectileImpacts);
+}
+
+
+bool BattleSimulator_v1_0_0::RestoreState(const std::vector<char>& data, const std::vector<BattleCommander*>& commanders)
+{
+	struct UnitReferences
+	{
+		int commandMeleeTarget{-1};
+		int commandMissileTarget{-1};
+		int nextCommandMeleeTarget{-1};
+		int nextCommandMissileTarget{-1};
+		int asleepMeleeTarget{-1};
+	};
+
+	StateReader reader(data);
+
+	char magic[sizeof(StateMagic)];
+	if (!reader.ReadBytes(magic, sizeof(magic)) || std::memcmp(magic, StateMagic, sizeof(magic)) != 0 || reader.Read<int>() != StateVersion)
+		return false;
+
+	// read everything before changing anything, so bad data leaves the simulator as it is
+
+	float secondsSinceLastTimeStep = reader.Read<float>();
+	float timeStep = reader.Read<float>();
+	int tick = reader.Read<int>();
+	int nextUnitId = reader.Read<int>();
+	std::uint64_t seed = reader.Read<std::uint64_t>();
+	int projectileSequence = reader.Read<int>();
+	int projectileTick = reader.Read<int>();
+	int awakeUnitCount = reader.Read<int>();
+	int asleepUnitCount = reader.Read<int>();
+	int aggregateUnitCount = reader.Read<int>();
+
+	std::map<int, int> kills;
+	for (int i = 0, count = reader.ReadCount(2 * sizeof(int)); i != count; ++i)
+	{
+		int team = reader.Read<int>();
+		kills[team] = reader.Read<int>();
+	}
+
+	std::vector<std::unique_ptr<BattleObjects_v1::Unit>> units;
+	std::vector<UnitReferences> references;
+	for (int i = 0, count = reader.ReadCount(1); i != count && !reader.IsFailed(); ++i)
 	{
-		BattleObjects_v1::Fighter* fighterLeft = unit->GetFighter(rank - 1, file - 1);
-		BattleObjects_v1::Fighter* fighterMiddle = unit->GetFighter(rank - 1, file);
-		BattleObjects_v1::Fighter* fighterRight = unit->GetFighter(rank - 1, file + 1);
+		std::unique_ptr<BattleObjects_v1::Unit> unit(new BattleObjects_v1::Unit());
+		UnitReferences refs;
+
+		unit->commander = ItemAt(commanders, reader.Read<int>());
+		if (unit->commander == nullptr)
+			reader.Fail();
+		unit->unitClass = reader.ReadString();
+		unit->deployed = reader.Read<bool>();
+		unit->canRally = reader.Read<bool>();
+		unit->SetOwnedBySimulator(reader.Read<bool>());
+
+		unit->unitId = reader.Read<int>();
+		unit->unitIndex = i;
+		unit->stats = reader.Read<BattleObjects_v1::UnitStats>();
+		unit->fighterStore = &_fighters;
+		unit->fighters = reader.Read<int>();
+		unit->fightersCapacity = reader.Read<int>();
+		unit->state = reader.Read<BattleObjects_v1::UnitState>();
+		unit->fightersCount = reader.Read<int>();
+		unit->shootingCounter = reader.Read<int>();
+		unit->formation = reader.Read<BattleObjects::Formation>();
+		unit->timeUntilSwapFighters = reader.Read<float>();
+		unit->nextState = reader.Read<BattleObjects_v1::UnitState>();
+
+		unit->unitRange.center = reader.Read<glm::vec2>();
+		unit->unitRange.angleStart = reader.Read<float>();
+		unit->unitRange.angleLength = reader.Read<float>();
+		unit->unitRange.minimumRange = reader.Read<float>();
+		unit->unitRange.maximumRange = reader.Read<float>();
+		reader.ReadVector(unit->unitRange.actualRanges);
+		unit->unitRangeCenter = reader.Read<glm::vec2>();
+		unit->unitRangeBearing = reader.Read<float>();
+		unit->unitRangeVersion = reader.Read<int>();
+
+		unit->asleep = reader.Read<bool>();
+		ReadFighterInputs(reader, unit->asleepInputs, refs.asleepMeleeTarget);
+		unit->asleepRadius = reader.Read<float>();
+		unit->aggregate = reader.Read<bool>();
+		unit->aggregateLosses = reader.Read<float>();
+
+		ReadUnitCommand(reader, unit->command, refs.commandMeleeTarget, refs.commandMissileTarget);
+		ReadUnitCommand(reader, unit->nextCommand, refs.nextCommandMeleeTarget, refs.nextCommandMissileTarget);
+		unit->nextCommandTimer = reader.Read<float>();
+		unit->pathGoal = reader.Read<int>();
+		unit->pathTick = reader.Read<int>();
+		unit->pathCell = reader.Read<int>();
+
+		units.push_back(std::move(unit));
+		references.push_back(refs);
+	}
+
+	FighterStore fighters;
+	std::vector<int> fighterUnits;
+	reader.ReadVector(fighterUnits);
+	std::size_t fighterCount = fighterUnits.size();
+	reader.ReadVector(fighters.generation);
+	ReadFighterStates(reader, fighters.state, fighterCount);
+	reader.ReadVector(fighters.terrainAttributes);
+	reader.ReadVector(fighters.terrainPosition);
+	reader.ReadVector(fighters.previousPosition);
+	reader.ReadVector(fighters.previousBearing);
+	ReadFighterStates(reader, fighters.nextState, fighterCount);
+	reader.ReadVector(fighters.casualty);
+	for (int i = 0, count = reader.ReadCount(2 * sizeof(int)); i != count; ++i)
+	{
+		int first = reader.Read<int>();
+		fighters.freeRanges.push_back(std::make_pair(first, reader.Read<int>()));
+	}
+	if (fighters.generation.size() != fighterCount || fighters.terrainAttributes.size() != fighterCount
+		|| fighters.terrainPosition.size() != fighterCount || fighters.previousPosition.size() != fighterCount
+		|| fighters.previousBearing.size() != fighterCount || fighters.casualty.size() != fighterCount)
+		reader.Fail();
+	fighters.formationDestination.assign(fighterCount, glm::vec2{}); // not saved, solved again every time step
+
+	std::vector<PendingRelease> pendingReleases;
+	std::vector<int> pendingReleaseUnits;
+	for (int i = 0, count = reader.ReadCount(1); i != count && !reader.IsFailed(); ++i)
+	{
+		PendingRelease pending;
+		pending.tick = reader.Read<int>();
+		pendingReleaseUnits.push_back(reader.Read<int>());
+		pending.shooting.missileType = reader.Read<MissileType>();
+		pending.shooting.timeToImpact = reader.Read<float>();
+		pending.shooting.target = reader.Read<glm::vec2>();
+		pending.shooting.released = reader.Read<bool>();
+		reader.ReadVector(pending.shooting.projectiles);
+		pendingReleases.push_back(pending);
+	}
+
+	std::vector<ProjectileImpact> projectileImpacts;
+	reader.ReadVector(projectileImpacts);
+
+	int unitCount = static_cast<int>(units.size());
+	for (const std::unique_ptr<BattleObjects_v1::Unit>& unit : units)
+		if (unit->fighters < 0 || unit->fightersCount < 0 || unit->fightersCount > unit->fightersCapacity
+			|| static_cast<std::size_t>(unit->fighters + unit->fightersCapacity) > fighterCount)
+			reader.Fail();
+	for (int index : fighterUnits)
+		if (index < -1 || index >= unitCount)
+			reader.Fail();
+	if (reader.IsFailed() || !reader.IsAtEnd())
+		return false;
 
-		if (fighterLeft == nullptr || fighterRight == nullptr)
+	// units with the same id keep their objects, so pointers to them stay valid
+
+	std::map<int, BattleObjects_v1::Unit*> existing;
+	for (BattleObjects_v1::Unit* unit : _units)
+		existing[unit->unitId] = unit;
+
+	std::vector<BattleObjects_v1::Unit*> restored;
+	std::vector<BattleObjects_v1::Unit*> added;
+	for (std::unique_ptr<BattleObjects_v1::Unit>& unit : units)
+	{
+		std::map<int, BattleObjects_v1::Unit*>::iterator i = existing.find(unit->unitId);
+		if (i != existing.end())
 		{
-			destination = fighterMiddle->state.destination;
+			*i->second = *unit;
+			restored.push_back(i->second);
+			existing.erase(i);
 		}
 		else
 		{
-			destination = (fighterLeft->state.destination + fighterRight->state.destination) / 2.0f;
+			restored.push_back(unit.release());
+			added.push_back(restored.back());
 		}
-		destination += unit->formation.towardBack;
 	}
 
-	return destination;
+	for (const std::pair<const int, BattleObjects_v1::Unit*>& i : existing)
+	{
+		NotifyRemoveUnit(i.second);
+		delete i.second;
+	}
+
+	_units = restored;
+	_units_base.assign(restored.begin(), restored.end());
+
+	for (int i = 0; i != unitCount; ++i)
+	{
+		BattleObjects_v1::Unit* unit = _units[i];
+		const UnitReferences& refs = references[i];
+		unit->command.meleeTarget = ItemAt(_units_base, refs.commandMeleeTarget);
+		unit->command.missileTarget = ItemAt(_units_base, refs.commandMissileTarget);
+		unit->nextCommand.meleeTarget = ItemAt(_units_base, refs.nextCommandMeleeTarget);
+		unit->nextCommand.missileTarget = ItemAt(_units_base, refs.nextCommandMissileTarget);
+		unit->asleepInputs.meleeTarget = ItemAt(_units_base, refs.asleepMeleeTarget);
+	}
+
+	fighters.unit.resize(fighterCount);
+	for (std::size_t i = 0; i != fighterCount; ++i)
+		fighters.unit[i] = ItemAt(_units, fighterUnits[i]);
+	_fighters = std::move(fighters);
+
+	for (std::size_t i = 0; i != pendingReleases.size(); ++i)
+		pendingReleases[i].shooting.unit = ItemAt(_units_base, pendingReleaseUnits[i]);
+	_pendingReleases = std::move(pendingReleases);
+	_projectileImpacts = std::move(projectileImpacts);
+
+	_secondsSinceLastTimeStep = secondsSinceLastTimeStep;
+	_timeStep = timeStep;
+	_tick = tick;
+	_nextUnitId = nextUnitId;
+	_random.set_seed(seed);
+	_projectileSequence = projectileSequence;
+	_projectileTick = projectileTick;
+	_awakeUnitCount = awakeUnitCount;
+	_asleepUnitCount = asleepUnitCount;
+	_aggregateUnitCount = aggregateUnitCount;
+	_kills = kills;
+
+	RebuildQuadTree();
+	RebuildTeamInfluence();
+	_teamUnitsValid = false;
+
+	for (BattleObjects_v1::Unit* unit : added)
+		NotifyAddUnit(unit);
+	for (BattleObjects_v1::Unit* unit : _units)
+		NotifyCommand(unit, 0);
+
+	return true;
 }
@@ -5,35 +5,212 @@
 #ifndef BattleSimulator_v1_0_0_H
 #define BattleSimulator_v1_0_0_H
 
+#include <functional>
 #include <map>
+#include <memory>
 #include <set>
 #include <string>
+#include "Algorithms/counter_rng.h"
+#include "Algorithms/mass_tree.h"
 #include "Algorithms/quadtree.h"
+#include "Algorithms/spatial_grid.h"
+#include "Algorithms/thread_pool.h"
 #include "BattleMap/GroundMap.h"
+#include "BattleFormationSolver.h"
 #include "BattleObjects_v1.h"
+#include "BattlePathfinder.h"
+#include "BattleSeparation.h"
 #include "BattleSimulator.h"
 
 
 
 class BattleSimulator_v1_0_0 : public BattleSimulator, public BattleObjects_v1
 {
-	quadtree<BattleObjects_v1::Fighter*> _fighterQuadTree{0, 0, 1024, 1024};
-	quadtree<BattleObjects_v1::Fighter*> _weaponQuadTree{0, 0, 1024, 1024};
+public:
+	// When to run a unit as one formation body, see NextAggregateState(). The
+	// distances are between formation edges, and the expand distances are shorter
+	// than the collapse ones so a unit does not switch back and forth.
+	struct AggregateSettings
+	{
+		bool enabled{};
+		float collapseViewpointDistance{400}; // collapse when farther from every viewpoint than this
+		float expandViewpointDistance{300};
+		float collapseContactDistance{120}; // and farther from every enemy than this
+		float expandContactDistance{80};
+	};
+
+private:
+	struct QuadTreeBuilder
+	{
+		std::vector<glm::vec2> points{};
+		std::vector<int> fighters{};
+		std::vector<int> partitions{};
+		std::vector<int> offsets{};
+		std::vector<int> cursors{};
+		std::vector<int> order{};
+
+		void Clear();
+		void Add(glm::vec2 point, int fighter);
+		int Partition(quadtree<int>& quadtree);
+		void Insert(quadtree<int>& quadtree, int partition) const;
+	};
+
+#if defined(OPENWAR_USE_SPATIAL_GRID)
+	typedef spatial_grid<int> FighterIndex;
+
+	// Neighbour lists of a range of query points, searched one at a time, see
+	// FindNeighbours(). With about one fighter per cell, the cells shared by
+	// consecutive queries do not pay for gathering them in one search.
+	class NeighbourLists
+	{
+		friend class BattleSimulator_v1_0_0;
+		std::vector<int> _offsets;
+		std::vector<int> _values;
+		int _visits{};
+
+	public:
+		int visits() const { return _visits; } // cells visited by the last search
+		int size() const { return _offsets.empty() ? 0 : static_cast<int>(_offsets.size()) - 1; }
+		const int* begin(int query) const { return _values.data() + _offsets[query]; }
+		const int* end(int query) const { return _values.data() + _offsets[query + 1]; }
+	};
+#else
+	typedef quadtree<int> FighterIndex;
+	typedef quadtree<int>::batch NeighbourLists;
+#endif
 
-	std::vector<std::pair<float, BattleObjects::Shooting>> _shootings{};
+	// Neighbours of a consecutive range of fighters, found with one search of
+	// each index. Fighters of the same unit are consecutive and close to each
+	// other, so the queries are already grouped by node.
+	struct FighterNeighbours
+	{
+		int first{};
+		std::vector<int> query{}; // per fighter from first, -1 if not searched
+		std::vector<glm::vec2> points{};
+		NeighbourLists fighters{};
+		NeighbourLists weapons{};
+		int visits{}; // index nodes visited by FindFighterStrikingTarget
+		BattleSeparation::Batch fighterSeparation{}; // per query, see NextFighterPosition
+		BattleSeparation::Batch weaponSeparation{};
+	};
+
+	struct ProjectileImpact
+	{
+		int tick{}; // time step of the impact
+		int sequence{}; // order of release, orders the impacts of a time step
+		glm::vec2 position{};
+
+		static bool IsLater(const ProjectileImpact& a, const ProjectileImpact& b)
+		{
+			return a.tick != b.tick ? a.tick > b.tick : a.sequence > b.sequence;
+		}
+	};
+
+	struct FighterSlot
+	{
+		glm::vec2 position{}; // in formation coordinates, the front is +x and the left +y
+		int fighter{}; // the one to move into the slot
+	};
+
+	struct PendingRelease
+	{
+		int tick{}; // time step of the release
+		BattleObjects::Shooting shooting{};
+	};
+
+	FighterIndex _fighterQuadTree{0, 0, 1024, 1024};
+	FighterIndex _weaponQuadTree{0, 0, 1024, 1024};
+	QuadTreeBuilder _fighterQuadTreeBuilder{};
+	QuadTreeBuilder _weaponQuadTreeBuilder{};
+	std::vector<FighterNeighbours> _fighterNeighbours{}; // one per chunk of FighterChunkSize fighters
+	std::vector<glm::vec2> _projectileHitpoints{};
+	std::vector<glm::vec2> _casualtyPositions{}; // of the unit being processed by RemoveCasualties
+	std::vector<FighterSlot> _fighterSlots{}; // of the unit being processed by MovementRules_SwapFighters
+	NeighbourLists _projectileHits{};
+	std::map<int, mass_tree> _teamInfluence{}; // morale weight of each team's units
+	std::map<int, spatial_grid<int>> _teamUnits{}; // index in _units of each team's units
+	bool _teamUnitsValid{};
+	std::unique_ptr<thread_pool> _threadPool{};
+	const TerrainAttributeMap* _attributeMap{}; // of the battle map's ground map
+	std::unique_ptr<BattlePathfinder> _pathfinder{}; // when pathfinding
+	bool _pathfindingWaits{};
+
+	std::vector<PendingRelease> _pendingReleases{}; // in the order they were added
+	std::vector<ProjectileImpact> _projectileImpacts{}; // min-heap on tick, then sequence
+	int _projectileSequence{};
+	int _projectileTick{}; // the last time step whose impacts have been resolved
 	std::map<int, int> _kills{};
 
+	bool _unitSleeping{true};
+	int _awakeUnitCount{};
+	int _asleepUnitCount{};
+
+	AggregateSettings _aggregateSettings{};
+	int _aggregateUnitCount{};
+
 	float _secondsSinceLastTimeStep{};
 	float _timeStep{1.0f / 15.0f};
+	int _tick{}; // time steps simulated
+	int _nextUnitId{};
+	counter_rng _random{};
 
 public:
 	BattleSimulator_v1_0_0(std::shared_ptr<BattleMap> battleMap);
 	~BattleSimulator_v1_0_0();
 
+	float GetTimeStep() const override { return _timeStep; }
+	float GetInterpolationAlpha() const override { return _secondsSinceLastTimeStep / _timeStep; }
 	void AdvanceTime(float secondsSinceLastTime) override;
 
 	int GetKills(int team) override { return _kills[team]; }
 
+	// total number of simulation threads, zero means one per hardware thread
+	void SetThreadCount(int value);
+	int GetThreadCount() const { return _threadPool ? _threadPool->size() : 1; }
+
+	int GetTick() const { return _tick; } // time steps simulated
+
+	// all random numbers of the simulation are drawn from this seed
+	void SetRandomSeed(std::uint64_t value) { _random.set_seed(value); }
+	std::uint64_t GetRandomSeed() const { return _random.get_seed(); }
+
+	// settled units with no other fighters near sleep, their fighters are not updated
+	void SetUnitSleeping(bool value) { _unitSleeping = value; }
+	bool IsUnitSleeping() const { return _unitSleeping; }
+	int GetAwakeUnitCount() const { return _awakeUnitCount; } // in the last time step
+	int GetAsleepUnitCount() const { return _asleepUnitCount; }
+
+	// units far from contact and from every viewpoint run as one formation body
+	void SetAggregateSettings(const AggregateSettings& value) { _aggregateSettings = value; }
+	const AggregateSettings& GetAggregateSettings() const { return _aggregateSettings; }
+	int GetAggregateUnitCount() const { return _aggregateUnitCount; } // in the last time step
+
+	// units find their way around impassable terrain and water, from a few time
+	// steps after they are given a destination, or once the way there is found
+	// if that takes longer; until then they go straight
+	void SetPathfinding(bool value);
+	bool IsPathfinding() const { return _pathfinder != nullptr; }
+
+	// the time step waits for a way that is not found a few time steps after the
+	// destination was given, so the simulation does not depend on how long it
+	// takes; for runs that must be reproducible, like replays
+	void SetPathfindingWaits(bool value) { _pathfindingWaits = value; }
+	bool IsPathfindingWaits() const { return _pathfindingWaits; }
+	const BattlePathfinder* GetPathfinder() const { return _pathfinder.get(); }
+
+	// The whole state of the battle as bytes, with the units written as indexes and
+	// the commanders as indexes in commanders. The settings, like the thread count,
+	// the unit sleeping, the aggregate settings and pathfinding, are not part of the state.
+	void SaveState(std::vector<char>& data, const std::vector<BattleCommander*>& commanders) const;
+
+	// Units in the state with the id of a current unit keep its object, the other
+	// current units are removed. Returns false, and changes nothing, if the data
+	// is not a state or refers to a commander not in commanders.
+	bool RestoreState(const std::vector<char>& data, const std::vector<BattleCommander*>& commanders);
+
+	// number of times the fighter indexes have allocated memory, stops growing once warmed up
+	int GetFighterIndexAllocations() const { return _fighterQuadTree.allocation_count() + _weaponQuadTree.allocation_count(); }
+
 	BattleObjects::Unit* AddUnit(BattleCommander* commander, const char* unitClass, int numberOfFighters, glm::vec2 position, float bearing) override;
 	void DeployUnit(BattleObjects::Unit* unit, glm::vec2 position, float bearing) override;
 	void RemoveUnit(BattleObjects::Unit* unit) override;
@@ -44,11 +221,34 @@ public:
 	void AddShooting(const BattleObjects::Shooting& shooting, float timer) override;
 
 private:
+	void DeleteUnit(BattleObjects_v1::Unit* unit);
+	void ApplyUnitCommand(BattleObjects_v1::Unit* unit, const BattleObjects::UnitCommand& command, float timer);
+
 	void SimulateOneTimeStep();
+	counter_rng::result_type Random(int stream, const BattleObjects_v1::Unit* unit, int index, int draw = 0) const;
+	void ParallelFor(int count, int grain, const std::function<void(int, int)>& body);
 
 	void RebuildQuadTree();
+#if !defined(OPENWAR_USE_SPATIAL_GRID)
+	void RebuildQuadTreeParallel();
+#endif
+
+	void RebuildTeamInfluence();
+	void RebuildTeamUnits();
 
 	void ComputeNextState();
+	void WakeUnit(BattleObjects_v1::Unit* unit);
+	void SleepUnit(BattleObjects_v1::Unit* unit);
+	BattleObjects_v1::FighterInputs GetFighterInputs(BattleObjects_v1::Unit* unit) const;
+	bool IsFighterStateSettled(BattleObjects_v1::Unit* unit) const;
+	bool IsEnemyNear(BattleObjects_v1::Unit* unit, float radius);
+	bool IsMovingFriendInContact(BattleObjects_v1::Unit* unit, float radius);
+
+	void UpdateUnitDetail(BattleObjects_v1::Unit* unit, float maxRadius);
+	float GetViewpointDistance(BattleObjects_v1::Unit* unit) const;
+	float GetContactDistance(BattleObjects_v1::Unit* unit, float maxRadius, float limit);
+	void NextAggregateState(BattleObjects_v1::Unit* unit);
+	void ResolveAttrition(BattleObjects_v1::Unit* unit, BattleObjects_v1::Unit* target);
 	void AssignNextState();
 	void UpdateUnitRange(BattleObjects_v1::Unit* unit);
 
@@ -60,25 +260,31 @@ private:
 
 	void RemoveCasualties();
 	void RemoveDeadUnits();
-	void RemoveFinishedShootings();
 
 	BattleObjects_v1::UnitState NextUnitState(BattleObjects_v1::Unit* unit);
+	void CommitNextUnitState(BattleObjects_v1::Unit* unit);
 	BattleObjects_v1::UnitMode NextUnitMode(BattleObjects_v1::Unit* unit);
 	float NextUnitDirection(BattleObjects_v1::Unit* unit);
 
-	BattleObjects_v1::FighterState NextFighterState(BattleObjects_v1::Fighter* fighter);
-	glm::vec2 NextFighterPosition(BattleObjects_v1::Fighter* fighter);
-	glm::vec2 NextFighterVelocity(BattleObjects_v1::Fighter* fighter);
+	void FindFighterNeighbours(FighterNeighbours& neighbours, int begin, int end);
+	static void FindNeighbours(FighterIndex& index, const float* xy, int count, float radius, NeighbourLists& result);
+	BattleObjects_v1::FighterState NextFighterState(int fighter, FighterNeighbours& neighbours);
+	glm::vec2 NextFighterPosition(int fighter, const FighterNeighbours& neighbours);
+	glm::vec2 NextFighterVelocity(int fighter);
+	void UpdateFighterTerrain(int fighter);
 
-	BattleObjects_v1::Fighter* FindFighterStrikingTarget(BattleObjects_v1::Fighter* fighter);
+	int FindFighterStrikingTarget(int fighter, FighterNeighbours& neighbours);
 
 	bool IsWithinLineOfFire(BattleObjects_v1::Unit* unit, glm::vec2 position);
 	BattleObjects_v1::Unit* ClosestEnemyWithinLineOfFire(BattleObjects_v1::Unit* unit);
 
-	static void MovementRules_AdvanceTime(BattleObjects_v1::Unit* unit, float timeStep);
-	static void MovementRules_SwapFighters(BattleObjects_v1::Unit* unit);
-	static glm::vec2 MovementRules_NextFighterDestination(BattleObjects_v1::Fighter* fighter);
+	void MovementRules_FindPaths();
+	void MovementRules_AdvanceTime(BattleObjects_v1::Unit* unit, float timeStep);
+	void MovementRules_SwapFighters(BattleObjects_v1::Unit* unit);
+	static glm::vec2 MovementRules_NextFighterDestination(BattleObjects_v1::Unit* unit, int fighter);
+	static void MovementRules_SolveFormation(BattleObjects_v1::Unit* unit);
 	static glm::vec2 MovementRules_NextWaypoint(BattleObjects_v1::Unit* unit);
+	static float GetFormationRadius(BattleObjects_v1::Unit* unit);
 };
 
 
@@ -0,0 +1,126 @@
+// Copyright (C) 2016 Felix Ungman
+//
+// This file is part of the openwar platform (GPL v3 or later), see LICENSE.txt
+
+#include "BattleSnapshot.h"
+#include "BattleScenario.h"
+
+
+void BattleSnapshot::Capture(const BattleObjects& battleObjects, int tickValue)
+{
+	tick = tickValue;
+	fighters.clear();
+	previousFighters.clear();
+	fighterAssignments.clear();
+	pathPoints.clear();
+
+	// assigned in place, so the strings, paths and ranges keep their capacity
+	const std::vector<BattleObjects::Unit*>& battleUnits = battleObjects.GetUnits();
+	units.resize(battleUnits.size());
+	unitIndex.clear();
+
+	for (std::size_t i = 0; i < battleUnits.size(); ++i)
+	{
+		BattleObjects::Unit* unit = battleUnits[i];
+		Unit& u = units[i];
+		unitIndex[unit] = static_cast<int>(i);
+		u.unit = unit;
+		u.unitId = unit->GetUnitId();
+		u.commander = unit->commander;
+		u.unitClass = unit->unitClass;
+		u.team = unit->GetTeam();
+		u.deployed = unit->deployed;
+		u.platformType = unit->GetPlatformType();
+		u.center = unit->GetCenter();
+		u.bearing = unit->GetBearing();
+		u.effectiveMorale = unit->GetEffectiveMorale();
+		u.routing = unit->IsRouting();
+		u.standing = unit->IsStanding();
+		u.moving = unit->IsMoving();
+		u.inMelee = unit->IsInMelee();
+		u.loadingProgress = unit->GetLoadingProgress();
+		CaptureCommand(u.issuedCommand, unit->GetIssuedCommand());
+		u.currentDestination = unit->GetCurrentCommand().GetDestination();
+		u.currentRunning = unit->GetCurrentCommand().running;
+		u.weaponReach = unit->GetWeaponReach();
+		u.missileWeaponRange = unit->GetMissileWeaponRange();
+		u.formation = unit->GetFormation();
+		u.firstFighter = static_cast<int>(fighters.size());
+		u.fighterCount = unit->GetFighterCount();
+
+		for (int index = 0; index < u.fighterCount; ++index)
+		{
+			fighters.push_back(unit->GetFighterPosition(index));
+			previousFighters.push_back(unit->GetPreviousFighterPosition(index));
+			fighterAssignments.push_back(unit->GetFighterAssignment(index));
+		}
+	}
+}
+
+
+void BattleSnapshot::CaptureCommand(Command& result, const BattleObjects::UnitCommand& command)
+{
+	result.firstPathPoint = static_cast<int>(pathPoints.size());
+	result.pathSize = static_cast<int>(command.path.size());
+	pathPoints.insert(pathPoints.end(), command.path.begin(), command.path.end());
+	result.destination = command.GetDestination();
+	result.running = command.running;
+	result.bearing = command.bearing;
+	result.meleeTarget = command.meleeTarget;
+	result.missileTarget = command.missileTarget;
+	result.missileTargetLocked = command.missileTargetLocked;
+}
+
+
+void BattleSnapshot::CaptureScenario(const BattleScenario& battleScenario)
+{
+	winnerTeam = battleScenario.GetWinnerTeam();
+	deploymentZones[0] = battleScenario.GetDeploymentZone(1);
+	deploymentZones[1] = battleScenario.GetDeploymentZone(2);
+}
+
+
+const BattleSnapshot::Unit* BattleSnapshot::FindUnit(const BattleObjects::Unit* unit) const
+{
+	std::unordered_map<const BattleObjects::Unit*, int>::const_iterator i = unitIndex.find(unit);
+	return i != unitIndex.end() ? &units[i->second] : nullptr;
+}
+
+
+BattleObjects::MovementPath BattleSnapshot::GetMovementPath(const Command& command) const
+{
+	BattleObjects::MovementPath result;
+	for (const glm::vec2* p = GetPathPoints(command), * end = p + command.pathSize; p != end; ++p)
+		result.push_back(*p);
+	return result;
+}
+
+
+BattleObjects::FighterPosition BattleSnapshot::GetInterpolatedFighter(int index, float alpha) const
+{
+	return BattleObjects::FighterPosition::Interpolate(previousFighters[index], fighters[index], alpha);
+}
+
+
+int BattleSnapshot::CountCavalryInMelee() const
+{
+	int result = 0;
+
+	for (const Unit& u : units)
+		if (u.platformType == BattleObjects::PlatformType::Cavalry && u.inMelee)
+			++result;
+
+	return result;
+}
+
+
+int BattleSnapshot::CountInfantryInMelee() const
+{
+	int result = 0;
+
+	for (const Unit& u : units)
+		if (u.platformType == BattleObjects::PlatformType::Infantry && u.inMelee)
+			++result;
+
+	return result;
+}
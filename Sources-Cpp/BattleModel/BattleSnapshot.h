@@ -0,0 +1,126 @@
+// Copyright (C) 2016 Felix Ungman
+//
+// This file is part of the openwar platform (GPL v3 or later), see LICENSE.txt
+
+#ifndef BattleSnapshot_H
+#define BattleSnapshot_H
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "BattleObjects.h"
+
+class BattleScenario;
+
+
+enum BattleEventType
+{
+	BattleEventType_AddUnit,
+	BattleEventType_RemoveUnit,
+	BattleEventType_Command,
+	BattleEventType_Shooting,
+	BattleEventType_Release,
+	BattleEventType_Casualties,
+	BattleEventType_Routing
+};
+
+
+// What happened to the observers of a simulator, in the order it happened.
+// The unit is only an identity, it may have been removed from the simulator
+// and deleted, so it must not be dereferenced.
+
+struct BattleEvent
+{
+	int sequence{}; // increases by one for each event
+	BattleEventType type{};
+	BattleObjects::Unit* unit{};
+	int firstCasualty{}; // in the casualties of the snapshot
+	int casualtyCount{};
+	float timer{}; // of the command or shooting
+	BattleObjects::Shooting shooting{}; // of the shooting or release
+};
+
+
+// The state of the units of a simulator after a time step, copied so that another
+// thread can read it while the simulator goes on. The units are only identities
+// for finding units and for commanding them, the simulator may delete them while
+// the snapshot is read, so they must not be dereferenced after Capture().
+
+struct BattleSnapshot
+{
+	// the part of an issued command that the views use, its path is only the
+	// waypoints that remain
+	struct Command
+	{
+		int firstPathPoint{}; // in pathPoints
+		int pathSize{};
+		glm::vec2 destination{}; // of UnitCommand::GetDestination()
+		bool running{};
+		float bearing{};
+		BattleObjects::Unit* meleeTarget{};
+		BattleObjects::Unit* missileTarget{}; // the unit itself to hold fire
+		bool missileTargetLocked{};
+	};
+
+	struct Unit
+	{
+		BattleObjects::Unit* unit{};
+		int unitId{};
+		BattleCommander* commander{};
+		std::string unitClass{};
+		int team{};
+		bool deployed{};
+		BattleObjects::PlatformType platformType{};
+		glm::vec2 center{};
+		float bearing{};
+		float effectiveMorale{};
+		bool routing{};
+		bool standing{};
+		bool moving{};
+		bool inMelee{};
+		std::pair<bool, float> loadingProgress{};
+		Command issuedCommand{};
+		glm::vec2 currentDestination{};
+		bool currentRunning{};
+		float weaponReach{};
+		BattleObjects::UnitRange missileWeaponRange{};
+		BattleObjects::Formation formation{};
+		int firstFighter{}; // in fighters
+		int fighterCount{};
+	};
+
+	int tick{}; // time steps simulated
+	std::vector<Unit> units{};
+	std::unordered_map<const BattleObjects::Unit*, int> unitIndex{}; // in units, for FindUnit()
+	std::vector<BattleObjects::FighterPosition> fighters{};
+	std::vector<BattleObjects::FighterPosition> previousFighters{}; // at the start of the last time step
+	std::vector<BattleObjects::FighterAssignment> fighterAssignments{};
+	std::vector<glm::vec2> pathPoints{}; // of the issued commands
+	std::vector<BattleEvent> events{}; // not yet known to have been read, oldest first
+	std::vector<glm::vec2> casualties{}; // of the events
+
+	// of the scenario, if the snapshot was captured with one
+	int winnerTeam{};
+	std::pair<glm::vec2, float> deploymentZones[2]{};
+
+	// reuses the capacity of the vectors, leaves the events alone
+	void Capture(const BattleObjects& battleObjects, int tickValue);
+	void CaptureScenario(const BattleScenario& battleScenario);
+
+	const Unit* FindUnit(const BattleObjects::Unit* unit) const;
+	const glm::vec2* GetPathPoints(const Command& command) const { return pathPoints.data() + command.firstPathPoint; }
+	BattleObjects::MovementPath GetMovementPath(const Command& command) const;
+	std::pair<glm::vec2, float> GetDeploymentZone(int team) const { return deploymentZones[team == 1 ? 0 : 1]; }
+	BattleObjects::FighterPosition GetInterpolatedFighter(int index, float alpha) const;
+
+	int CountCavalryInMelee() const;
+	int CountInfantryInMelee() const;
+
+private:
+	void CaptureCommand(Command& result, const BattleObjects::UnitCommand& command);
+};
+
+
+#endif
@@ -15,6 +15,14 @@ MonkeyScript::MonkeyScript(BattleScenario* battleScenario) :
 }
 
 
+MonkeyScript::MonkeyScript(BattleScenario* battleScenario, BattleCommander* commander) :
+	_battleScenario{battleScenario},
+	_battleSimulator{battleScenario->GetBattleSimulator()},
+	_commander{commander}
+{
+}
+
+
 /*static int random_int(int min, int max)
 {
 	return min + (int)glm::linearRand<float>(0, max - min);
@@ -93,13 +101,14 @@ static glm::vec2 FindClusterCenter(const std::vector<BattleObjects::Unit*>& unit
 
 void MonkeyScript::IssueCommands()
 {
-	BattleCommander* monkeyCommander = nullptr;
-	for (BattleCommander* commander : _battleScenario->GetCommanders())
-		if (commander->GetType() == BattleCommanderType::Player)
-		{
-			monkeyCommander = commander;
-			break;
-		}
+	BattleCommander* monkeyCommander = _commander;
+	if (monkeyCommander == nullptr)
+		for (BattleCommander* commander : _battleScenario->GetCommanders())
+			if (commander->GetType() == BattleCommanderType::Player)
+			{
+				monkeyCommander = commander;
+				break;
+			}
 
 	if (monkeyCommander == nullptr)
 		return;
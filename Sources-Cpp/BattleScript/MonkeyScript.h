@@ -3,6 +3,7 @@
 
 #include "BattleScript.h"
 
+class BattleCommander;
 class BattleScenario;
 class BattleSimulator;
 
@@ -11,10 +12,12 @@ class MonkeyScript : public BattleScript
 {
 	BattleScenario* _battleScenario{};
 	BattleSimulator* _battleSimulator{};
+	BattleCommander* _commander{};
 	double _commandTimer{};
 
 public:
 	MonkeyScript(BattleScenario* battleSimulator);
+	MonkeyScript(BattleScenario* battleScenario, BattleCommander* commander);
 
 	void Tick(double secondsSinceLastTick) override;
 
@@ -34,18 +34,11 @@ BattleGesture::BattleGesture(BattleHotspot* hotspot) :
 
 BattleGesture::~BattleGesture()
 {
-	if (_isBattleObserver)
-		_hotspot->GetBattleView()->GetBattleSimulator()->RemoveObserver(this);
 }
 
 
 void BattleGesture::TouchWasCaptured(Touch* touch)
 {
-	if (!_isBattleObserver)
-	{
-		_hotspot->GetBattleView()->GetBattleSimulator()->AddObserver(this);
-		_isBattleObserver = true;
-	}
 }
 
 
@@ -76,14 +69,15 @@ void BattleGesture::TouchBegan(Touch* touch)
 
 		if (unit && _hotspot->GetBattleView()->GetTrackingMarker(unit) == nullptr)
 		{
-			const BattleObjects::UnitCommand command = unit->GetIssuedCommand();
+			const BattleSnapshot::Unit& snapshotUnit = *_hotspot->GetBattleView()->GetSnapshotUnit(unit);
+			const BattleSnapshot::Command& command = snapshotUnit.issuedCommand;
 
-			_allowTargetEnemyUnit = unit->GetMissileWeaponRange().maximumRange > 0;
+			_allowTargetEnemyUnit = snapshotUnit.missileWeaponRange.maximumRange > 0;
 			_trackingMarker = _hotspot->GetBattleView()->AddTrackingMarker(unit);
 
-			float distanceToUnitCenter = glm::distance(GetUnitCurrentBounds(unit).mid(), screenPosition);
-			float distanceToDestination = glm::distance(GetUnitFutureBounds(unit).mid(), screenPosition);
-			float distanceToModifierArea = glm::distance(GetUnitModifierBounds(unit).mid(), screenPosition);
+			float distanceToUnitCenter = glm::distance(GetUnitCurrentBounds(snapshotUnit).mid(), screenPosition);
+			float distanceToDestination = glm::distance(GetUnitFutureBounds(snapshotUnit).mid(), screenPosition);
+			float distanceToModifierArea = glm::distance(GetUnitModifierBounds(snapshotUnit).mid(), screenPosition);
 			float distanceMinimum = glm::min(distanceToUnitCenter, glm::min(distanceToDestination, distanceToModifierArea));
 
 			_tappedUnitCenter = distanceToUnitCenter == distanceMinimum;
@@ -96,11 +90,9 @@ void BattleGesture::TouchBegan(Touch* touch)
 				if (_offsetToMarker < 0)
 					_offsetToMarker = 0;
 
-				std::vector<glm::vec2>& path = _trackingMarker->_path;
-				path.clear();
-				path.insert(path.begin(), command.path.begin(), command.path.end());
+				_trackingMarker->_path = _hotspot->GetBattleView()->GetSnapshot().GetMovementPath(command);
 
-				glm::vec2 orientation = command.GetDestination() + 18.0f * vector2_from_angle(command.bearing);
+				glm::vec2 orientation = command.destination + 18.0f * vector2_from_angle(command.bearing);
 				_trackingMarker->SetOrientation(&orientation);
 			}
 			else
@@ -109,7 +101,7 @@ void BattleGesture::TouchBegan(Touch* touch)
 				if (_offsetToMarker < 0)
 					_offsetToMarker = 0;
 
-				glm::vec2 orientation = unit->GetCenter() + 18.0f * vector2_from_angle(unit->GetBearing());
+				glm::vec2 orientation = snapshotUnit.center + 18.0f * vector2_from_angle(snapshotUnit.bearing);
 				_trackingMarker->SetOrientation(&orientation);
 			}
 
@@ -117,9 +109,9 @@ void BattleGesture::TouchBegan(Touch* touch)
 			{
 				BattleObjects::UnitCommand command;
 
-				command.ClearPathAndSetDestination(unit->GetCenter());
+				command.ClearPathAndSetDestination(snapshotUnit.center);
 
-				_hotspot->GetBattleView()->GetBattleSimulator()->SetUnitCommand(unit, command, _hotspot->GetBattleView()->GetBattleSimulator()->GetTimerDelay());
+				PushCommand(BattleSimulationThread::CommandType::Set, unit, command);
 			}
 
 			_trackingMarker->SetRunning(touch->GetTapCount() > 1 || (!_tappedUnitCenter && command.running));
@@ -230,7 +222,9 @@ void BattleGesture::TouchEnded(Touch* touch)
 
 void BattleGesture::UpdateTrackingMarker()
 {
-	BattleObjects::Unit* unit = _trackingMarker->GetUnit();
+	const BattleSnapshot::Unit* unit = _hotspot->GetBattleView()->GetSnapshotUnit(_trackingMarker->GetUnit());
+	if (unit == nullptr)
+		return;
 
 	glm::vec2 screenTouchPosition = _trackingTouch->GetCurrentPosition();
 	glm::vec2 screenMarkerPosition = screenTouchPosition + glm::vec2(0, 1) * (_offsetToMarker * GetFlipSign());
@@ -238,16 +232,16 @@ void BattleGesture::UpdateTrackingMarker()
 	glm::vec2 markerPosition = _hotspot->GetBattleView()->GetTerrainPosition3(screenMarkerPosition).xy();
 
 	BattleObjects::Unit* enemyUnit = FindEnemyUnit(touchPosition, markerPosition);
-	glm::vec2 unitCenter = unit->GetCenter();
+	glm::vec2 unitCenter = unit->center;
 
 	bool isModifierMode = _tappedModiferArea || _modifierTouch || _trackingTouch->GetCurrentButtons().right;
 	_trackingMarker->SetRenderOrientation(isModifierMode);
 
 	if (!isModifierMode)
 	{
-		std::vector<glm::vec2>& path = _trackingMarker->_path;
+		BattleObjects::MovementPath& path = _trackingMarker->_path;
 
-		glm::vec2 currentDestination = path.size() != 0 ? *(path.end() - 1) : unit->GetCenter();
+		glm::vec2 currentDestination = path.size() != 0 ? *(path.end() - 1) : unit->center;
 
 		bounds2f contentBounds = _hotspot->GetBattleView()->GetTerrainViewport().GetTerrainBounds();
 		glm::vec2 contentCenter = contentBounds.mid();
@@ -284,21 +278,19 @@ void BattleGesture::UpdateTrackingMarker()
 
 		if (!unit->deployed)
 		{
-			BattleScenario* battleScenario = _hotspot->GetBattleView()->GetBattleScenario();
-			BattleSimulator* battleSimulator = _hotspot->GetBattleView()->GetBattleSimulator();
-			int team = unit->GetTeam();
+			std::pair<glm::vec2, float> deploymentZone = _hotspot->GetBattleView()->GetSnapshot().GetDeploymentZone(unit->team);
 
-			if (battleScenario->IsDeploymentZone(team, markerPosition))
+			if (BattleScenario::IsDeploymentZone(deploymentZone, markerPosition))
 			{
-				unitCenter = battleScenario->ConstrainDeploymentZone(team, markerPosition, 10);
+				unitCenter = BattleScenario::ConstrainDeploymentZone(deploymentZone, markerPosition, 10);
 				_trackingMarker->_path.clear();
 			}
 			else
 			{
-				while (!_trackingMarker->_path.empty() && battleScenario->IsDeploymentZone(team, _trackingMarker->_path.front()))
-					_trackingMarker->_path.erase(_trackingMarker->_path.begin());
+				while (!_trackingMarker->_path.empty() && BattleScenario::IsDeploymentZone(deploymentZone, _trackingMarker->_path.front()))
+					_trackingMarker->_path.pop_front();
 
-				unitCenter = battleScenario->ConstrainDeploymentZone(team,
+				unitCenter = BattleScenario::ConstrainDeploymentZone(deploymentZone,
 					!_trackingMarker->_path.empty() ? _trackingMarker->_path.front() : unitCenter,
 					10);
 
@@ -306,21 +298,25 @@ void BattleGesture::UpdateTrackingMarker()
 					BattleObjects::UnitCommand::UpdateMovementPath(_trackingMarker->_path, unitCenter, _trackingMarker->_path.back());
 			}
 
-			battleSimulator->DeployUnit(unit, unitCenter, unit->GetBearing());
-			unitCenter = unit->GetCenter();
+			BattleObjects::UnitCommand command;
+			command.ClearPathAndSetDestination(unitCenter);
+			command.bearing = unit->bearing;
+			PushCommand(BattleSimulationThread::CommandType::Deploy, unit->unit, command);
 		}
 
 		_trackingMarker->SetMeleeTarget(enemyUnit);
 		_trackingMarker->SetDestination(&markerPosition);
 
+		glm::vec2 enemyCenter = enemyUnit ? _hotspot->GetBattleView()->GetSnapshotUnit(enemyUnit)->center : glm::vec2{};
+
 		if (enemyUnit)
-			BattleObjects::UnitCommand::UpdateMovementPath(_trackingMarker->_path, unitCenter, enemyUnit->GetCenter());
+			BattleObjects::UnitCommand::UpdateMovementPath(_trackingMarker->_path, unitCenter, enemyCenter);
 		else
 			BattleObjects::UnitCommand::UpdateMovementPath(_trackingMarker->_path, unitCenter, markerPosition);
 
 		if (enemyUnit)
 		{
-			glm::vec2 destination = enemyUnit->GetCenter();
+			glm::vec2 destination = enemyCenter;
 			glm::vec2 orientation = destination + glm::normalize(destination - unitCenter) * 18.0f;
 			_trackingMarker->SetOrientation(&orientation);
 		}
@@ -334,7 +330,7 @@ void BattleGesture::UpdateTrackingMarker()
 		}
 		else
 		{
-			glm::vec2 orientation = markerPosition + 18.0f * vector2_from_angle(unit->GetBearing());
+			glm::vec2 orientation = markerPosition + 18.0f * vector2_from_angle(unit->bearing);
 			_trackingMarker->SetOrientation(&orientation);
 		}
 	}
@@ -343,9 +339,9 @@ void BattleGesture::UpdateTrackingMarker()
 		BattleObjects::UnitCommand::UpdateMovementPathStart(_trackingMarker->_path, unitCenter);
 
 		bool holdFire = false;
-		if (_trackingMarker->GetUnit()->IsStanding() && _trackingMarker->GetUnit()->GetMissileWeaponRange().maximumRange > 0)
+		if (unit->standing && unit->missileWeaponRange.maximumRange > 0)
 		{
-			bounds2f unitCurrentBounds = GetUnitCurrentBounds(_trackingMarker->GetUnit());
+			bounds2f unitCurrentBounds = GetUnitCurrentBounds(*unit);
 			holdFire = glm::distance(screenMarkerPosition, unitCurrentBounds.mid()) <= unitCurrentBounds.x().radius();
 		}
 
@@ -396,8 +392,9 @@ void BattleGesture::TouchEndedOrCancelled(Touch* touch, bool cancelled)
 				{
 					command.missileTarget = missileTarget;
 					command.missileTargetLocked = true;
-					if (missileTarget != unit)
-						command.bearing = angle(missileTarget->GetCenter() - command.GetDestination());
+					const BattleSnapshot::Unit* target = _hotspot->GetBattleView()->GetSnapshotUnit(missileTarget);
+					if (missileTarget != unit && target)
+						command.bearing = angle(target->center - command.GetDestination());
 				}
 				else if (orientation)
 				{
@@ -409,7 +406,8 @@ void BattleGesture::TouchEndedOrCancelled(Touch* touch, bool cancelled)
 					if (_tappedUnitCenter && touch->GetTapCount() > 1)
 					{
 						command.meleeTarget = nullptr;
-						command.ClearPathAndSetDestination(unit->GetCenter());
+						if (const BattleSnapshot::Unit* snapshotUnit = _hotspot->GetBattleView()->GetSnapshotUnit(unit))
+							command.ClearPathAndSetDestination(snapshotUnit->center);
 						command.missileTarget = nullptr;
 						command.missileTargetLocked = false;
 					}
@@ -429,7 +427,7 @@ void BattleGesture::TouchEndedOrCancelled(Touch* touch, bool cancelled)
 					}
 				}
 
-				_hotspot->GetBattleView()->GetBattleSimulator()->IssueUnitCommand(unit, command, _hotspot->GetBattleView()->GetBattleSimulator()->GetTimerDelay());
+				PushCommand(BattleSimulationThread::CommandType::Issue, unit, command);
 
 				if (touch->GetTapCount() == 1)
 					SoundPlayer::GetSingleton()->PlayUserInterfaceSound(SoundSampleID::CommandAck);
@@ -510,8 +508,9 @@ BattleObjects::Unit* BattleGesture::FindCommandableUnit(glm::vec2 screenPosition
 
 	if (unitByPosition && unitByDestination)
 	{
-		float distanceToPosition = glm::distance(unitByPosition->GetCenter(), screenPosition);
-		float distanceToDestination = glm::distance(unitByDestination->GetIssuedCommand().GetDestination(), screenPosition);
+		BattleView* battleView = _hotspot->GetBattleView();
+		float distanceToPosition = glm::distance(battleView->GetSnapshotUnit(unitByPosition)->center, screenPosition);
+		float distanceToDestination = glm::distance(battleView->GetSnapshotUnit(unitByDestination)->issuedCommand.destination, screenPosition);
 		return distanceToPosition < distanceToDestination
 				? unitByPosition
 				: unitByDestination;
@@ -530,10 +529,10 @@ BattleObjects::Unit* BattleGesture::FindCommandableUnitByCurrentPosition(glm::ve
 	UnitCounter* unitMarker = _hotspot->GetBattleView()->GetNearestUnitCounter(terrainPosition, 0, _hotspot->GetBattleView()->GetCommander(), false);
 	if (unitMarker)
 	{
-		BattleObjects::Unit* unit = unitMarker->_unit;
-		if (!unit->IsRouting() && GetUnitCurrentBounds(unit).contains(screenPosition))
+		const BattleSnapshot::Unit* unit = unitMarker->GetSnapshotUnit();
+		if (unit && !unit->routing && GetUnitCurrentBounds(*unit).contains(screenPosition))
 		{
-			result = unit;
+			result = unit->unit;
 		}
 	}
 	return result;
@@ -546,10 +545,10 @@ BattleObjects::Unit* BattleGesture::FindCommandableUnitByFuturePosition(glm::vec
 	UnitMovementMarker* movementMarker = _hotspot->GetBattleView()->GetNearestMovementMarker(terrainPosition, _hotspot->GetBattleView()->GetCommander());
 	if (movementMarker)
 	{
-		BattleObjects::Unit* unit = movementMarker->GetUnit();
-		if (!unit->IsRouting() && GetUnitFutureBounds(unit).contains(screenPosition))
+		const BattleSnapshot::Unit* unit = _hotspot->GetBattleView()->GetSnapshotUnit(movementMarker->GetUnit());
+		if (unit && !unit->routing && GetUnitFutureBounds(*unit).contains(screenPosition))
 		{
-			result = unit;
+			result = unit->unit;
 		}
 	}
 	return result;
@@ -561,16 +560,16 @@ BattleObjects::Unit* BattleGesture::FindCommandableUnitByModifierArea(glm::vec2
 	BattleObjects::Unit* result = nullptr;
 	float distance = 10000;
 
-	for (BattleObjects::Unit* unit : _hotspot->GetBattleView()->GetBattleSimulator()->GetUnits())
+	for (const BattleSnapshot::Unit& unit : _hotspot->GetBattleView()->GetSnapshot().units)
 	{
-		if (_hotspot->GetBattleView()->GetBattleScenario()->IsCommandableBy(unit, _hotspot->GetBattleView()->GetCommander()))
+		if (_hotspot->GetBattleView()->GetBattleScenario()->IsCommandableBy(unit.commander, _hotspot->GetBattleView()->GetCommander()))
 		{
-			const BattleObjects::UnitCommand& command = unit->GetIssuedCommand();
-			glm::vec2 center = !command.path.empty() ? command.path.back() : unit->GetCenter();
+			const BattleSnapshot::Command& command = unit.issuedCommand;
+			glm::vec2 center = command.pathSize != 0 ? command.destination : unit.center;
 			float d = glm::distance(center, terrainPosition);
-			if (d < distance && !unit->IsRouting() && GetUnitModifierBounds(unit).contains(screenPosition))
+			if (d < distance && !unit.routing && GetUnitModifierBounds(unit).contains(screenPosition))
 			{
-				result = unit;
+				result = unit.unit;
 				distance = d;
 			}
 		}
@@ -582,7 +581,11 @@ BattleObjects::Unit* BattleGesture::FindCommandableUnitByModifierArea(glm::vec2
 
 BattleObjects::Unit* BattleGesture::FindEnemyUnit(glm::vec2 touchPosition, glm::vec2 markerPosition)
 {
-	int enemyTeam = _trackingMarker->GetUnit()->GetTeam() == 1 ? 2 : 1;
+	UnitCounter* unitCounter = _hotspot->GetBattleView()->GetUnitCounter(_trackingMarker->GetUnit());
+	if (unitCounter == nullptr)
+		return nullptr;
+
+	int enemyTeam = unitCounter->GetTeam() == 1 ? 2 : 1;
 
 	UnitCounter* enemyMarker = nullptr;
 
@@ -591,7 +594,7 @@ BattleObjects::Unit* BattleGesture::FindEnemyUnit(glm::vec2 touchPosition, glm::
 	for (int i = 0; i < 4; ++i)
 	{
 		UnitCounter* unitMarker = _hotspot->GetBattleView()->GetNearestUnitCounter(p, enemyTeam, nullptr, true);
-		if (unitMarker && glm::distance(unitMarker->_unit->GetCenter(), p) <= SNAP_TO_UNIT_TRESHOLD)
+		if (unitMarker && glm::distance(unitMarker->GetSnapshotUnit()->center, p) <= SNAP_TO_UNIT_TRESHOLD)
 		{
 			enemyMarker = unitMarker;
 			break;
@@ -606,38 +609,51 @@ BattleObjects::Unit* BattleGesture::FindEnemyUnit(glm::vec2 touchPosition, glm::
 }
 
 
-bounds2f BattleGesture::GetUnitCurrentBounds(BattleObjects::Unit* unit)
+void BattleGesture::PushCommand(BattleSimulationThread::CommandType type, BattleObjects::Unit* unit, const BattleObjects::UnitCommand& command)
+{
+	BattleView* battleView = _hotspot->GetBattleView();
+	const BattleSnapshot::Unit* snapshotUnit = battleView->GetSnapshotUnit(unit);
+	if (snapshotUnit == nullptr)
+		return;
+
+	const BattleSnapshot::Unit* meleeTarget = battleView->GetSnapshotUnit(command.meleeTarget);
+	const BattleSnapshot::Unit* missileTarget = battleView->GetSnapshotUnit(command.missileTarget);
+
+	BattleSimulationThread::Command result;
+	result.type = type;
+	result.unitId = snapshotUnit->unitId;
+	result.command = command;
+	result.meleeTargetId = meleeTarget ? meleeTarget->unitId : -1;
+	result.missileTargetId = missileTarget ? missileTarget->unitId : -1;
+	result.timer = battleView->GetBattleSimulator()->GetTimerDelay();
+	battleView->GetBattleSimulationThread()->PushCommand(result);
+}
+
+
+bounds2f BattleGesture::GetUnitCurrentBounds(const BattleSnapshot::Unit& unit)
 {
 	return _hotspot->GetBattleView()->GetUnitCurrentIconViewportBounds(unit).add_radius(12);
 }
 
 
-bounds2f BattleGesture::GetUnitFutureBounds(BattleObjects::Unit* unit)
+bounds2f BattleGesture::GetUnitFutureBounds(const BattleSnapshot::Unit& unit)
 {
 	return _hotspot->GetBattleView()->GetUnitFutureIconViewportBounds(unit).add_radius(12);
 }
 
 
-bounds2f BattleGesture::GetUnitModifierBounds(BattleObjects::Unit* unit)
+bounds2f BattleGesture::GetUnitModifierBounds(const BattleSnapshot::Unit& unit)
 {
-	if (unit->IsStanding())
+	if (unit.standing)
 		return _hotspot->GetBattleView()->GetUnitCurrentFacingMarkerBounds(unit).add_radius(12);
 
-	if (unit->IsMoving())
+	if (unit.moving)
 		return _hotspot->GetBattleView()->GetUnitFutureFacingMarkerBounds(unit).add_radius(12);
 
 	return bounds2f();
 }
 
 
-/* BattleObserver */
-
-
-void BattleGesture::OnAddUnit(BattleObjects::Unit* unit)
-{
-}
-
-
 void BattleGesture::OnRemoveUnit(BattleObjects::Unit* unit)
 {
 	if (_trackingMarker && _trackingMarker->GetUnit() == unit)
@@ -646,28 +662,3 @@ void BattleGesture::OnRemoveUnit(BattleObjects::Unit* unit)
 		_trackingMarker = nullptr;
 	}
 }
-
-
-void BattleGesture::OnCommand(BattleObjects::Unit* unit, float timer)
-{
-}
-
-
-void BattleGesture::OnShooting(const BattleObjects::Shooting& shooting, float timer)
-{
-}
-
-
-void BattleGesture::OnRelease(const BattleObjects::Shooting& shooting)
-{
-}
-
-
-void BattleGesture::OnCasualty(BattleObjects::Unit* unit, glm::vec2 fighter)
-{
-}
-
-
-void BattleGesture::OnRouting(BattleObjects::Unit* unit)
-{
-}
@@ -6,7 +6,7 @@
 #define BATTLEGESTURE_H
 
 #include "BattleModel/BattleSimulator_v1_0_0.h"
-#include "BattleModel/BattleObserver.h"
+#include "BattleModel/BattleSimulationThread.h"
 #include "Algebra/bounds.h"
 #include "Surface/Gesture.h"
 #include "Surface/Touch.h"
@@ -17,10 +17,9 @@ class UnitTrackingMarker;
 class UnitCounter;
 
 
-class BattleGesture : public Gesture, BattleObserver
+class BattleGesture : public Gesture
 {
 	BattleHotspot* _hotspot{};
-	bool _isBattleObserver{};
 
 	bool _tappedUnitCenter{};
 	bool _tappedDestination{};
@@ -45,6 +44,8 @@ public:
 	void TouchMoved(Touch* touch) override;
 	void TouchEnded(Touch* touch) override;
 
+	void OnRemoveUnit(BattleObjects::Unit* unit);
+
 private:
 	void UpdateTrackingMarker();
 	void TouchEndedOrCancelled(Touch* touch, bool cancelled);
@@ -58,18 +59,11 @@ private:
 
 	BattleObjects::Unit* FindEnemyUnit(glm::vec2 touchPosition, glm::vec2 markerPosition);
 
-	bounds2f GetUnitCurrentBounds(BattleObjects::Unit* unit);
-	bounds2f GetUnitFutureBounds(BattleObjects::Unit* unit);
-	bounds2f GetUnitModifierBounds(BattleObjects::Unit* unit);
-
-private: // BattleObserver
-	void OnAddUnit(BattleObjects::Unit* unit) override;
-	void OnRemoveUnit(BattleObjects::Unit* unit) override;
-	void OnCommand(BattleObjects::Unit* unit, float timer) override;
-	void OnShooting(const BattleObjects::Shooting& shooting, float timer) override;
-	void OnRelease(const BattleObjects::Shooting& shooting) override;
-	void OnCasualty(BattleObjects::Unit* unit, glm::vec2 fighter) override;
-	void OnRouting(BattleObjects::Unit* unit) override;
+	void PushCommand(BattleSimulationThread::CommandType type, BattleObjects::Unit* unit, const BattleObjects::UnitCommand& command);
+
+	bounds2f GetUnitCurrentBounds(const BattleSnapshot::Unit& unit);
+	bounds2f GetUnitFutureBounds(const BattleSnapshot::Unit& unit);
+	bounds2f GetUnitModifierBounds(const BattleSnapshot::Unit& unit);
 };
 
 
@@ -24,3 +24,9 @@ BattleView* BattleHotspot::GetBattleView() const
 {
 	return _battleView;
 }
+
+
+void BattleHotspot::OnRemoveUnit(BattleObjects::Unit* unit)
+{
+	_gesture.OnRemoveUnit(unit);
+}
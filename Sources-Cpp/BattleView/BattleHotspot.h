@@ -17,6 +17,8 @@ public:
 	Gesture* GetGesture() override;
 
 	BattleView* GetBattleView() const;
+
+	void OnRemoveUnit(BattleObjects::Unit* unit);
 };
 
 
@@ -1,4 +1,5 @@
 #include "BattleModel/BattleSimulator_v1_0_0.h"
+#include "BattleModel/BattleSimulationThread.h"
 #include "Surface/Surface.h"
 #include "BattleHotspot.h"
 #include "BattleView.h"
@@ -17,11 +18,16 @@ BattleLayer::BattleLayer(Surface* surface) :
 	_surface{surface},
 	_gc{surface->GetGraphicsContext()}
 {
+	_simulationSettings.aggregateSettings.enabled = true;
 }
 
 
 BattleLayer::~BattleLayer()
 {
+	while (!_battleViews.empty())
+		RemoveBattleView(_battleViews.back());
+
+	delete _battleSimulationThread;
 }
 
 
@@ -31,6 +37,7 @@ void BattleLayer::ResetBattleViews(BattleScenario* scenario, const std::vector<B
 	_editorModel = nullptr;
 	_editorHotspot = nullptr;
 
+	BattleSimulationThread* oldSimulationThread = ResetSimulationThread(scenario);
 	_battleScenario = scenario;
 	_battleSimulator = scenario->GetBattleSimulator();
 	_commanders = commanders;
@@ -49,6 +56,8 @@ void BattleLayer::ResetBattleViews(BattleScenario* scenario, const std::vector<B
 			CreateBattleView(commander);
 	}
 
+	delete oldSimulationThread;
+
 	UpdateBattleViewSize();
 }
 
@@ -59,6 +68,7 @@ void BattleLayer::ResetEditor(BattleScenario* scenario, const std::vector<Battle
 	_editorModel = nullptr;
 	_editorHotspot = nullptr;
 
+	BattleSimulationThread* oldSimulationThread = ResetSimulationThread(scenario);
 	_battleScenario = scenario;
 	_battleSimulator = scenario->GetBattleSimulator();
 	_commanders = commanders;
@@ -71,6 +81,8 @@ void BattleLayer::ResetEditor(BattleScenario* scenario, const std::vector<Battle
 	else
 		ResetBattleView(_battleViews.front(), commanders.front());
 
+	delete oldSimulationThread;
+
 	_editorModel = new EditorModel(_battleViews.front());
 	_editorHotspot = std::make_shared<EditorHotspot>(_battleViews.front(), _editorModel);
 	_battleViews.front()->SetEditorHotspot(_editorHotspot);
@@ -90,6 +102,8 @@ void BattleLayer::ResetCameraPosition()
 void BattleLayer::SetPlaying(bool value)
 {
 	_playing = value;
+	if (_battleSimulationThread)
+		_battleSimulationThread->SetPaused(!value);
 }
 
 
@@ -118,6 +132,10 @@ void BattleLayer::OnTerrainFeatureChanged(EditorModel* editorModel)
 void BattleLayer::Animate(double secondsSinceLastUpdate)
 {
 	UpdateBattleViewSize();
+
+	if (_battleSimulationThread && _battleSimulationThread->UpdateSnapshot())
+		for (BattleView* battleView : _battleViews)
+			battleView->ReadSnapshot();
 }
 
 
@@ -142,7 +160,7 @@ void BattleLayer::CreateBattleView(BattleCommander* commander)
 
 	battleView->GetTerrainViewport().SetFlip(commander != _commanders[0]);
 	battleView->SetCommander(commander);
-	battleView->SetSimulator(_battleScenario);
+	battleView->SetSimulator(_battleScenario, _battleSimulationThread);
 
 	battleView->Initialize();
 }
@@ -152,7 +170,7 @@ void BattleLayer::ResetBattleView(BattleView* battleView, BattleCommander* comma
 {
 	battleView->GetTerrainViewport().SetFlip(commander != _commanders[0]);
 	battleView->SetCommander(commander);
-	//battleView->SetSimulator(_scenario);
+	battleView->SetSimulator(_battleScenario, _battleSimulationThread);
 }
 
 
@@ -171,6 +189,31 @@ void BattleLayer::RemoveBattleView(BattleView* battleView)
 }
 
 
+// starts a new thread if the scenario changed, and returns the old thread,
+// which the caller deletes once no battle view refers to it
+BattleSimulationThread* BattleLayer::ResetSimulationThread(BattleScenario* scenario)
+{
+	if (scenario == _battleScenario)
+		return nullptr;
+
+	BattleSimulationThread* oldSimulationThread = _battleSimulationThread;
+
+	if (BattleSimulator_v1_0_0* simulator = dynamic_cast<BattleSimulator_v1_0_0*>(scenario->GetBattleSimulator()))
+	{
+		simulator->SetThreadCount(_simulationSettings.threadCount);
+		simulator->SetAggregateSettings(_simulationSettings.aggregateSettings);
+		simulator->SetPathfinding(_simulationSettings.pathfinding);
+	}
+
+	_battleSimulationThread = new BattleSimulationThread(scenario->GetBattleSimulator());
+	_battleSimulationThread->SetBattleScenario(scenario);
+	_battleSimulationThread->SetPaused(!_playing);
+	_battleSimulationThread->Start();
+
+	return oldSimulationThread;
+}
+
+
 void BattleLayer::UpdateBattleViewSize()
 {
 	if (!_battleViews.empty())
@@ -6,9 +6,11 @@
 #include "Surface/Animation.h"
 #include "TerrainView/EditorModel.h"
 #include "BattleModel/BattleObjects.h"
+#include "BattleModel/BattleSimulator_v1_0_0.h"
 
 class BattleGesture;
 class BattleModel;
+class BattleSimulationThread;
 class BattleSimulator;
 class BattleScript;
 class BattleView;
@@ -21,6 +23,16 @@ class SmoothTerrainSky;
 class Surface;
 
 
+// Settings of the simulator of each scenario the layer shows, applied before
+// its simulation thread starts, see BattleSimulator_v1_0_0.
+struct BattleSimulationSettings
+{
+	int threadCount{}; // zero is one per hardware thread
+	BattleSimulator_v1_0_0::AggregateSettings aggregateSettings{}; // enabled by BattleLayer, the battle views push their viewpoints
+	bool pathfinding{true}; // without waiting for the flow fields, see SetPathfindingWaits()
+};
+
+
 class BattleLayer : AnimationHost, EditorModelObserver
 {
 	Surface* _surface{};
@@ -31,7 +43,9 @@ class BattleLayer : AnimationHost, EditorModelObserver
 
 	BattleScenario* _battleScenario{};
 	BattleSimulator* _battleSimulator{};
+	BattleSimulationThread* _battleSimulationThread{}; // runs the simulator, paused while not playing
 	std::vector<BattleCommander*> _commanders{};
+	BattleSimulationSettings _simulationSettings{};
 
 	std::vector<BattleView*> _battleViews{};
 
@@ -43,10 +57,15 @@ public:
 	~BattleLayer();
 
 	BattleSimulator* GetBattleSimulator() const { return _battleSimulator; }
+	BattleSimulationThread* GetBattleSimulationThread() const { return _battleSimulationThread; }
 	const std::vector<BattleView*>& GetBattleViews() const { return _battleViews; }
 	BattleView* GetPrimaryBattleView() const { return _battleViews.empty() ? nullptr : _battleViews.front(); }
 	EditorModel* GetEditorModel() const { return _editorModel; }
 
+	// applies to the scenarios reset after it is set
+	void SetSimulationSettings(const BattleSimulationSettings& value) { _simulationSettings = value; }
+	const BattleSimulationSettings& GetSimulationSettings() const { return _simulationSettings; }
+
 	void ResetBattleViews(BattleScenario* scenario, const std::vector<BattleCommander*>& commanders);
 	void ResetEditor(BattleScenario* scenario, const std::vector<BattleCommander*>& commanders);
 
@@ -67,6 +86,8 @@ public: // EditorModelObserver
 	virtual void OnTerrainFeatureChanged(EditorModel* editorModel);
 
 private:
+	BattleSimulationThread* ResetSimulationThread(BattleScenario* scenario);
+
 	void CreateBattleView(BattleCommander* commander);
 	void ResetBattleView(BattleView* battleView, BattleCommander* commander);
 	void RemoveBattleView(BattleView* battleView);
@@ -151,7 +151,7 @@ BattleView::~BattleView()
 	if (_battleSimulator)
 	{
 		_battleSimulator->GetBattleMap()->RemoveObserver(this);
-		_battleSimulator->RemoveObserver(this);
+		_battleSimulationThread->PushViewpoint({this, glm::vec2{}, true});
 	}
 
 	delete _casualtyMarker;
@@ -197,21 +197,23 @@ BattleView::~BattleView()
 }
 
 
-void BattleView::SetSimulator(BattleScenario* battleScenario)
+void BattleView::SetSimulator(BattleScenario* battleScenario, BattleSimulationThread* battleSimulationThread)
 {
-	if (battleScenario->GetBattleSimulator() == _battleSimulator)
+	if (battleSimulationThread == _battleSimulationThread)
 		return;
 
 	if (_battleSimulator)
 	{
-		for (BattleObjects::Unit* unit : _battleSimulator->GetUnits())
-			OnRemoveUnit(unit);
+		while (!_unitMarkers.empty())
+			OnRemoveUnit(_unitMarkers.back()->GetUnit());
 		_battleSimulator->GetBattleMap()->RemoveObserver(this);
-		_battleSimulator->RemoveObserver(this);
+		_battleSimulationThread->PushViewpoint({this, glm::vec2{}, true});
 	}
 
 	_battleScenario = battleScenario;
-	_battleSimulator = battleScenario->GetBattleSimulator();
+	_battleSimulator = battleSimulationThread->GetBattleSimulator();
+	_battleSimulationThread = battleSimulationThread;
+	_secondsSinceSnapshot = 0;
 
 	if (std::shared_ptr<BattleMap> battleMap = _battleSimulator->GetBattleMap())
 		OnBattleMapChanged(battleMap.get());
@@ -219,8 +221,70 @@ void BattleView::SetSimulator(BattleScenario* battleScenario)
 	delete _casualtyMarker;
 	_casualtyMarker = new CasualtyMarker(_battleSimulator);
 
-	_battleSimulator->AddObserver(this);
 	_battleSimulator->GetBattleMap()->AddObserver(this);
+
+	// the units of snapshots that were read before this view was set
+	for (const BattleSnapshot::Unit& unit : GetSnapshot().units)
+	{
+		OnAddUnit(unit.unit);
+		OnCommand(unit.unit);
+	}
+}
+
+
+float BattleView::GetInterpolationAlpha() const
+{
+	float speed = _battleSimulationThread->GetSpeed();
+	if (speed <= 0 || _battleSimulationThread->IsPaused())
+		return 1;
+
+	float secondsPerTimeStep = _battleSimulator->GetTimeStep() / speed;
+	return glm::min(1.0f, _secondsSinceSnapshot / secondsPerTimeStep);
+}
+
+
+void BattleView::ReadSnapshot()
+{
+	_secondsSinceSnapshot = 0;
+
+	const BattleSnapshot& snapshot = GetSnapshot();
+	bool casualties = false;
+
+	for (std::size_t index = static_cast<std::size_t>(_battleSimulationThread->GetNewEventIndex()); index < snapshot.events.size(); ++index)
+	{
+		const BattleEvent& event = snapshot.events[index];
+		switch (event.type)
+		{
+			case BattleEventType_AddUnit:
+				OnAddUnit(event.unit);
+				break;
+
+			case BattleEventType_RemoveUnit:
+				OnRemoveUnit(event.unit);
+				break;
+
+			case BattleEventType_Command:
+				OnCommand(event.unit);
+				break;
+
+			case BattleEventType_Release:
+				OnRelease(event.shooting);
+				break;
+
+			case BattleEventType_Casualties:
+				for (int i = 0; i < event.casualtyCount; ++i)
+					AddCasualty(event.unit, snapshot.casualties[event.firstCasualty + i]);
+				casualties = true;
+				break;
+
+			default:
+				break;
+		}
+	}
+
+	// one sound for the casualties of a snapshot, like for those of a time step before
+	if (casualties)
+		SoundPlayer::GetSingleton()->PlayCasualty();
 }
 
 
@@ -236,7 +300,15 @@ static bool ShouldEnableRenderEdges(GraphicsContext* gc)
 
 void BattleView::OnAddUnit(BattleObjects::Unit* unit)
 {
-	UnitCounter* marker = new UnitCounter(this, unit);
+	if (GetUnitCounter(unit) != nullptr)
+		return;
+
+	// not in the snapshot if it was removed again before the snapshot was captured
+	const BattleSnapshot::Unit* snapshotUnit = GetSnapshotUnit(unit);
+	if (snapshotUnit == nullptr)
+		return;
+
+	UnitCounter* marker = new UnitCounter(this, *snapshotUnit);
 	marker->Animate(0);
 	_unitMarkers.push_back(marker);
 }
@@ -244,6 +316,9 @@ void BattleView::OnAddUnit(BattleObjects::Unit* unit)
 
 void BattleView::OnRemoveUnit(BattleObjects::Unit* unit)
 {
+	if (_battleHotspot)
+		_battleHotspot->OnRemoveUnit(unit);
+
 	for (auto i = _unitMarkers.begin(); i != _unitMarkers.end(); ++i)
 		if ((*i)->GetUnit() == unit)
 		{
@@ -279,37 +354,20 @@ void BattleView::OnRemoveUnit(BattleObjects::Unit* unit)
 }
 
 
-void BattleView::OnCommand(BattleObjects::Unit* unit, float timer)
+void BattleView::OnCommand(BattleObjects::Unit* unit)
 {
-	if (_battleScenario->IsFriendlyCommander(unit, _commander) && GetMovementMarker(unit) == nullptr)
+	UnitCounter* unitCounter = GetUnitCounter(unit);
+	if (unitCounter && _battleScenario->IsFriendlyCommander(unitCounter->GetCommander(), _commander) && GetMovementMarker(unit) == nullptr)
 		AddMovementMarker(unit);
 }
 
 
-void BattleView::OnShooting(const BattleObjects::Shooting& shooting, float timer)
-{
-}
-
-
 void BattleView::OnRelease(const BattleObjects::Shooting& shooting)
 {
 	AddShootingAndSmokeCounters(shooting);
 }
 
 
-void BattleView::OnCasualty(BattleObjects::Unit* unit, glm::vec2 fighter)
-{
-	SoundPlayer::GetSingleton()->PlayCasualty();
-
-	AddCasualty(unit, fighter);
-}
-
-
-void BattleView::OnRouting(BattleObjects::Unit* unit)
-{
-}
-
-
 void BattleView::OnBattleMapChanged(const BattleMap* battleMap)
 {
 	bounds2f terrainBounds = battleMap->GetHeightMap()->GetBounds();
@@ -365,9 +423,22 @@ void BattleView::OnBattleMapChanged(const BattleMap* battleMap)
 
 void BattleView::AddCasualty(const BattleObjects::Unit* unit, glm::vec2 position)
 {
+	UnitCounter* unitCounter = GetUnitCounter(unit);
+	if (unitCounter == nullptr)
+		return;
+
 	glm::vec3 p = glm::vec3(position, _battleSimulator->GetBattleMap()->GetHeightMap()->InterpolateHeight(position));
-	BattleObjects_v1::SamuraiPlatform platform = BattleObjects_v1::GetSamuraiPlatform(unit->unitClass.c_str());
-	_casualtyMarker->AddCasualty(p, unit->GetTeam(), platform);
+	_casualtyMarker->AddCasualty(p, unitCounter->GetTeam(), unitCounter->_samuraiPlatform);
+}
+
+
+UnitCounter* BattleView::GetUnitCounter(const BattleObjects::Unit* unit) const
+{
+	for (UnitCounter* marker : _unitMarkers)
+		if (marker->GetUnit() == unit)
+			return marker;
+
+	return nullptr;
 }
 
 
@@ -539,7 +610,7 @@ void BattleView::Render()
 
 	_plainLineVertices->Reset(GL_LINES);
 	for (UnitCounter* marker : _unitMarkers)
-		if (_battleScenario->IsFriendlyCommander(marker->GetUnit(), _commander) || marker->GetUnit()->deployed)
+		if (_battleScenario->IsFriendlyCommander(marker->GetCommander(), _commander) || marker->IsDeployed())
 			marker->AppendFighterWeapons(_plainLineVertices);
 
 	RenderCall<PlainShader_3f>(_gc)
@@ -571,7 +642,7 @@ void BattleView::Render()
 	_billboardModel->dynamicBillboards.clear();
 	_casualtyMarker->AppendCasualtyBillboards(_billboardModel);
 	for (UnitCounter* marker : _unitMarkers)
-		if (_battleScenario->IsFriendlyCommander(marker->GetUnit(), _commander) || marker->GetUnit()->deployed)
+		if (_battleScenario->IsFriendlyCommander(marker->GetCommander(), _commander) || marker->IsDeployed())
 			marker->AppendFighterBillboards(_billboardModel);
 	for (SmokeCounter* marker : _smokeMarkers)
 		marker->AppendSmokeBillboards(_billboardModel);
@@ -593,11 +664,12 @@ void BattleView::Render()
 
 	// Range Markers
 
-	for (BattleObjects::Unit* unit : _battleSimulator->GetUnits())
+	const BattleSnapshot& snapshot = GetSnapshot();
+	for (const BattleSnapshot::Unit& unit : snapshot.units)
 	{
-		if (_battleScenario->IsFriendlyCommander(unit, _commander))
+		if (_battleScenario->IsFriendlyCommander(unit.commander, _commander))
 		{
-			RangeMarker marker(_battleSimulator, unit);
+			RangeMarker marker(_battleSimulator, snapshot, unit);
 			_gradientTriangleStripVertices->Reset(GL_TRIANGLE_STRIP);
 			marker.Render(_gradientTriangleStripVertices);
 
@@ -616,14 +688,16 @@ void BattleView::Render()
 	_textureTriangleVertices2->Reset(GL_TRIANGLES);
 
 	for (UnitCounter* marker : _unitMarkers)
-		if (_battleScenario->IsFriendlyCommander(marker->GetUnit(), _commander))
+		if (_battleScenario->IsFriendlyCommander(marker->GetCommander(), _commander))
 			marker->AppendFacingMarker(_textureTriangleVertices2, this);
 	for (UnitMovementMarker* marker : _movementMarkers)
-		if (_battleScenario->IsFriendlyCommander(marker->GetUnit(), _commander))
-			marker->AppendFacingMarker(_textureTriangleVertices2, this);
+		if (UnitCounter* unitCounter = GetUnitCounter(marker->GetUnit()))
+			if (_battleScenario->IsFriendlyCommander(unitCounter->GetCommander(), _commander))
+				marker->AppendFacingMarker(_textureTriangleVertices2, this);
 	for (UnitTrackingMarker* marker : _trackingMarkers)
-		if (_battleScenario->IsFriendlyCommander(marker->GetUnit(), _commander))
-			marker->AppendFacingMarker(_textureTriangleVertices2, this);
+		if (UnitCounter* unitCounter = GetUnitCounter(marker->GetUnit()))
+			if (_battleScenario->IsFriendlyCommander(unitCounter->GetCommander(), _commander))
+				marker->AppendFacingMarker(_textureTriangleVertices2, this);
 
 	RenderCall<TextureShader_2f>(_gc)
 		.SetVertices(_textureTriangleVertices2, "position", "texcoord")
@@ -639,7 +713,7 @@ void BattleView::Render()
 	_textureBillboardShape2->Reset();
 
 	for (UnitCounter* marker : _unitMarkers)
-		if (_battleScenario->IsFriendlyCommander(marker->GetUnit(), _commander) || marker->GetUnit()->deployed)
+		if (_battleScenario->IsFriendlyCommander(marker->GetCommander(), _commander) || marker->IsDeployed())
 			marker->AppendUnitMarker(_textureBillboardShape2, GetTerrainViewport().GetFlip());
 	for (UnitMovementMarker* marker : _movementMarkers)
 		marker->RenderMovementMarker(_textureBillboardShape1);
@@ -815,9 +889,17 @@ template <class T> void AnimateMarkers(std::vector<T*>& markers, float seconds)
 
 void BattleView::Animate(double secondsSinceLastUpdate)
 {
+	_secondsSinceSnapshot += (float)secondsSinceLastUpdate;
+
 	UpdateSoundPlayer();
 	UpdateDeploymentZones();
 
+	if (_battleSimulator)
+	{
+		glm::vec3 center = GetTerrainPosition2(GetTerrainViewport().NormalizedToLocal(glm::vec2()));
+		_battleSimulationThread->PushViewpoint({this, center.xy(), false});
+	}
+
 	_casualtyMarker->Animate((float)secondsSinceLastUpdate);
 
 	::AnimateMarkers(_movementMarkers, (float)secondsSinceLastUpdate);
@@ -852,12 +934,13 @@ UnitMovementMarker* BattleView::GetNearestMovementMarker(glm::vec2 position, Bat
 
 	for (UnitMovementMarker* marker : _movementMarkers)
 	{
-		BattleObjects::Unit* unit = marker->GetUnit();
-		if (commander && !_battleScenario->IsCommandableBy(unit, commander))
+		const BattleSnapshot::Unit* unit = GetSnapshotUnit(marker->GetUnit());
+		if (unit == nullptr)
+			continue;
+		if (commander && !_battleScenario->IsCommandableBy(unit->commander, commander))
 			continue;
 
-		const BattleObjects::UnitCommand& command = unit->GetIssuedCommand();
-		glm::vec2 p = command.GetDestination();
+		glm::vec2 p = unit->issuedCommand.destination;
 		float dx = p.x - position.x;
 		float dy = p.y - position.y;
 		float d = dx * dx + dy * dy;
@@ -933,17 +1016,17 @@ bounds2f BattleView::GetBillboardBounds(glm::vec3 position, float height)
 }
 
 
-bounds2f BattleView::GetUnitCurrentIconViewportBounds(BattleObjects::Unit* unit)
+bounds2f BattleView::GetUnitCurrentIconViewportBounds(const BattleSnapshot::Unit& unit)
 {
-	glm::vec3 position = GetTerrainPosition(unit->GetCenter(), 0);
+	glm::vec3 position = GetTerrainPosition(unit.center, 0);
 	return GetBillboardBounds(position, 32);
 }
 
 
-bounds2f BattleView::GetUnitFutureIconViewportBounds(BattleObjects::Unit* unit)
+bounds2f BattleView::GetUnitFutureIconViewportBounds(const BattleSnapshot::Unit& unit)
 {
-	const BattleObjects::UnitCommand& command = unit->GetIssuedCommand();
-	glm::vec3 position = GetTerrainPosition(!command.path.empty() ? command.path.back() : unit->GetCenter(), 0);
+	const BattleSnapshot::Command& command = unit.issuedCommand;
+	glm::vec3 position = GetTerrainPosition(command.pathSize != 0 ? command.destination : unit.center, 0);
 	return GetBillboardBounds(position, 32);
 }
 
@@ -962,17 +1045,17 @@ bounds2f BattleView::GetUnitFacingMarkerBounds(glm::vec2 center, float direction
 }
 
 
-bounds2f BattleView::GetUnitCurrentFacingMarkerBounds(BattleObjects::Unit* unit)
+bounds2f BattleView::GetUnitCurrentFacingMarkerBounds(const BattleSnapshot::Unit& unit)
 {
-	return GetUnitFacingMarkerBounds(unit->GetCenter(), unit->GetBearing());
+	return GetUnitFacingMarkerBounds(unit.center, unit.bearing);
 }
 
 
-bounds2f BattleView::GetUnitFutureFacingMarkerBounds(BattleObjects::Unit* unit)
+bounds2f BattleView::GetUnitFutureFacingMarkerBounds(const BattleSnapshot::Unit& unit)
 {
-	const BattleObjects::UnitCommand& command = unit->GetIssuedCommand();
+	const BattleSnapshot::Command& command = unit.issuedCommand;
 
-	glm::vec2 center = !command.path.empty() ? command.path.back() : unit->GetCenter();
+	glm::vec2 center = command.pathSize != 0 ? command.destination : unit.center;
 
 	return GetUnitFacingMarkerBounds(center, command.bearing);
 }
@@ -1077,15 +1160,17 @@ UnitCounter* BattleView::GetNearestUnitCounter(glm::vec2 position, int filterTea
 
 	for (UnitCounter* marker : _unitMarkers)
 	{
-		BattleObjects::Unit* unit = marker->_unit;
-		if (filterTeam != 0 && unit->GetTeam() != filterTeam)
+		const BattleSnapshot::Unit* unit = marker->GetSnapshotUnit();
+		if (unit == nullptr)
+			continue;
+		if (filterTeam != 0 && unit->team != filterTeam)
 			continue;
-		if (filterCommander && !_battleScenario->IsCommandableBy(unit, filterCommander))
+		if (filterCommander && !_battleScenario->IsCommandableBy(unit->commander, filterCommander))
 			continue;
 		if (filterDeployed && !unit->deployed)
 			continue;
 
-		glm::vec2 p = unit->GetCenter();
+		glm::vec2 p = unit->center;
 		float dx = p.x - position.x;
 		float dy = p.y - position.y;
 		float d = dx * dx + dy * dy;
@@ -1110,34 +1195,34 @@ void BattleView::UpdateSoundPlayer()
 	int friendlyUnits = 0;
 	int enemyUnits = 0;
 
-	for (UnitCounter* unitMarker : GetUnitCounters())
+	const BattleSnapshot& snapshot = GetSnapshot();
+	for (const BattleSnapshot::Unit& unit : snapshot.units)
 	{
-		BattleObjects::Unit* unit = unitMarker->_unit;
-		if (unit->GetPlatformType() == BattleObjects::PlatformType::Cavalry)
+		if (unit.platformType == BattleObjects::PlatformType::Cavalry)
 		{
 			++cavalryCount;
 		}
 
-		if (!unit->IsRouting())
+		if (!unit.routing)
 		{
-			if (_battleScenario->IsFriendlyCommander(unit, _commander))
+			if (_battleScenario->IsFriendlyCommander(unit.commander, _commander))
 				++friendlyUnits;
 			else
 				++enemyUnits;
 		}
 
-		if (glm::length(unit->GetCurrentCommand().GetDestination() - unit->GetCenter()) > 4.0f)
+		if (glm::length(unit.currentDestination - unit.center) > 4.0f)
 		{
-			if (unit->GetPlatformType() == BattleObjects::PlatformType::Cavalry)
+			if (unit.platformType == BattleObjects::PlatformType::Cavalry)
 			{
-				if (unit->GetCurrentCommand().running)
+				if (unit.currentRunning)
 					++cavalryRunning;
 				else
 					++cavalryWalking;
 			}
 			else
 			{
-				if (unit->GetCurrentCommand().running)
+				if (unit.currentRunning)
 					++infantryRunning;
 				else
 					++infantryWalking;
@@ -1145,8 +1230,8 @@ void BattleView::UpdateSoundPlayer()
 		}
 	}
 
-	int meleeCavalry = _battleSimulator->CountCavalryInMelee();
-	int meleeInfantry = _battleSimulator->CountInfantryInMelee();
+	int meleeCavalry = snapshot.CountCavalryInMelee();
+	int meleeInfantry = snapshot.CountInfantryInMelee();
 
 	SoundPlayer* soundPlayer = SoundPlayer::GetSingleton();
 	soundPlayer->UpdateInfantryWalking(infantryWalking != 0);
@@ -1165,8 +1250,8 @@ void BattleView::UpdateSoundPlayer()
 	musicDirector.UpdateFriendlyUnits(friendlyUnits);
 	musicDirector.UpdateEnemyUnits(enemyUnits);
 
-	if (_battleScenario->GetWinnerTeam() != 0)
-		musicDirector.UpdateOutcome(_battleScenario->GetWinnerTeam() == _commander->GetTeam() ? 1 : -1);
+	if (snapshot.winnerTeam != 0)
+		musicDirector.UpdateOutcome(snapshot.winnerTeam == _commander->GetTeam() ? 1 : -1);
 	else
 		musicDirector.UpdateOutcome(0);
 }
@@ -1176,12 +1261,14 @@ void BattleView::UpdateDeploymentZones()
 {
 	if (_smoothTerrainSurface)
 	{
+		const BattleSnapshot& snapshot = GetSnapshot();
+
 		_smoothTerrainSurface->SetDeploymentZoneBlue(
-			_battleScenario->GetDeploymentZone(1).first,
-			_battleScenario->GetDeploymentZone(1).second);
+			snapshot.GetDeploymentZone(1).first,
+			snapshot.GetDeploymentZone(1).second);
 
 		_smoothTerrainSurface->SetDeploymentZoneRed(
-			_battleScenario->GetDeploymentZone(2).first,
-			_battleScenario->GetDeploymentZone(2).second);
+			snapshot.GetDeploymentZone(2).first,
+			snapshot.GetDeploymentZone(2).second);
 	}
 }
@@ -6,7 +6,7 @@
 #define BATTLEVIEW_H
 
 #include "BattleMap/BattleMap.h"
-#include "BattleModel/BattleObserver.h"
+#include "BattleModel/BattleSimulationThread.h"
 #include "BattleModel/BattleSimulator_v1_0_0.h"
 #include "Shapes/VertexShape.h"
 #include "Shapes/BillboardTextureShape.h"
@@ -31,12 +31,14 @@ class BattleScenario;
 class Touch;
 
 
-class BattleView : public TerrainView, BattleObserver, BattleMapObserver, AnimationHost
+class BattleView : public TerrainView, BattleMapObserver, AnimationHost
 {
 	GraphicsContext* _gc{};
 	BattleSimulator* _battleSimulator{};
+	BattleSimulationThread* _battleSimulationThread{};
 	BattleScenario* _battleScenario{};
 	BattleCommander* _commander{};
+	float _secondsSinceSnapshot{};
 
 	glm::vec3 _lightNormal{};
 
@@ -76,8 +78,19 @@ public:
 	~BattleView();
 
 	BattleScenario* GetBattleScenario() const { return _battleScenario; }
-	void SetSimulator(BattleScenario* battleScenario);
+	void SetSimulator(BattleScenario* battleScenario, BattleSimulationThread* battleSimulationThread);
+
+	// the simulator runs on the simulation thread, the view only uses it for its
+	// battle map, reads the units from the latest snapshot, and hands commands
+	// to the simulation thread
 	BattleSimulator* GetBattleSimulator() const { return _battleSimulator; }
+	BattleSimulationThread* GetBattleSimulationThread() const { return _battleSimulationThread; }
+	const BattleSnapshot& GetSnapshot() const { return _battleSimulationThread->GetSnapshot(); }
+	const BattleSnapshot::Unit* GetSnapshotUnit(const BattleObjects::Unit* unit) const { return GetSnapshot().FindUnit(unit); }
+	float GetInterpolationAlpha() const; // from the previous fighter positions of the snapshot to the current ones
+
+	// called by the battle layer when the simulation thread has a newer snapshot
+	void ReadSnapshot();
 
 	BattleCommander* GetCommander() const { return _commander; }
 	void SetCommander(BattleCommander* value) { _commander = value; }
@@ -85,14 +98,11 @@ public:
 	SmoothTerrainRenderer* GetSmoothTerrainRenderer() const { return _smoothTerrainSurface; }
 	SmoothTerrainWater* GetSmoothTerrainWater() const { return _smoothTerrainWater; }
 
-private: // BattleObserver
-	void OnAddUnit(BattleObjects::Unit* unit) override;
-	void OnRemoveUnit(BattleObjects::Unit* unit) override;
-	void OnCommand(BattleObjects::Unit* unit, float timer) override;
-	void OnShooting(const BattleObjects::Shooting& shooting, float timer) override;
-	void OnRelease(const BattleObjects::Shooting& shooting) override;
-	void OnCasualty(BattleObjects::Unit* unit, glm::vec2 fighter) override;
-	void OnRouting(BattleObjects::Unit* unit) override;
+private: // snapshot events
+	void OnAddUnit(BattleObjects::Unit* unit);
+	void OnRemoveUnit(BattleObjects::Unit* unit);
+	void OnCommand(BattleObjects::Unit* unit);
+	void OnRelease(const BattleObjects::Shooting& shooting);
 
 private: // BattleMapObserver
 	void OnBattleMapChanged(const BattleMap* battleMap) override;
@@ -101,6 +111,7 @@ public:
 	void AddCasualty(const BattleObjects::Unit* unit, glm::vec2 position);
 
 	const std::vector<UnitCounter*>& GetUnitCounters() const { return _unitMarkers; }
+	UnitCounter* GetUnitCounter(const BattleObjects::Unit* unit) const;
 
 	UnitMovementMarker* AddMovementMarker(BattleObjects::Unit* unit);
 	UnitMovementMarker* GetMovementMarker(BattleObjects::Unit* unit);
@@ -125,12 +136,12 @@ private: // RenderLoopObserver
 public:
 	bounds2f GetBillboardBounds(glm::vec3 position, float height);
 
-	bounds2f GetUnitCurrentIconViewportBounds(BattleObjects::Unit* unit);
-	bounds2f GetUnitFutureIconViewportBounds(BattleObjects::Unit* unit);
+	bounds2f GetUnitCurrentIconViewportBounds(const BattleSnapshot::Unit& unit);
+	bounds2f GetUnitFutureIconViewportBounds(const BattleSnapshot::Unit& unit);
 
 	bounds2f GetUnitFacingMarkerBounds(glm::vec2 center, float direction);
-	bounds2f GetUnitCurrentFacingMarkerBounds(BattleObjects::Unit* unit);
-	bounds2f GetUnitFutureFacingMarkerBounds(BattleObjects::Unit* unit);
+	bounds2f GetUnitCurrentFacingMarkerBounds(const BattleSnapshot::Unit& unit);
+	bounds2f GetUnitFutureFacingMarkerBounds(const BattleSnapshot::Unit& unit);
 
 	bounds1f GetUnitIconSizeLimit() const;
 
@@ -23,7 +23,8 @@ CasualtyMarker::~CasualtyMarker()
 
 void CasualtyMarker::AddCasualty(glm::vec3 position, int team, BattleObjects_v1::SamuraiPlatform platform)
 {
-	casualties.push_back(Casualty(position, team, platform));
+	int seed = static_cast<int>(_random(_casualtyCount++, 0, 0, 0)[0] & 0x7fff);
+	casualties.push_back(Casualty(position, team, platform, seed));
 }
 
 
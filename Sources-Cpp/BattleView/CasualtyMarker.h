@@ -5,7 +5,7 @@
 #ifndef CasualtyMarker_H
 #define CasualtyMarker_H
 
-#include <cstdlib>
+#include "Algorithms/counter_rng.h"
 #include "BattleModel/BattleSimulator_v1_0_0.h"
 #include "Shapes/VertexShape.h"
 
@@ -23,16 +23,18 @@ public:
 		float time{};
 		int seed{};
 
-		Casualty(glm::vec3 position_, int team_, BattleObjects_v1::SamuraiPlatform platform_) :
+		Casualty(glm::vec3 position_, int team_, BattleObjects_v1::SamuraiPlatform platform_, int seed_) :
 			position{position_},
 			team{team_},
 			platform{platform_},
-			seed{std::rand() & 0x7fff}
+			seed{seed_}
 		{ }
 	};
 
 	std::vector<Casualty> casualties;
 	BattleSimulator* _battleSimulator;
+	counter_rng _random{};
+	std::uint32_t _casualtyCount{};
 
 public:
 	CasualtyMarker(BattleSimulator* battleSimulator);
@@ -12,23 +12,25 @@
 #include "Algebra/geometry.h"
 
 
-RangeMarker::RangeMarker(BattleSimulator* battleSimulator, BattleObjects::Unit* unit) :
+RangeMarker::RangeMarker(BattleSimulator* battleSimulator, const BattleSnapshot& snapshot, const BattleSnapshot::Unit& unit) :
 	_battleSimulator{battleSimulator},
-	_unit{unit}
+	_snapshot{&snapshot},
+	_unit{&unit}
 {
 }
 
 
 void RangeMarker::Render(VertexShape_3f_4f* vertices)
 {
-	const BattleObjects::UnitCommand& command = _unit->GetIssuedCommand();
+	const BattleSnapshot::Command& command = _unit->issuedCommand;
 	if (command.missileTarget)
 	{
-		RenderMissileTarget(vertices, command.missileTarget->GetCenter());
+		if (const BattleSnapshot::Unit* missileTarget = _snapshot->FindUnit(command.missileTarget))
+			RenderMissileTarget(vertices, missileTarget->center);
 	}
-	else if (_unit->GetMissileWeaponRange().maximumRange > 0 && !_unit->IsMoving() && !_unit->IsRouting())
+	else if (_unit->missileWeaponRange.maximumRange > 0 && !_unit->moving && !_unit->routing)
 	{
-		RenderMissileRange(vertices, _unit->GetMissileWeaponRange());
+		RenderMissileRange(vertices, _unit->missileWeaponRange);
 	}
 }
 
@@ -98,8 +100,8 @@ void RangeMarker::RenderMissileTarget(VertexShape_3f_4f* vertices, glm::vec2 tar
 	glm::vec4 c0 = glm::vec4(255, 64, 64, 0) / 255.0f;
 	glm::vec4 c1 = glm::vec4(255, 64, 64, 24) / 255.0f;
 
-	const BattleObjects::Formation& formation = _unit->GetFormation();
-	glm::vec2 left = formation.GetFrontLeft(_unit->GetCenter());
+	const BattleObjects::Formation& formation = _unit->formation;
+	glm::vec2 left = formation.GetFrontLeft(_unit->center);
 	glm::vec2 right = left + formation.towardRight * (float)formation.numberOfFiles;
 	glm::vec2 p;
 
@@ -6,6 +6,7 @@
 #define RangeMarker_H
 
 #include "BattleModel/BattleSimulator_v1_0_0.h"
+#include "BattleModel/BattleSnapshot.h"
 #include "Shapes/VertexShape.h"
 
 
@@ -13,10 +14,11 @@ class RangeMarker
 {
 public:
 	BattleSimulator* _battleSimulator{};
-	BattleObjects::Unit* _unit{};
+	const BattleSnapshot* _snapshot{};
+	const BattleSnapshot::Unit* _unit{};
 
 public:
-	RangeMarker(BattleSimulator* battleSimulator, BattleObjects::Unit* unit);
+	RangeMarker(BattleSimulator* battleSimulator, const BattleSnapshot& snapshot, const BattleSnapshot::Unit& unit);
 
 	void Render(VertexShape_3f_4f* vertices);
 
@@ -13,12 +13,14 @@
 #include "BattleModel/BattleScenario.h"
 
 
-UnitCounter::UnitCounter(BattleView* battleView, BattleObjects::Unit* unit) :
+UnitCounter::UnitCounter(BattleView* battleView, const BattleSnapshot::Unit& unit) :
 _battleView{battleView},
-_unit{unit}
+_unit{unit.unit},
+_commander{unit.commander},
+_team{unit.team}
 {
-	_samuraiWeapon = BattleObjects_v1::GetSamuraiWeapon(unit->unitClass.c_str());
-	_samuraiPlatform = BattleObjects_v1::GetSamuraiPlatform(unit->unitClass.c_str());
+	_samuraiWeapon = BattleObjects_v1::GetSamuraiWeapon(unit.unitClass.c_str());
+	_samuraiPlatform = BattleObjects_v1::GetSamuraiPlatform(unit.unitClass.c_str());
 }
 
 
@@ -27,11 +29,28 @@ UnitCounter::~UnitCounter()
 }
 
 
+const BattleSnapshot::Unit* UnitCounter::GetSnapshotUnit() const
+{
+	return _battleView->GetSnapshotUnit(_unit);
+}
+
+
+bool UnitCounter::IsDeployed() const
+{
+	const BattleSnapshot::Unit* unit = GetSnapshotUnit();
+	return unit != nullptr && unit->deployed;
+}
+
+
 bool UnitCounter::Animate(float seconds)
 {
-	float routingBlinkTime = GetRoutingBlinkTime(_unit);
+	const BattleSnapshot::Unit* unit = GetSnapshotUnit();
+	if (unit == nullptr)
+		return true; // removed when the view reads the event
 
-	if (!_unit->IsRouting() && routingBlinkTime != 0)
+	float routingBlinkTime = GetRoutingBlinkTime(*unit);
+
+	if (!unit->routing && routingBlinkTime != 0)
 	{
 		_routingTimer -= seconds;
 		if (_routingTimer < 0)
@@ -44,10 +63,14 @@ bool UnitCounter::Animate(float seconds)
 
 void UnitCounter::AppendUnitMarker(BillboardTextureShape* renderer, bool flip)
 {
+	const BattleSnapshot::Unit* unit = GetSnapshotUnit();
+	if (unit == nullptr)
+		return;
+
 	bool routingIndicator = false;
-	float routingBlinkTime = GetRoutingBlinkTime(_unit);
+	float routingBlinkTime = GetRoutingBlinkTime(*unit);
 
-	if (_unit->IsRouting())
+	if (unit->routing)
 	{
 		routingIndicator = true;
 	}
@@ -59,19 +82,19 @@ void UnitCounter::AppendUnitMarker(BillboardTextureShape* renderer, bool flip)
 	int color = 3;
 	if (!routingIndicator)
 	{
-		if (_unit->GetTeam() != _battleView->GetCommander()->GetTeam())
+		if (_team != _battleView->GetCommander()->GetTeam())
 			color = 0;
-		else if (_battleView->GetBattleScenario()->GetCommanderForUnit(_unit) != _battleView->GetCommander())
+		else if (_commander != _battleView->GetCommander())
 			color = 1;
 		else
 			color = 2;
 	}
 
-	int command = !_unit->deployed ? 2
-		: !_battleView->GetBattleScenario()->IsCommandableBy(_unit, _battleView->GetCommander()) ? 1
+	int command = !unit->deployed ? 2
+		: !_battleView->GetBattleScenario()->IsCommandableBy(_commander, _battleView->GetCommander()) ? 1
 		: 0;
 
-	glm::vec3 position = _battleView->GetBattleSimulator()->GetBattleMap()->GetHeightMap()->GetPosition(_unit->GetCenter(), 0);
+	glm::vec3 position = _battleView->GetBattleSimulator()->GetBattleMap()->GetHeightMap()->GetPosition(unit->center, 0);
 	glm::vec2 texsize(0.1875f, 0.1875f); // 48 / 256
 	glm::vec2 texcoord1 = texsize * glm::vec2(color, command);
 	glm::vec2 texcoord2 = texsize * glm::vec2((int)_samuraiPlatform, 3);
@@ -93,18 +116,19 @@ void UnitCounter::AppendUnitMarker(BillboardTextureShape* renderer, bool flip)
 
 void UnitCounter::AppendFacingMarker(VertexShape_2f_2f* vertices, BattleView* battleView)
 {
-	if (!_battleView->GetBattleScenario()->IsCommandableBy(_unit, _battleView->GetCommander()))
+	const BattleSnapshot::Unit* unit = GetSnapshotUnit();
+	if (unit == nullptr || !_battleView->GetBattleScenario()->IsCommandableBy(_commander, _battleView->GetCommander()))
 		return;
 
-	const BattleObjects::UnitCommand& command = _unit->GetIssuedCommand();
+	const BattleSnapshot::Command& command = unit->issuedCommand;
 
-	if (!_unit->IsStanding() || command.meleeTarget || _unit->IsRouting())
+	if (!unit->standing || command.meleeTarget || unit->routing)
 	{
 		return;
 	}
 
 	int xindex = 0;
-	if (!_unit->deployed)
+	if (!unit->deployed)
 	{
 		xindex = 1;
 	}
@@ -114,7 +138,7 @@ void UnitCounter::AppendFacingMarker(VertexShape_2f_2f* vertices, BattleView* ba
 	}
 	else
 	{
-		std::pair<bool, float> loadingProgress = _unit->GetLoadingProgress();
+		std::pair<bool, float> loadingProgress = unit->loadingProgress;
 		if (loadingProgress.first)
 		{
 			xindex = 2 + (int)glm::round(9.0f * loadingProgress.second);
@@ -136,10 +160,10 @@ void UnitCounter::AppendFacingMarker(VertexShape_2f_2f* vertices, BattleView* ba
 
 	TerrainViewport* terrainViewport = &battleView->GetTerrainViewport();
 
-	bounds2f bounds = battleView->GetUnitCurrentFacingMarkerBounds(_unit);
+	bounds2f bounds = battleView->GetUnitCurrentFacingMarkerBounds(*unit);
 	glm::vec2 p = bounds.mid();
 	float size = bounds.y().size();
-	float direction = xindex >= 2 || yindex != 0 ? -glm::half_pi<float>() : (_unit->GetBearing() - terrainViewport->GetCameraFacing());
+	float direction = xindex >= 2 || yindex != 0 ? -glm::half_pi<float>() : (unit->bearing - terrainViewport->GetCameraFacing());
 	if (terrainViewport->GetFlip())
 		direction += glm::pi<float>();
 
@@ -159,13 +183,18 @@ void UnitCounter::AppendFacingMarker(VertexShape_2f_2f* vertices, BattleView* ba
 
 void UnitCounter::AppendFighterWeapons(VertexShape_3f* vertices)
 {
-	float weaponReach = _unit->GetWeaponReach();
+	const BattleSnapshot::Unit* unit = GetSnapshotUnit();
+	if (unit == nullptr)
+		return;
+
+	float weaponReach = unit->weaponReach;
 	if (weaponReach > 0)
 	{
-		int count = _unit->GetFighterCount();
-		for (int index = 0; index < count; ++index)
+		const BattleSnapshot& snapshot = _battleView->GetSnapshot();
+		float alpha = _battleView->GetInterpolationAlpha();
+		for (int index = unit->firstFighter, end = index + unit->fighterCount; index != end; ++index)
 		{
-			BattleObjects::FighterPosition fighter = _unit->GetFighterPosition(index);
+			BattleObjects::FighterPosition fighter = snapshot.GetInterpolatedFighter(index, alpha);
 			glm::vec2 p1 = fighter.position;
 			glm::vec2 p2 = p1 + weaponReach * vector2_from_angle(fighter.bearing);
 
@@ -178,7 +207,11 @@ void UnitCounter::AppendFighterWeapons(VertexShape_3f* vertices)
 
 void UnitCounter::AppendFighterBillboards(BillboardModel* billboardModel)
 {
-	bool isSameTeam = _unit->GetTeam() == _battleView->GetCommander()->GetTeam();
+	const BattleSnapshot::Unit* unit = GetSnapshotUnit();
+	if (unit == nullptr)
+		return;
+
+	bool isSameTeam = _team == _battleView->GetCommander()->GetTeam();
 	float size = 2.0;
 	int shape = 0;
 	switch (_samuraiPlatform)
@@ -200,10 +233,11 @@ void UnitCounter::AppendFighterBillboards(BillboardModel* billboardModel)
 			break;
 	}
 
-	int count = _unit->GetFighterCount();
-	for (int index = 0; index < count; ++index)
+	const BattleSnapshot& snapshot = _battleView->GetSnapshot();
+	float alpha = _battleView->GetInterpolationAlpha();
+	for (int index = unit->firstFighter, end = index + unit->fighterCount; index != end; ++index)
 	{
-		BattleObjects::FighterPosition fighter = _unit->GetFighterPosition(index);
+		BattleObjects::FighterPosition fighter = snapshot.GetInterpolatedFighter(index, alpha);
 		const float adjust = 0.5f - 2.0f / 64.0f; // place texture 2 texels below ground
 		glm::vec3 p = _battleView->GetBattleSimulator()->GetBattleMap()->GetHeightMap()->GetPosition(fighter.position, adjust * size);
 		float facing = glm::degrees(fighter.bearing);
@@ -212,8 +246,8 @@ void UnitCounter::AppendFighterBillboards(BillboardModel* billboardModel)
 }
 
 
-float UnitCounter::GetRoutingBlinkTime(BattleObjects::Unit* unit)
+float UnitCounter::GetRoutingBlinkTime(const BattleSnapshot::Unit& unit)
 {
-	float morale = unit->GetEffectiveMorale();
+	float morale = unit.effectiveMorale;
 	return 0 <= morale && morale < 0.33f ? 0.1f + morale * 3 : 0;
 }
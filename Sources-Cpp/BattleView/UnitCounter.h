@@ -6,6 +6,7 @@
 #define UnitCounter_H
 
 #include "BattleModel/BattleSimulator_v1_0_0.h"
+#include "BattleModel/BattleSnapshot.h"
 #include "Algebra/bounds.h"
 #include "Shapes/VertexShape.h"
 
@@ -19,15 +20,21 @@ class UnitCounter
 public:
 	BattleView* _battleView{};
 	BattleObjects::Unit* _unit{};
+	BattleCommander* _commander{};
+	int _team{};
 	float _routingTimer{};
 	BattleObjects_v1::SamuraiWeapon _samuraiWeapon{};
 	BattleObjects_v1::SamuraiPlatform _samuraiPlatform{};
 
 public:
-	UnitCounter(BattleView* battleView, BattleObjects::Unit* unit);
+	UnitCounter(BattleView* battleView, const BattleSnapshot::Unit& unit);
 	~UnitCounter();
 
 	BattleObjects::Unit* GetUnit() const { return _unit; }
+	BattleCommander* GetCommander() const { return _commander; }
+	int GetTeam() const { return _team; }
+	const BattleSnapshot::Unit* GetSnapshotUnit() const; // nullptr once the unit is gone
+	bool IsDeployed() const;
 
 	bool Animate(float seconds);
 
@@ -38,7 +45,7 @@ public:
 	void AppendFighterBillboards(BillboardModel* billboardModel);
 
 private:
-	static float GetRoutingBlinkTime(BattleObjects::Unit* unit);
+	static float GetRoutingBlinkTime(const BattleSnapshot::Unit& unit);
 };
 
 
@@ -4,6 +4,7 @@
 
 #include "UnitMarker.h"
 #include "BattleModel/BattleSimulator_v1_0_0.h"
+#include "BattleView.h"
 
 
 
@@ -17,3 +18,16 @@ UnitMarker::UnitMarker(BattleView* battleView, BattleObjects::Unit* unit) :
 UnitMarker::~UnitMarker()
 {
 }
+
+
+const BattleSnapshot::Unit* UnitMarker::GetSnapshotUnit() const
+{
+	return _battleView->GetSnapshotUnit(_unit);
+}
+
+
+glm::vec2 UnitMarker::GetSnapshotCenter(const BattleObjects::Unit* unit) const
+{
+	const BattleSnapshot::Unit* u = _battleView->GetSnapshotUnit(unit);
+	return u ? u->center : glm::vec2{};
+}
@@ -6,6 +6,7 @@
 #define UnitMarker_H
 
 #include "BattleModel/BattleObjects_v1.h"
+#include "BattleModel/BattleSnapshot.h"
 
 class BattleView;
 
@@ -21,6 +22,10 @@ public:
 	virtual ~UnitMarker();
 
 	BattleObjects::Unit* GetUnit() const { return _unit; }
+
+protected:
+	const BattleSnapshot::Unit* GetSnapshotUnit() const; // nullptr once the unit is gone
+	glm::vec2 GetSnapshotCenter(const BattleObjects::Unit* unit) const;
 };
 
 
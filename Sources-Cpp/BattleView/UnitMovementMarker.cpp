@@ -27,28 +27,30 @@ UnitMovementMarker::~UnitMovementMarker()
 
 bool UnitMovementMarker::Animate(float seconds)
 {
-	if (_unit->IsRouting())
+	const BattleSnapshot::Unit* unit = GetSnapshotUnit();
+	if (unit == nullptr || unit->routing)
 		return false;
 
-	const BattleObjects::UnitCommand& command = _unit->GetIssuedCommand();
-	return command.path.size() > 2 || BattleObjects::UnitCommand::MovementPathLength(command.path) > 8;
+	const BattleSnapshot::Command& command = unit->issuedCommand;
+	return command.pathSize > 2 || BattleObjects::UnitCommand::MovementPathLength(_battleView->GetSnapshot().GetMovementPath(command)) > 8;
 }
 
 
 void UnitMovementMarker::RenderMovementMarker(BillboardTextureShape* renderer)
 {
-	if (!_battleView->GetBattleScenario()->IsCommandableBy(_unit, _battleView->GetCommander()))
+	const BattleSnapshot::Unit* unit = GetSnapshotUnit();
+	if (unit == nullptr || !_battleView->GetBattleScenario()->IsCommandableBy(unit->commander, _battleView->GetCommander()))
 		return;
 
-	const BattleObjects::UnitCommand& command = _unit->GetIssuedCommand();
-	glm::vec2 finalDestination = command.GetDestination();
-	if (command.path.size() > 1 || glm::length(_unit->GetCenter() - finalDestination) > 25)
+	const BattleSnapshot::Command& command = unit->issuedCommand;
+	glm::vec2 finalDestination = command.destination;
+	if (command.pathSize > 1 || glm::length(unit->center - finalDestination) > 25)
 	{
 		if (command.meleeTarget == nullptr)
 		{
 			glm::vec3 position = _battleView->GetBattleSimulator()->GetBattleMap()->GetHeightMap()->GetPosition(finalDestination, 0.5);
 			glm::vec2 texsize(0.1875, 0.1875); // 48 / 256
-			glm::vec2 texcoord = texsize * glm::vec2(_unit->GetTeam() == _battleView->GetCommander()->GetTeam() ? 2 : 0, 2);
+			glm::vec2 texcoord = texsize * glm::vec2(unit->team == _battleView->GetCommander()->GetTeam() ? 2 : 0, 2);
 
 			renderer->AddBillboard(position, 32, affine2(texcoord, texcoord + texsize));
 		}
@@ -58,16 +60,17 @@ void UnitMovementMarker::RenderMovementMarker(BillboardTextureShape* renderer)
 
 void UnitMovementMarker::AppendFacingMarker(VertexShape_2f_2f* vertices, BattleView* battleView)
 {
-	if (!_battleView->GetBattleScenario()->IsCommandableBy(_unit, _battleView->GetCommander()))
+	const BattleSnapshot::Unit* unit = GetSnapshotUnit();
+	if (unit == nullptr || !_battleView->GetBattleScenario()->IsCommandableBy(unit->commander, _battleView->GetCommander()))
 		return;
-	if (!_unit->IsMoving())
+	if (!unit->moving)
 		return;
 
-	const BattleObjects::UnitCommand& command = _unit->GetIssuedCommand();
+	const BattleSnapshot::Command& command = unit->issuedCommand;
 
 	TerrainViewport* terrainViewport = &battleView->GetTerrainViewport();
 
-	bounds2f b = battleView->GetUnitFutureFacingMarkerBounds(_unit);
+	bounds2f b = battleView->GetUnitFutureFacingMarkerBounds(*unit);
 	glm::vec2 p = b.mid();
 	float size = b.y().size();
 	float direction = command.bearing - terrainViewport->GetCameraFacing();
@@ -96,26 +99,27 @@ void UnitMovementMarker::AppendFacingMarker(VertexShape_2f_2f* vertices, BattleV
 
 void UnitMovementMarker::RenderMovementFighters(VertexShape_3f_4f_1f* vertices)
 {
-	if (!_battleView->GetBattleScenario()->IsCommandableBy(_unit, _battleView->GetCommander()))
+	const BattleSnapshot::Unit* unit = GetSnapshotUnit();
+	if (unit == nullptr || !_battleView->GetBattleScenario()->IsCommandableBy(unit->commander, _battleView->GetCommander()))
 		return;
 
-	const BattleObjects::UnitCommand& command = _unit->GetIssuedCommand();
+	const BattleSnapshot::Command& command = unit->issuedCommand;
 	if (command.meleeTarget == nullptr)
 	{
-		bool isBlue = _unit->GetTeam() == _battleView->GetCommander()->GetTeam();
+		bool isBlue = unit->team == _battleView->GetCommander()->GetTeam();
 		glm::vec4 color = isBlue ? glm::vec4(0, 0, 255, 32) / 255.0f : glm::vec4(255, 0, 0, 32) / 255.0f;
 
-		glm::vec2 finalDestination = command.GetDestination();
+		glm::vec2 finalDestination = command.destination;
 
-		BattleObjects::Formation formation = _unit->GetFormation();
+		BattleObjects::Formation formation = unit->formation;
 		formation.SetDirection(command.bearing);
 
 		glm::vec2 frontLeft = formation.GetFrontLeft(finalDestination);
 
-		int count = _unit->GetFighterCount();
-		for (int index = 0; index < count; ++index)
+		const std::vector<BattleObjects::FighterAssignment>& assignments = _battleView->GetSnapshot().fighterAssignments;
+		for (int index = unit->firstFighter, end = index + unit->fighterCount; index != end; ++index)
 		{
-			BattleObjects::FighterAssignment assignment = _unit->GetFighterAssignment(index);
+			BattleObjects::FighterAssignment assignment = assignments[index];
 			glm::vec2 offsetRight = formation.towardRight * (float)assignment.file;
 			glm::vec2 offsetBack = formation.towardBack * (float)assignment.rank;
 			glm::vec3 p = _battleView->GetBattleSimulator()->GetBattleMap()->GetHeightMap()->GetPosition(frontLeft + offsetRight + offsetBack, 0.5);
@@ -127,8 +131,12 @@ void UnitMovementMarker::RenderMovementFighters(VertexShape_3f_4f_1f* vertices)
 
 void UnitMovementMarker::RenderMovementPath(VertexShape_3f_4f* vertices)
 {
-	const BattleObjects::UnitCommand& command = _unit->GetIssuedCommand();
-	if (!command.path.empty())
+	const BattleSnapshot::Unit* unit = GetSnapshotUnit();
+	if (unit == nullptr)
+		return;
+
+	const BattleSnapshot::Command& command = unit->issuedCommand;
+	if (command.pathSize != 0)
 	{
 		int mode = 0;
 		if (command.meleeTarget)
@@ -138,6 +146,7 @@ void UnitMovementMarker::RenderMovementPath(VertexShape_3f_4f* vertices)
 
 		const HeightMap* heightMap = _battleView->GetBattleSimulator()->GetBattleMap()->GetHeightMap();
 		PathRenderer pathRenderer([heightMap](glm::vec2 p) { return heightMap->GetPosition(p, 1); });
-		pathRenderer.Path(vertices, command.path, mode);
+		const glm::vec2* path = _battleView->GetSnapshot().GetPathPoints(command);
+		pathRenderer.Path(vertices, std::vector<glm::vec2>(path, path + command.pathSize), mode);
 	}
 }
@@ -14,7 +14,7 @@
 
 
 UnitTrackingMarker::UnitTrackingMarker(BattleView* battleView, BattleObjects::Unit* unit) : UnitMarker(battleView, unit),
-_destination{_unit->GetCenter()}
+_destination{GetSnapshotCenter(unit)}
 {
 }
 
@@ -24,32 +24,60 @@ UnitTrackingMarker::~UnitTrackingMarker()
 }
 
 
+glm::vec2* UnitTrackingMarker::GetOrientationX()
+{
+	if (_missileTarget)
+	{
+		_orientationX = GetSnapshotCenter(_missileTarget);
+		return &_orientationX;
+	}
+
+	if (_hasOrientation)
+		return &_orientation;
+
+	return nullptr;
+}
+
+
+glm::vec2 UnitTrackingMarker::DestinationXXX() const
+{
+	return GetMeleeTarget() ? GetSnapshotCenter(GetMeleeTarget())
+		: _path.size() != 0 ? *(_path.end() - 1)
+		: _hasDestination ? _destination
+		: GetSnapshotCenter(GetUnit());
+}
+
+
 float UnitTrackingMarker::GetFacing() const
 {
-	glm::vec2 orientation = _missileTarget ? _missileTarget->GetCenter() : _orientation;
+	glm::vec2 orientation = _missileTarget ? GetSnapshotCenter(_missileTarget) : _orientation;
 	return angle(orientation - DestinationXXX());
 }
 
 
 void UnitTrackingMarker::RenderTrackingFighters(VertexShape_3f_4f_1f* vertices)
 {
+	const BattleSnapshot::Unit* unit = GetSnapshotUnit();
+	if (unit == nullptr)
+		return;
+
 	if (!_meleeTarget && !_missileTarget)
 	{
-		bool isBlue = _unit->GetTeam() == _battleView->GetCommander()->GetTeam();
+		bool isBlue = unit->team == _battleView->GetCommander()->GetTeam();
 		glm::vec4 color = isBlue ? glm::vec4(0, 0, 255, 16) / 255.0f : glm::vec4(255, 0, 0, 16) / 255.0f;
 
 		glm::vec2 destination = DestinationXXX();
 		//glm::vec2 orientation = _missileTarget ? _missileTarget->state.center : _orientation;
 
-		BattleObjects::Formation formation = _unit->GetFormation();
+		BattleObjects::Formation formation = unit->formation;
 		formation.SetDirection(GetFacing());
 
 		glm::vec2 frontLeft = formation.GetFrontLeft(destination);
 
-		int count = _unit->GetFighterCount();
-		for (int index = 0; index < count; ++index)
+		const std::vector<BattleObjects::FighterAssignment>& assignments = _battleView->GetSnapshot().fighterAssignments;
+		for (int index = unit->firstFighter, end = index + unit->fighterCount; index != end; ++index)
 		{
-			BattleObjects::FighterAssignment assignment = _unit->GetFighterAssignment(index);
+			BattleObjects::FighterAssignment assignment = assignments[index];
 			glm::vec2 offsetRight = formation.towardRight * (float)assignment.file;
 			glm::vec2 offsetBack = formation.towardBack * (float)assignment.rank;
 			glm::vec3 p = _battleView->GetBattleSimulator()->GetBattleMap()->GetHeightMap()->GetPosition(frontLeft + offsetRight + offsetBack, 0.5);
@@ -62,12 +90,16 @@ void UnitTrackingMarker::RenderTrackingFighters(VertexShape_3f_4f_1f* vertices)
 
 void UnitTrackingMarker::RenderTrackingMarker(BillboardTextureShape* renderer)
 {
+	const BattleSnapshot::Unit* unit = GetSnapshotUnit();
+	if (unit == nullptr)
+		return;
+
 	if (_meleeTarget == nullptr)
 	{
 		glm::vec2 destination = DestinationXXX();
 		glm::vec3 position = _battleView->GetBattleSimulator()->GetBattleMap()->GetHeightMap()->GetPosition(destination, 0);
 		glm::vec2 texsize(0.1875, 0.1875); // 48 / 256
-		glm::vec2 texcoord = texsize * glm::vec2(_unit->GetTeam() == _battleView->GetCommander()->GetTeam() ? 2 : 0, 2);
+		glm::vec2 texcoord = texsize * glm::vec2(unit->team == _battleView->GetCommander()->GetTeam() ? 2 : 0, 2);
 
 		renderer->AddBillboard(position, 32, affine2(texcoord, texcoord + texsize));
 	}
@@ -132,7 +164,7 @@ void UnitTrackingMarker::RenderTrackingPath(VertexShape_3f_4f* vertices)
 
 		const HeightMap* heightMap = _battleView->GetBattleSimulator()->GetBattleMap()->GetHeightMap();
 		PathRenderer pathRenderer([heightMap](glm::vec2 p) { return heightMap->GetPosition(p, 1); });
-		pathRenderer.Path(vertices, _path, mode);
+		pathRenderer.Path(vertices, std::vector<glm::vec2>(_path.begin(), _path.end()), mode);
 	}
 }
 
@@ -141,7 +173,7 @@ void UnitTrackingMarker::RenderOrientation(VertexShape_3f_4f* vertices)
 {
 	if (_renderOrientation && _hasOrientation && !_path.empty())
 	{
-		glm::vec2 tip = _missileTarget ? _missileTarget->GetCenter() : _orientation;
+		glm::vec2 tip = _missileTarget ? GetSnapshotCenter(_missileTarget) : _orientation;
 		float overshoot = _missileTarget ? 5 : 20;
 		glm::vec2 center = _path.back();
 		glm::vec2 diff = tip - center;
@@ -28,7 +28,7 @@ class UnitTrackingMarker : public UnitMarker
 	bool _running{};
 
 public:
-	std::vector<glm::vec2> _path{};
+	BattleObjects::MovementPath _path{};
 
 public:
 	UnitTrackingMarker(BattleView* battleView, BattleObjects::Unit* unit);
@@ -60,28 +60,8 @@ public:
 
 	void SetRenderOrientation(bool value) { _renderOrientation = value; }
 
-	glm::vec2* GetOrientationX()
-	{
-		if (_missileTarget)
-		{
-			_orientationX = _missileTarget->GetCenter();
-			return &_orientationX;
-		}
-
-		if (_hasOrientation)
-			return &_orientation;
-
-		return nullptr;
-	}
-
-	glm::vec2 DestinationXXX() const
-	{
-		return GetMeleeTarget() ? GetMeleeTarget()->GetCenter()
-			: _path.size() != 0 ? *(_path.end() - 1)
-			: _hasDestination ? _destination
-			: GetUnit()->GetCenter();
-	}
-
+	glm::vec2* GetOrientationX();
+	glm::vec2 DestinationXXX() const;
 
 	float GetFacing() const;
 
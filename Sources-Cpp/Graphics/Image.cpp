@@ -4,8 +4,17 @@
 
 #include "Image.h"
 #include "Algorithms/GaussBlur.h"
-#include "FrameBuffer.h"
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
+
+#ifndef OPENWAR_PLATFORM_HEADLESS
+#include "FrameBuffer.h"
+#endif
+
+#ifdef OPENWAR_USE_LIBPNG
+#include <png.h>
+#endif
 
 
 #if defined(OPENWAR_PLATFORM_IOS) || defined(OPENWAR_PLATFORM_MAC)
@@ -119,6 +128,8 @@ void Image::SetPixelDensity(float value)
 
 Image& Image::ReadPixels(FrameBuffer* frameBuffer)
 {
+#ifndef OPENWAR_PLATFORM_HEADLESS
+
 	GLint oldFrameBufferId;
 	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &oldFrameBufferId);
 
@@ -128,6 +139,8 @@ Image& Image::ReadPixels(FrameBuffer* frameBuffer)
 
 	glBindFramebuffer(GL_FRAMEBUFFER, static_cast<GLuint>(oldFrameBufferId));
 
+#endif
+
 	return *this;
 }
 
@@ -166,6 +179,37 @@ Image& Image::LoadFromData(const void* data, size_t size)
 	SDL_FreeRW(src);
 	_surface = surface;
 
+#elif defined(OPENWAR_USE_LIBPNG)
+
+	png_image image;
+	std::memset(&image, 0, sizeof(image));
+	image.version = PNG_IMAGE_VERSION;
+
+	if (png_image_begin_read_from_memory(&image, data, size))
+	{
+		image.format = PNG_FORMAT_RGBA;
+
+		unsigned char* pixels = (unsigned char*)std::malloc(PNG_IMAGE_SIZE(image));
+		if (png_image_finish_read(&image, nullptr, pixels, 0, nullptr))
+		{
+			if (_owner)
+				std::free(_pixels);
+			_width = (int)image.width;
+			_height = (int)image.height;
+			_pixels = pixels;
+			_owner = true;
+		}
+		else
+		{
+			LOGERR(image.message);
+			std::free(pixels);
+		}
+	}
+	else
+	{
+		LOGERR(image.message);
+	}
+
 #endif
 
 	return *this;
@@ -206,6 +250,28 @@ Image& Image::LoadFromResource(const Resource& r)
 
 #endif
 
+#ifdef OPENWAR_USE_LIBPNG
+
+	if (r.data())
+	{
+		LoadFromData(r.data(), r.size());
+	}
+	else if (FILE* file = std::fopen(r.path(), "rb"))
+	{
+		std::vector<char> data;
+		char buffer[4096];
+		size_t count;
+		while ((count = std::fread(buffer, 1, sizeof(buffer), file)) != 0)
+			data.insert(data.end(), buffer, buffer + count);
+		std::fclose(file);
+
+		LoadFromData(data.data(), data.size());
+	}
+
+	PremultiplyAlpha();
+
+#endif
+
 #ifdef OPENWAR_USE_SDL
 
 
@@ -539,6 +605,12 @@ void Image::Draw(const Image& image, int x, int y, int w, int h)
 
 	SDL_SetSurfaceBlendMode(src, oldBlendMode);
 
+#else
+
+	for (int dy = 0; dy < h; ++dy)
+		for (int dx = 0; dx < w; ++dx)
+			SetPixel(x + dx, y + dy, image.GetPixel(dx * image.GetWidth() / w, dy * image.GetHeight() / h));
+
 #endif
 }
 
@@ -578,6 +650,17 @@ void Image::Fill(const glm::vec4& color, const bounds2f& bounds)
 
 	SDL_FillRect(dst, &rect, c);
 
+#else
+
+	int xmin = static_cast<int>(bounds.min.x);
+	int ymin = static_cast<int>(bounds.min.y);
+	int xmax = xmin + static_cast<int>(bounds.x().size());
+	int ymax = ymin + static_cast<int>(bounds.y().size());
+
+	for (int y = ymin; y < ymax; ++y)
+		for (int x = xmin; x < xmax; ++x)
+			SetPixel(x, y, color);
+
 #endif
 }
 
@@ -590,7 +673,7 @@ void Image::Resize(int width, int height)
 }
 
 
-#if !defined(OPENWAR_PLATFORM_IOS) && !defined(OPENWAR_PLATFORM_MAC)
+#if !defined(OPENWAR_PLATFORM_IOS) && !defined(OPENWAR_PLATFORM_MAC) && !defined(OPENWAR_PLATFORM_HEADLESS)
 #include "savepng.h"
 #endif
 
@@ -620,6 +703,24 @@ std::vector<char> ConvertImageToPng(const Image& image)
 	const char* p = reinterpret_cast<const char*>(data.bytes);
 	return std::vector<char>(p, p + data.length);
 
+#elif defined(OPENWAR_USE_LIBPNG)
+
+	png_image png;
+	std::memset(&png, 0, sizeof(png));
+	png.version = PNG_IMAGE_VERSION;
+	png.width = (png_uint_32)image.GetWidth();
+	png.height = (png_uint_32)image.GetHeight();
+	png.format = PNG_FORMAT_RGBA;
+
+	png_alloc_size_t size = 0;
+	if (!png_image_write_to_memory(&png, nullptr, &size, 0, image.GetPixels(), 0, nullptr))
+		return std::vector<char>();
+
+	std::vector<char> result(size);
+	png_image_write_to_memory(&png, result.data(), &size, 0, image.GetPixels(), 0, nullptr);
+	result.resize(size);
+	return result;
+
 #else
 
     std::vector<char> result(196 * 1024);
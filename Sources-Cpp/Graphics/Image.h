@@ -5,13 +5,18 @@
 #ifndef Image_H
 #define Image_H
 
+#include "OpenWarPlatform.h"
 #include "Storage/Resource.h"
 #include "Algebra/bounds.h"
+#ifndef OPENWAR_PLATFORM_HEADLESS
 #include "GraphicsContext.h"
+#endif
 #include <functional>
 #include <vector>
 #include <glm/glm.hpp>
 
+class FrameBuffer;
+
 
 class Image
 {
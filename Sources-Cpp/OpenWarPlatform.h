@@ -63,6 +63,12 @@
 //#define glDeleteVertexArraysOES glDeleteVertexArraysAPPLE
 
 
+/* HEADLESS */
+
+#elif defined(OPENWAR_PLATFORM_HEADLESS)
+#define OPENWAR_USE_LIBPNG
+
+
 /* WEB */
 
 #elif defined(OPENWAR_PLATFORM_WEB)
@@ -121,9 +121,6 @@ void OpenWarSurface::Animate(double secondsSinceLastUpdate)
 
 	_buttonsTopLeft->GetViewport().SetViewportBounds(viewportBounds);
 	_buttonsTopRight->GetViewport().SetViewportBounds(viewportBounds);
-
-	if (_battleLayer->GetBattleSimulator() && _battleLayer->IsPlaying())
-		_battleLayer->GetBattleSimulator()->AdvanceTime((float)secondsSinceLastUpdate);
 }
 
 
@@ -0,0 +1,50 @@
+// Copyright (C) 2016 Felix Ungman
+//
+// This file is part of the openwar platform (GPL v3 or later), see LICENSE.txt
+
+#include "MappedFile.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+
+bool MappedFile::open(const char* path)
+{
+	close();
+
+	int fd = ::open(path, O_RDONLY);
+	if (fd == -1)
+		return false;
+
+	struct stat st;
+	if (::fstat(fd, &st) == 0 && st.st_size > 0)
+	{
+		void* data = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data != MAP_FAILED)
+		{
+			_data = data;
+			_size = static_cast<size_t>(st.st_size);
+		}
+	}
+
+	::close(fd);
+	return _data != nullptr;
+}
+
+
+void MappedFile::close()
+{
+	if (_data != nullptr)
+	{
+		::munmap(const_cast<void*>(_data), _size);
+		_data = nullptr;
+		_size = 0;
+	}
+}
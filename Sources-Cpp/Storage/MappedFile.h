@@ -0,0 +1,35 @@
+// Copyright (C) 2016 Felix Ungman
+//
+// This file is part of the openwar platform (GPL v3 or later), see LICENSE.txt
+
+#ifndef MappedFile_H
+#define MappedFile_H
+
+#include <cstddef>
+
+
+// A file mapped read-only into memory, so it can be read in place without
+// copying it, and only the pages that are read are loaded.
+
+class MappedFile
+{
+	const void* _data{};
+	size_t _size{};
+
+public:
+	MappedFile() { }
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool open(const char* path);
+	void close();
+
+	bool is_open() const { return _data != nullptr; }
+	const void* data() const { return _data; }
+	size_t size() const { return _size; }
+};
+
+
+#endif
@@ -3,6 +3,7 @@
 // This file is part of the openwar platform (GPL v3 or later), see LICENSE.txt
 
 #include "Resource.h"
+#include <cstdio>
 #include <cstdlib>
 
 
@@ -43,7 +44,7 @@ void Resource::init(const char* argv0)
 	std::string::size_type i = app_path.rfind('/');
 	if (i != std::string::npos)
 	{
-#if defined(OPENWAR_PLATFORM_LINUX)
+#if defined(OPENWAR_PLATFORM_LINUX) || defined(OPENWAR_PLATFORM_HEADLESS)
 
 		_resources_path = app_path.substr(0, i) + "/../Resources/";
 
@@ -163,7 +164,22 @@ bool Resource::load(char const* type)
     
 #else
 
-#ifndef OPENWAR_PLATFORM_WEB
+#if defined(OPENWAR_PLATFORM_HEADLESS)
+	FILE* file = std::fopen(path(), "rb");
+	if (file == nullptr)
+		return false;
+
+	std::fseek(file, 0, SEEK_END);
+	_size = (size_t)std::ftell(file);
+	std::fseek(file, 0, SEEK_SET);
+
+	void* ptr = std::malloc(_size);
+	std::fread(ptr, _size, 1, file);
+
+	_data = ptr;
+
+	std::fclose(file);
+#elif !defined(OPENWAR_PLATFORM_WEB)
 	SDL_RWops* rw = SDL_RWFromFile(path(), "rb");
     if (rw == nullptr)
         return false;